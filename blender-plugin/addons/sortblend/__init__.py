@@ -32,6 +32,7 @@ from .ui import ui_render
 from .ui import ui_particle
 from .ui import ui_world
 from .ui import ui_camera
+from .ui import ui_object
 from .ui import ui_light
 from .ui import ui_material
 
@@ -434,14 +434,32 @@ def export_global_config(scene, fs, sort_resource_path):
     fs.serialize( int(sort_data.inte_max_recur_depth) )
     if integrator_type == "PathTracing":
         fs.serialize( int(sort_data.max_bssrdf_bounces) )
+        fs.serialize( bool(sort_data.pt_path_guiding) )
+        fs.serialize( int(sort_data.pt_guiding_training_passes) )
+        fs.serialize( bool(sort_data.pt_adaptive_rr) )
+        fs.serialize( bool(sort_data.pt_radiance_cache) )
+        fs.serialize( int(sort_data.pt_radiance_cache_bounces) )
     if integrator_type == "AmbientOcclusion":
         fs.serialize( sort_data.ao_max_dist )
-    if integrator_type == "BidirPathTracing" or integrator_type == "LightTracing":
+    if integrator_type == "DirectLight":
+        fs.serialize( bool(sort_data.direct_resampling) )
+        fs.serialize( int(sort_data.direct_candidates) )
+        fs.serialize( int(sort_data.direct_neighbors) )
+    if integrator_type == "BidirPathTracing" or integrator_type == "LightTracing" or integrator_type == "VertexConnectionMerging":
         fs.serialize( bool(sort_data.bdpt_mis) )
+    if integrator_type == "VertexConnectionMerging":
+        fs.serialize( int(sort_data.vcm_passes) )
+        fs.serialize( sort_data.vcm_radius )
+    if integrator_type == "StochasticProgressivePhotonMapping":
+        fs.serialize( int(sort_data.sppm_passes) )
+        fs.serialize( int(sort_data.sppm_photons) )
+        fs.serialize( sort_data.sppm_radius )
     if integrator_type == "InstantRadiosity":
         fs.serialize( sort_data.ir_light_path_set_num )
         fs.serialize( sort_data.ir_light_path_num )
         fs.serialize( sort_data.ir_min_dist )
+        fs.serialize( sort_data.ir_max_error )
+        fs.serialize( sort_data.ir_max_cut_size )
 
 # export smoke information
 def export_smoke(obj, fs):
@@ -479,6 +497,17 @@ def export_smoke(obj, fs):
     fs.serialize(density_data)
 
 # export a mesh
+def export_emission(obj, fs):
+    sort_data = obj.sort_data
+    if sort_data.emission_strength <= 0.0:
+        fs.serialize( SID('no_emission') )
+        return
+
+    fs.serialize( SID('has_emission') )
+    fs.serialize( ( sort_data.emission_color[0] * sort_data.emission_strength ,
+                    sort_data.emission_color[1] * sort_data.emission_strength ,
+                    sort_data.emission_color[2] * sort_data.emission_strength ) )
+
 def export_mesh(obj, mesh, fs):
     LENFMT = struct.Struct('=i')
     FLTFMT = struct.Struct('=f')
@@ -582,6 +611,9 @@ def export_mesh(obj, mesh, fs):
     # export smoke data if needed, this is for volumetric rendering
     export_smoke(obj, fs)
 
+    # export emission if needed, emissive meshes are turned into mesh lights
+    export_emission(obj, fs)
+
     fs.serialize(SID('end of mesh'))
 
     return (vert_cnt, primitive_cnt)
@@ -0,0 +1,50 @@
+#    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+#    platform physically based renderer.
+#
+#    Copyright (c) 2011-2023 by Jiayin Cao - All rights reserved.
+#
+#    SORT is a free software written for educational purpose. Anyone can distribute
+#    or modify it under the the terms of the GNU General Public License Version 3 as
+#    published by the Free Software Foundation. However, there is NO warranty that
+#    all components are functional in a perfect manner. Without even the implied
+#    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+#    General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License along with
+#    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+
+
+import bpy
+from bl_ui import properties_object
+from .. import base
+
+# attach customized properties to objects
+@base.register_class
+class SORTObjectData(bpy.types.PropertyGroup):
+    emission_color : bpy.props.FloatVectorProperty( name='Emission Color', default=(1.0, 1.0, 1.0), min=0.0, max=1.0, subtype='COLOR')
+    emission_strength : bpy.props.FloatProperty( name='Emission Strength', default=0.0, min=0.0, max=float('inf'))
+    @classmethod
+    def register(cls):
+        bpy.types.Object.sort_data = bpy.props.PointerProperty(name="SORT Data", type=cls)
+    @classmethod
+    def unregister(cls):
+        del bpy.types.Object.sort_data
+
+class SORTObjectPanel(properties_object.ObjectButtonsPanel):
+    bl_space_type = "PROPERTIES"
+    bl_region_type = "WINDOW"
+    bl_context = "object"
+    COMPAT_ENGINES = {'SORT'}
+    @classmethod
+    def poll(cls, context):
+        rd = context.scene.render
+        return context.object and context.object.type == 'MESH' and rd.engine in cls.COMPAT_ENGINES
+
+@base.register_class
+class OBJECT_PT_SORTEmissionPanel(SORTObjectPanel, bpy.types.Panel):
+    bl_label = 'Mesh Light'
+    def draw(self, context):
+        layout = self.layout
+        sort_data = context.object.sort_data
+        layout.prop(sort_data, "emission_color")
+        layout.prop(sort_data, "emission_strength")
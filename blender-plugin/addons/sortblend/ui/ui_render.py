@@ -33,7 +33,9 @@ class SORTRenderData(bpy.types.PropertyGroup):
                          ("InstantRadiosity", "Instant Radiosity", "", 4),
                          ("AmbientOcclusion", "Ambient Occlusion", "", 5),
                          ("DirectLight", "Direct Lighting", "", 6),
-                         ("WhittedRT", "Whitted", "", 7) ]
+                         ("WhittedRT", "Whitted", "", 7),
+                         ("VertexConnectionMerging", "Vertex Connection and Merging", "", 8),
+                         ("StochasticProgressivePhotonMapping", "Stochastic Progressive Photon Mapping", "", 9) ]
     integrator_type_prop : bpy.props.EnumProperty(items=integrator_types, name='Accelerator')
 
     # general integrator parameters
@@ -41,6 +43,11 @@ class SORTRenderData(bpy.types.PropertyGroup):
 
     # maxmum bounces supported in BSSRDF, exceeding the threshold will result in replacing BSSRDF with Lambert
     max_bssrdf_bounces : bpy.props.IntProperty(name='Maximum Bounces in SSS path', default=4, min=1)
+    pt_path_guiding : bpy.props.BoolProperty(name='Path Guiding', default=False)
+    pt_guiding_training_passes : bpy.props.IntProperty(name='Training Passes', default=5, min=1, max=12)
+    pt_adaptive_rr : bpy.props.BoolProperty(name='Adaptive Russian Roulette', default=False)
+    pt_radiance_cache : bpy.props.BoolProperty(name='Radiance Cache', default=False)
+    pt_radiance_cache_bounces : bpy.props.IntProperty(name='Diffuse Bounces before Cache', default=2, min=1)
 
     # ao integrator parameters
     ao_max_dist : bpy.props.FloatProperty(name='Maximum Distance', default=3.0, min=0.01)
@@ -49,10 +56,26 @@ class SORTRenderData(bpy.types.PropertyGroup):
     ir_light_path_set_num : bpy.props.IntProperty(name='Light Path Set Num', default=1, min=1)
     ir_light_path_num : bpy.props.IntProperty(name='Light Path Num', default=64, min=1)
     ir_min_dist : bpy.props.FloatProperty(name='Minimum Distance', default=1.0, min=0.0)
+    ir_max_error : bpy.props.FloatProperty(name='Light Cut Error', default=0.02, min=0.0, max=1.0)
+    ir_max_cut_size : bpy.props.IntProperty(name='Maximum Light Cut Size', default=1000, min=1)
+
+    # direct lighting parameters
+    direct_resampling : bpy.props.BoolProperty(name='Resampled Light Sampling', default=False)
+    direct_candidates : bpy.props.IntProperty(name='Candidate Light Samples', default=32, min=1)
+    direct_neighbors : bpy.props.IntProperty(name='Neighboring Reservoirs', default=4, min=0)
 
     # bidirectional path tracing parameters
     bdpt_mis : bpy.props.BoolProperty(name='Multiple Importance Sampling', default=True)
 
+    # vertex connection and merging parameters
+    vcm_passes : bpy.props.IntProperty(name='Light Path Passes', default=4, min=1)
+    vcm_radius : bpy.props.FloatProperty(name='Merging Radius', default=0.003, min=0.0001, max=1.0)
+
+    # stochastic progressive photon mapping parameters
+    sppm_passes : bpy.props.IntProperty(name='Passes', default=64, min=1)
+    sppm_photons : bpy.props.IntProperty(name='Photons per Pass', default=1000000, min=1)
+    sppm_radius : bpy.props.FloatProperty(name='Initial Radius', default=0.005, min=0.0001, max=1.0)
+
     #------------------------------------------------------------------------------------#
     #                              Spatial Accelerator Settings                          #
     #------------------------------------------------------------------------------------#
@@ -149,14 +172,36 @@ class RENDER_PT_IntegratorPanel(SORTRenderPanel,bpy.types.Panel):
             self.layout.prop(data,"inte_max_recur_depth")
         if integrator_type == "PathTracing":
             self.layout.prop(data,"max_bssrdf_bounces" )
+            self.layout.prop(data,"pt_path_guiding" )
+            self.layout.prop(data,"pt_adaptive_rr" )
+            if data.pt_path_guiding or data.pt_adaptive_rr:
+                self.layout.prop(data,"pt_guiding_training_passes" )
+            self.layout.prop(data,"pt_radiance_cache" )
+            if data.pt_radiance_cache:
+                self.layout.prop(data,"pt_radiance_cache_bounces" )
         if integrator_type == "AmbientOcclusion":
             self.layout.prop(data,"ao_max_dist")
+        if integrator_type == "DirectLight":
+            self.layout.prop(data,"direct_resampling")
+            if data.direct_resampling:
+                self.layout.prop(data,"direct_candidates")
+                self.layout.prop(data,"direct_neighbors")
         if integrator_type == "BidirPathTracing":
             self.layout.prop(data,"bdpt_mis")
+        if integrator_type == "VertexConnectionMerging":
+            self.layout.prop(data,"bdpt_mis")
+            self.layout.prop(data,"vcm_passes")
+            self.layout.prop(data,"vcm_radius")
+        if integrator_type == "StochasticProgressivePhotonMapping":
+            self.layout.prop(data,"sppm_passes")
+            self.layout.prop(data,"sppm_photons")
+            self.layout.prop(data,"sppm_radius")
         if integrator_type == "InstantRadiosity":
             self.layout.prop(data,"ir_light_path_set_num")
             self.layout.prop(data,"ir_light_path_num")
             self.layout.prop(data, "ir_min_dist")
+            self.layout.prop(data, "ir_max_error")
+            self.layout.prop(data, "ir_max_cut_size")
 
 @base.register_class
 class RENDER_PT_AcceleratorPanel(SORTRenderPanel,bpy.types.Panel):
@@ -22,6 +22,14 @@ SORT_STATS_DEFINE_COUNTER(sRayCount)
 SORT_STATS_DEFINE_COUNTER(sShadowRayCount)
 SORT_STATS_DEFINE_COUNTER(sIntersectionTest)
 
+#ifdef ENABLE_TRANSPARENT_SHADOW
+SORT_STATS_DEFINE_COUNTER(sTransparentShadowHits)
+SORT_STATS_DEFINE_COUNTER(sOpacityMaskResolvedHits)
+
+SORT_STATS_COUNTER("Statistics", "Shadow Ray Hits on Transparent Surfaces", sTransparentShadowHits);
+SORT_STATS_RATIO("Statistics", "Hits Resolved by Opacity Masks", sOpacityMaskResolvedHits, sTransparentShadowHits);
+#endif
+
 #ifdef ENABLE_TRANSPARENT_SHADOW
 bool Accelerator::GetAttenuation( Ray& ray , Spectrum& attenuation , RenderContext& rc , MediumStack* ms ) const {
     SurfaceInteraction intersection;
@@ -42,8 +50,21 @@ bool Accelerator::GetAttenuation( Ray& ray , Spectrum& attenuation , RenderConte
     const MaterialBase* material = intersection.primitive->GetMaterial();
     sAssert( IS_PTR_VALID( material ) , SPATIAL_ACCELERATOR );
 
-    // evaluate the transparency first in case it is fully opaque.
-    attenuation = material->EvaluateTransparency(intersection);
+    // evaluate the transparency first in case it is fully opaque, opacity masks resolve most hits without the material.
+    SORT_STATS(++sTransparentShadowHits);
+    switch (intersection.primitive->GetShape()->ClassifyOpacity(intersection)) {
+        case OPACITY_OPAQUE:
+            SORT_STATS(++sOpacityMaskResolvedHits);
+            attenuation = 0.0f;
+            break;
+        case OPACITY_CLEAR:
+            SORT_STATS(++sOpacityMaskResolvedHits);
+            attenuation = 1.0f;
+            break;
+        default:
+            attenuation = material->EvaluateTransparency(intersection);
+            break;
+    }
 
     // consider beam transmittance during ray traversal if medium is presented.
     if (ms && !attenuation.IsBlack() ) {
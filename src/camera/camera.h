@@ -68,6 +68,13 @@ public:
     virtual Vector2i GetScreenCoord(const SurfaceInteraction& inter, float* pdfw, float* pdfa, float& cosAtCamera , Spectrum* we ,
                                     Point* eyeP , Visibility* visibility, RenderContext& rc) const = 0;
 
+    //! @brief      Get viewing point.
+    //!
+    //! @return     Viewing point of the camera in world space, camera rays could start off it with a lens or an orthographic projection.
+    const Point& GetEye() const {
+        return m_eye;
+    }
+
     //! @brief Get targe image resolution
     virtual Vector2i GetImageResolution() const {
         return Vector2i(m_image_width, m_image_height);
@@ -83,6 +83,22 @@ Ray PerspectiveCamera::GenerateRay( float x , float y , const PixelSample& ps )
         r.m_Dir = normalize( target - r.m_Ori );
     }
 
+    // Ray differentials, rays shooting through the neighboring pixels sharing the same sample on the lens.
+    const Vector view_dir_x = m_cameraToRaster.invMatrix.TransformPoint( rastP + Point( 1.0f , 0.0f , 0.0f ) );
+    const Vector view_dir_y = m_cameraToRaster.invMatrix.TransformPoint( rastP + Point( 0.0f , 1.0f , 0.0f ) );
+    r.m_hasDifferentials = true;
+    r.m_rxOri = r.m_ryOri = r.m_Ori;
+    if( m_lensRadius != 0 ){
+        // this matches how the focal target of the primary ray is evaluated
+        const Point target_x = Point( normalize( view_dir_x ) * ( m_focalDistance / view_dir_x.z ) );
+        const Point target_y = Point( normalize( view_dir_y ) * ( m_focalDistance / view_dir_y.z ) );
+        r.m_rxDir = normalize( target_x - r.m_Ori );
+        r.m_ryDir = normalize( target_y - r.m_Ori );
+    }else{
+        r.m_rxDir = normalize( view_dir_x );
+        r.m_ryDir = normalize( view_dir_y );
+    }
+
     // transform the ray from camera space to world space
     r = m_worldToCamera.invMatrix( r );
 
@@ -132,8 +132,8 @@
 // leading to worse performance with multi-thread shader compilation enabled.
 #define ENABLE_MULTI_THREAD_SHADER_COMPILATION
 
-// This is a temporary quick solution to enable multi-thread texture loading. It is by no means a very good idea to 
-// parallel a bunch of IO bound threads. However, my newly planned job system is far from being ready yet, I'll live 
-// with it for now. This async loading eventually will be less useful since I'm planning to implement a texture cache
-// system in the future to do lazy texture loading in the future.
+// Multi-thread texture loading. Each texture is decoded in its own marl task and nothing waits for it until the
+// renderer is about to execute the first shader, meaning texture IO and decoding overlap with shader compilation,
+// scene loading and acceleration structure construction. This async loading eventually will be less useful since I'm
+// planning to implement a texture cache system in the future to do lazy texture loading in the future.
 #define ENABLE_ASYNC_TEXTURE_LOADING
\ No newline at end of file
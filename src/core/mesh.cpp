@@ -171,6 +171,17 @@ void Mesh::Serialize(IStreamBase& stream) {
         sAssert(volume_sid == no_volume_sid, VOLUME);
     }
 
+    static const StringID has_emission_sid("has_emission");
+    static const StringID no_emission_sid("no_emission");
+
+    // serialize emission if the mesh is a light source
+    StringID emission_sid;
+    stream >> emission_sid;
+    if (emission_sid == has_emission_sid)
+        stream >> m_emission;
+    else
+        sAssert(emission_sid == no_emission_sid, LIGHT);
+
     static const StringID end_of_mesh("end of mesh");
     StringID eom_sid;
     stream >> eom_sid;
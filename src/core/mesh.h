@@ -40,6 +40,7 @@ struct MeshVertex {
 struct MeshFaceIndex {
     int                     m_id[3] = { -1 };   /**< Indices for one triangle. */
     const MaterialBase*     m_mat = nullptr;    /**< Materials attached to the triangle. */
+    unsigned                m_opacityMask = 0;  /**< Opacity micro-mask of the triangle, all cells are unknown by default. */
 };
 
 //! @brief  A wrapper for mesh information.
@@ -55,6 +56,7 @@ public:
     std::vector<MeshVertex>     m_vertices;         /**< Vertex information including position, normal and etc.*/
     std::vector<MeshFaceIndex>  m_indices;          /**< Index information of the mesh, there is also material id in it. */
     bool                        m_hasUV = false;    /**< Whether the mesh has UV information. */
+    Spectrum                    m_emission;         /**< Radiance emitted by the surface of the mesh, black for non-emissive meshes. */
 
     //! @brief      Generate UV coordinate for the vertices.
     void    GenUV();
@@ -89,6 +91,20 @@ public:
     //! @return         The color of the volume.
     Spectrum    SampleVolumeColor(const Point& pos) const;
 
+    //! @brief      Get the density of the volume inside this mesh.
+    //!
+    //! @return         The density of the volume, nullptr if there is no volume data.
+    const MediumDensity* GetVolumeDensity() const {
+        return m_volumeDensity.get();
+    }
+
+    //! @brief      Get the transformation from world space to volume texture space.
+    //!
+    //! @return         The transformation to volume texture space.
+    const Matrix& GetWorldToVolume() const {
+        return m_world2Volume;
+    }
+
 private:
     //! @brief      Generate tangent for the triangles.
     //!
@@ -35,13 +35,15 @@
 #define LOWER_MASK 0x7fffffffUL /* least significant r bits */
 
 RandomNumberGenerator::RandomNumberGenerator(){
-    init();
+    init( (unsigned)time(0) );
 }
 
-void RandomNumberGenerator::init(){
-    unsigned _seed = (unsigned)time(0);
+void RandomNumberGenerator::Seed( unsigned seed ){
+    init( seed );
+}
 
-    mt[0]= _seed & 0xffffffffUL;
+void RandomNumberGenerator::init( unsigned seed ){
+    mt[0]= seed & 0xffffffffUL;
     for (mti=1; mti<MT_CNT; mti++) {
         mt[mti] =
         (1812433253UL * (mt[mti-1] ^ (mt[mti-1] >> 30)) + mti);
@@ -63,13 +65,13 @@ unsigned RandomNumberGenerator::rand(){
         /* mag01[x] = x * MATRIX_A  for x=0,1 */
 
         if( seed_setup == false )
-            init();
+            init( (unsigned)time(0) );
 
         if (mti >= MT_CNT) { /* generate N words at one time */
             int kk;
 
             if (mti == MT_CNT+1)   /* if Seed() has not been called, */
-                init(); /* default initial seed */
+                init( (unsigned)time(0) ); /* default initial seed */
 
             for (kk=0;kk<MT_CNT-M;kk++) {
                 y = (mt[kk]&UPPER_MASK)|(mt[kk+1]&LOWER_MASK);
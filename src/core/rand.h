@@ -29,12 +29,15 @@ public:
     // Generate a random unsigned number
     unsigned    rand();
 
+    // Seed the generator, generators sharing the same seed produce the same sequence
+    void        Seed( unsigned seed );
+
 private:
     unsigned long mt[MT_CNT]; /* the array for the state vector  */
     int mti;
     bool seed_setup = false;
 
-    void init();
+    void init( unsigned seed );
 };
 
 template<class T>
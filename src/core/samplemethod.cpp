@@ -0,0 +1,59 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+
+    Copyright (c) 2011-2023 by Jiayin Cao - All rights reserved.
+
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+
+#include <marl/defer.h>
+#include <marl/scheduler.h>
+#include <marl/waitgroup.h>
+#include "samplemethod.h"
+
+// Distributions with fewer entries than this are not worth building in parallel.
+static constexpr unsigned   PARALLEL_DISTRIBUTION_SIZE = 64 * 1024;
+
+// Number of rows built in each task.
+static constexpr unsigned   PARALLEL_DISTRIBUTION_ROWS = 16;
+
+void Distribution2D::_init( const float* data , unsigned nu , unsigned nv ){
+    m_nu = nu;
+    m_nv = nv;
+
+    pConditions.resize( nv );
+    const auto build_rows = [&]( unsigned begin , unsigned end ){
+        for( auto i = begin ; i < end ; ++i )
+            pConditions[i] = std::make_unique<Distribution1D>( &data[i*nu] , nu );
+    };
+
+    // rows are independent from each other, large environment maps build them in parallel.
+    if( marl::Scheduler::get() && nu * nv >= PARALLEL_DISTRIBUTION_SIZE ){
+        marl::WaitGroup rows_done;
+        for( auto begin = 0u ; begin < nv ; begin += PARALLEL_DISTRIBUTION_ROWS ){
+            rows_done.add();
+            marl::schedule([&, rows_done, begin]() {
+                defer(rows_done.done());
+                build_rows( begin , std::min( begin + PARALLEL_DISTRIBUTION_ROWS , nv ) );
+            });
+        }
+        rows_done.wait();
+    } else {
+        build_rows( 0 , nv );
+    }
+
+    std::unique_ptr<float[]> m = std::make_unique<float[]>(nv);
+    for( unsigned i = 0 ; i < nv ; i++ )
+        m[i] = pConditions[i]->GetSum();
+    marginal = std::make_unique<Distribution1D>( m.get() , nv );
+}
@@ -125,15 +125,151 @@ SORT_FORCEINLINE float UniformSpherePdf(){
     return INV_FOUR_PI;
 }
 
+// sampling a distance along a ray with density proportional to the inverse squared distance to a point
+// 'Importance Sampling Techniques for Path Tracing in Participating Media', Kulla and Fajardo 2012
+// para 'u' : a canonical random variable
+// para 'delta' : distance along the ray to the projection of the point on the ray
+// para 'd' : distance between the point and the ray, it has to be positive
+// para 't0' , 't1' : range of the distance along the ray
+// para 'pdf' : pdf of the sampled distance
+SORT_FORCEINLINE float EquiangularSample( float u , float delta , float d , float t0 , float t1 , float* pdf ){
+    const auto theta_a = atan2( t0 - delta , d );
+    const auto theta_b = atan2( t1 - delta , d );
+    const auto x = d * tan( theta_a + u * ( theta_b - theta_a ) );
+    if( pdf )
+        *pdf = d / ( ( theta_b - theta_a ) * ( d * d + x * x ) );
+    return clamp( delta + x , t0 , t1 );
+}
+
+// pdf of equiangular sampling
+SORT_FORCEINLINE float EquiangularPdf( float t , float delta , float d , float t0 , float t1 ){
+    if( t < t0 || t > t1 )
+        return 0.0f;
+    const auto theta_a = atan2( t0 - delta , d );
+    const auto theta_b = atan2( t1 - delta , d );
+    const auto x = t - delta;
+    return d / ( ( theta_b - theta_a ) * ( d * d + x * x ) );
+}
+
+// alias table, picking an entry with probability proportional to its weight in constant time
+// the table is built with Vose's method, each bin keeps the chance of picking itself and the entry to fall back to
+class AliasTable{
+public:
+    // constructor
+    // para 'f' : weights of the entries, they don't need to be normalized
+    // para 'n' : number of entries
+    AliasTable( const float* f , unsigned n ):
+        count(n)
+    {
+        sum = 0.0f;
+        if( f == 0 || n == 0 )
+            return;
+
+        auto total = 0.0;
+        for( unsigned i = 0 ; i < n ; ++i )
+            total += f[i];
+        sum = (float)total;
+
+        bins = std::make_unique<Bin[]>(n);
+        std::vector<double>     scaled(n);
+        std::vector<unsigned>   small, large;
+        for( unsigned i = 0 ; i < n ; ++i ){
+            const auto p = total > 0.0 ? f[i] / total : 1.0 / n;
+            bins[i].pdf = (float)p;
+            scaled[i] = p * n;
+            ( scaled[i] < 1.0 ? small : large ).push_back( i );
+        }
+
+        // pair each under-full bin with an over-full one, which donates the rest of the bin
+        while( !small.empty() && !large.empty() ){
+            const auto s = small.back(); small.pop_back();
+            const auto l = large.back(); large.pop_back();
+            bins[s].q = (float)scaled[s];
+            bins[s].alias = l;
+            scaled[l] += scaled[s] - 1.0;
+            ( scaled[l] < 1.0 ? small : large ).push_back( l );
+        }
+
+        // Whatever is left is full up to floating point error. Entries without weight could be left in here too, they
+        // can't be picked at all, so their bins fall back to the entry with the largest weight.
+        auto fallback = 0u;
+        for( unsigned i = 1 ; i < n ; ++i )
+            fallback = bins[i].pdf > bins[fallback].pdf ? i : fallback;
+        for( const auto i : small ){
+            bins[i].q = bins[i].pdf > 0.0f ? 1.0f : 0.0f;
+            bins[i].alias = bins[i].pdf > 0.0f ? i : fallback;
+        }
+        for( const auto i : large )
+            bins[i].q = 1.0f , bins[i].alias = i;
+    }
+
+    // get a discrete sample
+    // para 'u' : a canonical random variable
+    // para 'pdf' : probability of picking the sample
+    // para 'u_remapped' : a new canonical random variable that can be reused for further sampling
+    // result   : index of the picked entry
+    unsigned SampleDiscrete( float u , float* pdf , float* u_remapped = nullptr ) const{
+        sAssert( count != 0 && bins != 0 , SAMPLING );
+        sAssert( u <= 1.0f && u >= 0.0f , SAMPLING );
+
+        const auto scaled = u * count;
+        auto offset = std::min( (unsigned)scaled , count - 1 );
+        const auto up = std::min( scaled - offset , ONE_MINUS_EPSILON );
+
+        const auto& bin = bins[offset];
+        if( up < bin.q ){
+            if( u_remapped )
+                *u_remapped = std::min( up / bin.q , ONE_MINUS_EPSILON );
+        }else{
+            if( u_remapped )
+                *u_remapped = std::min( ( up - bin.q ) / ( 1.0f - bin.q ) , ONE_MINUS_EPSILON );
+            offset = bin.alias;
+        }
+
+        if( pdf )
+            *pdf = bins[offset].pdf;
+        return offset;
+    }
+
+    // get the sum of the original data
+    float GetSum() const{
+        return sum;
+    }
+
+    // get the count
+    unsigned GetCount() const{
+        return count;
+    }
+
+    // get probability of the entry
+    float GetProperty( unsigned i ) const{
+        sAssert( i < count , GENERAL );
+        return bins[i].pdf;
+    }
+
+private:
+    struct Bin{
+        float       q = 1.0f;       // the chance of picking the entry itself when landing in the bin
+        float       pdf = 0.0f;     // the probability of picking the entry
+        unsigned    alias = 0;      // the entry picked otherwise
+    };
+
+    const unsigned              count;
+    std::unique_ptr<Bin[]>      bins;
+    float                       sum;
+};
+
 // one dimensional distribution
+// both discrete and continuous samples are taken in constant time through an alias table, the bucket is picked by the
+// table and the position inside the bucket comes from the part of the canonical random variable that is left unused.
+// the mapping of the alias table is not monotonic though, callers relying on the stratification of their samples
+// should invert the cdf instead, which takes logarithmic time.
 class Distribution1D{
 public:
     // constructor
     Distribution1D( const float* f , unsigned n ):
-        count(n)
+        count(n) , table( f , n )
     {
-        cdf = 0;
-        sum = 0.0f;
         if( f == 0 || n == 0 )
             return;
 
@@ -141,8 +277,8 @@ public:
         cdf[0] = 0;
         for( unsigned i = 0 ; i < n ; i++ )
             cdf[i+1] = cdf[i] + f[i];
-        sum = cdf[n];
 
+        const auto sum = cdf[n];
         if( sum != 0.0f )
             for( unsigned i = 0 ; i < n+1 ; ++i )
                 cdf[i] /= sum;
@@ -154,56 +290,57 @@ public:
     // get a discrete sample
     // para 'u' : a canonical random variable
     // para 'pdf' : probability density function value for the sample
-    // result   : corresponding bucket straddle the u, -1 if there is no data in the distribution
+    // result   : corresponding bucket straddle the u
     int SampleDiscrete( float u , float* pdf ) const{
+        sAssert( count != 0 , SAMPLING );
+        return (int)table.SampleDiscrete( u , pdf );
+    }
+
+    // get a continuous sample
+    // para 'u' : a canonical random variable
+    // para 'pdf' : property density function value for the sample
+    float SampleContinuous( float u , float* pdf ) const{
+        sAssert( count != 0 , SAMPLING );
+
+        float p = 0.0f , du = 0.0f;
+        const auto offset = table.SampleDiscrete( u , &p , &du );
+        if( pdf )
+            *pdf = p * count;
+        return ( du + (float)offset ) / (float)count;
+    }
+
+    // get a discrete sample by inverting the cdf, stratification of 'u' is preserved
+    // para 'u' : a canonical random variable
+    // para 'pdf' : probability density function value for the sample
+    // result   : corresponding bucket straddle the u
+    int InvertDiscrete( float u , float* pdf ) const{
         sAssert( count != 0 && cdf != 0 , SAMPLING );
         sAssert( u <= 1.0f && u >= 0.0f , SAMPLING );
 
-        float* target = std::lower_bound( cdf.get() , cdf.get() + count + 1 , u );
-        unsigned offset = (u<=0.0f)? 0:(int)(target-cdf.get()-1);
-        // special care needs to be payed to situation when u == 0.0f
-        if( offset == 0 ){
-            while( offset < count && cdf[offset+1] == 0.0f )
-                offset++;
-        }
-        if( offset == count ){
-            if( pdf ) *pdf = 0.0f;
-            return 0;
-        }
+        const auto offset = invert( u );
         if( pdf )
             *pdf = cdf[offset+1] - cdf[offset];
         return offset;
     }
 
-    // get a continuous sample
+    // get a continuous sample by inverting the cdf, stratification of 'u' is preserved
     // para 'u' : a canonical random variable
     // para 'pdf' : property density function value for the sample
-    float SampleContinuous( float u , float* pdf ) const{
+    float InvertContinuous( float u , float* pdf ) const{
         sAssert( count != 0 && cdf != 0 , SAMPLING );
         sAssert( u <= 1.0f && u >= 0.0f , SAMPLING );
 
-        float* target = std::lower_bound( cdf.get() , cdf.get()+count+1 , u );
-        unsigned offset = (u<=0.0f)?0:(int)(target-cdf.get()-1);
-        // special care needs to be payed to situation when u == 0.0f
-        if( offset == 0 )
-        {
-            while( offset < count && cdf[offset+1] == 0.0f )
-                offset++;
-        }
-        if( offset == count )
-        {
-            if( pdf ) *pdf = 0.0f;
-            return 0.0f;
-        }
+        const auto offset = invert( u );
+        const auto p = cdf[offset+1] - cdf[offset];
         if( pdf )
-            *pdf = (cdf[offset+1]-cdf[offset]) * count;
-        float du = ( u - cdf[offset] ) / ( cdf[offset+1] - cdf[offset] );
-        return ( du + (float)offset ) / (float)count;
+            *pdf = p * count;
+        const auto du = std::min( ( u - cdf[offset] ) / p , ONE_MINUS_EPSILON );
+        return ( std::max( du , 0.0f ) + (float)offset ) / (float)count;
     }
 
     // get the sum of the original data
     float GetSum() const{
-        return sum;
+        return table.GetSum();
     }
 
     // get the count
@@ -214,13 +351,24 @@ public:
     // get property of the unit
     float GetProperty( unsigned i ) const{
         sAssert( i < count , GENERAL );
-        return cdf[i+1]-cdf[i];
+        return table.GetProperty( i );
     }
 
 private:
     const unsigned              count;
+    const AliasTable            table;
     std::unique_ptr<float[]>    cdf;
-    float                       sum;
+
+    // the last bucket whose cdf is below 'u', buckets without weight are never returned
+    unsigned invert( float u ) const{
+        const auto target = std::upper_bound( cdf.get() + 1 , cdf.get() + count + 1 , u );
+        auto offset = (unsigned)std::min<ptrdiff_t>( target - cdf.get() - 1 , count - 1 );
+        while( offset > 0 && cdf[offset+1] == cdf[offset] )
+            --offset;
+        while( offset < count - 1 && cdf[offset+1] == cdf[offset] )
+            ++offset;
+        return offset;
+    }
 };
 
 // two dimensional distribution
@@ -256,6 +404,16 @@ public:
         if( pdf )
             *pdf = pdf0 * pdf1;
     }
+    // get a sample point by inverting the cdfs, stratification of 'u' and 'v' is preserved
+    void InvertContinuous( float u , float v , float uv[2] , float* pdf ) const{
+        float pdf0 , pdf1;
+        uv[1] = marginal->InvertContinuous( v , &pdf1 );
+        const auto vi = std::min( (unsigned)( uv[1] * m_nv ) , m_nv - 1 );
+        uv[0] = pConditions[vi]->InvertContinuous( u , &pdf0 );
+
+        if( pdf )
+            *pdf = pdf0 * pdf1;
+    }
     // get pdf
     float Pdf( float u , float v ) const{
         u = clamp( u , 0.0f , 1.0f );
@@ -276,15 +434,6 @@ private:
     // the size for the two dimensions
     unsigned m_nu , m_nv;
 
-    // initialize data
-    void _init( const float* data , unsigned nu , unsigned nv ){
-        for( unsigned i = 0 ; i < nv ; i++ )
-            pConditions.push_back( std::make_unique<Distribution1D>( &data[i*nu] , nu ) );
-        std::unique_ptr<float[]> m = std::make_unique<float[]>(nv);
-        for( unsigned i = 0 ; i < nv ; i++ )
-            m[i] = pConditions[i]->GetSum();
-        marginal = std::make_unique<Distribution1D>( m.get() , nv );
-        m_nu = nu;
-        m_nv = nv;
-    }
+    // initialize data, rows of large distributions are built in parallel
+    void _init( const float* data , unsigned nu , unsigned nv );
 };
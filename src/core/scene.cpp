@@ -25,6 +25,7 @@
 #include "core/sassert.h"
 #include "core/sassert.h"
 #include "core/stats.h"
+#include "core/profile.h"
 #include "core/strid.h"
 #include "core/primitive.h"
 #include "entity/visual_entity.h"
@@ -181,7 +182,13 @@ bool Scene::LoadScene( IStreamBase& stream ){
 
 bool Scene::GetIntersect( RenderContext& rc, const Ray& r , SurfaceInteraction& intersect ) const{
     intersect.t = FLT_MAX;
-    return m_accelerator->GetIntersect( rc, r , intersect );
+    if( !m_accelerator->GetIntersect( rc, r , intersect ) )
+        return false;
+
+    // texture footprint is only needed on the closest hit
+    if( r.m_hasDifferentials )
+        intersect.ComputeDifferentials( r );
+    return true;
 }
 
 #ifndef ENABLE_TRANSPARENT_SHADOW
@@ -218,6 +225,22 @@ void Scene::RestoreMediumStack( const Point& p , RenderContext& rc, MediumStack&
     while (m_accelerator->UpdateMediumStack(ray, ms, rc, true)) {}
 }
 
+void Scene::UpdateMediumStack( const Point& from , const Point& to , RenderContext& rc, MediumStack& ms ) const{
+    if (IS_PTR_INVALID(m_accelerator))
+        return;
+
+    const auto delta = to - from;
+    const auto dist = delta.Length();
+    if (dist == 0.0f)
+        return;
+
+    Ray ray;
+    ray.m_Ori = from;
+    ray.m_Dir = delta / dist;
+    ray.m_fMax = dist;
+    while (m_accelerator->UpdateMediumStack(ray, ms, rc)) {}
+}
+
 void Scene::GetIntersect( const Ray& r , BSSRDFIntersections& intersect , RenderContext& rc, const StringID matID ) const{
     // no brute force support in BSSRDF
     if(IS_PTR_VALID(m_accelerator))
@@ -241,6 +264,9 @@ void Scene::genLightDistribution(){
         m_lights[i]->SetPickPDF( pdf[i] / total_pdf );
 
     m_lightsDis = std::make_unique<Distribution1D>( pdf.get() , count );
+
+    // lights picked for shading points go through the light hierarchy
+    m_lightBVH.Build( m_lights );
 }
 
 const Light* Scene::SampleLight( float u , float* pdf ) const{
@@ -281,6 +307,12 @@ void Scene::BuildAccelerationStructure() {
     m_accelerator->Build(*this);
 }
 
+void Scene::BuildOpacityMasks() {
+    SORT_PROFILE("Build Opacity Masks");
+    for (auto& entity : m_entities)
+        entity->BuildOpacityMasks();
+}
+
 unsigned Scene::GetPrimitiveCount() const{
     unsigned int cnt = 0;
     for(const auto& entity: m_entities)
@@ -30,6 +30,7 @@
 #include "core/samplemethod.h"
 #include "core/render_context.h"
 #include "accel/accelerator.h"
+#include "light/light_bvh.h"
 
 class Light;
 struct BSSRDFIntersections;
@@ -116,6 +117,15 @@ public:
     //! @param    ms            The medium stack to be populated.
     void        RestoreMediumStack( const Point& p , RenderContext& rc , MediumStack& ms ) const ;
 
+    //! @brief    Update the medium stack with the surfaces crossed when moving from one point to another.
+    //!
+    //! This is way cheaper than restoring the medium stack from scratch when the two points are close to each other.
+    //!
+    //! @param    from          The point where the medium stack is valid.
+    //! @param    to            The point where the medium stack is moved to.
+    //! @param    ms            The medium stack to be updated.
+    void        UpdateMediumStack( const Point& from , const Point& to , RenderContext& rc , MediumStack& ms ) const ;
+
     //! @brief Get multiple intersections between the ray and the primitive set using spatial data structure.
     //!
     //! This is a specific interface designed for SSS during disk ray casting. Without this interface, the algorithm has to use the
@@ -147,6 +157,29 @@ public:
     const Light* SampleLight( float u , float* pdf ) const;
     // get the properbility of the sample
     float LightProperbility( unsigned i ) const;
+
+    //! @brief  Pick a light for a shading point through the light hierarchy.
+    //!
+    //! Unlike the above version, lights are picked based on how much they could contribute to the shading point.
+    //!
+    //! @param  p       Position of the shading point.
+    //! @param  n       Normal of the shading point, zero vector if the shading point is not on a surface.
+    //! @param  u       A canonical random number.
+    //! @param  pdf     The probability of picking the light.
+    //! @return         The picked light, it could be nullptr if no light could contribute to the shading point.
+    const Light* SampleLight( const Point& p , const Vector& n , float u , float* pdf ) const{
+        return m_lightBVH.Sample( p , n , u , pdf );
+    }
+
+    //! @brief  The probability of picking a light for a shading point through the light hierarchy.
+    //!
+    //! @param  p       Position of the shading point.
+    //! @param  n       Normal of the shading point, zero vector if the shading point is not on a surface.
+    //! @param  light   The light of interest.
+    //! @return         The probability of picking the light.
+    float LightProperbility( const Point& p , const Vector& n , const Light* light ) const{
+        return m_lightBVH.Pmf( p , n , light );
+    }
     // get the number of lights
     unsigned LightNum() const{
         return (unsigned)m_lights.size();
@@ -174,6 +207,12 @@ public:
     // Build acceleration structure
     void BuildAccelerationStructure();
 
+    //! @brief  Build opacity micro-masks of transparent surfaces.
+    //!
+    //! Shadow rays use the masks to avoid evaluating the transparency of alpha tested surfaces, it needs to happen
+    //! after all materials are built and all textures are loaded.
+    void BuildOpacityMasks();
+
     // Get the primitive count
     unsigned GetPrimitiveCount() const;
 
@@ -189,6 +228,9 @@ private:
     /**< distribution of light power */
     std::unique_ptr<Distribution1D>             m_lightsDis = nullptr;
 
+    /**< light hierarchy for picking lights based on shading points */
+    LightBVH                                    m_lightBVH;
+
     // bounding box for the scene
     BBox    m_bbox;
 
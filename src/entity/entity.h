@@ -42,6 +42,12 @@ public:
     //! @param  scene       The scene to be filled.
     virtual void    FillScene( class Scene& scene ) {};
 
+    //! @brief  Build opacity micro-masks of all visuals in this entity.
+    void            BuildOpacityMasks(){
+        for(auto& visual: m_visuals)
+            visual->BuildOpacityMasks();
+    }
+
     //! @brief  Get the number of primitives in this entity.
     unsigned        GetPrimitiveCount() const{
         unsigned cnt = 0;
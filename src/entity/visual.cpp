@@ -16,19 +16,30 @@
  */
 
 #include <numeric>
+#include <marl/defer.h>
+#include <marl/scheduler.h>
+#include <marl/waitgroup.h>
 #include "visual.h"
 #include "material/matmanager.h"
 #include "core/scene.h"
 #include "accel/embree_util.h"
 #include "accel/embree.h"
+#include "light/meshlight.h"
+
+MeshVisual::MeshVisual() = default;
+MeshVisual::~MeshVisual() = default;
 
 void MeshVisual::Serialize( IStreamBase& stream ){
     m_memory = std::make_unique<Mesh>();
     m_memory->Serialize(stream);
 
+    // emissive meshes are light sources, all of their primitives point back to the light so that hitting them gets radiance.
+    if (!m_memory->m_emission.IsBlack())
+        m_light = std::make_unique<MeshLight>(this, m_memory->m_emission);
+
     for (const auto& mi : m_memory->m_indices){
         m_triangles.push_back( std::make_unique<Triangle>( this , mi ) );
-        m_primitives.push_back(std::make_unique<Primitive>(m_memory.get(), mi.m_mat, m_triangles.back().get()));
+        m_primitives.push_back(std::make_unique<Primitive>(m_memory.get(), mi.m_mat, m_triangles.back().get(), m_light.get()));
     }
 }
 
@@ -36,6 +47,49 @@ void MeshVisual::ApplyTransform( const Transform& transform ){
     m_memory->ApplyTransform( transform );
     m_memory->GenUV();
     m_memory->GenSmoothTagent();
+
+    // the area of triangles is only known in world space
+    if (m_light)
+        m_light->BuildDistribution();
+}
+
+Light* MeshVisual::GetLight() const{
+    return m_light.get();
+}
+
+void MeshVisual::BuildOpacityMasks(){
+    // only triangles with transparent materials are tested against their materials by shadow rays
+    std::vector<unsigned> faces;
+    for( auto i = 0u ; i < m_primitives.size() ; ++i ){
+        if( m_primitives[i]->GetMaterial()->HasTransparency() )
+            faces.push_back( i );
+    }
+
+    const auto build = [&]( unsigned begin , unsigned end ){
+        for( auto k = begin ; k < end ; ++k ){
+            const auto i = faces[k];
+            m_memory->m_indices[i].m_opacityMask = m_triangles[i]->BuildOpacityMask( *m_primitives[i]->GetMaterial() );
+        }
+    };
+
+    const auto face_cnt = (unsigned)faces.size();
+    if( !marl::Scheduler::get() ){
+        build( 0u , face_cnt );
+        return;
+    }
+
+    // each triangle evaluates the material at dozens of points, foliage meshes are worth spreading across threads
+    constexpr unsigned triangles_per_task = 1024;
+    marl::WaitGroup wait_group;
+    for( auto begin = 0u ; begin < face_cnt ; begin += triangles_per_task ){
+        const auto end = std::min( begin + triangles_per_task , face_cnt );
+        wait_group.add();
+        marl::schedule( [&build , wait_group , begin , end ](){
+            defer( wait_group.done() );
+            build( begin , end );
+        });
+    }
+    wait_group.wait();
 }
 
 void HairVisual::Serialize( IStreamBase& stream ){
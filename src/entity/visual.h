@@ -29,6 +29,8 @@
 #include "accel/embree_util.h"
 
 class Embree;
+class Light;
+class MeshLight;
 
 //! @brief Visual is the container for a specific type of shape that can be seen in SORT.
 /**
@@ -47,6 +49,18 @@ public:
         return (unsigned)m_primitives.size();
     }
 
+    //! @brief  Get the light source emitted by the visual, if there is one.
+    //!
+    //! @return     The light attached to the visual. 'nullptr' means the visual doesn't emit any light.
+    virtual Light*      GetLight() const {
+        return nullptr;
+    }
+
+    //! @brief  Build opacity micro-masks of the primitives with transparent materials.
+    //!
+    //! Materials need to be ready for evaluation before this is called.
+    virtual void        BuildOpacityMasks() {}
+
     #if INTEL_EMBREE_ENABLED
         //! @brief  Process embree data.
         virtual void BuildEmbreeGeometry(RTCDevice device, Embree& embree) const;
@@ -68,6 +82,10 @@ class MeshVisual : public Visual{
 public:
     DEFINE_RTTI( MeshVisual , Visual );
 
+    //! @brief  Constructor and destructor are defined where the mesh light is a complete type.
+    MeshVisual();
+    ~MeshVisual() override;
+
     //! @brief  Serialization interface. Loading data from stream.
     //!
     //! Serialize the visual. Loading from an IStreamBase, which could be coming from file, memory or network.
@@ -80,6 +98,14 @@ public:
     //! @param  transform   The transform of the visual to be applied.
     void        ApplyTransform( const Transform& transform ) override;
 
+    //! @brief  Get the light source emitted by the mesh.
+    //!
+    //! @return     The mesh light if the mesh is emissive, otherwise 'nullptr'.
+    Light*      GetLight() const override;
+
+    //! @brief  Build opacity micro-masks of the triangles with transparent materials.
+    void        BuildOpacityMasks() override;
+
     #if INTEL_EMBREE_ENABLED
         //! @brief  Process embree data.
         //!
@@ -94,6 +120,8 @@ public:
     std::unique_ptr<Mesh>                       m_memory;
     /**< This is to make sure the memory of triangles will be properly cleared. */
     std::vector<std::unique_ptr<Triangle>>      m_triangles;
+    /**< Light source emitted by the mesh, only emissive meshes have it. */
+    std::unique_ptr<MeshLight>                  m_light;
 };
 
 //! HairVisual has a bunch of lines.
@@ -17,7 +17,11 @@
 
 #pragma once
 
+#include <marl/defer.h>
+#include <marl/scheduler.h>
+#include <marl/waitgroup.h>
 #include "entity.h"
+#include "core/scene.h"
 
 //! @brief  Visual entity has a list of visuals.
 /**
@@ -48,9 +52,38 @@ public:
             visual->Serialize( stream );
 
             // Apply transform, some Visual applies transformation eariler for better performance.
-            visual->ApplyTransform( m_transform );
+            // Transforming a mesh also regenerates its uv and tangents, which is the heavy part of mesh loading. It
+            // doesn't depend on anything else in the stream, it is done in a separate task so that the rest of the
+            // entities can be parsed in the mean time.
+            if (marl::Scheduler::get()) {
+                m_visual_ready.add();
+                marl::schedule([this](Visual* visual) {
+                    defer(m_visual_ready.done());
+                    visual->ApplyTransform( m_transform );
+                }, visual.get());
+            } else {
+                visual->ApplyTransform( m_transform );
+            }
 
             m_visuals.push_back( std::move(visual) );
         }
     }
+
+    //! @brief  Fill the scene with primitives.
+    //!
+    //! Primitives are iterated through the visuals, the only thing pushed in the scene explicitly are lights emitted by
+    //! the visuals. It is also necessary to make sure all visuals are fully transformed before anyone touches them.
+    //!
+    //! @param  scene       The scene to be filled.
+    void    FillScene( class Scene& scene ) override {
+        m_visual_ready.wait();
+
+        for( const auto& visual : m_visuals ){
+            if( auto light = visual->GetLight() )
+                scene.AddLight( light );
+        }
+    }
+
+private:
+    marl::WaitGroup     m_visual_ready;     /**< Signaled when all visuals in this entity are transformed. */
 };
\ No newline at end of file
@@ -33,6 +33,10 @@ SORT_STATS_AVG_COUNT("Bi-directional Path Tracing", "Average Path Length Startin
 SORT_STATS_AVG_COUNT("Bi-directional Path Tracing", "Average Path Length Starting from Lights", sTotalLengthPathFromLight , sPrimaryRayCount);       // This also counts the case where ray hits sky
 
 Spectrum BidirPathTracing::Li( const Ray& ray , const PixelSample& ps , const Scene& scene, RenderContext& rc) const{
+    return _Li( ray , scene , BDPT_MergeFactors() , nullptr , rc );
+}
+
+Spectrum BidirPathTracing::_Li( const Ray& ray , const Scene& scene , const BDPT_MergeFactors& factors , const BDPT_Merge& merge , RenderContext& rc ) const{
     SORT_STATS(++sPrimaryRayCount);
 
     const auto& camera = scene.GetCamera();
@@ -45,93 +49,23 @@ Spectrum BidirPathTracing::Li( const Ray& ray , const PixelSample& ps , const Sc
 
     Spectrum li;
 
-    auto    light_emission_pdf = 0.0f;
-    auto    light_pdfa = 0.0f;
-    Ray     light_ray;
-    auto    cosAtLight = 1.0f;
-    LightSample light_sample(rc);
-    const auto le = light->sample_l( rc, light_sample , light_ray , &light_emission_pdf , &light_pdfa , &cosAtLight );
-
     //-----------------------------------------------------------------------------------------------------
     // Trace light path from light source
     std::vector<BDPT_Vertex> light_path;
-    auto    wi = light_ray;
-    double  vc = (light->IsDelta())?0.0f: MIS(cosAtLight / light_emission_pdf);
-    double  vcm = MIS(light_pdfa / light_emission_pdf);
-    auto    throughput = le * cosAtLight / (light_emission_pdf * pdf);
-    auto    rr = 1.0f;
-    while ((int)light_path.size() < max_recursive_depth){
-        SORT_STATS(++sTotalLengthPathFromLight);
-
-        BDPT_Vertex vert;
-        if (!scene.GetIntersect(rc, wi, vert.inter))
-            break;
-
-        const auto distSqr = vert.inter.t * vert.inter.t;
-        const auto cosIn = absDot( wi.m_Dir , vert.inter.normal );
-        if( light_path.size() > 0 || ( light_path.size() == 0 && !light->IsInfinite() ) )
-            vcm *= MIS( distSqr );
-        vcm /= MIS( cosIn );
-        vc /= MIS( cosIn );
-
-        rr = 1.0f;
-        if (throughput.GetIntensity() < 0.01f)
-            rr = 0.5f;
-
-        vert.p = vert.inter.intersect;
-        vert.n = vert.inter.normal;
-        vert.wi = -wi.m_Dir;
-
-        vert.se = SORT_MALLOC(rc.m_memory_arena, ScatteringEvent)(vert.inter, SE_EVALUATE_ALL_NO_SSS);
-        vert.inter.primitive->GetMaterial()->UpdateScatteringEvent(*vert.se, rc);
-
-        vert.throughput = throughput;
-        vert.vcm = vcm;
-        vert.vc = vc;
-        vert.rr = rr;
-        vert.depth = (unsigned)(light_path.size() + 1);
-
-        light_path.push_back(vert);
-
-        //-----------------------------------------------------------------------------------------------------
-        // Path evaluation: light tracing
-        _ConnectCamera( vert , (unsigned)light_path.size() , light , scene, rc );
-
-        // russian roulette
-        if (sort_rand<float>(rc) > rr)
-            break;
-
-        float bsdf_pdf;
-        const auto bsdf_value = vert.se->Sample_BSDF( vert.wi , vert.wo , BsdfSample(rc) , bsdf_pdf, rc );
-        bsdf_pdf *= rr;
-
-        if( 0.0f == bsdf_pdf )
-            break;
-
-        const auto cosOut = absDot(vert.wo, vert.n);
-        throughput *= bsdf_value / bsdf_pdf;
-
-        if (throughput.IsBlack())
-            break;
-
-        const auto rev_bsdf_pdfw = vert.se->Pdf_BSDF( vert.wo , vert.wi ) * rr;
-        vc = MIS(cosOut/bsdf_pdf) * ( MIS(rev_bsdf_pdfw) * vc + vcm ) ;
-        vcm = MIS(1.0f/bsdf_pdf);
-
-        wi = Ray(vert.inter.intersect, vert.wo, 0, 0.001f);
-    }
+    _TraceLightPath( light , pdf , scene , factors , true , light_path , rc );
 
     //-----------------------------------------------------------------------------------------------------
     // Trace light path from eye point
     const auto lps = (const unsigned)light_path.size();
     const auto resolution = camera->GetImageResolution();
     const auto total_pixel = resolution.x * resolution.y;
-    wi = ray;
-    throughput = 1.0f;
+    auto    wi = ray;
+    Spectrum throughput = 1.0f;
     auto light_path_len = 0;
-    vc = 0.0f;
-    vcm = MIS(total_pixel / ray.m_fPdfW);
-    rr = 1.0f;
+    double  vc = 0.0f;
+    double  vm = 0.0f;
+    double  vcm = MIS(total_pixel / ray.m_fPdfW);
+    auto    rr = 1.0f;
     while (light_path_len <= (int)max_recursive_depth){
         SORT_STATS(++sTotalLengthPathFromEye);
 
@@ -160,6 +94,7 @@ Spectrum BidirPathTracing::Li( const Ray& ray , const PixelSample& ps , const Sc
         vcm *= MIS( distSqr );
         vcm /= MIS( cosIn );
         vc /= MIS( cosIn );
+        vm /= MIS( cosIn );
 
         //-----------------------------------------------------------------------------------------------------
         // Path evaluation: it hits a light source
@@ -189,17 +124,23 @@ Spectrum BidirPathTracing::Li( const Ray& ray , const PixelSample& ps , const Sc
 
         vert.throughput = throughput;
         vert.vc = vc;
+        vert.vm = vm;
         vert.vcm = vcm;
         vert.rr = rr;
 
         //-----------------------------------------------------------------------------------------------------
         // Path evaluation: connect light sample first
-        li += _ConnectLight(vert, light, scene, rc) / pdf;
+        li += _ConnectLight(vert, light, scene, factors, rc) / pdf;
 
         //-----------------------------------------------------------------------------------------------------
         // Path evaluation: connect vertices
         for (unsigned j = 0; j < lps; ++j)
-            li += _ConnectVertices( light_path[j] , vert , light , scene , rc);
+            li += _ConnectVertices( light_path[j] , vert , light , scene , factors , rc);
+
+        //-----------------------------------------------------------------------------------------------------
+        // Path evaluation: merge with light vertices nearby
+        if( merge )
+            li += merge( vert );
 
         ++light_path_len;
 
@@ -221,7 +162,8 @@ Spectrum BidirPathTracing::Li( const Ray& ray , const PixelSample& ps , const Sc
             break;
 
         const auto rev_bsdf_pdfw = vert.se->Pdf_BSDF( vert.wo , vert.wi ) * rr;
-        vc = MIS( cosOut / bsdf_pdf ) * ( MIS( rev_bsdf_pdfw ) * vc + vcm );
+        vm = MIS( cosOut / bsdf_pdf ) * ( MIS( rev_bsdf_pdfw ) * vm + vcm * factors.vc_weight + 1.0f );
+        vc = MIS( cosOut / bsdf_pdf ) * ( MIS( rev_bsdf_pdfw ) * vc + vcm + factors.vm_weight );
         vcm = MIS( 1.0f / bsdf_pdf );
 
         wi = Ray(vert.inter.intersect, vert.wo, 0, 0.001f);
@@ -230,13 +172,94 @@ Spectrum BidirPathTracing::Li( const Ray& ray , const PixelSample& ps , const Sc
     return li;
 }
 
+void BidirPathTracing::_TraceLightPath( const Light* light , float light_pick_pdf , const Scene& scene , const BDPT_MergeFactors& factors ,
+                                        bool connect_camera , std::vector<BDPT_Vertex>& light_path , RenderContext& rc ) const{
+    auto    light_emission_pdf = 0.0f;
+    auto    light_pdfa = 0.0f;
+    Ray     light_ray;
+    auto    cosAtLight = 1.0f;
+    LightSample light_sample(rc);
+    const auto le = light->sample_l( rc, light_sample , light_ray , &light_emission_pdf , &light_pdfa , &cosAtLight );
+
+    auto    wi = light_ray;
+    double  vc = (light->IsDelta())?0.0f: MIS(cosAtLight / light_emission_pdf);
+    double  vcm = MIS(light_pdfa / light_emission_pdf);
+    double  vm = vc * factors.vc_weight;
+    auto    throughput = le * cosAtLight / (light_emission_pdf * light_pick_pdf);
+    auto    rr = 1.0f;
+    while ((int)light_path.size() < max_recursive_depth){
+        SORT_STATS(++sTotalLengthPathFromLight);
+
+        BDPT_Vertex vert;
+        if (!scene.GetIntersect(rc, wi, vert.inter))
+            break;
+
+        const auto distSqr = vert.inter.t * vert.inter.t;
+        const auto cosIn = absDot( wi.m_Dir , vert.inter.normal );
+        if( light_path.size() > 0 || ( light_path.size() == 0 && !light->IsInfinite() ) )
+            vcm *= MIS( distSqr );
+        vcm /= MIS( cosIn );
+        vc /= MIS( cosIn );
+        vm /= MIS( cosIn );
+
+        rr = 1.0f;
+        if (throughput.GetIntensity() < 0.01f)
+            rr = 0.5f;
+
+        vert.p = vert.inter.intersect;
+        vert.n = vert.inter.normal;
+        vert.wi = -wi.m_Dir;
+
+        vert.se = SORT_MALLOC(rc.m_memory_arena, ScatteringEvent)(vert.inter, SE_EVALUATE_ALL_NO_SSS);
+        vert.inter.primitive->GetMaterial()->UpdateScatteringEvent(*vert.se, rc);
+
+        vert.throughput = throughput;
+        vert.vcm = vcm;
+        vert.vc = vc;
+        vert.vm = vm;
+        vert.rr = rr;
+        vert.depth = (unsigned)(light_path.size() + 1);
+
+        light_path.push_back(vert);
+
+        //-----------------------------------------------------------------------------------------------------
+        // Path evaluation: light tracing
+        if( connect_camera )
+            _ConnectCamera( vert , (unsigned)light_path.size() , light , scene, factors , rc );
+
+        // russian roulette
+        if (sort_rand<float>(rc) > rr)
+            break;
+
+        float bsdf_pdf;
+        const auto bsdf_value = vert.se->Sample_BSDF( vert.wi , vert.wo , BsdfSample(rc) , bsdf_pdf, rc );
+        bsdf_pdf *= rr;
+
+        if( 0.0f == bsdf_pdf )
+            break;
+
+        const auto cosOut = absDot(vert.wo, vert.n);
+        throughput *= bsdf_value / bsdf_pdf;
+
+        if (throughput.IsBlack())
+            break;
+
+        const auto rev_bsdf_pdfw = vert.se->Pdf_BSDF( vert.wo , vert.wi ) * rr;
+        vm = MIS(cosOut/bsdf_pdf) * ( MIS(rev_bsdf_pdfw) * vm + vcm * factors.vc_weight + 1.0f );
+        vc = MIS(cosOut/bsdf_pdf) * ( MIS(rev_bsdf_pdfw) * vc + vcm + factors.vm_weight ) ;
+        vcm = MIS(1.0f/bsdf_pdf);
+
+        wi = Ray(vert.inter.intersect, vert.wo, 0, 0.001f);
+    }
+}
+
 void BidirPathTracing::RequestSample( Sampler* sampler , PixelSample* ps , unsigned ps_num ){
     Integrator::RequestSample( sampler, ps , ps_num );
     sample_per_pixel = ps_num;
 }
 
 // connect vertices
-Spectrum BidirPathTracing::_ConnectVertices( const BDPT_Vertex& p0 , const BDPT_Vertex& p1 , const Light* light , const Scene& scene , RenderContext& rc ) const{
+Spectrum BidirPathTracing::_ConnectVertices( const BDPT_Vertex& p0 , const BDPT_Vertex& p1 , const Light* light , const Scene& scene , const BDPT_MergeFactors& factors , RenderContext& rc ) const{
     if( p0.depth + p1.depth >= max_recursive_depth )
         return 0.0f;
 
@@ -246,20 +269,21 @@ Spectrum BidirPathTracing::_ConnectVertices( const BDPT_Vertex& p0 , const BDPT_
 
     const auto cosAtP0 = absDot( p0.n , n_delta );
     const auto cosAtP1 = absDot( p1.n , n_delta );
-    const Spectrum g = p1.se->Evaluate_BSDF( p1.wi , n_delta ) * p0.se->Evaluate_BSDF( p0.wi , -n_delta ) * invDistcSqr;
+    float p0_bsdf_pdfw , p0_bsdf_rev_pdfw , p1_bsdf_pdfw , p1_bsdf_rev_pdfw;
+    const Spectrum g = p1.se->Evaluate_BSDF_Pdf( p1.wi , n_delta , p1_bsdf_pdfw , &p1_bsdf_rev_pdfw ) * p0.se->Evaluate_BSDF_Pdf( p0.wi , -n_delta , p0_bsdf_pdfw , &p0_bsdf_rev_pdfw ) * invDistcSqr;
     if( g.IsBlack() )
         return 0.0f;
 
-    const auto p0_bsdf_pdfw     = p0.se->Pdf_BSDF( p0.wi , -n_delta ) * p0.rr;
-    const auto p0_bsdf_rev_pdfw = p0.se->Pdf_BSDF( -n_delta , p0.wi ) * p0.rr;
-    const auto p1_bsdf_pdfw     = p1.se->Pdf_BSDF( p1.wi , n_delta ) * p1.rr;
-    const auto p1_bsdf_rev_pdfw = p1.se->Pdf_BSDF( n_delta , p1.wi ) * p1.rr;
+    p0_bsdf_pdfw *= p0.rr;
+    p0_bsdf_rev_pdfw *= p0.rr;
+    p1_bsdf_pdfw *= p1.rr;
+    p1_bsdf_rev_pdfw *= p1.rr;
 
     const auto p0_a = p1_bsdf_pdfw * cosAtP0 * invDistcSqr;
     const auto p1_a = p0_bsdf_pdfw * cosAtP1 * invDistcSqr;
 
-    const double mis_0 = MIS( p0_a ) * ( p0.vcm + p0.vc * MIS( p0_bsdf_rev_pdfw ) );
-    const double mis_1 = MIS( p1_a ) * ( p1.vcm + p1.vc * MIS( p1_bsdf_rev_pdfw ) );
+    const double mis_0 = MIS( p0_a ) * ( factors.vm_weight + p0.vcm + p0.vc * MIS( p0_bsdf_rev_pdfw ) );
+    const double mis_1 = MIS( p1_a ) * ( factors.vm_weight + p1.vcm + p1.vc * MIS( p1_bsdf_rev_pdfw ) );
 
     const auto weight = (float)(1.0f / (mis_0 + 1.0f + mis_1));
 
@@ -280,7 +304,7 @@ Spectrum BidirPathTracing::_ConnectVertices( const BDPT_Vertex& p0 , const BDPT_
 }
 
 // connect light sample
-Spectrum BidirPathTracing::_ConnectLight(const BDPT_Vertex& eye_vertex , const Light* light , const Scene& scene , RenderContext& rc) const{
+Spectrum BidirPathTracing::_ConnectLight(const BDPT_Vertex& eye_vertex , const Light* light , const Scene& scene , const BDPT_MergeFactors& factors , RenderContext& rc) const{
     if( eye_vertex.depth >= max_recursive_depth )
         return 0.0f;
 
@@ -297,7 +321,8 @@ Spectrum BidirPathTracing::_ConnectLight(const BDPT_Vertex& eye_vertex , const L
         return 0.0f;
     
     const auto cosAtEyeVertex = absDot(eye_vertex.n, wi);
-    li *= eye_vertex.throughput * eye_vertex.se->Evaluate_BSDF( eye_vertex.wi , wi ) / directPdfW;
+    float eye_bsdf_pdfw , eye_bsdf_rev_pdfw;
+    li *= eye_vertex.throughput * eye_vertex.se->Evaluate_BSDF_Pdf( eye_vertex.wi , wi , eye_bsdf_pdfw , &eye_bsdf_rev_pdfw ) / directPdfW;
 
     if (li.IsBlack())
         return 0.0f;
@@ -311,11 +336,11 @@ Spectrum BidirPathTracing::_ConnectLight(const BDPT_Vertex& eye_vertex , const L
         return 0.0f;
 #endif
 
-    const auto eye_bsdf_pdfw = eye_vertex.se->Pdf_BSDF( eye_vertex.wi , wi ) * eye_vertex.rr;
-    const auto eye_bsdf_rev_pdfw = eye_vertex.se->Pdf_BSDF( wi , eye_vertex.wi ) * eye_vertex.rr;
+    eye_bsdf_pdfw *= eye_vertex.rr;
+    eye_bsdf_rev_pdfw *= eye_vertex.rr;
 
     const double mis0 = light->IsDelta()?0.0f:MIS(eye_bsdf_pdfw / directPdfW);
-    const double mis1 = MIS( cosAtEyeVertex * emissionPdfW / ( cosAtLight * directPdfW ) ) * ( eye_vertex.vcm + eye_vertex.vc * MIS( eye_bsdf_rev_pdfw ) );
+    const double mis1 = MIS( cosAtEyeVertex * emissionPdfW / ( cosAtLight * directPdfW ) ) * ( factors.vm_weight + eye_vertex.vcm + eye_vertex.vc * MIS( eye_bsdf_rev_pdfw ) );
 
     const auto weight = (float)(1.0f / (mis0 + mis1 + 1.0f));
 
@@ -326,7 +351,7 @@ Spectrum BidirPathTracing::_ConnectLight(const BDPT_Vertex& eye_vertex , const L
 #endif
 }
 
-void BidirPathTracing::_ConnectCamera(const BDPT_Vertex& light_vertex, int len , const Light* light , const Scene& scene , RenderContext& rc) const{
+void BidirPathTracing::_ConnectCamera(const BDPT_Vertex& light_vertex, int len , const Light* light , const Scene& scene , const BDPT_MergeFactors& factors , RenderContext& rc) const{
     if( light_vertex.depth > max_recursive_depth )
         return;
 
@@ -354,7 +379,8 @@ void BidirPathTracing::_ConnectCamera(const BDPT_Vertex& light_vertex, int len ,
         camera_pdfW == 0.0f )
         return;
 
-    const auto bsdf_value = light_vertex.se->Evaluate_BSDF( light_vertex.wi , -n_delta );
+    float bsdf_pdfw , bsdf_rev_pdfw;
+    const auto bsdf_value = light_vertex.se->Evaluate_BSDF_Pdf( light_vertex.wi , -n_delta , bsdf_pdfw , &bsdf_rev_pdfw );
     if( bsdf_value.IsBlack() )
         return;
 
@@ -377,8 +403,7 @@ void BidirPathTracing::_ConnectCamera(const BDPT_Vertex& light_vertex, int len ,
 
     if( !light_tracing_only ){
         const float lightvert_pdfA = camera_pdfW * absDot( light_vertex.n, n_delta ) * invSqrLen ;
-        const float bsdf_rev_pdfw = light_vertex.se->Pdf_BSDF( -n_delta , light_vertex.wi ) * light_vertex.rr;
-        const double mis0 = ( light_vertex.vcm + light_vertex.vc * MIS( bsdf_rev_pdfw ) ) * MIS( lightvert_pdfA / total_pixel );
+        const double mis0 = ( factors.vm_weight + light_vertex.vcm + light_vertex.vc * MIS( bsdf_rev_pdfw * light_vertex.rr ) ) * MIS( lightvert_pdfA / total_pixel );
         const float weight = (float)(1.0f / (1.0f + mis0));
 
         radiance *= weight;
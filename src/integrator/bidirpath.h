@@ -17,6 +17,7 @@
 
 #pragma once
 
+#include <functional>
 #include "integrator.h"
 #include "math/point.h"
 #include "math/vector3.h"
@@ -39,11 +40,21 @@ struct BDPT_Vertex{
     // MIS factors
     double      vc = 0.0f;
     double      vcm = 0.0f;
+    double      vm = 0.0f;
 
     // depth of the vertex
     int         depth = 0;
 };
 
+// Factors of vertex merging in MIS weights, they are zero when there is no vertex merging.
+struct BDPT_MergeFactors{
+    double      vm_weight = 0.0f;   // MIS of the ratio between the pdf of merging and the pdf of connecting, pi * r^2 * N
+    double      vc_weight = 0.0f;   // MIS of the ratio between the pdf of connecting and the pdf of merging
+};
+
+// Merge an eye vertex with light vertices nearby, it returns the contribution of all merged paths.
+using BDPT_Merge = std::function<Spectrum( const BDPT_Vertex& eye_vertex )>;
+
 struct Pending_Sample{
     Vector2i    coord;
     Spectrum    radiance;
@@ -98,21 +109,27 @@ protected:
     bool    light_tracing_only = false;     // only do light tracing
     int     sample_per_pixel = 1;           // light sample per pixel
 
+    // use multiple importance sampling to sample direct illumination
+    bool    m_bMIS = true;
+
+    // trace a light path and an eye path, vertices of the two paths are connected, eye vertices are also merged with 'merge' if it is valid
+    Spectrum    _Li( const Ray& ray , const Scene& scene , const BDPT_MergeFactors& factors , const BDPT_Merge& merge , RenderContext& rc ) const;
+
+    // trace a path starting from a light, all vertices are connected to the camera if 'connect_camera' is true
+    void        _TraceLightPath( const Light* light , float light_pick_pdf , const Scene& scene , const BDPT_MergeFactors& factors ,
+                                 bool connect_camera , std::vector<BDPT_Vertex>& light_path , RenderContext& rc ) const;
+
     // compute G term
     Spectrum    _Gterm( const BDPT_Vertex& p0 , const BDPT_Vertex& p1 ) const;
 
     // connect light sample
-    Spectrum    _ConnectLight(const BDPT_Vertex& eye_vertex, const Light* light , const Scene& scene , RenderContext& rc) const;
+    Spectrum    _ConnectLight(const BDPT_Vertex& eye_vertex, const Light* light , const Scene& scene , const BDPT_MergeFactors& factors , RenderContext& rc) const;
 
     // connect camera point
-    void        _ConnectCamera(const BDPT_Vertex& light_vertex , int len , const Light* light , const Scene& scene , RenderContext& rc ) const;
+    void        _ConnectCamera(const BDPT_Vertex& light_vertex , int len , const Light* light , const Scene& scene , const BDPT_MergeFactors& factors , RenderContext& rc ) const;
 
     // connect vertices
-    Spectrum    _ConnectVertices( const BDPT_Vertex& light_vertex , const BDPT_Vertex& eye_vertex , const Light* light , const Scene& scene, RenderContext& rc ) const;
-
-private:
-    // use multiple importance sampling to sample direct illumination
-    bool    m_bMIS = true;
+    Spectrum    _ConnectVertices( const BDPT_Vertex& light_vertex , const BDPT_Vertex& eye_vertex , const Light* light , const Scene& scene, const BDPT_MergeFactors& factors , RenderContext& rc ) const;
 
     // mis factor
     SORT_FORCEINLINE double MIS(double t) const {
@@ -122,5 +139,6 @@ private:
         return m_bMIS ? t * t : 1.0f;
     }
 
+private:
     SORT_STATS_ENABLE( "Bi-directional Path Tracing" )
 };
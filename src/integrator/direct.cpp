@@ -22,10 +22,46 @@
 #include "light/light.h"
 #include "core/memory.h"
 #include "sampler/sampler.h"
+#include "scatteringevent/scatteringevent.h"
+#include "material/material.h"
+#include "camera/camera.h"
+#include "work/image_evaluation/image_evaluation.h"
 
 SORT_STATS_DECLARE_COUNTER(sPrimaryRayCount)
 
+// Scenes with more lights than this don't evaluate all lights at each shading point, lights are picked through the
+// light hierarchy instead.
+static constexpr unsigned DIRECT_LIGHT_EXHAUSTIVE_COUNT = 16;
+
+// Number of lights picked at each shading point when lights are not evaluated exhaustively.
+static constexpr unsigned DIRECT_LIGHT_SAMPLE_COUNT = 4;
+
+// Maximum offset of neighboring pixels that reservoirs are reused from.
+static constexpr int DIRECT_LIGHT_REUSE_RADIUS = 8;
+
+// Reservoirs of neighboring pixels are only reused if the normals are within this cosine.
+static constexpr float DIRECT_LIGHT_REUSE_COS = 0.9f;
+
+// Reservoirs of neighboring pixels are only reused if the depths differ by less than this ratio.
+static constexpr float DIRECT_LIGHT_REUSE_DEPTH = 0.1f;
+
+SORT_STATS_DEFINE_COUNTER(sReusedReservoirs)
+
 SORT_STATS_COUNTER("Direct Illumination", "Primary Ray Count" , sPrimaryRayCount);
+SORT_STATS_AVG_COUNT("Direct Illumination", "Average Reused Reservoirs", sReusedReservoirs , sPrimaryRayCount);
+
+void DirectLight::PreProcess( const Scene& scene , RenderContext& rc ){
+    m_reservoirs = nullptr;
+
+    const auto camera = scene.GetCamera();
+    if( !m_resampling || IS_PTR_INVALID( camera ) )
+        return;
+
+    const auto resolution = camera->GetImageResolution();
+    m_width = resolution.x;
+    m_height = resolution.y;
+    m_reservoirs = std::make_unique<DirectLightReservoir[]>( m_width * m_height );
+}
 
 Spectrum DirectLight::Li( const Ray& r , const PixelSample& ps , const Scene& scene, RenderContext& rc) const{
     SORT_STATS(++sPrimaryRayCount);
@@ -41,12 +77,126 @@ Spectrum DirectLight::Li( const Ray& r , const PixelSample& ps , const Scene& sc
 
     auto li = ip.Le( -r.m_Dir );
 
-    // evaluate direct light
-    auto light_num = scene.LightNum();
-    for( auto i = 0u ; i < light_num ; ++i ){
-        const auto light = scene.GetLight(i);
-        li += EvaluateDirect( r , scene , light , ip , LightSample(rc) , BsdfSample(rc) , rc, true );
+    // resample many candidate light samples while tracing only a few shadow rays
+    if( m_reservoirs ){
+        ScatteringEvent se( ip , SE_EVALUATE_ALL_NO_SSS );
+        ip.primitive->GetMaterial()->UpdateScatteringEvent( se , rc );
+        return li + resampleDirect( r , ps , se , scene , rc );
+    }
+
+    // evaluate all lights if there are not many of them
+    const auto light_num = scene.LightNum();
+    if( light_num <= DIRECT_LIGHT_EXHAUSTIVE_COUNT ){
+        for( auto i = 0u ; i < light_num ; ++i ){
+            const auto light = scene.GetLight(i);
+            li += EvaluateDirect( r , scene , light , ip , LightSample(rc) , BsdfSample(rc) , rc, true );
+        }
+        return li;
     }
 
-    return li;
-}
\ No newline at end of file
+    // otherwise pick a few of them through the light hierarchy
+    ScatteringEvent se( ip , SE_EVALUATE_ALL_NO_SSS );
+    ip.primitive->GetMaterial()->UpdateScatteringEvent( se , rc );
+
+    Spectrum direct;
+    for( auto i = 0u ; i < DIRECT_LIGHT_SAMPLE_COUNT ; ++i ){
+        auto light_pdf = 0.0f;
+        const auto light_sample = LightSample(rc);
+        const auto light = scene.SampleLight( ip.intersect , ip.normal , light_sample.t , &light_pdf );
+        if( light && light_pdf > 0.0f )
+            direct += EvaluateDirect( se , r , scene , light , light_sample , BsdfSample(rc) , rc ) / light_pdf;
+    }
+
+    return li + direct / (float)DIRECT_LIGHT_SAMPLE_COUNT;
+}
+Spectrum DirectLight::resampleDirect( const Ray& r , const PixelSample& ps , const ScatteringEvent& se , const Scene& scene , RenderContext& rc ) const{
+    const auto& ip = se.GetInteraction();
+    const auto wo = -r.m_Dir;
+
+    // unshadowed contribution of a light sample divided by its pdf, which is the integrand in the primary sample space
+    const auto evaluate = [&]( const LightSample& ls , Visibility& visibility ) -> Spectrum {
+        auto pick_pdf = 0.0f;
+        const auto light = scene.SampleLight( ip.intersect , ip.normal , ls.t , &pick_pdf );
+        if( IS_PTR_INVALID( light ) || pick_pdf == 0.0f )
+            return 0.0f;
+
+        Vector wi;
+        auto light_pdf = 0.0f;
+        const auto le = light->sample_l( ip.intersect , &ls , wi , 0 , &light_pdf , 0 , 0 , visibility );
+        if( light_pdf == 0.0f || le.IsBlack() )
+            return 0.0f;
+        return se.Evaluate_BSDF( wo , wi ) * le / ( light_pdf * pick_pdf );
+    };
+    const auto shadow = [&]( const Visibility& visibility ) -> Spectrum {
+#ifndef ENABLE_TRANSPARENT_SHADOW
+        return visibility.IsVisible() ? 1.0f : 0.0f;
+#else
+        return visibility.GetAttenuation(rc);
+#endif
+    };
+
+    // stream candidates through the reservoir of the pixel, no shadow ray is needed for them
+    DirectLightReservoir reservoir;
+    reservoir.n = ip.normal;
+    reservoir.depth = ip.t;
+    for( auto i = 0u ; i < m_candidateCnt ; ++i ){
+        const LightSample ls(rc);
+        Visibility visibility( scene );
+        const auto target = evaluate( ls , visibility ).GetIntensity();
+        reservoir.Update( ls , target , target , sort_rand<float>(rc) );
+    }
+    reservoir.M = m_candidateCnt;
+
+    // occluded samples are dropped before the reservoir is shared with other pixels
+    if( reservoir.target > 0.0f ){
+        Visibility visibility( scene );
+        evaluate( reservoir.sample , visibility );
+        if( !shadow( visibility ).IsBlack() )
+            reservoir.W = reservoir.w_sum / ( reservoir.M * reservoir.target );
+    }
+
+    const auto x = ps.pixel_x;
+    const auto y = ps.pixel_y;
+    const auto valid_pixel = x >= 0 && x < m_width && y >= 0 && y < m_height;
+    if( valid_pixel )
+        m_reservoirs[y * m_width + x] = reservoir;
+
+    // reuse reservoirs of pixels rendered earlier in the same tile, they are rendered by the same task
+    DirectLightReservoir combined;
+    combined.Update( reservoir.sample , reservoir.target , reservoir.target * reservoir.W * reservoir.M , sort_rand<float>(rc) );
+    combined.M = reservoir.M;
+    for( auto k = 0u ; valid_pixel && k < m_neighborCnt ; ++k ){
+        const auto nx = x + (int)floor( ( sort_rand<float>(rc) * 2.0f - 1.0f ) * DIRECT_LIGHT_REUSE_RADIUS );
+        const auto ny = y + (int)floor( ( sort_rand<float>(rc) * 2.0f - 1.0f ) * DIRECT_LIGHT_REUSE_RADIUS );
+        if( nx < 0 || ny < 0 || nx >= m_width || ny >= m_height )
+            continue;
+        if( nx / (int)IMAGE_TILE_SIZE != x / (int)IMAGE_TILE_SIZE || ny / (int)IMAGE_TILE_SIZE != y / (int)IMAGE_TILE_SIZE )
+            continue;
+        if( ny > y || ( ny == y && nx >= x ) )
+            continue;
+
+        // reservoirs of very different surfaces would introduce too much bias
+        const auto& neighbor = m_reservoirs[ny * m_width + nx];
+        if( neighbor.M == 0 || dot( neighbor.n , ip.normal ) < DIRECT_LIGHT_REUSE_COS ||
+            fabs( neighbor.depth - ip.t ) > DIRECT_LIGHT_REUSE_DEPTH * ip.t )
+            continue;
+
+        auto target = 0.0f;
+        if( neighbor.W > 0.0f ){
+            Visibility visibility( scene );
+            target = evaluate( neighbor.sample , visibility ).GetIntensity();
+        }
+        combined.Update( neighbor.sample , target , target * neighbor.W * neighbor.M , sort_rand<float>(rc) );
+        combined.M += neighbor.M;
+        SORT_STATS(++sReusedReservoirs);
+    }
+
+    if( combined.target <= 0.0f )
+        return 0.0f;
+
+    Visibility visibility( scene );
+    const auto contribution = evaluate( combined.sample , visibility );
+    if( contribution.IsBlack() )
+        return 0.0f;
+    return contribution * shadow( visibility ) * ( combined.w_sum / ( combined.M * combined.target ) );
+}
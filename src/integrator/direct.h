@@ -19,6 +19,38 @@
 
 #include "integrator.h"
 
+class ScatteringEvent;
+
+//! @brief  Reservoir of light samples for resampled importance sampling.
+/**
+ * Light samples are kept in the primary sample space, a light sample of one pixel maps to a sample on a light through
+ * the same light picking and light sampling at another pixel. The mapping has a jacobian of one in the primary sample
+ * space, which makes it trivial to reuse reservoirs between pixels.
+ */
+struct DirectLightReservoir{
+    LightSample sample;             // the light sample kept in the reservoir
+    float       target = 0.0f;      // target function value of the kept sample
+    float       w_sum = 0.0f;       // sum of weights of all candidates
+    float       W = 0.0f;           // contribution weight of the kept sample
+    unsigned    M = 0;              // number of candidates seen by the reservoir
+    Vector      n;                  // normal at the shading point
+    float       depth = 0.0f;       // distance from the camera to the shading point
+
+    //! @brief  Stream a candidate through the reservoir.
+    //!
+    //! @param  ls          The light sample of the candidate.
+    //! @param  p           Target function value of the candidate.
+    //! @param  w           Resampling weight of the candidate.
+    //! @param  u           A canonical random variable.
+    SORT_FORCEINLINE void Update( const LightSample& ls , float p , float w , float u ){
+        w_sum += w;
+        if( w > 0.0f && u * w_sum < w ){
+            sample = ls;
+            target = p;
+        }
+    }
+};
+
 //! @brief  Only evaluate direct illumination.
 /**
  * Comparing with whitted ray tracing , direct light requires more samples per pixel
@@ -36,13 +68,44 @@ public:
     //! @return                 The radiance along the opposite direction that the ray points to.
     Spectrum    Li( const Ray& ray , const PixelSample& ps , const Scene& scene, RenderContext& rc) const override;
 
+    //! @brief  Allocate reservoirs of all pixels if resampling is enabled.
+    //!
+    //! @param  scene           The scene to be evaluated.
+    //! @param  rc              The render context.
+    void        PreProcess( const Scene& scene , RenderContext& rc ) override;
+
     //! @brief      Serializing data from stream
     //!
     //! @param      Stream where the serialization data comes from. Depending on different situation, it could come from different places.
     void    Serialize( IStreamBase& stream ) override {
         Integrator::Serialize( stream );
+        stream >> m_resampling;
+        stream >> m_candidateCnt;
+        stream >> m_neighborCnt;
     }
 
 private:
+    bool        m_resampling = false;       /**< Whether to resample light samples, ReSTIR style. */
+    unsigned    m_candidateCnt = 32;        /**< Number of candidate light samples of each pixel sample. */
+    unsigned    m_neighborCnt = 4;          /**< Number of neighboring pixels to reuse reservoirs from. */
+
+    std::unique_ptr<DirectLightReservoir[]> m_reservoirs;   /**< Reservoirs of all pixels before spatial reuse. */
+    int                                     m_width = 0;    /**< Width of the image. */
+    int                                     m_height = 0;   /**< Height of the image. */
+
+    //! @brief  Evaluate direct illumination through resampled importance sampling with spatial reuse.
+    //!
+    //! Many candidate light samples are streamed through a reservoir without tracing shadow rays, the reservoir is
+    //! then combined with reservoirs of pixels nearby. Only two shadow rays are traced, one for the sample kept
+    //! before the spatial reuse and one for the final sample.
+    //!
+    //! @param  r               The ray hitting the shading point.
+    //! @param  ps              The pixel sample.
+    //! @param  se              The scattering event at the shading point.
+    //! @param  scene           The scene to be evaluated.
+    //! @param  rc              The render context.
+    //! @return                 The direct illumination at the shading point.
+    Spectrum    resampleDirect( const Ray& r , const PixelSample& ps , const ScatteringEvent& se , const Scene& scene , RenderContext& rc ) const;
+
     SORT_STATS_ENABLE( "Direct Illumination" )
 };
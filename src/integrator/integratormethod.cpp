@@ -24,6 +24,10 @@
 #include "material/material.h"
 #include "light/light.h"
 #include "medium/phasefunction.h"
+#include "medium/medium.h"
+#include "light/light_bvh.h"
+#include "core/samplemethod.h"
+#include "core/scene.h"
 
 SORT_FORCEINLINE float MisFactor( float f, float g ){
     return (f*f) / (f*f + g*g);
@@ -39,14 +43,14 @@ Spectrum    EvaluateDirect( const ScatteringEvent& se , const Ray& r , const Sce
     Vector wi;
     const auto li = light->sample_l( ip.intersect , &ls , wi , 0 , &light_pdf , 0 , 0 , visibility );
     if( light_pdf > 0.0f && !li.IsBlack() ){
-        Spectrum f = se.Evaluate_BSDF( wo , wi );
+        // the pdf is only needed by MIS, it is evaluated along with the bsdf in a single pass
+        Spectrum f = light->IsDelta() ? se.Evaluate_BSDF( wo , wi ) : se.Evaluate_BSDF_Pdf( wo , wi , bsdf_pdf );
 
 #ifndef ENABLE_TRANSPARENT_SHADOW
         if( !f.IsBlack() && visibility.IsVisible() ){
             if( light->IsDelta() ){
                 radiance += li * f / light_pdf;
             }else{
-                bsdf_pdf = se.Pdf_BSDF( wo , wi );
                 const auto weight = MisFactor( light_pdf , bsdf_pdf );
                 radiance = li * f * weight / light_pdf;
             }
@@ -58,7 +62,6 @@ Spectrum    EvaluateDirect( const ScatteringEvent& se , const Ray& r , const Sce
                 if (light->IsDelta()) {
                     radiance += attenuation * li * f / light_pdf;
                 } else {
-                    bsdf_pdf = se.Pdf_BSDF(wo, wi);
                     const auto weight = MisFactor(light_pdf, bsdf_pdf);
                     radiance = attenuation * li * f * weight / light_pdf;
                 }
@@ -107,14 +110,14 @@ Spectrum    EvaluateDirect(const ScatteringEvent& se, const Ray& r, const Scene&
     Vector wi;
     const auto li = light->sample_l(ip.intersect, &ls, wi, 0, &light_pdf, 0, 0, visibility);
     if (light_pdf > 0.0f && !li.IsBlack()) {
-        Spectrum f = se.Evaluate_BSDF(wo, wi);
+        // the pdf is only needed by MIS, it is evaluated along with the bsdf in a single pass
+        Spectrum f = light->IsDelta() ? se.Evaluate_BSDF(wo, wi) : se.Evaluate_BSDF_Pdf(wo, wi, bsdf_pdf);
 
 #ifndef ENABLE_TRANSPARENT_SHADOW
         if (!f.IsBlack() && visibility.IsVisible()) {
             if (light->IsDelta()) {
                 radiance += li * f / light_pdf;
             } else {
-                bsdf_pdf = se.Pdf_BSDF(wo, wi);
                 const auto weight = MisFactor(light_pdf, bsdf_pdf);
                 radiance = li * f * weight / light_pdf;
             }
@@ -138,7 +141,6 @@ Spectrum    EvaluateDirect(const ScatteringEvent& se, const Ray& r, const Scene&
                     radiance += attenuation * li * f / light_pdf;
                 }
                 else {
-                    bsdf_pdf = se.Pdf_BSDF(wo, wi);
                     const auto weight = MisFactor(light_pdf, bsdf_pdf);
                     radiance = attenuation * li * f * weight / light_pdf;
                 }
@@ -216,12 +218,74 @@ Spectrum    EvaluateDirect(const Point& ip, const PhaseFunction* ph, const Vecto
     return radiance;
 }
 
+// Closest distance between the center of equiangular sampling and the ray, it avoids the singularity of the pdf.
+static constexpr float EQUIANGULAR_MIN_DIST = 1e-4f;
+
+// Equiangular sampling aims at a fixed point of the light, the center of its bounds, so that the pdf of any distance
+// along the ray could be evaluated for MIS.
+static bool equiangularSetup(const Ray& r, const Light* light, float& delta, float& d) {
+    LightBounds bounds;
+    if (IS_PTR_INVALID(light) || light->IsInfinite() || !light->GetBounds(bounds))
+        return false;
+
+    const auto center = bounds.bbox.m_Min + (bounds.bbox.m_Max - bounds.bbox.m_Min) * 0.5f;
+    delta = dot(center - r.m_Ori, r.m_Dir);
+    d = std::max((r(delta) - center).Length(), EQUIANGULAR_MIN_DIST);
+    return true;
+}
+
+// Probability of picking a light for equiangular sampling, lights are picked for the middle of the segment.
+static float equiangularLightPdf(const Ray& r, const float max_t, const Scene& scene, const Light* light) {
+    return scene.LightProperbility(r(max_t * 0.5f), Vector(0.0f, 0.0f, 0.0f), light);
+}
+
+Spectrum EvaluateDirectEquiangular(const Ray& r, const float max_t, const Scene& scene, const MediumStack& ms, RenderContext& rc) {
+    // there is nothing to be combined with if the distance pdf of the medium is unknown
+    if (ms.SamplePdf(0.0f) <= 0.0f)
+        return 0.0f;
+
+    float light_pdf = 0.0f;
+    const auto light = scene.SampleLight(r(max_t * 0.5f), Vector(0.0f, 0.0f, 0.0f), sort_rand<float>(rc), &light_pdf);
+    float delta, d;
+    if (light_pdf <= 0.0f || !equiangularSetup(r, light, delta, d))
+        return 0.0f;
+
+    auto pdf = 0.0f;
+    const auto t = EquiangularSample(sort_rand<float>(rc), delta, d, 0.0f, max_t, &pdf);
+    if (pdf <= 0.0f)
+        return 0.0f;
+
+    MediumInteraction* mi = nullptr;
+    const auto scattering = ms.EvaluateScattering(r, t, mi, rc);
+    if (IS_PTR_INVALID(mi) || scattering.IsBlack())
+        return 0.0f;
+
+    const auto ld = EvaluateDirect(mi->intersect, mi->phaseFunction, -r.m_Dir, scene, light, ms, rc);
+    if (ld.IsBlack())
+        return 0.0f;
+
+    // balance heuristic, distance sampling picks the light at the scattering point instead
+    const auto equiangular_pdf = light_pdf * pdf;
+    const auto distance_pdf = ms.SamplePdf(t) * scene.LightProperbility(mi->intersect, Vector(0.0f, 0.0f, 0.0f), light);
+    return scattering * ld / (equiangular_pdf + distance_pdf);
+}
+
+float DistanceSamplingWeight(const Ray& r, const float max_t, const float t, const Scene& scene, const Light* light, const float light_pdf, const MediumStack& ms) {
+    const auto distance_pdf = ms.SamplePdf(t) * light_pdf;
+    float delta, d;
+    if (distance_pdf <= 0.0f || !equiangularSetup(r, light, delta, d))
+        return 1.0f;
+
+    const auto equiangular_pdf = equiangularLightPdf(r, max_t, scene, light) * EquiangularPdf(t, delta, d, 0.0f, max_t);
+    return distance_pdf / (distance_pdf + equiangular_pdf);
+}
+
 // This is only used by SSS for now, since it is a smooth BRDF, there is no need to do MIS.
 Spectrum SampleOneLight( const ScatteringEvent& se , const Ray& r, const SurfaceInteraction& inter, const Scene& scene, const MaterialBase* material, const MediumStack& ms, RenderContext& rc) {
-    // Uniformly choose a light, this may not be the optimal solution in case of more lights, need more research in this topic later.
+    // Pick a light through the light hierarchy based on how much it could contribute to the shading point.
     float light_pick_pdf = 0.0f;
-    const auto light = scene.SampleLight( sort_rand<float>(rc) , &light_pick_pdf );
-    if(IS_PTR_INVALID(light))
+    const auto light = scene.SampleLight( inter.intersect , inter.normal , sort_rand<float>(rc) , &light_pick_pdf );
+    if(IS_PTR_INVALID(light) || light_pick_pdf == 0.0f)
         return 0.0f;
 
     Spectrum radiance;
@@ -264,4 +328,35 @@ Spectrum    EvaluateDirect( const Ray& r , const Scene& scene , const Light* lig
     ScatteringEvent se( ip , replaceSSS ? SE_EVALUATE_ALL_NO_SSS : SE_EVALUATE_ALL );
     ip.primitive->GetMaterial()->UpdateScatteringEvent( se , rc);
     return EvaluateDirect( se , r , scene , light , ls , bs , rc);
-}
\ No newline at end of file
+}
+
+// Each sample is roughly responsible for a solid angle of 1/pdf in the lobe, since there are usually quite a few
+// samples per pixel, the angular spread of a sample is scaled down by this factor.
+static constexpr float PATH_DIFFERENTIAL_SPREAD = 0.125f;
+
+void PropagateRayDifferentials( const SurfaceInteraction& inter , const Vector& wi , float pdf , Ray& r ){
+    if( !r.m_hasDifferentials || pdf <= 0.0f || ( inter.dpdx.SquaredLength() == 0.0f && inter.dpdy.SquaredLength() == 0.0f ) ){
+        r.m_hasDifferentials = false;
+        return;
+    }
+
+    const auto& n = inter.normal;
+    auto ddx = r.m_rxDir - r.m_Dir;
+    auto ddy = r.m_ryDir - r.m_Dir;
+
+    // Reflection mirrors the direction differentials along the normal, transmission simply passes them through,
+    // which is exact for index-matched interfaces and a fair approximation for the rest.
+    if( dot( wi , n ) * dot( r.m_Dir , n ) < 0.0f ){
+        ddx = ddx - 2.0f * dot( ddx , n ) * n;
+        ddy = ddy - 2.0f * dot( ddy , n ) * n;
+    }
+
+    Vector s , t;
+    coordinateSystem( wi , s , t );
+    const auto spread = PATH_DIFFERENTIAL_SPREAD / sqrt( pdf );
+
+    r.m_rxOri = inter.intersect + inter.dpdx;
+    r.m_ryOri = inter.intersect + inter.dpdy;
+    r.m_rxDir = normalize( wi + ddx + spread * s );
+    r.m_ryDir = normalize( wi + ddy + spread * t );
+}
@@ -30,9 +30,21 @@ Spectrum    EvaluateDirect(const ScatteringEvent& se, const Ray& r, const Scene&
 
 Spectrum    EvaluateDirect(const Point& ip, const PhaseFunction* ph, const Vector& wo, const Scene& scene, const Light* light, MediumStack ms, RenderContext& rc);
 
+// evaluate single scattering of one light along a ray segment inside the medium, the distance is sampled toward the light
+// with equiangular sampling and combined with distance sampling of the medium stack through MIS.
+Spectrum    EvaluateDirectEquiangular(const Ray& r, const float max_t, const Scene& scene, const MediumStack& ms, RenderContext& rc);
+
+// MIS weight of the direct illumination at a scattering point sampled by the medium stack, against equiangular sampling.
+float       DistanceSamplingWeight(const Ray& r, const float max_t, const float t, const Scene& scene, const Light* light, const float light_pdf, const MediumStack& ms);
+
 // uniformly evaluate direct illumination from one light
 Spectrum    SampleOneLight( const ScatteringEvent& se , const Ray& r, const SurfaceInteraction& inter, const Scene& scene, const MaterialBase* material, const MediumStack& ms, RenderContext& rc);
 
 // helper function to evaluate light contribution
 Spectrum    EvaluateDirect( const Ray& r , const Scene& scene , const Light* light , const SurfaceInteraction& ip ,
-                            const LightSample& ls , const BsdfSample& bs , RenderContext& rc, bool replaceSSS = false );
\ No newline at end of file
+                            const LightSample& ls , const BsdfSample& bs , RenderContext& rc, bool replaceSSS = false );
+
+// Propagate ray differentials through a bounce sampled from the BSDF.
+// Differentials are reflected or passed through depending on the sampled direction, then widened based on the pdf
+// of the sample, meaning footprints barely grow after mirror-like bounces and quickly grow after rough ones.
+void        PropagateRayDifferentials( const SurfaceInteraction& inter , const Vector& wi , float pdf , Ray& r );
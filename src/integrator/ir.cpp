@@ -15,6 +15,10 @@
     this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
  */
 
+#include <functional>
+#include <marl/defer.h>
+#include <marl/scheduler.h>
+#include <marl/waitgroup.h>
 #include "ir.h"
 #include "integratormethod.h"
 #include "math/interaction.h"
@@ -24,73 +28,201 @@
 
 SORT_STATS_DECLARE_COUNTER(sPrimaryRayCount)
 SORT_STATS_DEFINE_COUNTER(sVPLCount)
+SORT_STATS_DEFINE_COUNTER(sShadingPointCount)
+SORT_STATS_DEFINE_COUNTER(sLightCutSize)
 
 SORT_STATS_COUNTER("Instant Radiosity", "Primary Ray Count" , sPrimaryRayCount);
 SORT_STATS_COUNTER("Instant Radiosity", "Virtual Point Lights Count" , sVPLCount);
+SORT_STATS_AVG_COUNT("Instant Radiosity", "Average Light Cut Size", sLightCutSize , sShadingPointCount);
+
+// Number of light paths traced in each task.
+static constexpr unsigned IR_LIGHT_PATHS_PER_TASK = 256;
+
+// Split a range into batches and process them in parallel if there is a scheduler.
+template<class T>
+static void parallelFor( unsigned cnt , unsigned batch , T func ){
+    if( !marl::Scheduler::get() ){
+        func( 0u , cnt );
+        return;
+    }
+
+    marl::WaitGroup done;
+    for( auto begin = 0u ; begin < cnt ; begin += batch ){
+        done.add();
+        marl::schedule([&, done, begin]() {
+            defer(done.done());
+            func( begin , std::min( begin + batch , cnt ) );
+        });
+    }
+    done.wait();
+}
+
+// Squared distance between a point and a bounding box.
+SORT_STATIC_FORCEINLINE float sqrDistance( const Point& p , const BBox& bbox ){
+    auto ret = 0.0f;
+    for( auto k = 0u ; k < 3 ; ++k ){
+        const auto d = std::max( 0.0f , std::max( bbox.m_Min[k] - p[k] , p[k] - bbox.m_Max[k] ) );
+        ret += d * d;
+    }
+    return ret;
+}
 
 // Preprocess
 void InstantRadiosity::PreProcess( const Scene& scene , RenderContext& rc )
 {
     SORT_PROFILE("Instant Radiosity (LPV distribution stage)");
 
-    m_pVirtualLightSources = std::make_unique<std::list<VirtualLightSource>[]>(m_nLightPathSet);
-
-    for( int k = 0 ; k < m_nLightPathSet ; ++k ){
-        for( int i = 0 ; i < m_nLightPaths ; ++i ){
-            // pick a light first
-            float light_pick_pdf;
-            const Light* light = scene.SampleLight( sort_rand<float>(rc) , &light_pick_pdf );
-
-            // sample a ray from the light source
-            float   light_emission_pdf = 0.0f;
-            float   light_pdfa = 0.0f;
-            Ray     ray;
-            float   cosAtLight = 1.0f;
-            Spectrum le = light->sample_l( rc, LightSample(rc) , ray , &light_emission_pdf , &light_pdfa , &cosAtLight );
-
-            Spectrum throughput = le * cosAtLight / ( light_pick_pdf * light_emission_pdf );
-
-            int current_depth = 0;
-            SurfaceInteraction intersect;
-            while( true ){
-                if (false == scene.GetIntersect(rc, ray, intersect))
-                    break;
-
-                VirtualLightSource ls;
-                ls.power = throughput;
-                ls.intersect = intersect;
-                ls.wi = -ray.m_Dir;
-                ls.depth = ++current_depth;
-                m_pVirtualLightSources[k].push_back( ls );
-
-                float bsdf_pdf;
-                Vector wo;
-                
-                ScatteringEvent se( intersect , SE_EVALUATE_ALL_NO_SSS );
-                intersect.primitive->GetMaterial()->UpdateScatteringEvent(se, rc);
-                Spectrum bsdf_value = se.Sample_BSDF( ls.wi , wo, BsdfSample(rc) , bsdf_pdf, rc );
-
-                if( bsdf_pdf == 0.0f )
-                    break;
-
-                // apply russian roulette
-                float continueProperbility = std::min( 1.0f , throughput.GetIntensity() );
-                if( sort_rand<float>(rc) > continueProperbility )
-                    break;
-                throughput /= continueProperbility;
-
-                // update throughput
-                throughput *= bsdf_value / bsdf_pdf;
-
-                // update next ray
-                ray = Ray(intersect.intersect, wo, 0, 0.001f);
+    m_pVirtualLightSources = std::make_unique<VirtualLightSet[]>(m_nLightPathSet);
+    if( m_nLightPathSet <= 0 || m_nLightPaths <= 0 )
+        return;
+
+    // light paths are traced in parallel, each task has its own render context seeded differently
+    const auto task_per_set = ( (unsigned)m_nLightPaths + IR_LIGHT_PATHS_PER_TASK - 1 ) / IR_LIGHT_PATHS_PER_TASK;
+    const auto task_cnt = task_per_set * (unsigned)m_nLightPathSet;
+    const auto seed = sort_rand<unsigned>(rc);
+    std::vector<std::vector<VirtualLightSource>> task_lights( task_cnt );
+    parallelFor( task_cnt , 1 , [&]( unsigned begin , unsigned end ){
+        for( auto t = begin ; t < end ; ++t ){
+            auto task_rc = std::make_unique<RenderContext>();
+            task_rc->Init();
+            task_rc->m_random_num_generator->Seed( seed + t );
+
+            const auto first = ( t % task_per_set ) * IR_LIGHT_PATHS_PER_TASK;
+            const auto last = std::min( first + IR_LIGHT_PATHS_PER_TASK , (unsigned)m_nLightPaths );
+            for( auto i = first ; i < last ; ++i ){
+                task_rc->Reset();
+                _traceLightPath( scene , task_lights[t] , *task_rc );
             }
         }
+    });
+
+    // gather the lights of each set and build their light trees
+    parallelFor( (unsigned)m_nLightPathSet , 1 , [&]( unsigned begin , unsigned end ){
+        for( auto k = begin ; k < end ; ++k ){
+            auto task_rc = std::make_unique<RenderContext>();
+            task_rc->Init();
+            task_rc->m_random_num_generator->Seed( seed + task_cnt + k );
 
-        SORT_STATS(sVPLCount+=m_pVirtualLightSources[k].size());
+            auto& set = m_pVirtualLightSources[k];
+            for( auto t = k * task_per_set ; t < ( k + 1 ) * task_per_set ; ++t )
+                set.lights.insert( set.lights.end() , task_lights[t].begin() , task_lights[t].end() );
+            _buildLightTree( set , *task_rc );
+
+            SORT_STATS(sVPLCount+=set.lights.size());
+        }
+    });
+}
+
+void InstantRadiosity::_traceLightPath( const Scene& scene , std::vector<VirtualLightSource>& lights , RenderContext& rc ) const{
+    // pick a light first
+    float light_pick_pdf;
+    const Light* light = scene.SampleLight( sort_rand<float>(rc) , &light_pick_pdf );
+    if( IS_PTR_INVALID( light ) || light_pick_pdf == 0.0f )
+        return;
+
+    // sample a ray from the light source
+    float   light_emission_pdf = 0.0f;
+    float   light_pdfa = 0.0f;
+    Ray     ray;
+    float   cosAtLight = 1.0f;
+    Spectrum le = light->sample_l( rc, LightSample(rc) , ray , &light_emission_pdf , &light_pdfa , &cosAtLight );
+    if( light_emission_pdf == 0.0f )
+        return;
+
+    Spectrum throughput = le * cosAtLight / ( light_pick_pdf * light_emission_pdf );
+
+    int current_depth = 0;
+    SurfaceInteraction intersect;
+    while( true ){
+        if (false == scene.GetIntersect(rc, ray, intersect))
+            break;
+
+        VirtualLightSource ls;
+        ls.power = throughput;
+        ls.intersect = intersect;
+        ls.wi = -ray.m_Dir;
+        ls.depth = ++current_depth;
+        lights.push_back( ls );
+
+        float bsdf_pdf;
+        Vector wo;
+
+        ScatteringEvent se( intersect , SE_EVALUATE_ALL_NO_SSS );
+        intersect.primitive->GetMaterial()->UpdateScatteringEvent(se, rc);
+        Spectrum bsdf_value = se.Sample_BSDF( ls.wi , wo, BsdfSample(rc) , bsdf_pdf, rc );
+
+        if( bsdf_pdf == 0.0f )
+            break;
+
+        // apply russian roulette
+        float continueProperbility = std::min( 1.0f , throughput.GetIntensity() );
+        if( sort_rand<float>(rc) > continueProperbility )
+            break;
+        throughput /= continueProperbility;
+
+        // update throughput
+        throughput *= bsdf_value / bsdf_pdf;
+
+        // update next ray
+        ray = Ray(intersect.intersect, wo, 0, 0.001f);
     }
 }
 
+void InstantRadiosity::_buildLightTree( VirtualLightSet& set , RenderContext& rc ) const{
+    const auto& lights = set.lights;
+    set.clusters.clear();
+    if( lights.empty() )
+        return;
+
+    // a binary tree with n leaves has exactly 2n-1 nodes, references to clusters stay valid during the build
+    set.clusters.reserve( 2 * lights.size() - 1 );
+
+    std::vector<unsigned> indices( lights.size() );
+    for( auto i = 0u ; i < (unsigned)indices.size() ; ++i )
+        indices[i] = i;
+
+    // clusters are split in the middle along the longest axis of their lights
+    std::function<unsigned( unsigned , unsigned )> build = [&]( unsigned begin , unsigned end ) -> unsigned {
+        const auto index = (unsigned)set.clusters.size();
+        set.clusters.emplace_back();
+
+        if( end - begin == 1 ){
+            const auto& light = lights[indices[begin]];
+            auto& cluster = set.clusters[index];
+            cluster.bbox = BBox( light.intersect.intersect , light.intersect.intersect );
+            cluster.intensity = light.power.GetIntensity();
+            cluster.representative = indices[begin];
+            cluster.min_depth = cluster.max_depth = light.depth;
+            return index;
+        }
+
+        BBox bbox;
+        for( auto i = begin ; i < end ; ++i )
+            bbox.Union( lights[indices[i]].intersect.intersect );
+        const auto axis = bbox.MaxAxisId();
+        const auto mid = ( begin + end ) / 2;
+        std::nth_element( indices.begin() + begin , indices.begin() + mid , indices.begin() + end , [&]( unsigned a , unsigned b ){
+            return lights[a].intersect.intersect[axis] < lights[b].intersect.intersect[axis];
+        });
+
+        const auto left = build( begin , mid );
+        const auto right = build( mid , end );
+
+        const auto& l = set.clusters[left];
+        const auto& r = set.clusters[right];
+        auto& cluster = set.clusters[index];
+        cluster.bbox = Union( l.bbox , r.bbox );
+        cluster.intensity = l.intensity + r.intensity;
+        cluster.representative = ( sort_rand<float>(rc) * cluster.intensity < l.intensity ) ? l.representative : r.representative;
+        cluster.left = left;
+        cluster.right = right;
+        cluster.min_depth = std::min( l.min_depth , r.min_depth );
+        cluster.max_depth = std::max( l.max_depth , r.max_depth );
+        return index;
+    };
+    build( 0 , (unsigned)lights.size() );
+}
+
 // radiance along a specific ray direction
 Spectrum InstantRadiosity::Li( const Ray& r , const PixelSample& ps  , const Scene& scene , RenderContext& rc) const{
     SORT_STATS( ++sPrimaryRayCount );
@@ -121,50 +253,13 @@ Spectrum InstantRadiosity::_li( const Ray& r , const Scene& scene, RenderContext
 
     // pick a virtual light source randomly
     const unsigned lps_id = std::min( m_nLightPathSet - 1 , (int)(sort_rand<float>(rc) * m_nLightPathSet) );
-    std::list<VirtualLightSource> vps = m_pVirtualLightSources[lps_id];
+    const auto& vps = m_pVirtualLightSources[lps_id];
 
     ScatteringEvent se( ip , SE_EVALUATE_ALL_NO_SSS );
     ip.primitive->GetMaterial()->UpdateScatteringEvent(se, rc);
 
     // evaluate indirect illumination
-    Spectrum indirectIllum;
-    std::list<VirtualLightSource>::const_iterator it = vps.begin();
-    while( it != vps.end() ){
-        if( r.m_Depth + it->depth > max_recursive_depth ){
-            ++it;
-            continue;
-        }
-
-        const auto  delta = ip.intersect - it->intersect.intersect;
-        const auto  sqrLen = delta.SquaredLength();
-        const auto  len = sqrt( sqrLen );
-        const auto  n_delta = delta / len;
-
-        ScatteringEvent se1( it->intersect , SE_EVALUATE_ALL_NO_SSS );
-        it->intersect.primitive->GetMaterial()->UpdateScatteringEvent(se1, rc);
-
-        const auto    gterm = 1.0f / std::max( m_fMinSqrDist , sqrLen );
-        const auto    f0 = se.Evaluate_BSDF( -r.m_Dir , -n_delta );
-        const auto    f1 = se1.Evaluate_BSDF( n_delta , it->wi );
-
-        Spectrum    contr = gterm * f0 * f1 * it->power;
-        if( !contr.IsBlack() ){
-            Visibility vis(scene);
-            vis.ray = Ray( it->intersect.intersect , n_delta , 0 , 0.001f , len - 0.001f );
-
-#ifndef ENABLE_TRANSPARENT_SHADOW
-            if( vis.IsVisible() )
-                indirectIllum += contr;
-#else
-            const auto attenuation = vis.GetAttenuation(rc);
-            if( !attenuation.IsBlack() )
-                indirectIllum += contr * attenuation;
-#endif
-        }
-
-        ++it;
-    }
-    radiance += indirectIllum / (float)m_nLightPaths;
+    radiance += _evaluateLightCut( vps , se , r , scene , rc ) / (float)m_nLightPaths;
 
     if( m_fMinDist > 0.0f ){
         Vector  wi;
@@ -185,4 +280,115 @@ Spectrum InstantRadiosity::_li( const Ray& r , const Scene& scene, RenderContext
     }
 
     return radiance;
-}
\ No newline at end of file
+}
+Spectrum InstantRadiosity::_evaluateLightCut( const VirtualLightSet& set , const ScatteringEvent& se , const Ray& r , const Scene& scene , RenderContext& rc ) const{
+    if( set.clusters.empty() )
+        return 0.0f;
+
+    SORT_STATS(++sShadingPointCount);
+
+    const auto& ip = se.GetInteraction();
+    const auto max_light_depth = max_recursive_depth - r.m_Depth;
+
+    // contribution of a single virtual light source
+    const auto evaluate_light = [&]( const VirtualLightSource& light ) -> Spectrum {
+        const auto  delta = ip.intersect - light.intersect.intersect;
+        const auto  sqrLen = delta.SquaredLength();
+        const auto  len = sqrt( sqrLen );
+        const auto  n_delta = delta / len;
+
+        ScatteringEvent se1( light.intersect , SE_EVALUATE_ALL_NO_SSS );
+        light.intersect.primitive->GetMaterial()->UpdateScatteringEvent(se1, rc);
+
+        const auto    gterm = 1.0f / std::max( m_fMinSqrDist , sqrLen );
+        const auto    f0 = se.Evaluate_BSDF( -r.m_Dir , -n_delta );
+        const auto    f1 = se1.Evaluate_BSDF( n_delta , light.wi );
+
+        Spectrum    contr = gterm * f0 * f1 * light.power;
+        if( contr.IsBlack() )
+            return 0.0f;
+
+        Visibility vis(scene);
+        vis.ray = Ray( light.intersect.intersect , n_delta , 0 , 0.001f , len - 0.001f );
+
+#ifndef ENABLE_TRANSPARENT_SHADOW
+        return vis.IsVisible() ? contr : 0.0f;
+#else
+        const auto attenuation = vis.GetAttenuation(rc);
+        return contr * attenuation;
+#endif
+    };
+
+    // a cluster in the cut along with its estimation and the upper bound of its error
+    struct CutEntry{
+        unsigned    cluster;
+        Spectrum    contribution;   // contribution of the representative light alone
+        Spectrum    estimate;       // estimation of the contribution of the whole cluster
+        float       error;          // upper bound of the error of the estimation
+    };
+    const auto evaluate_cluster = [&]( unsigned index , const CutEntry* parent ) -> CutEntry {
+        const auto& cluster = set.clusters[index];
+        CutEntry entry = { index , 0.0f , 0.0f , 0.0f };
+
+        // none of the lights could contribute without exceeding the maximum depth
+        if( cluster.min_depth > max_light_depth )
+            return entry;
+
+        // the representative is shared with the parent cluster, there is no need to evaluate it again
+        const auto& light = set.lights[cluster.representative];
+        if( parent && set.clusters[parent->cluster].representative == cluster.representative )
+            entry.contribution = parent->contribution;
+        else if( light.depth <= max_light_depth )
+            entry.contribution = evaluate_light( light );
+
+        const auto intensity = light.power.GetIntensity();
+        if( intensity > 0.0f )
+            entry.estimate = entry.contribution * ( cluster.intensity / intensity );
+
+        // leaves are evaluated exactly, clusters mixing lights that are too deep have to be refined
+        if( cluster.left == cluster.right || cluster.intensity <= 0.0f )
+            entry.error = 0.0f;
+        else if( cluster.max_depth > max_light_depth )
+            entry.error = FLT_MAX;
+        else
+            entry.error = cluster.intensity * INV_PI * INV_PI / std::max( m_fMinSqrDist , sqrDistance( ip.intersect , cluster.bbox ) );
+        return entry;
+    };
+
+    // refine the cluster with the largest error bound until all of them are small enough comparing with the total, clusters
+    // mixing lights that are too deep are always refined, even past the maximum cut size, since their estimation would
+    // include the power of lights that can't contribute.
+    const auto compare = []( const CutEntry& e0 , const CutEntry& e1 ){ return e0.error < e1.error; };
+    std::vector<CutEntry> cut;
+    cut.reserve( std::min( (size_t)m_nMaxCutSize , set.clusters.size() ) );
+
+    const auto root = evaluate_cluster( 0 , nullptr );
+    auto total = root.estimate;
+    auto cut_size = 1;
+    if( root.error > 0.0f )
+        cut.push_back( root );
+
+    while( !cut.empty() && ( cut_size < m_nMaxCutSize || cut.front().error == FLT_MAX ) ){
+        if( cut.front().error <= m_fMaxError * total.GetIntensity() )
+            break;
+
+        std::pop_heap( cut.begin() , cut.end() , compare );
+        const auto entry = cut.back();
+        cut.pop_back();
+        total -= entry.estimate;
+
+        const auto& cluster = set.clusters[entry.cluster];
+        for( const auto child : { cluster.left , cluster.right } ){
+            const auto child_entry = evaluate_cluster( child , &entry );
+            total += child_entry.estimate;
+            if( child_entry.error > 0.0f ){
+                cut.push_back( child_entry );
+                std::push_heap( cut.begin() , cut.end() , compare );
+            }
+        }
+        ++cut_size;
+    }
+
+    SORT_STATS(sLightCutSize += cut_size);
+    return total;
+}
@@ -17,9 +17,12 @@
 
 #pragma once
 
-#include <list>
+#include <vector>
 #include "integrator.h"
 #include "math/interaction.h"
+#include "math/bbox.h"
+
+class ScatteringEvent;
 
 struct VirtualLightSource{
     SurfaceInteraction  intersect;
@@ -28,12 +31,37 @@ struct VirtualLightSource{
     int                 depth;
 };
 
+//! @brief  A cluster of virtual light sources in the light tree.
+/**
+ * The representative light of a cluster is picked among the lights in it with probability proportional to their
+ * intensities, so that the contribution of the representative scaled by the ratio of intensities is an unbiased
+ * estimation of the contribution of the whole cluster.
+ */
+struct VirtualLightCluster{
+    BBox        bbox;               // bounding box of all lights in the cluster
+    float       intensity = 0.0f;   // total intensity of all lights in the cluster
+    unsigned    representative = 0; // index of the representative light
+    unsigned    left = 0;           // index of the first child, there is no child if it is the same as 'right'
+    unsigned    right = 0;          // index of the second child
+    int         min_depth = 0;      // minimum depth of lights in the cluster
+    int         max_depth = 0;      // maximum depth of lights in the cluster
+};
+
+//! @brief  A set of virtual light sources and the light tree built on top of them.
+struct VirtualLightSet{
+    std::vector<VirtualLightSource>     lights;     // all virtual light sources in the set, stored contiguously
+    std::vector<VirtualLightCluster>    clusters;   // clusters of the light tree, the first one is the root
+};
+
 //! @brief  Instant radiosity integrator.
 /**
  * Instant Radiosity is a subset of directional path tracing. It has two seperate passes.
  * First pass generates virtual light sources along the path tracing from light sources.
  * Second pass will use those virtual light source to evaluate indirect illuimination.
  * Direct illumination is handled the same way in directlight integrator.
+ * Virtual light sources are organized in a light tree, shading points only evaluate a cut of the tree, which is
+ * refined until the error bound of every cluster in the cut is small enough comparing with the total estimation.
+ * Please refer to the paper 'Lightcuts: A Scalable Approach to Illumination' by Bruce Walter et al. for details.
  */
 class   InstantRadiosity : public Integrator{
 public:
@@ -62,6 +90,9 @@ public:
         stream >> m_nLightPathSet;
         stream >> m_nLightPaths;
         stream >> m_fMinDist;
+        stream >> m_fMaxError;
+        stream >> m_nMaxCutSize;
+        m_fMinSqrDist = m_fMinDist * m_fMinDist;
     }
 
 private:
@@ -75,10 +106,25 @@ private:
     float   m_fMinDist      = 1.0f;
     float   m_fMinSqrDist   = 1.0f;
 
+    /**< maximum error of a cluster in the light cut, relative to the total estimation. */
+    float   m_fMaxError     = 0.02f;
+
+    /**< maximum number of clusters in the light cut. */
+    int     m_nMaxCutSize   = 1000;
+
     /**< container for light sources. */
-    std::unique_ptr<std::list<VirtualLightSource>[]>    m_pVirtualLightSources;
+    std::unique_ptr<VirtualLightSet[]>  m_pVirtualLightSources;
 
     Spectrum _li( const Ray& ray , const Scene& scene , RenderContext& rc, bool ignoreLe = false , float* first_intersect_dist = 0 ) const;
 
+    // trace a light path and store the virtual light sources along it
+    void     _traceLightPath( const Scene& scene , std::vector<VirtualLightSource>& lights , RenderContext& rc ) const;
+
+    // build the light tree of a set of virtual light sources
+    void     _buildLightTree( VirtualLightSet& set , RenderContext& rc ) const;
+
+    // evaluate indirect illumination from a cut of the light tree
+    Spectrum _evaluateLightCut( const VirtualLightSet& set , const ScatteringEvent& se , const Ray& r , const Scene& scene , RenderContext& rc ) const;
+
     SORT_STATS_ENABLE( "Instant Radiosity" )
 };
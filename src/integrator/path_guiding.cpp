@@ -0,0 +1,357 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+
+    Copyright (c) 2011-2023 by Jiayin Cao - All rights reserved.
+
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+
+#include <cmath>
+#include "path_guiding.h"
+#include "core/render_context.h"
+#include "core/memory.h"
+#include "core/rand.h"
+#include "math/utils.h"
+
+// Quadrants holding more than this fraction of the total energy are subdivided.
+static constexpr float      DIRECTIONAL_SPLIT_THRESHOLD = 0.01f;
+
+// Maximum depth of the directional tree.
+static constexpr unsigned   DIRECTIONAL_MAX_DEPTH = 20;
+
+// A region is split once it records more samples than this, scaled by the square root of samples per pixel.
+static constexpr float      SPATIAL_SPLIT_SAMPLES = 12000.0f;
+
+// Maximum depth of the spatial tree.
+static constexpr unsigned   SPATIAL_MAX_DEPTH = 48;
+
+SORT_STATIC_FORCEINLINE void atomicAdd( std::atomic<float>& target , float value ){
+    auto current = target.load( std::memory_order_relaxed );
+    while( !target.compare_exchange_weak( current , current + value , std::memory_order_relaxed ) );
+}
+
+// Map a direction to the unit square through the cylindrical mapping, which preserves area.
+SORT_STATIC_FORCEINLINE Vector2f dirToCanonical( const Vector& d ){
+    const auto cos_theta = clamp( d.y , -1.0f , 1.0f );
+    auto phi = atan2f( d.z , d.x );
+    if( phi < 0.0f )
+        phi += TWO_PI;
+    return Vector2f( clamp( ( cos_theta + 1.0f ) * 0.5f , 0.0f , ONE_MINUS_EPSILON ) , clamp( phi * INV_TWOPI , 0.0f , ONE_MINUS_EPSILON ) );
+}
+
+// Map a point in the unit square back to a direction.
+SORT_STATIC_FORCEINLINE Vector canonicalToDir( const Vector2f& p ){
+    const auto cos_theta = 2.0f * p.x - 1.0f;
+    const auto sin_theta = sqrt( std::max( 0.0f , 1.0f - cos_theta * cos_theta ) );
+    const auto phi = TWO_PI * p.y;
+    return Vector( sin_theta * cos( phi ) , cos_theta , sin_theta * sin( phi ) );
+}
+
+// Get the quadrant that a point falls in and transform the point to the local space of the quadrant.
+SORT_STATIC_FORCEINLINE unsigned descend( Vector2f& p ){
+    unsigned quadrant = 0;
+    if( p.x >= 0.5f ){
+        quadrant |= 1;
+        p.x -= 0.5f;
+    }
+    if( p.y >= 0.5f ){
+        quadrant |= 2;
+        p.y -= 0.5f;
+    }
+    p.x *= 2.0f;
+    p.y *= 2.0f;
+    return quadrant;
+}
+
+DirectionalTree::Node::Node(){
+    for( auto i = 0 ; i < 4 ; ++i ){
+        m_sum[i].store( 0.0f , std::memory_order_relaxed );
+        m_children[i] = 0;
+    }
+}
+
+DirectionalTree::Node::Node( const Node& node ){
+    *this = node;
+}
+
+DirectionalTree::Node& DirectionalTree::Node::operator = ( const Node& node ){
+    for( auto i = 0 ; i < 4 ; ++i ){
+        m_sum[i].store( node.m_sum[i].load( std::memory_order_relaxed ) , std::memory_order_relaxed );
+        m_children[i] = node.m_children[i];
+    }
+    return *this;
+}
+
+float DirectionalTree::Node::Sum() const{
+    auto sum = 0.0f;
+    for( auto i = 0 ; i < 4 ; ++i )
+        sum += m_sum[i].load( std::memory_order_relaxed );
+    return sum;
+}
+
+DirectionalTree::DirectionalTree() : m_nodes( 1 ) , m_sample_cnt( 0.0f ) , m_length_sum( 0.0f ) {
+}
+
+DirectionalTree::DirectionalTree( const DirectionalTree& tree ) : m_nodes( tree.m_nodes ) , m_sample_cnt( tree.GetSampleCount() ) ,
+    m_length_sum( tree.m_length_sum.load( std::memory_order_relaxed ) ) {
+}
+
+DirectionalTree& DirectionalTree::operator = ( const DirectionalTree& tree ){
+    m_nodes = tree.m_nodes;
+    m_sample_cnt.store( tree.GetSampleCount() , std::memory_order_relaxed );
+    m_length_sum.store( tree.m_length_sum.load( std::memory_order_relaxed ) , std::memory_order_relaxed );
+    return *this;
+}
+
+void DirectionalTree::Scale( float scale ){
+    for( auto& node : m_nodes ){
+        for( auto i = 0 ; i < 4 ; ++i )
+            node.m_sum[i].store( node.m_sum[i].load( std::memory_order_relaxed ) * scale , std::memory_order_relaxed );
+    }
+    m_sample_cnt.store( GetSampleCount() * scale , std::memory_order_relaxed );
+    m_length_sum.store( m_length_sum.load( std::memory_order_relaxed ) * scale , std::memory_order_relaxed );
+}
+
+void DirectionalTree::Record( const Vector& wi , float value , float length ){
+    atomicAdd( m_sample_cnt , 1.0f );
+    atomicAdd( m_length_sum , length );
+    if( !( value > 0.0f ) || IsInf( value ) )
+        return;
+
+    auto p = dirToCanonical( wi );
+    auto index = 0u;
+    while( true ){
+        auto& node = m_nodes[index];
+        const auto quadrant = descend( p );
+        atomicAdd( node.m_sum[quadrant] , value );
+        if( 0 == node.m_children[quadrant] )
+            break;
+        index = node.m_children[quadrant];
+    }
+}
+
+Vector DirectionalTree::Sample( RenderContext& rc ) const{
+    if( !HasEnergy() )
+        return canonicalToDir( Vector2f( sort_rand<float>(rc) , sort_rand<float>(rc) ) );
+
+    Vector2f origin( 0.0f , 0.0f );
+    auto size = 1.0f;
+    auto index = 0u;
+    while( true ){
+        const auto& node = m_nodes[index];
+
+        // pick a quadrant proportional to its energy, quadrants with no energy are never picked
+        auto u = sort_rand<float>(rc) * node.Sum();
+        auto quadrant = 0u;
+        for( auto i = 0u ; i < 4 ; ++i ){
+            const auto sum = node.m_sum[i].load( std::memory_order_relaxed );
+            if( sum <= 0.0f )
+                continue;
+            quadrant = i;
+            if( u < sum )
+                break;
+            u -= sum;
+        }
+
+        size *= 0.5f;
+        origin.x += ( quadrant & 1 ) ? size : 0.0f;
+        origin.y += ( quadrant & 2 ) ? size : 0.0f;
+
+        if( 0 == node.m_children[quadrant] )
+            break;
+        index = node.m_children[quadrant];
+    }
+
+    const auto x = std::min( origin.x + size * sort_rand<float>(rc) , ONE_MINUS_EPSILON );
+    const auto y = std::min( origin.y + size * sort_rand<float>(rc) , ONE_MINUS_EPSILON );
+    return canonicalToDir( Vector2f( x , y ) );
+}
+
+float DirectionalTree::Pdf( const Vector& wi ) const{
+    if( !HasEnergy() )
+        return INV_FOUR_PI;
+
+    auto p = dirToCanonical( wi );
+    auto pdf = INV_FOUR_PI;
+    auto index = 0u;
+    while( true ){
+        const auto& node = m_nodes[index];
+        const auto total = node.Sum();
+        if( total <= 0.0f )
+            return 0.0f;
+
+        const auto quadrant = descend( p );
+        pdf *= 4.0f * node.m_sum[quadrant].load( std::memory_order_relaxed ) / total;
+
+        if( 0 == node.m_children[quadrant] || pdf == 0.0f )
+            break;
+        index = node.m_children[quadrant];
+    }
+    return pdf;
+}
+
+void DirectionalTree::Refine(){
+    struct Entry{
+        unsigned    new_index;      // index of the node in the new tree
+        int         old_index;      // index of the node in the old tree, negative if the old tree is not as deep
+        unsigned    depth;          // depth of the node
+        float       energy;         // energy of the node
+    };
+
+    const auto total = m_nodes[0].Sum();
+
+    std::vector<Node> nodes( 1 );
+    std::vector<Entry> stack;
+    stack.push_back( { 0 , 0 , 1 , total } );
+    while( !stack.empty() ){
+        const auto entry = stack.back();
+        stack.pop_back();
+
+        for( auto i = 0u ; i < 4 ; ++i ){
+            // energy in a quadrant beyond the old tree is assumed to be evenly distributed
+            const auto energy = entry.old_index >= 0 ? m_nodes[entry.old_index].m_sum[i].load( std::memory_order_relaxed ) : entry.energy * 0.25f;
+            if( total <= 0.0f || entry.depth >= DIRECTIONAL_MAX_DEPTH || energy <= total * DIRECTIONAL_SPLIT_THRESHOLD )
+                continue;
+
+            const auto old_child = ( entry.old_index >= 0 && m_nodes[entry.old_index].m_children[i] ) ? (int)m_nodes[entry.old_index].m_children[i] : -1;
+            const auto new_child = (unsigned)nodes.size();
+            nodes[entry.new_index].m_children[i] = new_child;
+            nodes.emplace_back();
+            stack.push_back( { new_child , old_child , entry.depth + 1 , energy } );
+        }
+    }
+
+    m_nodes = std::move( nodes );
+    m_sample_cnt.store( 0.0f , std::memory_order_relaxed );
+    m_length_sum.store( 0.0f , std::memory_order_relaxed );
+}
+
+SDTree::SDTree( const BBox& bbox ) : m_bbox( bbox ) {
+    // a cubic bounding box keeps the regions from being stretched
+    const auto extent = std::max( std::max( bbox.Delta( 0 ) , bbox.Delta( 1 ) ) , bbox.Delta( 2 ) ) * 1.001f + 0.001f;
+    m_bbox.m_Max = m_bbox.m_Min + Vector( extent , extent , extent );
+
+    m_nodes.emplace_back();
+    m_regions.push_back( std::make_unique<GuidingRegion>() );
+}
+
+GuidingRegion* SDTree::GetRegion( const Point& p ) const{
+    auto rel = p - m_bbox.m_Min;
+    for( auto i = 0 ; i < 3 ; ++i )
+        rel[i] = clamp( rel[i] / m_bbox.Delta( i ) , 0.0f , ONE_MINUS_EPSILON );
+
+    auto index = 0u;
+    while( m_nodes[index].m_children[0] ){
+        const auto& node = m_nodes[index];
+        auto& x = rel[node.m_axis];
+        if( x < 0.5f ){
+            x *= 2.0f;
+            index = node.m_children[0];
+        }else{
+            x = x * 2.0f - 1.0f;
+            index = node.m_children[1];
+        }
+    }
+    return m_regions[m_nodes[index].m_region].get();
+}
+
+void SDTree::Refine( unsigned spp ){
+    const auto threshold = SPATIAL_SPLIT_SAMPLES * sqrt( (float)spp );
+
+    // split regions with too many samples, a split region could be split again if it is still too busy
+    std::vector<std::pair<unsigned, unsigned>> stack;
+    stack.push_back( std::make_pair( 0u , 0u ) );
+    while( !stack.empty() ){
+        const auto index = stack.back().first;
+        const auto depth = stack.back().second;
+        stack.pop_back();
+
+        if( m_nodes[index].m_children[0] ){
+            stack.push_back( std::make_pair( m_nodes[index].m_children[0] , depth + 1 ) );
+            stack.push_back( std::make_pair( m_nodes[index].m_children[1] , depth + 1 ) );
+            continue;
+        }
+
+        auto& building = m_regions[m_nodes[index].m_region]->m_building;
+        if( depth >= SPATIAL_MAX_DEPTH || building.GetSampleCount() <= threshold )
+            continue;
+
+        // both halves start with the directional trees of the parent, each of them takes half of the samples
+        building.Scale( 0.5f );
+        m_regions.push_back( std::make_unique<GuidingRegion>( *m_regions[m_nodes[index].m_region] ) );
+
+        Node left , right;
+        left.m_axis = right.m_axis = ( m_nodes[index].m_axis + 1 ) % 3;
+        left.m_region = m_nodes[index].m_region;
+        right.m_region = (unsigned)m_regions.size() - 1;
+
+        const auto left_index = (unsigned)m_nodes.size();
+        m_nodes.push_back( left );
+        m_nodes.push_back( right );
+        m_nodes[index].m_children[0] = left_index;
+        m_nodes[index].m_children[1] = left_index + 1;
+
+        stack.push_back( std::make_pair( left_index , depth + 1 ) );
+        stack.push_back( std::make_pair( left_index + 1 , depth + 1 ) );
+    }
+
+    auto length_sum = 0.0f , sample_cnt = 0.0f;
+    for( const auto& region : m_regions ){
+        length_sum += region->m_building.GetAveragePathLength() * region->m_building.GetSampleCount();
+        sample_cnt += region->m_building.GetSampleCount();
+    }
+    m_average_length = sample_cnt > 0.0f ? length_sum / sample_cnt : 0.0f;
+
+    // what is learned in this pass guides the next one
+    for( auto& region : m_regions ){
+        region->m_sampling = region->m_building;
+        region->m_building.Refine();
+    }
+}
+
+GuidingPath::GuidingPath( SDTree* sdtree , unsigned max_length , RenderContext& rc ){
+    if( IS_PTR_INVALID( sdtree ) || 0 == max_length )
+        return;
+    m_vertices = (Vertex*)SORT_MALLOC_ARRAY( rc.m_memory_arena , Vertex , max_length );
+    m_max_length = max_length;
+}
+
+GuidingPath::~GuidingPath(){
+    for( auto i = 0u ; i < m_length ; ++i ){
+        const auto& vertex = m_vertices[i];
+        if( vertex.m_pdf > 0.0f )
+            vertex.m_region->m_building.Record( vertex.m_wi , vertex.m_radiance.GetIntensity() / vertex.m_pdf , (float)( m_length - i ) );
+    }
+}
+
+void GuidingPath::AddVertex( GuidingRegion* region , const Vector& wi , const Spectrum& throughput , float pdf ){
+    if( IS_PTR_INVALID( m_vertices ) || IS_PTR_INVALID( region ) || m_length >= m_max_length )
+        return;
+
+    auto& vertex = m_vertices[m_length++];
+    vertex.m_region = region;
+    vertex.m_wi = wi;
+    vertex.m_throughput = throughput;
+    vertex.m_radiance = 0.0f;
+    vertex.m_pdf = pdf;
+}
+
+void GuidingPath::AddRadiance( const Spectrum& radiance ){
+    for( auto i = 0u ; i < m_length ; ++i ){
+        auto& vertex = m_vertices[i];
+        for( auto k = 0 ; k < 3 ; ++k ){
+            if( vertex.m_throughput[k] > 0.0f )
+                vertex.m_radiance[k] += radiance[k] / vertex.m_throughput[k];
+        }
+    }
+}
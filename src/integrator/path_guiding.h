@@ -0,0 +1,217 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+
+    Copyright (c) 2011-2023 by Jiayin Cao - All rights reserved.
+
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "core/define.h"
+#include "math/bbox.h"
+#include "math/point.h"
+#include "math/vector2.h"
+#include "math/vector3.h"
+#include "spectrum/spectrum.h"
+
+struct RenderContext;
+
+//! @brief  Quadtree approximating the distribution of incident radiance over the sphere of directions.
+/**
+ * Directions are mapped to the unit square through the cylindrical mapping, which preserves area, so that the
+ * quadtree is a piecewise constant distribution over solid angle too. Each node keeps the energy that falls in
+ * each of its four quadrants. Energy is recorded with atomics so that all threads can record samples concurrently,
+ * while the structure of the tree only changes between passes.
+ * Please refer to the paper 'Practical Path Guiding for Efficient Light-Transport Simulation' by Thomas Muller,
+ * Markus Gross and Jan Novak for further details.
+ */
+class DirectionalTree{
+public:
+    //! @brief  Default constructor, a single level tree with no energy in it.
+    DirectionalTree();
+
+    //! @brief  Copy constructor, the energy is copied as well.
+    DirectionalTree( const DirectionalTree& tree );
+
+    //! @brief  Copy the structure and energy of another tree.
+    DirectionalTree& operator = ( const DirectionalTree& tree );
+
+    //! @brief  Record incident radiance along a direction.
+    //!
+    //! @param  wi          The incident direction in world space.
+    //! @param  value       Incident radiance divided by the pdf of sampling the direction.
+    //! @param  length      Number of vertices traced after the sample, which is the cost of the sample.
+    void        Record( const Vector& wi , float value , float length );
+
+    //! @brief  Sample a direction proportional to the recorded energy.
+    //!
+    //! @param  rc          The render context.
+    //! @return             The sampled direction in world space.
+    Vector      Sample( RenderContext& rc ) const;
+
+    //! @brief  The pdf w.r.t solid angle of sampling a direction.
+    //!
+    //! @param  wi          The direction in world space.
+    //! @return             The pdf w.r.t solid angle.
+    float       Pdf( const Vector& wi ) const;
+
+    //! @brief  Whether there is any energy recorded in the tree, it can't be sampled otherwise.
+    bool        HasEnergy() const {
+        return m_nodes[0].Sum() > 0.0f;
+    }
+
+    //! @brief  Get the number of samples recorded in the tree.
+    float       GetSampleCount() const {
+        return m_sample_cnt.load( std::memory_order_relaxed );
+    }
+
+    //! @brief  Estimate of the incident radiance integrated over the sphere of directions.
+    float       GetIncidentRadiance() const {
+        const auto cnt = GetSampleCount();
+        return cnt > 0.0f ? m_nodes[0].Sum() / cnt : 0.0f;
+    }
+
+    //! @brief  Average number of vertices traced after the recorded samples.
+    float       GetAveragePathLength() const {
+        const auto cnt = GetSampleCount();
+        return cnt > 0.0f ? m_length_sum.load( std::memory_order_relaxed ) / cnt : 0.0f;
+    }
+
+    //! @brief  Scale the recorded samples, this is needed when the region of the tree is split into two.
+    //!
+    //! Energy and sample count are scaled together so that the estimates of the tree stay the same.
+    void        Scale( float scale );
+
+    //! @brief  Rebuild the tree based on the recorded energy and clear it for the next pass.
+    //!
+    //! Quadrants holding more than a fraction of the total energy are subdivided, the rest of them are collapsed.
+    void        Refine();
+
+private:
+    //! @brief  A node holding the energy of its four quadrants.
+    struct Node{
+        std::atomic<float>  m_sum[4];               /**< Energy of each quadrant. */
+        unsigned            m_children[4];          /**< Child node of each quadrant, zero means the quadrant is a leaf. */
+
+        Node();
+        Node( const Node& node );
+        Node& operator = ( const Node& node );
+
+        //! @brief  Get the total energy of the node.
+        float   Sum() const;
+    };
+
+    std::vector<Node>       m_nodes;                /**< Nodes of the tree, the first one is the root. */
+    std::atomic<float>      m_sample_cnt;           /**< Number of recorded samples. */
+    std::atomic<float>      m_length_sum;           /**< Total number of vertices traced after the recorded samples. */
+};
+
+//! @brief  The directional trees of a region of the scene.
+/**
+ * Radiance is learned in one tree while the other one, learned in the previous pass, is used for sampling.
+ */
+struct GuidingRegion{
+    DirectionalTree     m_building;     /**< Tree recording radiance in the current pass. */
+    DirectionalTree     m_sampling;     /**< Tree learned in the previous pass for sampling directions. */
+};
+
+//! @brief  Spatial-directional tree for path guiding.
+/**
+ * A binary tree subdivides the bounding box of the scene, each leaf owns a region with its own directional trees.
+ * A leaf is split in the middle, alternating the axis, once enough samples are recorded in it.
+ */
+class SDTree{
+public:
+    //! @brief  Constructor.
+    //!
+    //! @param  bbox        Bounding box of the scene.
+    SDTree( const BBox& bbox );
+
+    //! @brief  Get the region of a point.
+    //!
+    //! @param  p           The point in world space.
+    //! @return             The region that the point belongs to.
+    GuidingRegion*  GetRegion( const Point& p ) const;
+
+    //! @brief  Refine the tree once a training pass is done.
+    //!
+    //! @param  spp         Number of samples per pixel taken in the training pass.
+    void            Refine( unsigned spp );
+
+    //! @brief  Average number of vertices traced after a vertex in the whole scene, learned in the last pass.
+    float           GetAveragePathLength() const {
+        return m_average_length;
+    }
+
+private:
+    //! @brief  A node in the spatial tree.
+    struct Node{
+        unsigned    m_axis = 0;                 /**< The axis to split along. */
+        unsigned    m_children[2] = { 0 , 0 };  /**< Children of the node, zero means the node is a leaf. */
+        unsigned    m_region = 0;               /**< The region of the leaf node. */
+    };
+
+    BBox                                        m_bbox;         /**< Bounding box of the scene. */
+    std::vector<Node>                           m_nodes;        /**< Nodes of the tree, the first one is the root. */
+    std::vector<std::unique_ptr<GuidingRegion>> m_regions;      /**< Regions of leaf nodes. */
+    float                                       m_average_length = 0.0f;    /**< Average number of vertices traced after a vertex. */
+};
+
+//! @brief  Vertices of a path being traced during training.
+/**
+ * Radiance gathered by the path is also the incident radiance at all previous vertices, divided by the throughput
+ * up to the vertex. Once the path is done, the incident radiance of each vertex is recorded in its region.
+ */
+class GuidingPath{
+public:
+    //! @brief  Constructor.
+    //!
+    //! @param  sdtree      The tree to record radiance in, nothing is recorded if it is 'nullptr'.
+    //! @param  max_length  Maximum number of vertices in the path.
+    //! @param  rc          The render context.
+    GuidingPath( SDTree* sdtree , unsigned max_length , RenderContext& rc );
+
+    //! @brief  Record the incident radiance of all vertices in their regions.
+    ~GuidingPath();
+
+    //! @brief  Add a vertex to the path.
+    //!
+    //! @param  region      The region of the vertex.
+    //! @param  wi          The direction sampled at the vertex.
+    //! @param  throughput  The throughput of the path up to the vertex, including the scattering at the vertex.
+    //! @param  pdf         The pdf w.r.t solid angle of sampling 'wi'.
+    void    AddVertex( GuidingRegion* region , const Vector& wi , const Spectrum& throughput , float pdf );
+
+    //! @brief  Accumulate radiance gathered by the path.
+    //!
+    //! @param  radiance    Radiance gathered by the path, weighted by the path throughput.
+    void    AddRadiance( const Spectrum& radiance );
+
+private:
+    //! @brief  A vertex in the path.
+    struct Vertex{
+        GuidingRegion*  m_region;
+        Vector          m_wi;
+        Spectrum        m_throughput;
+        Spectrum        m_radiance;
+        float           m_pdf;
+    };
+
+    Vertex*         m_vertices = nullptr;   /**< Vertices of the path, it is only allocated when recording. */
+    unsigned        m_max_length = 0;       /**< Maximum number of vertices. */
+    unsigned        m_length = 0;           /**< Number of vertices in the path. */
+};
@@ -27,27 +27,213 @@
 #include "scatteringevent/scatteringevent.h"
 #include "medium/medium.h"
 #include "medium/phasefunction.h"
+#include "sampler/sample.h"
+
+#include <marl/defer.h>
+#include <marl/scheduler.h>
+#include <marl/waitgroup.h>
 
 SORT_STATS_DEFINE_COUNTER(sTotalPathLength)
+SORT_STATS_DEFINE_COUNTER(sGuidedBounces)
+SORT_STATS_DEFINE_COUNTER(sUnguidedBounces)
 SORT_STATS_DECLARE_COUNTER(sPrimaryRayCount)
 
 SORT_STATS_COUNTER("Path Tracing", "Primary Ray Count" , sPrimaryRayCount);
 SORT_STATS_AVG_COUNT("Path Tracing", "Average Length of Path", sTotalPathLength , sPrimaryRayCount);    // This also counts the case where ray hits sky
+SORT_STATS_COUNTER("Path Tracing", "Guided Bounces" , sGuidedBounces);
+SORT_STATS_COUNTER("Path Tracing", "Unguided Bounces" , sUnguidedBounces);
+SORT_STATS_DEFINE_COUNTER(sAdaptiveTerminations)
+SORT_STATS_DEFINE_COUNTER(sAdaptiveSplits)
+SORT_STATS_COUNTER("Path Tracing", "Adaptive Terminations" , sAdaptiveTerminations);
+SORT_STATS_COUNTER("Path Tracing", "Adaptive Splits" , sAdaptiveSplits);
+SORT_STATS_DEFINE_COUNTER(sRadianceCacheHits)
+SORT_STATS_COUNTER("Path Tracing", "Radiance Cache Hits" , sRadianceCacheHits);
+
+// Size of the tiles traced in parallel during training passes.
+static constexpr int    GUIDING_TILE_SIZE = 64;
+
+// Probability of sampling the learned distribution instead of the BSDF in guided regions.
+static constexpr float  GUIDING_SAMPLE_RATIO = 0.5f;
+
+// Surfaces smoother than this are sampled with the BSDF alone, the learned distribution can't resolve such a narrow lobe.
+static constexpr float  GUIDING_MIN_ROUGHNESS = 0.1f;
+
+// Ratio between the upper and lower bound of the weight window, paths in the window are left untouched.
+static constexpr float  ADAPTIVE_RR_WINDOW = 5.0f;
+
+// Maximum number of paths a path can be split into at one vertex.
+static constexpr int    ADAPTIVE_RR_MAX_SPLIT = 4;
+
+// Minimum probability of a path surviving adaptive russian roulette, this avoids fireflies.
+static constexpr float  ADAPTIVE_RR_MIN_SURVIVAL = 0.05f;
+
+// Bounces whose BSDF pdf of the sampled direction is below this are rough enough to take cached radiance. The pdf of
+// a lambertian BSDF never goes beyond 1/PI, while glossy and specular lobes concentrate their samples way above it.
+static constexpr float  RADIANCE_CACHE_MAX_BSDF_PDF = 1.0f;
+
+void PathTracing::PreProcess( const Scene& scene , RenderContext& rc ){
+    // restore the medium stack at the camera once instead of once per camera ray
+    m_cameraMediumStack = MediumStack();
+    m_cameraMediumRc = nullptr;
+    if( IS_PTR_VALID( scene.GetCamera() ) ){
+        m_cameraMediumRc = std::make_unique<RenderContext>();
+        m_cameraMediumRc->Init();
+        m_cameraMediumOrigin = scene.GetCamera()->GetEye();
+        scene.RestoreMediumStack( m_cameraMediumOrigin , *m_cameraMediumRc , m_cameraMediumStack );
+    }
+
+    m_sdtree = nullptr;
+    m_imageRadiance = 0.0f;
+    m_radianceCache = m_radianceCaching ? std::make_unique<RadianceCache>( scene.GetBBox() ) : nullptr;
+    if( ( !m_pathGuiding && !m_adaptiveRR ) || 0 == m_guidingTrainingPasses )
+        return;
+
+    const auto camera = scene.GetCamera();
+    if( IS_PTR_INVALID( camera ) )
+        return;
+
+    SORT_PROFILE("Path tracing (path guiding training stage)");
+
+    const auto resolution = camera->GetImageResolution();
+    m_sdtree = std::make_unique<SDTree>( scene.GetBBox() );
+
+    // each pass renders the whole image without keeping the result, it only feeds the tree and the average radiance
+    const auto tile_cnt_x = ( resolution.x + GUIDING_TILE_SIZE - 1 ) / GUIDING_TILE_SIZE;
+    const auto tile_cnt_y = ( resolution.y + GUIDING_TILE_SIZE - 1 ) / GUIDING_TILE_SIZE;
+    std::vector<double> tile_radiance( tile_cnt_x * tile_cnt_y );
+    const auto trace_tile = [&]( int x , int y , unsigned spp , unsigned seed ){
+        auto tile_rc = std::make_unique<RenderContext>();
+        tile_rc->Init();
+        tile_rc->m_random_num_generator->Seed( seed );
+
+        auto radiance = 0.0;
+        const auto x_end = std::min( x + GUIDING_TILE_SIZE , resolution.x );
+        const auto y_end = std::min( y + GUIDING_TILE_SIZE , resolution.y );
+        for( auto i = y ; i < y_end ; ++i ){
+            for( auto j = x ; j < x_end ; ++j ){
+                for( auto k = 0u ; k < spp ; ++k ){
+                    tile_rc->Reset();
+
+                    PixelSample ps;
+                    ps.img_u = sort_rand<float>(*tile_rc);
+                    ps.img_v = sort_rand<float>(*tile_rc);
+                    ps.dof_u = sort_rand<float>(*tile_rc);
+                    ps.dof_v = sort_rand<float>(*tile_rc);
+
+                    const auto r = camera->GenerateRay( (float)j , (float)i , ps );
+                    const auto li = Li( r , ps , scene , *tile_rc );
+                    if( li.IsValid() )
+                        radiance += li.GetIntensity();
+                }
+            }
+        }
+        tile_radiance[ ( y / GUIDING_TILE_SIZE ) * tile_cnt_x + x / GUIDING_TILE_SIZE ] = radiance;
+    };
+
+    m_training = true;
+    for( auto pass = 0u ; pass < m_guidingTrainingPasses ; ++pass ){
+        const auto spp = 1u << pass;
+        const auto seed = sort_rand<unsigned>(rc);
+
+        marl::WaitGroup pass_done;
+        for( auto y = 0 ; y < resolution.y ; y += GUIDING_TILE_SIZE ){
+            for( auto x = 0 ; x < resolution.x ; x += GUIDING_TILE_SIZE ){
+                if( marl::Scheduler::get() ){
+                    pass_done.add();
+                    marl::schedule([&, pass_done, x, y, spp, seed]() {
+                        defer(pass_done.done());
+                        trace_tile( x , y , spp , seed + y * resolution.x + x );
+                    });
+                } else {
+                    trace_tile( x , y , spp , seed + y * resolution.x + x );
+                }
+            }
+        }
+        pass_done.wait();
+
+        m_sdtree->Refine( spp );
+
+        auto total_radiance = 0.0;
+        for( const auto radiance : tile_radiance )
+            total_radiance += radiance;
+        m_imageRadiance = (float)( total_radiance / ( (double)resolution.x * resolution.y * spp ) );
+    }
+    m_training = false;
+}
+
+int PathTracing::adaptiveContinuation( const GuidingRegion* region , Spectrum& throughput , bool splitting , RenderContext& rc ) const{
+    if( IS_PTR_INVALID( region ) || m_imageRadiance <= 0.0f )
+        return -1;
+
+    const auto& tree = region->m_sampling;
+    const auto length = tree.GetAveragePathLength();
+    if( tree.GetSampleCount() <= 0.0f || length <= 0.0f )
+        return -1;
+
+    // the expected contribution of continuing the path relative to the pixel, assuming a white diffuse surface.
+    // the learned incident radiance is integrated over the sphere while only half of it is visible in average.
+    const auto contribution = throughput.GetIntensity() * tree.GetIncidentRadiance() * INV_TWOPI / m_imageRadiance;
+
+    // the estimate is favored in regions where continuing paths is cheaper than average, efficiency is the ratio
+    // of contribution to the cost, which is square rooted since variance is linear to the number of samples.
+    const auto ratio = contribution * sqrt( m_sdtree->GetAveragePathLength() / length );
+
+    // the weight window centers at one
+    const auto lower = 2.0f / ( 1.0f + ADAPTIVE_RR_WINDOW );
+    const auto upper = lower * ADAPTIVE_RR_WINDOW;
+    if( ratio < lower ){
+        const auto survival = std::max( ADAPTIVE_RR_MIN_SURVIVAL , ratio );
+        if( sort_rand<float>(rc) >= survival ){
+            SORT_STATS(++sAdaptiveTerminations);
+            return 0;
+        }
+        throughput /= survival;
+        return 1;
+    }
+    if( ratio > upper && splitting ){
+        const auto split = std::min( (int)ratio , ADAPTIVE_RR_MAX_SPLIT );
+        SORT_STATS(sAdaptiveSplits += split - 1);
+        throughput /= (float)split;
+        return split;
+    }
+    return 1;
+}
 
 Spectrum PathTracing::Li( const Ray& ray , const PixelSample& ps , const Scene& scene, RenderContext& rc) const{
+    // only camera rays are counted, split paths and the ones leaving BSSRDF are traced recursively through 'li'
+    SORT_STATS(++sPrimaryRayCount);
+
+    // camera rays starting off the viewing point, like the ones through a lens, only need to cross the surfaces in between
     MediumStack ms;
-    scene.RestoreMediumStack(ray.m_Ori, rc, ms);
+    if( IS_PTR_VALID( m_cameraMediumRc ) ){
+        ms = m_cameraMediumStack;
+        if( ray.m_Ori != m_cameraMediumOrigin )
+            scene.UpdateMediumStack(m_cameraMediumOrigin, ray.m_Ori, rc, ms);
+    }else{
+        scene.RestoreMediumStack(ray.m_Ori, rc, ms);
+    }
 
     return li( ray , ps , scene , 0 , false , 0 , false , ms , rc);
 }
 
 Spectrum PathTracing::li( const Ray& ray , const PixelSample& ps , const Scene& scene , int bounces , bool indirectOnly , int bssrdfBounces , bool replaceSSS , MediumStack& ms, RenderContext& rc ) const{
     SORT_PROFILE("Path tracing");
-    SORT_STATS(++sPrimaryRayCount);
 
     Spectrum    L = 0.0f;
     Spectrum    throughput = 1.0f;
 
+    // radiance gathered by the path is recorded at all of its surface vertices during training passes
+    GuidingPath guiding_path( m_training ? m_sdtree.get() : nullptr , max_recursive_depth , rc );
+    // diffuse vertices of the path feed the radiance cache
+    RadianceCachePath cache_path( m_radianceCache.get() , max_recursive_depth , rc );
+    auto diffuse_bounces = 0u;
+
+    const auto add_radiance = [&]( const Spectrum& radiance ){
+        L += radiance;
+        guiding_path.AddRadiance( radiance );
+        cache_path.AddRadiance( radiance );
+    };
+
     int local_bounce = 0;
     auto    r = ray;
     while(true){
@@ -69,7 +255,11 @@ Spectrum PathTracing::li( const Ray& ray , const PixelSample& ps , const Scene&
         MediumInteraction* pMi = nullptr;
         const auto medium_attenuation = ms.Sample(r, inter.t, pMi, emission, rc);
 
-        L += emission * throughput;
+        add_radiance( emission * throughput );
+
+        // lights inside the medium are also sampled with equiangular sampling, which is a lot better at capturing the halo around
+        // them than sampling distance proportional to transmittance alone.
+        add_radiance( throughput * EvaluateDirectEquiangular(r, inter.t, scene, ms, rc) );
 
         // update the through put based on the medium attenuation due to particle scattering and absorption.
         throughput *= medium_attenuation;
@@ -82,10 +272,13 @@ Spectrum PathTracing::li( const Ray& ray , const PixelSample& ps , const Scene&
             if ( UNLIKELY(pdf == 0.0f) )
                 break;
 
-            // evaluate direct light illumination
+            // evaluate direct light illumination, there is no surface normal in participating media
             float light_pdf = 0.0f;
-            const auto  light = scene.SampleLight(sort_rand<float>(rc), &light_pdf);
-            L += throughput * EvaluateDirect(pMi->intersect, pMi->phaseFunction, -r.m_Dir, scene, light, ms, rc) / light_pdf;
+            const auto  light = scene.SampleLight(pMi->intersect, Vector(0.0f, 0.0f, 0.0f), sort_rand<float>(rc), &light_pdf);
+            if (light && light_pdf > 0.0f) {
+                const auto mis = DistanceSamplingWeight(r, inter.t, dot(pMi->intersect - r.m_Ori, r.m_Dir), scene, light, light_pdf, ms);
+                add_radiance( throughput * EvaluateDirect(pMi->intersect, pMi->phaseFunction, -r.m_Dir, scene, light, ms, rc) * ( mis / light_pdf ) );
+            }
 
             // update path weight
             throughput *= pf / pdf;
@@ -96,6 +289,7 @@ Spectrum PathTracing::li( const Ray& ray , const PixelSample& ps , const Scene&
             r.m_Ori = pMi->intersect;
             r.m_Dir = wi;
             r.m_fMin = 0.0f;    // no need for bias anymore since there is no geometry
+            r.m_hasDifferentials = false;
 
             // apply Prussian Roulette in volume scattering too
             if (bounces > 3 && throughput.GetMaxComponent() < 0.1f) {
@@ -112,7 +306,7 @@ Spectrum PathTracing::li( const Ray& ray , const PixelSample& ps , const Scene&
         }
 
         if( local_bounce == 0 && !indirectOnly ) 
-            L += inter.Le(-r.m_Dir);
+            add_radiance( inter.Le(-r.m_Dir) );
         
         // make sure there is intersected primitive
         sAssert(IS_PTR_VALID(inter.primitive), INTEGRATOR );
@@ -136,9 +330,9 @@ Spectrum PathTracing::li( const Ray& ray , const PixelSample& ps , const Scene&
             auto        light_pdf = 0.0f;
             const auto  light_sample = LightSample(rc);
             const auto  bsdf_sample = BsdfSample(rc);
-            const auto  light = scene.SampleLight( light_sample.t , &light_pdf );
-            if( light_pdf > 0.0f )
-                L += throughput * EvaluateDirect( se , r , scene, light , light_sample , bsdf_sample , material , ms , rc) / light_pdf / pdf_scattering_type;
+            const auto  light = scene.SampleLight( inter.intersect , inter.normal , light_sample.t , &light_pdf );
+            if( light && light_pdf > 0.0f )
+                add_radiance( throughput * EvaluateDirect( se , r , scene, light , light_sample , bsdf_sample , material , ms , rc) / light_pdf / pdf_scattering_type );
         }else if(scattering_type_flag & SE_EVALUATE_BSSRDF) {
             BSSRDFIntersections bssrdf_inter;
             float               bssrdf_pdf = 0.0f;
@@ -162,7 +356,7 @@ Spectrum PathTracing::li( const Ray& ray , const PixelSample& ps , const Scene&
                     total_bssrdf += SampleOneLight( se , r , intersection , scene , material , ms , rc ) * pInter->weight;
                 }
                 
-                L += total_bssrdf * throughput / pdf_scattering_type / bssrdf_pdf;
+                add_radiance( total_bssrdf * throughput / pdf_scattering_type / bssrdf_pdf );
             }
         }
 
@@ -173,31 +367,104 @@ Spectrum PathTracing::li( const Ray& ray , const PixelSample& ps , const Scene&
             break;
 
         throughput /= pdf_scattering_type;
+
+        auto adaptive_rr = false;
         if( scattering_type_flag & SE_EVALUATE_BXDF ){
-            // sample the next direction using bsdf
-            float       path_pdf;
+            const auto region = m_sdtree ? m_sdtree->GetRegion( inter.intersect ) : nullptr;
+
+            // sample the next direction using bsdf, with path guiding the direction is sampled from either the learned distribution
+            // or the bsdf, the pdf of the combination of both strategies is used so that either of them can be picked. The pdf of
+            // the bsdf alone is also returned, it tells how rough the surface is in the sampled direction. Near specular surfaces
+            // are never guided, half of their samples would be wasted on directions the bsdf barely reflects.
+            const auto guided = m_pathGuiding && region && region->m_sampling.HasEnergy() && se.GetRoughness() >= GUIDING_MIN_ROUGHNESS;
+            const auto sample_direction = [&]( Vector& wi , float& pdf , float& bsdf_pdf ) -> Spectrum {
+                if( !guided ){
+                    SORT_STATS(++sUnguidedBounces);
+                    const auto f = se.Sample_BSDF( -r.m_Dir , wi , BsdfSample(rc) , pdf, rc);
+                    bsdf_pdf = pdf;
+                    return f;
+                }
+
+                SORT_STATS(++sGuidedBounces);
+
+                Spectrum f;
+                bsdf_pdf = 0.0f;
+                if( sort_rand<float>(rc) < GUIDING_SAMPLE_RATIO ){
+                    wi = region->m_sampling.Sample( rc );
+                    f = se.Evaluate_BSDF_Pdf( -r.m_Dir , wi , bsdf_pdf );
+                }else{
+                    f = se.Sample_BSDF( -r.m_Dir , wi , BsdfSample(rc) , bsdf_pdf, rc);
+                }
+                pdf = GUIDING_SAMPLE_RATIO * region->m_sampling.Pdf( wi ) + ( 1.0f - GUIDING_SAMPLE_RATIO ) * bsdf_pdf;
+                return f;
+            };
+
+            // as long as the ray is passing through the surface, it is necessary to update the medium stack.
+            const auto update_medium_stack = [&]( const Vector& wi , MediumStack& stack ){
+                const auto interaction_flag = update_interaction_flag(dot(wi,inter.gnormal), dot(-r.m_Dir,inter.gnormal));
+                if (SE_Interaction::SE_REFLECTION != interaction_flag) {
+                    MediumInteraction mi;
+                    mi.intersect = inter.intersect;
+                    mi.mesh = inter.primitive->GetMesh();
+                    material->UpdateMediumStack(mi, interaction_flag, stack, rc);
+                }
+            };
+
+            // adaptive russian roulette and splitting takes over the default russian roulette once the region is learned
+            const auto continuation = ( m_adaptiveRR && !m_training ) ? adaptiveContinuation( region , throughput , !indirectOnly , rc ) : -1;
+            if( 0 == continuation )
+                break;
+            adaptive_rr = continuation > 0;
+
+            // split paths are traced recursively, they won't be split again
+            for( auto i = 1 ; i < continuation ; ++i ){
+                float   pdf = 0.0f , bsdf_pdf = 0.0f;
+                Vector  wi;
+                const auto f = sample_direction( wi , pdf , bsdf_pdf );
+                if( f.IsBlack() || pdf == 0.0f )
+                    continue;
+
+                MediumStack ms_copy = ms;
+                update_medium_stack( wi , ms_copy );
+                add_radiance( li( Ray( inter.intersect , wi , 0 , 0.0001f ) , PixelSample() , scene , bounces + 1 , true , bssrdfBounces , false , ms_copy , rc ) * throughput * f / pdf );
+            }
+
+            float       path_pdf = 0.0f , bsdf_pdf = 0.0f;
             Vector      wi;
-            Spectrum f;
-            BsdfSample  _bsdf_sample = BsdfSample(rc);
-            f = se.Sample_BSDF( -r.m_Dir , wi , _bsdf_sample , path_pdf, rc);
+            const auto  f = sample_direction( wi , path_pdf , bsdf_pdf );
             if( ( f.IsBlack() || path_pdf == 0.0f ) )
                 break;
 
-            // as long as the ray is passing through the surface, it is necessary to update the medium stack.
-            const auto interaction_flag = update_interaction_flag(dot(wi,inter.gnormal), dot(-r.m_Dir,inter.gnormal));
-            if (SE_Interaction::SE_REFLECTION != interaction_flag) {
-                MediumInteraction mi;
-                mi.intersect = inter.intersect;
-                mi.mesh = inter.primitive->GetMesh();
-                material->UpdateMediumStack(mi, interaction_flag, ms, rc);
-            }
+            update_medium_stack( wi , ms );
 
             // update path weight
             throughput *= f / path_pdf;
 
             if( 0.0f == throughput.GetIntensity() )
                 break;
+
+            if( m_training )
+                guiding_path.AddVertex( region , wi , throughput , path_pdf );
+
+            // deep diffuse paths take the average radiance arriving at the cell instead of tracing further, only the roughness of
+            // this bounce matters, the learned distribution of path guiding doesn't make a surface any less diffuse.
+            if( m_radianceCache && bsdf_pdf <= RADIANCE_CACHE_MAX_BSDF_PDF ){
+                const auto n = dot( wi , inter.gnormal ) < 0.0f ? -inter.gnormal : inter.gnormal;
+
+                Spectrum cached;
+                if( !m_training && diffuse_bounces >= m_radianceCacheBounces && m_radianceCache->Lookup( inter.intersect , n , cached ) ){
+                    SORT_STATS(++sRadianceCacheHits);
+                    add_radiance( throughput * cached );
+                    break;
+                }
+
+                cache_path.AddVertex( inter.intersect , n , throughput );
+                ++diffuse_bounces;
+            }
             
+            // this has to be done before the ray is updated since it relies on the incoming differentials
+            PropagateRayDifferentials( inter , wi , path_pdf , r );
+
             r.m_Ori = inter.intersect;
             r.m_Dir = wi;
             r.m_fMin = 0.0001f;
@@ -236,12 +503,12 @@ Spectrum PathTracing::li( const Ray& ray , const PixelSample& ps , const Scene&
                     }
                 }
                 
-                L += total_bssrdf * throughput / bssrdf_pdf;
+                add_radiance( total_bssrdf * throughput / bssrdf_pdf );
             }
             return L;
         }
 
-        if( bounces > 3 && throughput.GetMaxComponent() < 0.1f ){
+        if( !adaptive_rr && bounces > 3 && throughput.GetMaxComponent() < 0.1f ){
             auto continueProperbility = std::max( 0.05f , 1.0f - throughput.GetMaxComponent() );
             if( sort_rand<float>(rc) < continueProperbility )
                 break;
@@ -18,6 +18,10 @@
 #pragma once
 
 #include "integrator.h"
+#include "path_guiding.h"
+#include "radiance_cache.h"
+#include "medium/medium.h"
+#include "core/render_context.h"
 
 //! @brief  The core of path tracing algorithm, the most commonly used algorithm in SORT.
 /**
@@ -36,12 +40,27 @@ public:
     //! @return                 The radiance along the opposite direction that the ray points to.
     Spectrum    Li( const Ray& ray , const PixelSample& ps , const Scene& scene, RenderContext& rc) const override;
 
+    //! @brief  Learn the distribution of incident radiance in a few training passes if path guiding or adaptive
+    //!         russian roulette is enabled.
+    //!
+    //! Each training pass renders the whole image with twice as many samples per pixel as the previous one, the
+    //! final rendering uses what is learned in the last training pass.
+    //!
+    //! @param  scene           The scene to be evaluated.
+    //! @param  rc              The render context.
+    void        PreProcess( const Scene& scene , RenderContext& rc ) override;
+
     //! @brief      Serializing data from stream
     //!
     //! @param      Stream where the serialization data comes from. Depending on different situation, it could come from different places.
     void    Serialize( IStreamBase& stream ) override {
         Integrator::Serialize( stream );
         stream >> m_maxBouncesInBSSRDFPath;
+        stream >> m_pathGuiding;
+        stream >> m_guidingTrainingPasses;
+        stream >> m_adaptiveRR;
+        stream >> m_radianceCaching;
+        stream >> m_radianceCacheBounces;
     }
 
     SORT_STATS_ENABLE( "Path Tracing" )
@@ -52,6 +71,44 @@ private:
     // Most importantly, it kills the performance and introduces quite some fireflies with bounces more than 2.
     int     m_maxBouncesInBSSRDFPath;
 
+    // Whether to guide paths with the incident radiance learned during training passes.
+    bool        m_pathGuiding = false;
+    // Number of training passes, each one takes twice as many samples per pixel as the previous one.
+    unsigned    m_guidingTrainingPasses = 5;
+    // The spatial-directional tree learned for path guiding.
+    std::unique_ptr<SDTree> m_sdtree;
+    // Whether incident radiance is recorded in the tree, this is only true during training passes.
+    bool        m_training = false;
+    // Whether to decide russian roulette and splitting based on the learned radiance and cost of paths.
+    bool        m_adaptiveRR = false;
+    // Average radiance of the image learned in the last training pass.
+    float       m_imageRadiance = 0.0f;
+    // Whether deep diffuse paths are terminated with the radiance cache.
+    bool        m_radianceCaching = false;
+    // Number of diffuse bounces before paths look up the radiance cache.
+    unsigned    m_radianceCacheBounces = 2;
+    // The radiance cache filled progressively by paths during rendering.
+    std::unique_ptr<RadianceCache> m_radianceCache;
+    // The medium stack at the camera, restored once before rendering and shared by all camera rays.
+    MediumStack m_cameraMediumStack;
+    // Where the medium stack of the camera is restored.
+    Point       m_cameraMediumOrigin;
+    // Mediums in the stack of the camera are allocated from this context, which lives as long as the stack.
+    std::unique_ptr<RenderContext> m_cameraMediumRc;
+
+    //! @brief  Number of paths to continue with at a surface vertex, adaptive russian roulette and splitting.
+    //!
+    //! Paths whose expected contribution is small compared to the pixel are terminated randomly, those with large
+    //! expected contribution are split. Continuing paths from regions where they are cheap is preferred.
+    //!
+    //! @param  region          The region of the vertex.
+    //! @param  throughput      Throughput of the path up to the vertex, excluding the scattering at the vertex.
+    //! @param  splitting       Whether the path could be split.
+    //! @param  rc              The render context.
+    //! @return                 Number of paths to continue with, zero means the path is terminated, negative
+    //!                         means there is not enough knowledge about the region.
+    int         adaptiveContinuation( const GuidingRegion* region , Spectrum& throughput , bool splitting , RenderContext& rc ) const;
+
     //! @brief  Evaluate the radiance along a specific direction.
     //!
     //! @param  ray             The ray to be tested with.
@@ -0,0 +1,166 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+
+    Copyright (c) 2011-2023 by Jiayin Cao - All rights reserved.
+
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+
+#include <cmath>
+#include "radiance_cache.h"
+#include "core/render_context.h"
+#include "core/memory.h"
+#include "math/utils.h"
+
+// Number of cells along the longest axis of the scene.
+static constexpr float      RADIANCE_CACHE_RESOLUTION = 256.0f;
+
+// Number of cells in the hash table, it has to be power of two.
+static constexpr unsigned   RADIANCE_CACHE_CAPACITY = 1u << 20;
+
+// Maximum number of cells to probe before giving up.
+static constexpr unsigned   RADIANCE_CACHE_MAX_PROBE = 16;
+
+// Cells with fewer samples than this are not used yet.
+static constexpr float      RADIANCE_CACHE_MIN_SAMPLES = 32.0f;
+
+// Number of bits of each coordinate in a key.
+static constexpr unsigned   RADIANCE_CACHE_COORD_BITS = 20;
+
+SORT_STATIC_FORCEINLINE void atomicAdd( std::atomic<float>& target , float value ){
+    auto current = target.load( std::memory_order_relaxed );
+    while( !target.compare_exchange_weak( current , current + value , std::memory_order_relaxed ) );
+}
+
+// Scramble the bits of a key so that neighbouring cells spread over the table.
+SORT_STATIC_FORCEINLINE unsigned long long hashKey( unsigned long long key ){
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return key;
+}
+
+RadianceCache::RadianceCache( const BBox& bbox ) : m_bbox( bbox ) {
+    const auto extent = std::max( std::max( bbox.Delta( 0 ) , bbox.Delta( 1 ) ) , bbox.Delta( 2 ) );
+    m_inv_cell_size = extent > 0.0f ? RADIANCE_CACHE_RESOLUTION / extent : 1.0f;
+
+    m_cells = std::make_unique<Cell[]>( RADIANCE_CACHE_CAPACITY );
+    for( auto i = 0u ; i < RADIANCE_CACHE_CAPACITY ; ++i ){
+        auto& cell = m_cells[i];
+        cell.m_key.store( 0 , std::memory_order_relaxed );
+        for( auto k = 0 ; k < 3 ; ++k )
+            cell.m_radiance[k].store( 0.0f , std::memory_order_relaxed );
+        cell.m_count.store( 0.0f , std::memory_order_relaxed );
+    }
+}
+
+unsigned long long RadianceCache::getKey( const Point& p , const Vector& n ) const{
+    constexpr auto coord_mask = ( 1ull << RADIANCE_CACHE_COORD_BITS ) - 1;
+
+    unsigned long long key = 0;
+    for( auto i = 0 ; i < 3 ; ++i ){
+        const auto coord = std::min( std::max( floor( ( p[i] - m_bbox.m_Min[i] ) * m_inv_cell_size ) , 0.0f ) , (float)coord_mask );
+        key = ( key << RADIANCE_CACHE_COORD_BITS ) | (unsigned long long)coord;
+    }
+
+    // the dominant axis of the normal and its sign, surfaces facing different ways don't share cells
+    const auto ax = fabs( n.x ) , ay = fabs( n.y ) , az = fabs( n.z );
+    const auto axis = ( ax >= ay && ax >= az ) ? 0 : ( ay >= az ? 1 : 2 );
+    const auto side = n[axis] < 0.0f ? 1 : 0;
+    key = ( key << 3 ) | (unsigned long long)( axis * 2 + side );
+
+    // zero is reserved for empty cells
+    return key + 1;
+}
+
+RadianceCache::Cell* RadianceCache::findCell( unsigned long long key , bool insert ) const{
+    const auto slot = hashKey( key );
+    for( auto i = 0u ; i < RADIANCE_CACHE_MAX_PROBE ; ++i ){
+        auto& cell = m_cells[ ( slot + i ) & ( RADIANCE_CACHE_CAPACITY - 1 ) ];
+        auto current = cell.m_key.load( std::memory_order_acquire );
+        if( current == key )
+            return &cell;
+        if( current != 0 )
+            continue;
+        if( !insert )
+            return nullptr;
+
+        // claim the empty cell, another fiber could be claiming it at the same time for the same key
+        if( cell.m_key.compare_exchange_strong( current , key , std::memory_order_acq_rel ) || current == key )
+            return &cell;
+    }
+    return nullptr;
+}
+
+void RadianceCache::Record( const Point& p , const Vector& n , const Spectrum& radiance ){
+    if( !radiance.IsValid() )
+        return;
+
+    auto cell = findCell( getKey( p , n ) , true );
+    if( IS_PTR_INVALID( cell ) )
+        return;
+
+    for( auto k = 0 ; k < 3 ; ++k )
+        atomicAdd( cell->m_radiance[k] , radiance[k] );
+    atomicAdd( cell->m_count , 1.0f );
+}
+
+bool RadianceCache::Lookup( const Point& p , const Vector& n , Spectrum& radiance ) const{
+    const auto cell = findCell( getKey( p , n ) , false );
+    if( IS_PTR_INVALID( cell ) )
+        return false;
+
+    const auto count = cell->m_count.load( std::memory_order_relaxed );
+    if( count < RADIANCE_CACHE_MIN_SAMPLES )
+        return false;
+
+    for( auto k = 0 ; k < 3 ; ++k )
+        radiance[k] = cell->m_radiance[k].load( std::memory_order_relaxed ) / count;
+    return true;
+}
+
+RadianceCachePath::RadianceCachePath( RadianceCache* cache , unsigned max_length , RenderContext& rc ){
+    if( IS_PTR_INVALID( cache ) || 0 == max_length )
+        return;
+    m_cache = cache;
+    m_vertices = (Vertex*)SORT_MALLOC_ARRAY( rc.m_memory_arena , Vertex , max_length );
+    m_max_length = max_length;
+}
+
+RadianceCachePath::~RadianceCachePath(){
+    for( auto i = 0u ; i < m_length ; ++i )
+        m_cache->Record( m_vertices[i].m_position , m_vertices[i].m_normal , m_vertices[i].m_radiance );
+}
+
+void RadianceCachePath::AddVertex( const Point& p , const Vector& n , const Spectrum& throughput ){
+    if( IS_PTR_INVALID( m_vertices ) || m_length >= m_max_length )
+        return;
+
+    auto& vertex = m_vertices[m_length++];
+    vertex.m_position = p;
+    vertex.m_normal = n;
+    vertex.m_throughput = throughput;
+    vertex.m_radiance = 0.0f;
+}
+
+void RadianceCachePath::AddRadiance( const Spectrum& radiance ){
+    for( auto i = 0u ; i < m_length ; ++i ){
+        auto& vertex = m_vertices[i];
+        for( auto k = 0 ; k < 3 ; ++k ){
+            if( vertex.m_throughput[k] > 0.0f )
+                vertex.m_radiance[k] += radiance[k] / vertex.m_throughput[k];
+        }
+    }
+}
@@ -0,0 +1,125 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+
+    Copyright (c) 2011-2023 by Jiayin Cao - All rights reserved.
+
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include "core/define.h"
+#include "math/bbox.h"
+#include "math/point.h"
+#include "math/vector3.h"
+#include "spectrum/spectrum.h"
+
+struct RenderContext;
+
+//! @brief  World space cache of incident radiance at diffuse surfaces.
+/**
+ * The cache is a hash grid keyed by the quantized position and the dominant axis of the normal. Each cell keeps the
+ * running average of the radiance arriving along directions sampled at the diffuse vertices falling in it, so that
+ * a path could take the average instead of tracing deeper. The table is of fixed size with linear probing, cells are
+ * claimed and updated with atomics so that all worker fibers could update the cache concurrently without any lock.
+ */
+class RadianceCache{
+public:
+    //! @brief  Constructor.
+    //!
+    //! @param  bbox        Bounding box of the scene.
+    RadianceCache( const BBox& bbox );
+
+    //! @brief  Record radiance arriving at a point.
+    //!
+    //! @param  p           The position in world space.
+    //! @param  n           The normal on the side that the radiance arrives from.
+    //! @param  radiance    The radiance arriving along a sampled direction.
+    void    Record( const Point& p , const Vector& n , const Spectrum& radiance );
+
+    //! @brief  Look up the average radiance arriving at a point.
+    //!
+    //! @param  p           The position in world space.
+    //! @param  n           The normal on the side that the radiance arrives from.
+    //! @param  radiance    The average radiance in the cell.
+    //! @return             Whether enough samples are recorded in the cell to be used.
+    bool    Lookup( const Point& p , const Vector& n , Spectrum& radiance ) const;
+
+private:
+    //! @brief  A cell in the hash grid.
+    struct Cell{
+        std::atomic<unsigned long long> m_key;          /**< Key of the cell, zero means the cell is empty. */
+        std::atomic<float>              m_radiance[3];  /**< Sum of the recorded radiance. */
+        std::atomic<float>              m_count;        /**< Number of recorded samples. */
+    };
+
+    //! @brief  Get the key of the cell that a point falls in.
+    unsigned long long  getKey( const Point& p , const Vector& n ) const;
+
+    //! @brief  Find the cell of a key.
+    //!
+    //! @param  key         The key of the cell.
+    //! @param  insert      Whether to claim an empty cell if the key is not in the table yet.
+    //! @return             The cell, 'nullptr' if it is not found or the table is too crowded.
+    Cell*               findCell( unsigned long long key , bool insert ) const;
+
+    BBox                        m_bbox;             /**< Bounding box of the scene. */
+    float                       m_inv_cell_size;    /**< Inverse of the size of a cell. */
+    std::unique_ptr<Cell[]>     m_cells;            /**< Cells of the hash table. */
+};
+
+//! @brief  Diffuse vertices of a path that are recorded in the radiance cache.
+/**
+ * Radiance gathered by the path after a vertex, divided by the throughput up to the vertex, is the radiance arriving
+ * at the vertex along the sampled direction. It is recorded in the cache once the path is done.
+ */
+class RadianceCachePath{
+public:
+    //! @brief  Constructor.
+    //!
+    //! @param  cache       The cache to record radiance in, nothing is recorded if it is 'nullptr'.
+    //! @param  max_length  Maximum number of vertices in the path.
+    //! @param  rc          The render context.
+    RadianceCachePath( RadianceCache* cache , unsigned max_length , RenderContext& rc );
+
+    //! @brief  Record the radiance of all vertices in the cache.
+    ~RadianceCachePath();
+
+    //! @brief  Add a vertex to the path.
+    //!
+    //! @param  p           The position of the vertex.
+    //! @param  n           The normal on the side of the sampled direction.
+    //! @param  throughput  The throughput of the path up to the vertex, including the scattering at the vertex.
+    void    AddVertex( const Point& p , const Vector& n , const Spectrum& throughput );
+
+    //! @brief  Accumulate radiance gathered by the path.
+    //!
+    //! @param  radiance    Radiance gathered by the path, weighted by the path throughput.
+    void    AddRadiance( const Spectrum& radiance );
+
+private:
+    //! @brief  A vertex in the path.
+    struct Vertex{
+        Point           m_position;
+        Vector          m_normal;
+        Spectrum        m_throughput;
+        Spectrum        m_radiance;
+    };
+
+    RadianceCache*  m_cache = nullptr;      /**< The cache to record radiance in. */
+    Vertex*         m_vertices = nullptr;   /**< Vertices of the path, it is only allocated when recording. */
+    unsigned        m_max_length = 0;       /**< Maximum number of vertices. */
+    unsigned        m_length = 0;           /**< Number of vertices in the path. */
+};
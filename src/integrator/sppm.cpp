@@ -0,0 +1,417 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+
+    Copyright (c) 2011-2023 by Jiayin Cao - All rights reserved.
+
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+
+#include <algorithm>
+#include <marl/defer.h>
+#include <marl/scheduler.h>
+#include <marl/waitgroup.h>
+#include "sppm.h"
+#include "integratormethod.h"
+#include "core/scene.h"
+#include "core/memory.h"
+#include "camera/camera.h"
+#include "light/light.h"
+#include "material/material.h"
+#include "material/shading_batch.h"
+#include "scatteringevent/scatteringevent.h"
+
+SORT_STATS_DEFINE_COUNTER(sTracedPhotons)
+SORT_STATS_DEFINE_COUNTER(sGatheredPhotons)
+SORT_STATS_DEFINE_COUNTER(sVisiblePoints)
+
+SORT_STATS_COUNTER("Stochastic Progressive Photon Mapping", "Traced Photons" , sTracedPhotons);
+SORT_STATS_COUNTER("Stochastic Progressive Photon Mapping", "Visible Points" , sVisiblePoints);
+SORT_STATS_AVG_COUNT("Stochastic Progressive Photon Mapping", "Average Gathered Visible Points", sGatheredPhotons , sTracedPhotons);
+
+// Size of the image tiles that visible points are traced in.
+static constexpr int        SPPM_TILE_SIZE = 64;
+
+// Number of photons traced in each task.
+static constexpr unsigned   SPPM_PHOTONS_PER_TASK = 4096;
+
+// Fraction of the photons gathered in a pass that are kept in the pixel statistics, alpha in the paper.
+static constexpr float      SPPM_ALPHA = 0.7f;
+
+// Surfaces smoother than this are considered near specular, density estimation doesn't work well on such surfaces,
+// eye paths go on through them until they reach a rougher one.
+static constexpr float      SPPM_SPECULAR_ROUGHNESS = 0.1f;
+
+// Split a range into batches and process them in parallel if there is a scheduler.
+template<class T>
+static void parallelFor( unsigned cnt , unsigned batch , T func ){
+    if( !marl::Scheduler::get() ){
+        func( 0u , cnt );
+        return;
+    }
+
+    marl::WaitGroup done;
+    for( auto begin = 0u ; begin < cnt ; begin += batch ){
+        done.add();
+        marl::schedule([&, done, begin]() {
+            defer(done.done());
+            func( begin , std::min( begin + batch , cnt ) );
+        });
+    }
+    done.wait();
+}
+
+SORT_STATIC_FORCEINLINE void atomicAdd( std::atomic<float>& target , float value ){
+    auto current = target.load( std::memory_order_relaxed );
+    while( !target.compare_exchange_weak( current , current + value , std::memory_order_relaxed ) );
+}
+
+void VisiblePointGrid::Reset( const BBox& bbox , float max_radius , unsigned bucket_cnt ){
+    m_bbox = bbox;
+    m_inv_cell_size = max_radius > 0.0f ? 0.5f / max_radius : 0.0f;
+
+    if( bucket_cnt != m_bucket_cnt ){
+        m_buckets = std::make_unique<std::atomic<Node*>[]>( bucket_cnt );
+        m_bucket_cnt = bucket_cnt;
+    }
+    for( auto i = 0u ; i < m_bucket_cnt ; ++i )
+        m_buckets[i].store( nullptr , std::memory_order_relaxed );
+}
+
+void VisiblePointGrid::Insert( SPPM_Pixel* pixel , RenderContext& rc ){
+    const auto r = Vector( pixel->radius , pixel->radius , pixel->radius );
+    const auto c = ( pixel->p - m_bbox.m_Min ) * m_inv_cell_size;
+    const auto lo = ( pixel->p - r - m_bbox.m_Min ) * m_inv_cell_size;
+    const auto hi = ( pixel->p + r - m_bbox.m_Min ) * m_inv_cell_size;
+
+    // The diameter of the pixel is at most one cell, so it never overlaps cells beyond the neighbors of the one holding
+    // its center. Clamping to them keeps float rounding from touching more than 3x3x3 cells.
+    int lo_cell[3] , hi_cell[3];
+    for( auto k = 0 ; k < 3 ; ++k ){
+        const auto center = (int)std::floor( c[k] );
+        lo_cell[k] = std::max( (int)std::floor( lo[k] ) , center - 1 );
+        hi_cell[k] = std::min( (int)std::floor( hi[k] ) , center + 1 );
+    }
+
+    // different cells could share the same bucket, the pixel is only pushed once in each bucket
+    unsigned buckets[27];
+    auto bucket_cnt = 0u;
+    for( auto z = lo_cell[2] ; z <= hi_cell[2] ; ++z ){
+        for( auto y = lo_cell[1] ; y <= hi_cell[1] ; ++y ){
+            for( auto x = lo_cell[0] ; x <= hi_cell[0] ; ++x ){
+                const auto bucket = getBucket( x , y , z );
+                if( std::find( buckets , buckets + bucket_cnt , bucket ) != buckets + bucket_cnt )
+                    continue;
+                buckets[bucket_cnt++] = bucket;
+
+                auto node = SORT_MALLOC(rc.m_memory_arena, Node)();
+                node->pixel = pixel;
+                node->next = m_buckets[bucket].load( std::memory_order_relaxed );
+                while( !m_buckets[bucket].compare_exchange_weak( node->next , node , std::memory_order_release , std::memory_order_relaxed ) );
+            }
+        }
+    }
+}
+
+void StochasticProgressivePhotonMapping::PreProcess( const Scene& scene , RenderContext& rc ){
+    SORT_PROFILE("Stochastic Progressive Photon Mapping");
+
+    m_radiance = nullptr;
+
+    const auto camera = scene.GetCamera();
+    if( IS_PTR_INVALID( camera ) || 0 == m_passCnt )
+        return;
+
+    const auto resolution = camera->GetImageResolution();
+    m_width = resolution.x;
+    m_height = resolution.y;
+    const auto pixel_cnt = (unsigned)( m_width * m_height );
+
+    const auto& bbox = scene.GetBBox();
+    const auto scene_radius = ( bbox.m_Max - bbox.m_Min ).Length() * 0.5f;
+
+    auto pixels = std::make_unique<SPPM_Pixel[]>( pixel_cnt );
+    for( auto i = 0u ; i < pixel_cnt ; ++i ){
+        pixels[i].radius = m_radiusFactor * scene_radius;
+        for( auto& phi : pixels[i].phi )
+            phi.store( 0.0f , std::memory_order_relaxed );
+        pixels[i].m.store( 0 , std::memory_order_relaxed );
+    }
+
+    // scattering events of visible points live in the memory of their tiles until the pass is done
+    const auto tile_cnt_x = ( m_width + SPPM_TILE_SIZE - 1 ) / SPPM_TILE_SIZE;
+    const auto tile_cnt_y = ( m_height + SPPM_TILE_SIZE - 1 ) / SPPM_TILE_SIZE;
+    const auto tile_cnt = (unsigned)( tile_cnt_x * tile_cnt_y );
+    std::vector<std::unique_ptr<RenderContext>> tile_contexts( tile_cnt );
+    std::vector<BBox> tile_bboxes( tile_cnt );
+    std::vector<float> tile_max_radius( tile_cnt );
+    const auto tile_seed = sort_rand<unsigned>(rc);
+    for( auto t = 0u ; t < tile_cnt ; ++t ){
+        tile_contexts[t] = std::make_unique<RenderContext>();
+        tile_contexts[t]->Init();
+        tile_contexts[t]->m_random_num_generator->Seed( tile_seed + t );
+    }
+
+    const auto for_each_pixel_in_tile = [&]( unsigned t , auto func ){
+        const auto x = (int)( t % tile_cnt_x ) * SPPM_TILE_SIZE;
+        const auto y = (int)( t / tile_cnt_x ) * SPPM_TILE_SIZE;
+        const auto x_end = std::min( x + SPPM_TILE_SIZE , m_width );
+        const auto y_end = std::min( y + SPPM_TILE_SIZE , m_height );
+        for( auto i = y ; i < y_end ; ++i )
+            for( auto j = x ; j < x_end ; ++j )
+                func( pixels[i * m_width + j] , j , i );
+    };
+
+    for( auto pass = 0u ; pass < m_passCnt ; ++pass ){
+        // trace visible points of all pixels
+        parallelFor( tile_cnt , 1 , [&]( unsigned begin , unsigned end ){
+            for( auto t = begin ; t < end ; ++t ){
+                auto& tile_rc = *tile_contexts[t];
+                tile_rc.Reset();
+
+                std::vector<SPPM_EyePath> paths;
+                for_each_pixel_in_tile( t , [&]( SPPM_Pixel& pixel , int x , int y ){
+                    pixel.se = nullptr;
+
+                    PixelSample ps;
+                    ps.img_u = sort_rand<float>(tile_rc);
+                    ps.img_v = sort_rand<float>(tile_rc);
+                    ps.dof_u = sort_rand<float>(tile_rc);
+                    ps.dof_v = sort_rand<float>(tile_rc);
+
+                    SPPM_EyePath path;
+                    path.pixel = &pixel;
+                    path.ray = scene.GetCamera()->GenerateRay( (float)x , (float)y , ps );
+                    paths.push_back( path );
+                });
+                _TraceVisiblePoints( paths , scene , tile_rc );
+
+                auto tile_bbox = BBox();
+                auto max_radius = 0.0f;
+                for_each_pixel_in_tile( t , [&]( SPPM_Pixel& pixel , int x , int y ){
+                    if( IS_PTR_INVALID( pixel.se ) )
+                        return;
+
+                    const auto r = Vector( pixel.radius , pixel.radius , pixel.radius );
+                    tile_bbox.Union( pixel.p - r );
+                    tile_bbox.Union( pixel.p + r );
+                    max_radius = std::max( max_radius , pixel.radius );
+                });
+                tile_bboxes[t] = tile_bbox;
+                tile_max_radius[t] = max_radius;
+            }
+        });
+
+        // build the grid of visible points
+        auto grid_bbox = BBox();
+        auto max_radius = 0.0f;
+        for( auto t = 0u ; t < tile_cnt ; ++t ){
+            if( tile_max_radius[t] <= 0.0f )
+                continue;
+            grid_bbox.Union( tile_bboxes[t] );
+            max_radius = std::max( max_radius , tile_max_radius[t] );
+        }
+        if( max_radius <= 0.0f )
+            continue;
+
+        m_grid.Reset( grid_bbox , max_radius , pixel_cnt );
+        parallelFor( tile_cnt , 1 , [&]( unsigned begin , unsigned end ){
+            for( auto t = begin ; t < end ; ++t ){
+                for_each_pixel_in_tile( t , [&]( SPPM_Pixel& pixel , int x , int y ){
+                    if( IS_PTR_VALID( pixel.se ) )
+                        m_grid.Insert( &pixel , *tile_contexts[t] );
+                });
+            }
+        });
+
+        // trace photons, each task has its own render context so that it won't race with others
+        const auto photon_seed = sort_rand<unsigned>(rc);
+        parallelFor( m_photonsPerPass , SPPM_PHOTONS_PER_TASK , [&]( unsigned begin , unsigned end ){
+            auto task_rc = std::make_unique<RenderContext>();
+            task_rc->Init();
+            task_rc->m_random_num_generator->Seed( photon_seed + begin );
+
+            for( auto i = begin ; i < end ; ++i ){
+                task_rc->Reset();
+                _TracePhoton( scene , *task_rc );
+            }
+        });
+
+        // update statistics of all pixels, the radius shrinks as only part of the new photons is kept
+        parallelFor( tile_cnt , 1 , [&]( unsigned begin , unsigned end ){
+            for( auto t = begin ; t < end ; ++t ){
+                for_each_pixel_in_tile( t , [&]( SPPM_Pixel& pixel , int x , int y ){
+                    const auto m = pixel.m.load( std::memory_order_relaxed );
+                    if( m > 0 ){
+                        const auto n = pixel.photon_cnt + SPPM_ALPHA * m;
+                        const auto radius = pixel.radius * sqrt( n / ( pixel.photon_cnt + m ) );
+                        const auto phi = Spectrum( pixel.phi[0].load( std::memory_order_relaxed ) ,
+                                                   pixel.phi[1].load( std::memory_order_relaxed ) ,
+                                                   pixel.phi[2].load( std::memory_order_relaxed ) );
+                        pixel.tau = ( pixel.tau + pixel.beta * phi ) * ( radius * radius ) / ( pixel.radius * pixel.radius );
+                        pixel.photon_cnt = n;
+                        pixel.radius = radius;
+                    }
+
+                    for( auto& phi : pixel.phi )
+                        phi.store( 0.0f , std::memory_order_relaxed );
+                    pixel.m.store( 0 , std::memory_order_relaxed );
+                    pixel.se = nullptr;
+                });
+            }
+        });
+    }
+
+    // the flux gathered is divided by the number of all photons traced and the area of the gathering disk
+    m_radiance = std::make_unique<Spectrum[]>( pixel_cnt );
+    const auto photon_cnt = (float)m_photonsPerPass * m_passCnt;
+    for( auto i = 0u ; i < pixel_cnt ; ++i ){
+        const auto& pixel = pixels[i];
+        m_radiance[i] = pixel.ld / (float)m_passCnt;
+        if( pixel.radius > 0.0f && photon_cnt > 0.0f )
+            m_radiance[i] += pixel.tau / ( photon_cnt * PI * pixel.radius * pixel.radius );
+    }
+
+    m_grid.Reset( BBox() , 0.0f , 0 );
+}
+
+Spectrum StochasticProgressivePhotonMapping::Li( const Ray& ray , const PixelSample& ps , const Scene& scene , RenderContext& rc ) const{
+    if( !m_radiance || ps.pixel_x < 0 || ps.pixel_x >= m_width || ps.pixel_y < 0 || ps.pixel_y >= m_height )
+        return 0.0f;
+    return m_radiance[ps.pixel_y * m_width + ps.pixel_x];
+}
+
+void StochasticProgressivePhotonMapping::_TraceVisiblePoints( std::vector<SPPM_EyePath>& paths , const Scene& scene , RenderContext& rc ) const{
+    ShadingBatch batch;
+    std::vector<SPPM_EyePath> hits;
+    for( auto depth = 0 ; depth <= max_recursive_depth && !paths.empty() ; ++depth ){
+        // intersect all paths first, shading is deferred so that materials are evaluated over their shading points back to back
+        hits.clear();
+        for( auto& path : paths ){
+            // the scattering event keeps a reference of the interaction, both of them need to live until the pass is done
+            auto inter = SORT_MALLOC(rc.m_memory_arena, SurfaceInteraction)();
+            if( !scene.GetIntersect( rc , path.ray , *inter ) ){
+                path.pixel->ld += path.beta * scene.Le( path.ray );
+                continue;
+            }
+
+            // emission is only counted on the first hit and after near specular bounces, direct illumination covers the rest
+            path.pixel->ld += path.beta * inter->Le( -path.ray.m_Dir );
+
+            path.inter = inter;
+            path.se = SORT_MALLOC(rc.m_memory_arena, ScatteringEvent)( *inter , SE_EVALUATE_ALL_NO_SSS );
+            batch.Add( inter->primitive->GetMaterial() , *path.se );
+            hits.push_back( path );
+        }
+        batch.Execute( rc );
+
+        paths.clear();
+        for( auto& path : hits ){
+            auto& pixel = *path.pixel;
+            const auto& inter = *path.inter;
+            const auto& se = *path.se;
+
+            // whether a visible point is created is decided by the surface itself, deciding it per sampled direction would
+            // bias the estimator since the two branches are not weighted by the probability of taking them.
+            const auto wo = -path.ray.m_Dir;
+            if( se.GetRoughness() < SPPM_SPECULAR_ROUGHNESS && depth < max_recursive_depth ){
+                Vector wi;
+                auto pdf = 0.0f;
+                const auto f = se.Sample_BSDF( wo , wi , BsdfSample(rc) , pdf , rc );
+                if( f.IsBlack() || pdf == 0.0f )
+                    continue;
+                path.beta *= f / pdf;
+                path.ray = Ray( inter.intersect , wi , 0 , 0.001f );
+                paths.push_back( path );
+                continue;
+            }
+
+            // direct illumination is evaluated at visible points, photons only account for indirect illumination
+            auto light_pdf = 0.0f;
+            const auto light = scene.SampleLight( sort_rand<float>(rc) , &light_pdf );
+            if( IS_PTR_VALID( light ) && light_pdf > 0.0f )
+                pixel.ld += path.beta * EvaluateDirect( se , path.ray , scene , light , LightSample(rc) , BsdfSample(rc) , rc ) / light_pdf;
+
+            pixel.p = inter.intersect;
+            pixel.n = inter.normal;
+            pixel.wo = wo;
+            pixel.beta = path.beta;
+            pixel.se = &se;
+            SORT_STATS(++sVisiblePoints);
+        }
+    }
+}
+
+void StochasticProgressivePhotonMapping::_TracePhoton( const Scene& scene , RenderContext& rc ) const{
+    SORT_STATS(++sTracedPhotons);
+
+    auto light_pick_pdf = 0.0f;
+    const auto light = scene.SampleLight( sort_rand<float>(rc) , &light_pick_pdf );
+    if( IS_PTR_INVALID( light ) || light_pick_pdf == 0.0f )
+        return;
+
+    Ray     ray;
+    auto    emission_pdf = 0.0f;
+    auto    pdfa = 0.0f;
+    auto    cosAtLight = 1.0f;
+    const auto le = light->sample_l( rc , LightSample(rc) , ray , &emission_pdf , &pdfa , &cosAtLight );
+    if( emission_pdf == 0.0f )
+        return;
+
+    auto beta = le * cosAtLight / ( emission_pdf * light_pick_pdf );
+    for( auto depth = 0 ; depth < max_recursive_depth && !beta.IsBlack() ; ++depth ){
+        SurfaceInteraction inter;
+        if( !scene.GetIntersect( rc , ray , inter ) )
+            return;
+
+        const auto wi = -ray.m_Dir;
+
+        // photons arriving directly from lights are already accounted for by the direct illumination
+        if( depth > 0 ){
+            m_grid.Query( inter.intersect , [&]( SPPM_Pixel& pixel ){
+                if( ( pixel.p - inter.intersect ).SquaredLength() > pixel.radius * pixel.radius )
+                    return;
+
+                // the cosine factor at the visible point is already taken into account by the density of photons
+                const auto cosAtVisiblePoint = absDot( pixel.n , wi );
+                if( cosAtVisiblePoint == 0.0f )
+                    return;
+                const auto phi = beta * pixel.se->Evaluate_BSDF( pixel.wo , wi ) / cosAtVisiblePoint;
+                if( phi.IsBlack() )
+                    return;
+
+                for( auto k = 0 ; k < 3 ; ++k )
+                    atomicAdd( pixel.phi[k] , phi[k] );
+                pixel.m.fetch_add( 1 , std::memory_order_relaxed );
+                SORT_STATS(++sGatheredPhotons);
+            });
+        }
+
+        ScatteringEvent se( inter , SE_EVALUATE_ALL_NO_SSS );
+        inter.primitive->GetMaterial()->UpdateScatteringEvent( se , rc );
+
+        Vector wo;
+        auto pdf = 0.0f;
+        const auto f = se.Sample_BSDF( wi , wo , BsdfSample(rc) , pdf , rc );
+        if( pdf == 0.0f )
+            return;
+
+        // russian roulette keeps the flux of surviving photons roughly the same
+        const auto new_beta = beta * f / pdf;
+        const auto q = std::max( 0.0f , 1.0f - new_beta.GetIntensity() / beta.GetIntensity() );
+        if( sort_rand<float>(rc) < q )
+            return;
+        beta = new_beta / ( 1.0f - q );
+
+        ray = Ray( inter.intersect , wo , 0 , 0.001f );
+    }
+}
@@ -0,0 +1,177 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+
+    Copyright (c) 2011-2023 by Jiayin Cao - All rights reserved.
+
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "integrator.h"
+#include "math/bbox.h"
+
+class ScatteringEvent;
+struct SurfaceInteraction;
+
+//! @brief  Statistics of a pixel in stochastic progressive photon mapping.
+struct SPPM_Pixel{
+    float                   radius = 0.0f;      // radius of photon gathering
+    float                   photon_cnt = 0.0f;  // number of photons kept in the pixel statistics, N in the paper
+    Spectrum                tau;                // unnormalized flux gathered so far, scaled to the current radius
+    Spectrum                ld;                 // direct illumination accumulated over all passes
+
+    // the visible point of the current pass, there is no visible point if the scattering event is 'nullptr'
+    Point                   p;                  // position of the visible point
+    Vector                  n;                  // normal at the visible point
+    Vector                  wo;                 // the direction pointing to the camera
+    Spectrum                beta;               // throughput from the camera to the visible point
+    const ScatteringEvent*  se = nullptr;       // the scattering event at the visible point
+
+    // photons gathered in the current pass, they are updated concurrently by all photon tasks
+    std::atomic<float>      phi[3];             // flux of photons gathered in the current pass
+    std::atomic<unsigned>   m;                  // number of photons gathered in the current pass
+};
+
+//! @brief  An eye path being traced to the visible point of its pixel.
+struct SPPM_EyePath{
+    SPPM_Pixel*             pixel = nullptr;    // the pixel the eye path starts from
+    Ray                     ray;                // the ray of the current bounce
+    Spectrum                beta = 1.0f;        // throughput from the camera
+    SurfaceInteraction*     inter = nullptr;    // the interaction of the current bounce
+    ScatteringEvent*        se = nullptr;       // the scattering event of the current bounce
+};
+
+//! @brief  Hash grid of visible points.
+/**
+ * Visible points are inserted in all cells overlapping with their gathering spheres, so that a photon only needs to
+ * look at the cell it falls in. Each cell is as large as the diameter of the largest sphere, a sphere overlaps eight
+ * cells at most. Cells are hashed to a table of buckets, each bucket is a linked list of visible points. Nodes of the
+ * lists are pushed through compare-and-swap so that all tasks could insert visible points concurrently without a lock.
+ */
+class VisiblePointGrid{
+public:
+    //! @brief  Clear the grid and set up the cells.
+    //!
+    //! @param  bbox        Bounding box of all gathering spheres.
+    //! @param  max_radius  The largest radius of the gathering spheres.
+    //! @param  bucket_cnt  Number of buckets in the table.
+    void    Reset( const BBox& bbox , float max_radius , unsigned bucket_cnt );
+
+    //! @brief  Insert the visible point of a pixel.
+    //!
+    //! This could be called from multiple threads at the same time.
+    //!
+    //! @param  pixel       The pixel with a valid visible point.
+    //! @param  rc          The render context to allocate nodes from, the memory needs to be alive until the grid is reset.
+    void    Insert( SPPM_Pixel* pixel , RenderContext& rc );
+
+    //! @brief  Visit all pixels whose visible points may gather a photon.
+    //!
+    //! Pixels are visited at most once, but they are not necessarily within the radius of the point.
+    //!
+    //! @param  p           Position of the photon.
+    //! @param  visit       The function to call for each pixel.
+    template<class T>
+    void    Query( const Point& p , T visit ) const;
+
+private:
+    //! @brief  Node of the linked list in a bucket.
+    struct Node{
+        SPPM_Pixel*     pixel = nullptr;    // the pixel of the visible point
+        Node*           next = nullptr;     // the next node in the bucket
+    };
+
+    std::unique_ptr<std::atomic<Node*>[]>   m_buckets;              /**< Heads of the lists in all buckets. */
+    unsigned                                m_bucket_cnt = 0;       /**< Number of buckets. */
+    BBox                                    m_bbox;                 /**< Bounding box of all gathering spheres. */
+    float                                   m_inv_cell_size = 0.0f; /**< Inverse of the size of cells. */
+
+    //! @brief  Get the bucket of a cell.
+    SORT_FORCEINLINE unsigned getBucket( int x , int y , int z ) const {
+        return ( ( (unsigned)x * 73856093u ) ^ ( (unsigned)y * 19349663u ) ^ ( (unsigned)z * 83492791u ) ) % m_bucket_cnt;
+    }
+};
+
+template<class T>
+void VisiblePointGrid::Query( const Point& p , T visit ) const{
+    if( 0 == m_bucket_cnt || !m_bbox.IsInBBox( p , 0.0f ) )
+        return;
+
+    const auto d = ( p - m_bbox.m_Min ) * m_inv_cell_size;
+    const auto bucket = getBucket( (int)d.x , (int)d.y , (int)d.z );
+    for( auto node = m_buckets[bucket].load( std::memory_order_acquire ) ; node ; node = node->next )
+        visit( *node->pixel );
+}
+
+//! @brief  Stochastic progressive photon mapping integrator.
+/**
+ * Stochastic progressive photon mapping is consistent and handles caustics much better than unbiased algorithms,
+ * like the light paths reflected by water or refracted by gems. Each pass traces a visible point for every pixel
+ * first, the eye path goes through near specular surfaces until it reaches a rough one, then photons are traced from
+ * lights and gathered by all visible points nearby. The gathering radius of each pixel shrinks over passes so that
+ * the bias vanishes in the limit.
+ * There is no progressive rendering loop in the renderer, all passes are done in the pre-process step and the
+ * radiance of each pixel is simply returned during rendering.
+ * Please refer to the paper 'Stochastic Progressive Photon Mapping' by Toshiya Hachisuka and Henrik Wann Jensen for
+ * further details.
+ */
+class StochasticProgressivePhotonMapping : public Integrator{
+public:
+    DEFINE_RTTI( StochasticProgressivePhotonMapping , Integrator );
+
+    //! @brief  Evaluate the radiance along a specific direction.
+    //!
+    //! @param  ray             The ray to be tested with.
+    //! @param  ps              Pixel sample used to evaluate Monte Carlo method.
+    //! @param  scene           The scene to be evaluated.
+    //! @return                 The radiance of the pixel that the sample belongs to.
+    Spectrum    Li( const Ray& ray , const PixelSample& ps , const Scene& scene, RenderContext& rc) const override;
+
+    //! @brief  Run all passes of photon mapping.
+    //!
+    //! @param  scene           The scene to be evaluated.
+    //! @param  rc              The render context.
+    void        PreProcess( const Scene& scene , RenderContext& rc ) override;
+
+    //! @brief      Serializing data from stream
+    //!
+    //! @param      Stream where the serialization data comes from. Depending on different situation, it could come from different places.
+    void    Serialize( IStreamBase& stream ) override {
+        Integrator::Serialize( stream );
+        stream >> m_passCnt;
+        stream >> m_photonsPerPass;
+        stream >> m_radiusFactor;
+    }
+
+private:
+    unsigned    m_passCnt = 64;                 // number of passes
+    unsigned    m_photonsPerPass = 1000000;     // number of photons traced in each pass
+    float       m_radiusFactor = 0.005f;        // initial radius of gathering, relative to the radius of the scene
+
+    std::unique_ptr<Spectrum[]>     m_radiance;         // radiance of all pixels
+    int                             m_width = 0;        // width of the image
+    int                             m_height = 0;       // height of the image
+    VisiblePointGrid                m_grid;             // hash grid of visible points in the current pass
+
+    // trace the visible points of eye paths, all paths advance one bounce at a time so that shading is batched
+    void        _TraceVisiblePoints( std::vector<SPPM_EyePath>& paths , const Scene& scene , RenderContext& rc ) const;
+
+    // trace a photon and let visible points nearby gather it
+    void        _TracePhoton( const Scene& scene , RenderContext& rc ) const;
+
+    SORT_STATS_ENABLE( "Stochastic Progressive Photon Mapping" )
+};
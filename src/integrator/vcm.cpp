@@ -0,0 +1,212 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+
+    Copyright (c) 2011-2023 by Jiayin Cao - All rights reserved.
+
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+
+#include <marl/defer.h>
+#include <marl/scheduler.h>
+#include <marl/waitgroup.h>
+#include "vcm.h"
+#include "core/scene.h"
+#include "core/memory.h"
+#include "camera/camera.h"
+#include "light/light.h"
+
+SORT_STATS_DEFINE_COUNTER(sStoredLightVertices)
+SORT_STATS_DEFINE_COUNTER(sMergedLightVertices)
+SORT_STATS_DECLARE_COUNTER(sPrimaryRayCount)
+
+SORT_STATS_COUNTER("Vertex Connection and Merging", "Primary Ray Count" , sPrimaryRayCount);
+SORT_STATS_COUNTER("Vertex Connection and Merging", "Light Vertices for Merging" , sStoredLightVertices);
+SORT_STATS_AVG_COUNT("Vertex Connection and Merging", "Average Merged Light Vertices", sMergedLightVertices , sPrimaryRayCount);
+
+// Number of light paths traced in each task.
+static constexpr unsigned   VCM_LIGHT_PATHS_PER_TASK = 4096;
+
+// Number of vertices processed in each task when building the grid.
+static constexpr unsigned   VCM_GRID_VERTICES_PER_TASK = 64 * 1024;
+
+// The radius of merging shrinks across passes, the same as progressive photon mapping.
+static constexpr float      VCM_RADIUS_ALPHA = 0.75f;
+
+// Split a range into batches and process them in parallel if there is a scheduler.
+template<class T>
+static void parallelFor( unsigned cnt , unsigned batch , T func ){
+    if( !marl::Scheduler::get() ){
+        func( 0u , cnt );
+        return;
+    }
+
+    marl::WaitGroup done;
+    for( auto begin = 0u ; begin < cnt ; begin += batch ){
+        done.add();
+        marl::schedule([&, done, begin]() {
+            defer(done.done());
+            func( begin , std::min( begin + batch , cnt ) );
+        });
+    }
+    done.wait();
+}
+
+void LightVertexGrid::Build( const std::vector<VCM_LightVertex>& vertices , float radius ){
+    m_vertices = &vertices;
+    m_radius_sqr = radius * radius;
+    m_inv_cell_size = 0.5f / radius;
+
+    const auto cnt = (unsigned)vertices.size();
+    m_indices.resize( cnt );
+    m_bucket_ends.assign( std::max( cnt , 1u ) , 0 );
+    if( 0 == cnt )
+        return;
+
+    m_bbox = BBox();
+    for( const auto& vertex : vertices )
+        m_bbox.Union( vertex.p );
+
+    // count the vertices falling in each bucket
+    std::vector<std::atomic<unsigned>> cursors( m_bucket_ends.size() );
+    for( auto& cursor : cursors )
+        cursor.store( 0 , std::memory_order_relaxed );
+    parallelFor( cnt , VCM_GRID_VERTICES_PER_TASK , [&]( unsigned begin , unsigned end ){
+        for( auto i = begin ; i < end ; ++i )
+            cursors[getBucket( vertices[i].p )].fetch_add( 1 , std::memory_order_relaxed );
+    });
+
+    // the cursor of each bucket starts from the end of the previous bucket
+    auto sum = 0u;
+    for( auto i = 0u ; i < (unsigned)cursors.size() ; ++i ){
+        const auto bucket_cnt = cursors[i].load( std::memory_order_relaxed );
+        cursors[i].store( sum , std::memory_order_relaxed );
+        sum += bucket_cnt;
+        m_bucket_ends[i] = sum;
+    }
+
+    // scatter the vertices to their buckets
+    parallelFor( cnt , VCM_GRID_VERTICES_PER_TASK , [&]( unsigned begin , unsigned end ){
+        for( auto i = begin ; i < end ; ++i )
+            m_indices[cursors[getBucket( vertices[i].p )].fetch_add( 1 , std::memory_order_relaxed )] = i;
+    });
+}
+
+void VertexConnectionMerging::PreProcess( const Scene& scene , RenderContext& rc ){
+    SORT_PROFILE("Vertex Connection and Merging (light path stage)");
+
+    m_passes.clear();
+
+    const auto camera = scene.GetCamera();
+    if( IS_PTR_INVALID( camera ) || 0 == m_passCnt )
+        return;
+
+    // each pass traces as many light paths as pixels, the same as light tracing in one sample per pixel
+    const auto resolution = camera->GetImageResolution();
+    const auto light_path_cnt = (unsigned)( resolution.x * resolution.y );
+    const auto task_cnt = ( light_path_cnt + VCM_LIGHT_PATHS_PER_TASK - 1 ) / VCM_LIGHT_PATHS_PER_TASK;
+
+    const auto& bbox = scene.GetBBox();
+    const auto scene_radius = ( bbox.m_Max - bbox.m_Min ).Length() * 0.5f;
+
+    for( auto k = 0u ; k < m_passCnt ; ++k ){
+        auto pass = std::make_unique<MergePass>();
+
+        const auto radius = m_radiusFactor * scene_radius * pow( (float)( k + 1 ) , ( VCM_RADIUS_ALPHA - 1.0f ) * 0.5f );
+        const auto eta = PI * radius * radius * light_path_cnt;
+        pass->factors.vm_weight = MIS( eta );
+        pass->factors.vc_weight = MIS( 1.0f / eta );
+        pass->normalization = 1.0f / eta;
+
+        // tasks would trace the very same light paths if their generators were seeded the same way
+        const auto seed = sort_rand<unsigned>(rc);
+
+        std::vector<std::vector<VCM_LightVertex>> task_vertices( task_cnt );
+        parallelFor( light_path_cnt , VCM_LIGHT_PATHS_PER_TASK , [&]( unsigned begin , unsigned end ){
+            auto task_rc = std::make_unique<RenderContext>();
+            task_rc->Init();
+            task_rc->m_random_num_generator->Seed( seed + begin );
+
+            std::vector<BDPT_Vertex> light_path;
+            auto& vertices = task_vertices[begin / VCM_LIGHT_PATHS_PER_TASK];
+            for( auto i = begin ; i < end ; ++i ){
+                // scattering events of the light path are not needed once the path is stored
+                task_rc->Reset();
+
+                float pdf = 0.0f;
+                const auto light = scene.SampleLight( sort_rand<float>(*task_rc) , &pdf );
+                if( IS_PTR_INVALID( light ) || pdf == 0.0f )
+                    continue;
+
+                light_path.clear();
+                _TraceLightPath( light , pdf , scene , pass->factors , false , light_path , *task_rc );
+
+                for( const auto& vert : light_path ){
+                    VCM_LightVertex light_vertex;
+                    light_vertex.p = vert.p;
+                    light_vertex.wi = vert.wi;
+                    light_vertex.throughput = vert.throughput;
+                    light_vertex.vc = vert.vc;
+                    light_vertex.vcm = vert.vcm;
+                    light_vertex.vm = vert.vm;
+                    light_vertex.depth = vert.depth;
+                    vertices.push_back( light_vertex );
+                }
+            }
+        });
+
+        for( auto& vertices : task_vertices )
+            pass->vertices.insert( pass->vertices.end() , vertices.begin() , vertices.end() );
+        SORT_STATS(sStoredLightVertices += pass->vertices.size());
+
+        pass->grid.Build( pass->vertices , radius );
+        m_passes.push_back( std::move( pass ) );
+    }
+}
+
+Spectrum VertexConnectionMerging::Li( const Ray& ray , const PixelSample& ps , const Scene& scene , RenderContext& rc ) const{
+    if( m_passes.empty() )
+        return BidirPathTracing::Li( ray , ps , scene , rc );
+
+    // picking a pass randomly for each eye path converges to the average of all passes
+    const auto k = std::min( (unsigned)( sort_rand<float>(rc) * m_passes.size() ) , (unsigned)m_passes.size() - 1 );
+    const auto& pass = *m_passes[k];
+    return _Li( ray , scene , pass.factors , [&]( const BDPT_Vertex& eye_vertex ){ return _Merge( pass , eye_vertex ); } , rc );
+}
+
+Spectrum VertexConnectionMerging::_Merge( const MergePass& pass , const BDPT_Vertex& eye_vertex ) const{
+    Spectrum radiance;
+    pass.grid.Query( eye_vertex.p , [&]( const VCM_LightVertex& light_vertex ){
+        if( light_vertex.depth + eye_vertex.depth > max_recursive_depth )
+            return;
+
+        // the cosine factor at the merged vertex is already taken into account by the light vertex
+        const auto cosAtEyeVertex = absDot( eye_vertex.n , light_vertex.wi );
+        if( cosAtEyeVertex == 0.0f )
+            return;
+        float eye_bsdf_pdfw , eye_bsdf_rev_pdfw;
+        const auto bsdf_value = eye_vertex.se->Evaluate_BSDF_Pdf( eye_vertex.wi , light_vertex.wi , eye_bsdf_pdfw , &eye_bsdf_rev_pdfw ) / cosAtEyeVertex;
+        if( bsdf_value.IsBlack() )
+            return;
+
+        eye_bsdf_pdfw *= eye_vertex.rr;
+        eye_bsdf_rev_pdfw *= eye_vertex.rr;
+
+        const double mis_light = light_vertex.vcm * pass.factors.vc_weight + light_vertex.vm * MIS( eye_bsdf_pdfw );
+        const double mis_eye = eye_vertex.vcm * pass.factors.vc_weight + eye_vertex.vm * MIS( eye_bsdf_rev_pdfw );
+        const auto weight = (float)( 1.0f / ( mis_light + 1.0f + mis_eye ) );
+
+        radiance += bsdf_value * light_vertex.throughput * weight;
+        SORT_STATS(++sMergedLightVertices);
+    });
+    return radiance * eye_vertex.throughput * pass.normalization;
+}
@@ -0,0 +1,165 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+
+    Copyright (c) 2011-2023 by Jiayin Cao - All rights reserved.
+
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+#include "bidirpath.h"
+#include "math/bbox.h"
+
+//! @brief  A vertex of light paths stored for vertex merging.
+struct VCM_LightVertex{
+    Point       p;                  // the position of the vertex
+    Vector      wi;                 // the direction pointing to the previous vertex of the light path
+    Spectrum    throughput;         // through put of the light path up to the vertex
+    double      vc = 0.0f;          // MIS factors
+    double      vcm = 0.0f;
+    double      vm = 0.0f;
+    int         depth = 0;          // depth of the vertex
+};
+
+//! @brief  Spatial hash grid of light vertices for range queries of a fixed radius.
+/**
+ * Each cell is twice as large as the radius so that a query only needs to visit the eight cells closest to the point.
+ * Vertices are sorted by cells through counting sort, both the counting and scattering are done in parallel with
+ * atomics. There is no cell storage, cells are hashed to a table of buckets, which could be shared by different cells.
+ */
+class LightVertexGrid{
+public:
+    //! @brief  Build the grid.
+    //!
+    //! @param  vertices    The light vertices, the grid keeps a pointer to them.
+    //! @param  radius      Radius of the queries.
+    void    Build( const std::vector<VCM_LightVertex>& vertices , float radius );
+
+    //! @brief  Visit all vertices within the radius of a point.
+    //!
+    //! @param  p           The point to search around.
+    //! @param  visit       The function to call for each vertex in range.
+    template<class T>
+    void    Query( const Point& p , T visit ) const;
+
+private:
+    const std::vector<VCM_LightVertex>*     m_vertices = nullptr;   /**< Light vertices in the grid. */
+    std::vector<unsigned>                   m_indices;              /**< Indices of vertices sorted by buckets. */
+    std::vector<unsigned>                   m_bucket_ends;          /**< End of each bucket in the sorted indices. */
+    BBox                                    m_bbox;                 /**< Bounding box of all vertices. */
+    float                                   m_radius_sqr = 0.0f;    /**< Square of the radius. */
+    float                                   m_inv_cell_size = 0.0f; /**< Inverse of the size of cells. */
+
+    //! @brief  Get the bucket of a cell.
+    SORT_FORCEINLINE unsigned getBucket( int x , int y , int z ) const {
+        return ( ( (unsigned)x * 73856093u ) ^ ( (unsigned)y * 19349663u ) ^ ( (unsigned)z * 83492791u ) ) % (unsigned)m_bucket_ends.size();
+    }
+
+    //! @brief  Get the bucket of a point.
+    SORT_FORCEINLINE unsigned getBucket( const Point& p ) const {
+        const auto d = ( p - m_bbox.m_Min ) * m_inv_cell_size;
+        return getBucket( (int)floor( d.x ) , (int)floor( d.y ) , (int)floor( d.z ) );
+    }
+};
+
+template<class T>
+void LightVertexGrid::Query( const Point& p , T visit ) const{
+    if( m_indices.empty() )
+        return;
+
+    const auto d = ( p - m_bbox.m_Min ) * m_inv_cell_size;
+    const int c[3] = { (int)floor( d.x ) , (int)floor( d.y ) , (int)floor( d.z ) };
+
+    // the neighbour cell along each axis is on the side closer to the point
+    int o[3];
+    for( auto i = 0 ; i < 3 ; ++i )
+        o[i] = ( d[i] - c[i] < 0.5f ) ? c[i] - 1 : c[i] + 1;
+
+    unsigned visited[8];
+    for( auto j = 0 ; j < 8 ; ++j ){
+        const auto bucket = getBucket( ( j & 1 ) ? o[0] : c[0] , ( j & 2 ) ? o[1] : c[1] , ( j & 4 ) ? o[2] : c[2] );
+
+        // different cells could share the same bucket, which should be visited only once
+        visited[j] = bucket;
+        if( std::find( visited , visited + j , bucket ) != visited + j )
+            continue;
+
+        const auto begin = bucket == 0 ? 0u : m_bucket_ends[bucket - 1];
+        const auto end = m_bucket_ends[bucket];
+        for( auto i = begin ; i < end ; ++i ){
+            const auto& vertex = (*m_vertices)[m_indices[i]];
+            if( ( vertex.p - p ).SquaredLength() <= m_radius_sqr )
+                visit( vertex );
+        }
+    }
+}
+
+//! @brief  Vertex connection and merging integrator.
+/**
+ * Vertex connection and merging combines bi-directional path tracing and progressive photon mapping through multiple
+ * importance sampling. On top of all connections done in bi-directional path tracing, eye vertices are also merged with
+ * light vertices nearby, which is way more efficient in capturing caustics paths, like the ones seen through glass.
+ * Light paths for merging are traced in a few passes before rendering, each pass traces as many light paths as pixels
+ * with a shrinking radius. Each eye path merges with the light vertices of one pass picked randomly.
+ * Please refer to the paper 'Light Transport Simulation with Vertex Connection and Merging' by Iliyan Georgiev, Jaroslav
+ * Krivanek, Tomas Davidovic and Philipp Slusallek for further details.
+ */
+class VertexConnectionMerging : public BidirPathTracing{
+public:
+    DEFINE_RTTI( VertexConnectionMerging , Integrator );
+
+    //! @brief  Evaluate the radiance along a specific direction.
+    //!
+    //! @param  ray             The ray to be tested with.
+    //! @param  ps              Pixel sample used to evaluate Monte Carlo method.
+    //! @param  scene           The scene to be evaluated.
+    //! @return                 The radiance along the opposite direction that the ray points to.
+    Spectrum    Li( const Ray& ray , const PixelSample& ps , const Scene& scene, RenderContext& rc) const override;
+
+    //! @brief  Trace light paths for vertex merging.
+    //!
+    //! @param  scene           The scene to be evaluated.
+    //! @param  rc              The render context.
+    void        PreProcess( const Scene& scene , RenderContext& rc ) override;
+
+    //! @brief      Serializing data from stream
+    //!
+    //! @param      Stream where the serialization data comes from. Depending on different situation, it could come from different places.
+    void    Serialize( IStreamBase& stream ) override {
+        BidirPathTracing::Serialize( stream );
+        stream >> m_passCnt;
+        stream >> m_radiusFactor;
+    }
+
+private:
+    //! @brief  Light vertices traced in a pass.
+    struct MergePass{
+        std::vector<VCM_LightVertex>    vertices;           // light vertices of the pass
+        LightVertexGrid                 grid;               // hash grid of the light vertices
+        BDPT_MergeFactors               factors;            // MIS factors of the pass
+        float                           normalization;      // normalization of the density estimation, 1 / ( pi * r^2 * N )
+    };
+
+    unsigned    m_passCnt = 4;              // number of passes of light paths for merging
+    float       m_radiusFactor = 0.003f;    // initial radius of merging, relative to the radius of the scene
+    std::vector<std::unique_ptr<MergePass>> m_passes;   // light vertices of all passes
+
+    // merge an eye vertex with light vertices of a pass
+    Spectrum    _Merge( const MergePass& pass , const BDPT_Vertex& eye_vertex ) const;
+
+    SORT_STATS_ENABLE( "Vertex Connection and Merging" )
+};
@@ -79,6 +79,25 @@ Spectrum AreaLight::Power() const{
     return m_shape->SurfaceArea() * intensity.GetIntensity() * TWO_PI;
 }
 
+bool AreaLight::GetBounds( LightBounds& bounds ) const{
+    sAssert(IS_PTR_VALID(m_shape), LIGHT );
+
+    bounds.bbox = m_shape->GetBBox();
+    bounds.phi = Power().GetIntensity();
+    bounds.two_sided = false;
+
+    // Flat shapes emit in the hemisphere around their normal, the rest of them could emit in any direction.
+    Vector normal;
+    if( m_shape->GetNormalBound( normal ) ){
+        bounds.w = normal;
+        bounds.cos_theta_o = 1.0f;
+    }else{
+        bounds.cos_theta_o = -1.0f;
+    }
+    bounds.cos_theta_e = 0.0f;
+    return true;
+}
+
 Spectrum AreaLight::Le( const SurfaceInteraction& intersect , const Vector& wo , float* directPdfA , float* emissionPdf ) const{
     const float cos = satDot( wo , intersect.normal );
     if( cos == 0.0f )
@@ -102,6 +102,12 @@ public:
     //! @return         The pdf w.r.t solid angle if the ray starting from 'p', tracing through 'wi' hits the light source.
     float Pdf( const Point& p , const Vector& wi ) const override;
 
+    //! @brief  Get the spatial and directional bounds of the light.
+    //!
+    //! @param  bounds  The bounds of the light.
+    //! @return         Always true for area light.
+    bool GetBounds( LightBounds& bounds ) const override;
+
     //! @brief  Get the shape of the area light.
     //!
     //! @return     It usually returns a valid shape for area light.
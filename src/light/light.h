@@ -20,6 +20,7 @@
 #include "spectrum/spectrum.h"
 #include "math/transform.h"
 #include "core/scene.h"
+#include "light/light_bvh.h"
 #include "math/vector3.h"
 
 struct SurfaceInteraction;
@@ -102,6 +103,16 @@ public:
         return false;
     }
 
+    //! @brief  Get the spatial and directional bounds of the light.
+    //!
+    //! Infinite lights have no bounds and they are not supposed to implement this.
+    //!
+    //! @param  bounds  The bounds of the light.
+    //! @return         Whether the light is bounded.
+    virtual bool        GetBounds( LightBounds& bounds ) const {
+        return false;
+    }
+
     //! @brief  Get the shape of light, if there is one.
     //!
     //! Some light source has shape attached to it, like area light.
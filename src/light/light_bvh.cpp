@@ -0,0 +1,382 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+
+    Copyright (c) 2011-2023 by Jiayin Cao - All rights reserved.
+
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+
+#include <algorithm>
+#include "light_bvh.h"
+#include "light.h"
+#include "math/utils.h"
+#include "core/sassert.h"
+#include "core/stats.h"
+
+SORT_STATS_DEFINE_COUNTER(sLightBVHNodeCount)
+SORT_STATS_DEFINE_COUNTER(sLightBVHDepth)
+
+SORT_STATS_COUNTER("Light BVH", "Node Count", sLightBVHNodeCount);
+SORT_STATS_COUNTER("Light BVH", "Depth", sLightBVHDepth);
+
+// Number of buckets evaluated along each axis when splitting a node.
+static constexpr unsigned   LIGHT_BVH_SPLIT_COUNT = 12;
+
+// Bit trails are 64 bits, which limits the depth of the tree.
+static constexpr unsigned   LIGHT_BVH_MAX_DEPTH = 64;
+
+SORT_STATIC_FORCEINLINE float safeSqrt( float x ){
+    return std::sqrt( std::max( 0.0f , x ) );
+}
+
+SORT_STATIC_FORCEINLINE float safeAcos( float x ){
+    return std::acos( clamp( x , -1.0f , 1.0f ) );
+}
+
+// cos( max( 0 , a - b ) )
+SORT_STATIC_FORCEINLINE float cosSubClamped( float sin_a , float cos_a , float sin_b , float cos_b ){
+    if( cos_a > cos_b )
+        return 1.0f;
+    return cos_a * cos_b + sin_a * sin_b;
+}
+
+// sin( max( 0 , a - b ) )
+SORT_STATIC_FORCEINLINE float sinSubClamped( float sin_a , float cos_a , float sin_b , float cos_b ){
+    if( cos_a > cos_b )
+        return 0.0f;
+    return sin_a * cos_b - cos_a * sin_b;
+}
+
+// Union of two direction cones, the result is the smallest cone containing both of them.
+static void unionCone( const Vector& wa , float cos_a , const Vector& wb , float cos_b , Vector& w , float& cos_theta ){
+    const auto theta_a = safeAcos( cos_a );
+    const auto theta_b = safeAcos( cos_b );
+    const auto theta_d = safeAcos( dot( wa , wb ) );
+
+    // one of the cones contains the other one
+    if( std::min( theta_d + theta_b , PI ) <= theta_a ){
+        w = wa;
+        cos_theta = cos_a;
+        return;
+    }
+    if( std::min( theta_d + theta_a , PI ) <= theta_b ){
+        w = wb;
+        cos_theta = cos_b;
+        return;
+    }
+
+    const auto theta_o = ( theta_a + theta_d + theta_b ) * 0.5f;
+    const auto axis = cross( wa , wb );
+    if( theta_o >= PI || axis.SquaredLength() == 0.0f ){
+        w = wa;
+        cos_theta = -1.0f;
+        return;
+    }
+
+    // rotate 'wa' towards 'wb' around the axis perpendicular to both of them
+    const auto theta_r = theta_o - theta_a;
+    const auto k = normalize( axis );
+    w = normalize( wa * std::cos( theta_r ) + cross( k , wa ) * std::sin( theta_r ) );
+    cos_theta = std::cos( theta_o );
+}
+
+static LightBounds unionBounds( const LightBounds& a , const LightBounds& b ){
+    if( a.phi == 0.0f )
+        return b;
+    if( b.phi == 0.0f )
+        return a;
+
+    LightBounds ret;
+    ret.bbox = Union( a.bbox , b.bbox );
+    unionCone( a.w , a.cos_theta_o , b.w , b.cos_theta_o , ret.w , ret.cos_theta_o );
+    ret.cos_theta_e = std::min( a.cos_theta_e , b.cos_theta_e );
+    ret.phi = a.phi + b.phi;
+    ret.two_sided = a.two_sided || b.two_sided;
+    return ret;
+}
+
+// An estimation of the contribution from the lights in the bounds to a shading point. It is conservative in the
+// sense that it never returns zero as long as any of the lights could contribute.
+static float importance( const LightBounds& b , const Point& p , const Vector& n ){
+    const auto center = ( b.bbox.m_Min + b.bbox.m_Max ) * 0.5f;
+    const auto diagonal = b.bbox.m_Max - b.bbox.m_Min;
+
+    // clamp the distance so that shading points close to or inside the bounds don't get infinite importance
+    auto to_point = p - center;
+    const auto d2 = std::max( to_point.SquaredLength() , diagonal.Length() * 0.5f );
+
+    // the angle between the emission axis and the direction from the bounds to the shading point
+    const auto len = to_point.Length();
+    if( len > 0.0f )
+        to_point /= len;
+    auto cos_theta_w = dot( b.w , to_point );
+    if( b.two_sided )
+        cos_theta_w = fabs( cos_theta_w );
+    const auto sin_theta_w = safeSqrt( 1.0f - cos_theta_w * cos_theta_w );
+
+    // the angle subtended by the bounds from the shading point
+    const auto radius2 = diagonal.SquaredLength() * 0.25f;
+    const auto dist2 = ( p - center ).SquaredLength();
+    const auto cos_theta_b = dist2 <= radius2 ? -1.0f : safeSqrt( 1.0f - radius2 / dist2 );
+    const auto sin_theta_b = safeSqrt( 1.0f - cos_theta_b * cos_theta_b );
+
+    // the minimum angle between the emission cone and the shading point
+    const auto sin_theta_o = safeSqrt( 1.0f - b.cos_theta_o * b.cos_theta_o );
+    const auto cos_theta_x = cosSubClamped( sin_theta_w , cos_theta_w , sin_theta_o , b.cos_theta_o );
+    const auto sin_theta_x = sinSubClamped( sin_theta_w , cos_theta_w , sin_theta_o , b.cos_theta_o );
+    const auto cos_theta_p = cosSubClamped( sin_theta_x , cos_theta_x , sin_theta_b , cos_theta_b );
+    if( cos_theta_p <= b.cos_theta_e )
+        return 0.0f;
+
+    auto ret = b.phi * cos_theta_p / d2;
+
+    // the minimum angle between the normal of the shading point and the bounds
+    if( n.SquaredLength() > 0.0f && len > 0.0f ){
+        const auto cos_theta_i = fabs( dot( to_point , n ) );
+        const auto sin_theta_i = safeSqrt( 1.0f - cos_theta_i * cos_theta_i );
+        ret *= cosSubClamped( sin_theta_i , cos_theta_i , sin_theta_b , cos_theta_b );
+    }
+
+    return std::max( ret , 0.0f );
+}
+
+// Cost of a node used to find the best split, it accounts for power, spatial size and directional spread of the bounds.
+static float evaluateCost( const LightBounds& b , const BBox& node_bbox , unsigned dim ){
+    if( b.phi == 0.0f )
+        return 0.0f;
+
+    const auto theta_o = safeAcos( b.cos_theta_o );
+    const auto theta_e = safeAcos( b.cos_theta_e );
+    const auto theta_w = std::min( theta_o + theta_e , PI );
+    const auto sin_theta_o = safeSqrt( 1.0f - b.cos_theta_o * b.cos_theta_o );
+    const auto m_omega = TWO_PI * ( 1.0f - b.cos_theta_o ) +
+                         PI * 0.5f * ( 2.0f * theta_w * sin_theta_o - std::cos( theta_o - 2.0f * theta_w ) - 2.0f * theta_o * sin_theta_o + b.cos_theta_o );
+
+    // penalize thin slabs so that the split doesn't produce long and thin nodes
+    const auto max_delta = std::max( node_bbox.Delta( 0 ) , std::max( node_bbox.Delta( 1 ) , node_bbox.Delta( 2 ) ) );
+    const auto kr = node_bbox.Delta( dim ) > 0.0f ? max_delta / node_bbox.Delta( dim ) : 1.0f;
+
+    return b.phi * m_omega * kr * b.bbox.SurfaceArea();
+}
+
+void LightBVH::Build( const std::vector<Light*>& lights ){
+    m_nodes.clear();
+    m_bounded_lights.clear();
+    m_infinite_lights.clear();
+    m_bit_trails.clear();
+
+    std::vector<std::pair<unsigned, LightBounds>> bounds;
+    for( const auto light : lights ){
+        LightBounds lb;
+        if( !light->GetBounds( lb ) ){
+            m_infinite_lights.push_back( light );
+            continue;
+        }
+
+        // lights not emitting anything will never be picked
+        if( lb.phi <= 0.0f )
+            continue;
+
+        bounds.push_back( std::make_pair( (unsigned)m_bounded_lights.size() , lb ) );
+        m_bounded_lights.push_back( light );
+    }
+
+    if( bounds.empty() )
+        return;
+
+    m_nodes.reserve( 2 * bounds.size() - 1 );
+    buildNode( bounds , 0 , (unsigned)bounds.size() , 0 , 0 );
+
+    SORT_STATS(sLightBVHNodeCount = (StatsInt)m_nodes.size());
+}
+
+unsigned LightBVH::buildNode( std::vector<std::pair<unsigned, LightBounds>>& bounds , unsigned start , unsigned end , unsigned long long bit_trail , unsigned depth ){
+    sAssert( start < end , LIGHT );
+    SORT_STATS(sLightBVHDepth = std::max( sLightBVHDepth , (StatsInt)depth + 1 ));
+
+    const auto node_id = (unsigned)m_nodes.size();
+    m_nodes.push_back( Node() );
+
+    if( end - start == 1 ){
+        auto& node = m_nodes[node_id];
+        node.bounds = bounds[start].second;
+        node.child_or_light = bounds[start].first;
+        node.is_leaf = true;
+        m_bit_trails[m_bounded_lights[bounds[start].first]] = bit_trail;
+        return node_id;
+    }
+
+    BBox node_bbox , centroid_bbox;
+    for( auto i = start ; i < end ; ++i ){
+        const auto& bbox = bounds[i].second.bbox;
+        node_bbox.Union( bbox );
+        centroid_bbox.Union( ( bbox.m_Min + bbox.m_Max ) * 0.5f );
+    }
+
+    // Find the split with the minimum cost among buckets along all axes.
+    auto min_cost = FLT_MAX;
+    auto min_dim = 0u , min_bucket = 0u;
+    auto found = false;
+    for( auto dim = 0u ; dim < 3 ; ++dim ){
+        const auto extent = centroid_bbox.m_Max[dim] - centroid_bbox.m_Min[dim];
+        if( extent <= 0.0f )
+            continue;
+
+        LightBounds buckets[LIGHT_BVH_SPLIT_COUNT];
+        for( auto i = start ; i < end ; ++i ){
+            const auto& lb = bounds[i].second;
+            const auto centroid = ( lb.bbox.m_Min[dim] + lb.bbox.m_Max[dim] ) * 0.5f;
+            const auto b = std::min( (unsigned)( LIGHT_BVH_SPLIT_COUNT * ( centroid - centroid_bbox.m_Min[dim] ) / extent ) , LIGHT_BVH_SPLIT_COUNT - 1 );
+            buckets[b] = unionBounds( buckets[b] , lb );
+        }
+
+        for( auto split = 0u ; split < LIGHT_BVH_SPLIT_COUNT - 1 ; ++split ){
+            LightBounds below , above;
+            for( auto i = 0u ; i <= split ; ++i )
+                below = unionBounds( below , buckets[i] );
+            for( auto i = split + 1 ; i < LIGHT_BVH_SPLIT_COUNT ; ++i )
+                above = unionBounds( above , buckets[i] );
+
+            if( below.phi == 0.0f || above.phi == 0.0f )
+                continue;
+
+            const auto cost = evaluateCost( below , node_bbox , dim ) + evaluateCost( above , node_bbox , dim );
+            if( cost < min_cost ){
+                min_cost = cost;
+                min_dim = dim;
+                min_bucket = split;
+                found = true;
+            }
+        }
+    }
+
+    auto mid = ( start + end ) / 2;
+    if( found ){
+        const auto extent = centroid_bbox.m_Max[min_dim] - centroid_bbox.m_Min[min_dim];
+        const auto it = std::partition( bounds.begin() + start , bounds.begin() + end , [&]( const std::pair<unsigned, LightBounds>& lb ){
+            const auto centroid = ( lb.second.bbox.m_Min[min_dim] + lb.second.bbox.m_Max[min_dim] ) * 0.5f;
+            const auto b = std::min( (unsigned)( LIGHT_BVH_SPLIT_COUNT * ( centroid - centroid_bbox.m_Min[min_dim] ) / extent ) , LIGHT_BVH_SPLIT_COUNT - 1 );
+            return b <= min_bucket;
+        });
+        mid = (unsigned)( it - bounds.begin() );
+        if( mid == start || mid == end )
+            mid = ( start + end ) / 2;
+    }
+
+    // This only happens with a huge number of lights sharing the same position, in which case the tree is not
+    // able to tell them apart anyway.
+    sAssertMsg( depth + 1 < LIGHT_BVH_MAX_DEPTH , LIGHT , "Light BVH is too deep." );
+
+    const auto first_child = buildNode( bounds , start , mid , bit_trail , depth + 1 );
+    const auto second_child = buildNode( bounds , mid , end , bit_trail | ( 1ull << depth ) , depth + 1 );
+    sAssert( first_child == node_id + 1 , LIGHT );
+
+    auto& node = m_nodes[node_id];
+    node.bounds = unionBounds( m_nodes[first_child].bounds , m_nodes[second_child].bounds );
+    node.child_or_light = second_child;
+    node.is_leaf = false;
+    return node_id;
+}
+
+float LightBVH::boundedProbability() const{
+    if( m_nodes.empty() )
+        return 0.0f;
+    return 1.0f / (float)( m_infinite_lights.size() + 1 );
+}
+
+const Light* LightBVH::Sample( const Point& p , const Vector& n , float u , float* pmf ) const{
+    // pick an infinite light uniformly
+    const auto p_bounded = boundedProbability();
+    const auto p_infinite = 1.0f - p_bounded;
+    if( u < p_infinite ){
+        const auto cnt = (unsigned)m_infinite_lights.size();
+        const auto id = std::min( (unsigned)( u / p_infinite * cnt ) , cnt - 1 );
+        if( pmf )
+            *pmf = p_infinite / (float)cnt;
+        return m_infinite_lights[id];
+    }
+
+    if( m_nodes.empty() )
+        return nullptr;
+
+    // reuse the random number to traverse the tree
+    u = std::min( ( u - p_infinite ) / p_bounded , ONE_MINUS_EPSILON );
+
+    auto node_pmf = p_bounded;
+    auto node_id = 0u;
+    while( true ){
+        const auto& node = m_nodes[node_id];
+        if( node.is_leaf ){
+            // the root may not be able to reach the shading point at all
+            if( node_id > 0 || importance( node.bounds , p , n ) > 0.0f ){
+                if( pmf )
+                    *pmf = node_pmf;
+                return m_bounded_lights[node.child_or_light];
+            }
+            return nullptr;
+        }
+
+        const auto i0 = importance( m_nodes[node_id + 1].bounds , p , n );
+        const auto i1 = importance( m_nodes[node.child_or_light].bounds , p , n );
+        if( i0 == 0.0f && i1 == 0.0f )
+            return nullptr;
+
+        const auto p0 = i0 / ( i0 + i1 );
+        if( u < p0 ){
+            node_id = node_id + 1;
+            node_pmf *= p0;
+            u = std::min( u / p0 , ONE_MINUS_EPSILON );
+        }else{
+            node_id = node.child_or_light;
+            node_pmf *= 1.0f - p0;
+            u = std::min( ( u - p0 ) / ( 1.0f - p0 ) , ONE_MINUS_EPSILON );
+        }
+    }
+}
+
+float LightBVH::Pmf( const Point& p , const Vector& n , const Light* light ) const{
+    const auto it = m_bit_trails.find( light );
+    if( it == m_bit_trails.end() ){
+        // infinite lights are picked uniformly
+        if( std::find( m_infinite_lights.begin() , m_infinite_lights.end() , light ) == m_infinite_lights.end() )
+            return 0.0f;
+        return ( 1.0f - boundedProbability() ) / (float)m_infinite_lights.size();
+    }
+
+    // follow the choices from the root to the light
+    auto bit_trail = it->second;
+    auto pmf = boundedProbability();
+    auto node_id = 0u;
+    while( !m_nodes[node_id].is_leaf ){
+        const auto& node = m_nodes[node_id];
+        const auto i0 = importance( m_nodes[node_id + 1].bounds , p , n );
+        const auto i1 = importance( m_nodes[node.child_or_light].bounds , p , n );
+        if( i0 == 0.0f && i1 == 0.0f )
+            return 0.0f;
+
+        if( bit_trail & 1 ){
+            pmf *= i1 / ( i0 + i1 );
+            node_id = node.child_or_light;
+        }else{
+            pmf *= i0 / ( i0 + i1 );
+            node_id = node_id + 1;
+        }
+        bit_trail >>= 1;
+    }
+
+    // a single light in the tree is only picked if it reaches the shading point
+    if( node_id == 0 && importance( m_nodes[0].bounds , p , n ) == 0.0f )
+        return 0.0f;
+
+    return pmf;
+}
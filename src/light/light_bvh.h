@@ -0,0 +1,106 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+
+    Copyright (c) 2011-2023 by Jiayin Cao - All rights reserved.
+
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+#include "core/define.h"
+#include "math/bbox.h"
+#include "math/point.h"
+#include "math/vector3.h"
+
+class Light;
+
+//! @brief  Spatial and directional bounds of the emission of a light.
+/**
+ * Emission directions are bounded by a cone around 'w' with spread angle 'theta_o', on top of which the emission
+ * could fall off within another 'theta_e'. This is the information needed by the light hierarchy to estimate how
+ * much a light, or a group of lights, could contribute to a shading point.
+ */
+struct LightBounds{
+    BBox    bbox;                                   /**< Bounding box of the light. */
+    Vector  w = Vector( 0.0f , 1.0f , 0.0f );       /**< Axis of the emission cone. */
+    float   phi = 0.0f;                             /**< Approximation of the power of the light. */
+    float   cos_theta_o = -1.0f;                    /**< Cosine of the spread angle of the emission cone, -1 means the whole sphere. */
+    float   cos_theta_e = 0.0f;                     /**< Cosine of the extra angle beyond the cone where emission falls off. */
+    bool    two_sided = false;                      /**< Whether the light emits along both 'w' and '-w'. */
+};
+
+//! @brief  Light hierarchy for many-light sampling.
+/**
+ * Lights are organized in a binary tree, each node bounds the position, emission direction and power of the lights
+ * below it. Picking a light traverses the tree from the root and randomly descends into one of the children based
+ * on an estimation of how much light they could deliver to the shading point, so that lights far away or facing
+ * away from the shading point are rarely picked.
+ * Infinite lights can't be bounded, they are picked uniformly with the same chance as the whole tree.
+ * Please refer to the paper 'Importance Sampling of Many Lights with Adaptive Tree Splitting' by Alejandro Conty Estevez
+ * and Christopher Kulla for further details.
+ */
+class LightBVH{
+public:
+    //! @brief  Build the light hierarchy.
+    //!
+    //! @param  lights      All lights in the scene.
+    void            Build( const std::vector<Light*>& lights );
+
+    //! @brief  Pick a light for a shading point.
+    //!
+    //! @param  p           The position of the shading point.
+    //! @param  n           The normal of the shading point, zero vector if there is no surface, like in participating media.
+    //! @param  u           A canonical random number.
+    //! @param  pmf         The probability of picking the light.
+    //! @return             The picked light, it could be nullptr if no light contributes to the shading point.
+    const Light*    Sample( const Point& p , const Vector& n , float u , float* pmf ) const;
+
+    //! @brief  The probability of picking a light for a shading point.
+    //!
+    //! @param  p           The position of the shading point.
+    //! @param  n           The normal of the shading point, zero vector if there is no surface.
+    //! @param  light       The light of interest.
+    //! @return             The probability of picking the light through 'Sample'.
+    float           Pmf( const Point& p , const Vector& n , const Light* light ) const;
+
+private:
+    //! @brief  Node of the light hierarchy, the first child of an interior node is always right after the node itself.
+    struct Node{
+        LightBounds bounds;                 /**< Bounds of all lights in the sub-tree. */
+        unsigned    child_or_light = 0;     /**< Index of the second child for interior node, index of the light for leaf node. */
+        bool        is_leaf = false;        /**< Whether the node is a leaf node. */
+    };
+
+    std::vector<Node>           m_nodes;            /**< Nodes of the tree, the first one is the root. */
+    std::vector<const Light*>   m_bounded_lights;   /**< Lights in the tree. */
+    std::vector<const Light*>   m_infinite_lights;  /**< Lights that can't be bounded. */
+
+    /**< Each bit records whether the second child is taken at a depth from the root to the light. */
+    std::unordered_map<const Light*, unsigned long long>   m_bit_trails;
+
+    //! @brief  Build a sub-tree recursively.
+    //!
+    //! @param  bounds      Bounds of all bounded lights, paired with their indices. Only [start, end) is built.
+    //! @param  start       The first light of the sub-tree.
+    //! @param  end         One after the last light of the sub-tree.
+    //! @param  bit_trail   Choices made from the root to this node.
+    //! @param  depth       Depth of the node.
+    //! @return             Index of the node.
+    unsigned    buildNode( std::vector<std::pair<unsigned, LightBounds>>& bounds , unsigned start , unsigned end , unsigned long long bit_trail , unsigned depth );
+
+    //! @brief  The probability of picking a bounded light instead of an infinite one.
+    float       boundedProbability() const;
+};
@@ -0,0 +1,255 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+
+    Copyright (c) 2011-2023 by Jiayin Cao - All rights reserved.
+
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+
+#include <algorithm>
+#include "meshlight.h"
+#include "entity/visual.h"
+#include "sampler/sample.h"
+
+// Maximum number of triangles in a leaf node of the bounding volume hierarchy of the mesh.
+static constexpr unsigned MESH_LIGHT_BVH_LEAF_SIZE = 4;
+// Nodes are split in the middle, the depth of the hierarchy never gets close to this.
+static constexpr unsigned MESH_LIGHT_BVH_STACK_SIZE = 64;
+
+// Geometric normal at the intersection, facing the side the mesh emits light to.
+SORT_STATIC_FORCEINLINE Vector emissionNormal( const SurfaceInteraction& intersect ){
+    return dot( intersect.gnormal , intersect.normal ) < 0.0f ? -intersect.gnormal : intersect.gnormal;
+}
+
+void MeshLight::BuildDistribution(){
+    sAssert(IS_PTR_VALID(m_visual), LIGHT );
+
+    const auto& triangles = m_visual->m_triangles;
+    const auto cnt = (unsigned)triangles.size();
+    if( 0 == cnt )
+        return;
+
+    std::unique_ptr<float[]> area = std::make_unique<float[]>(cnt);
+    Vector axis;
+    m_area = 0.0f;
+    m_bbox = BBox();
+    for( auto i = 0u ; i < cnt ; ++i ){
+        Vector n;
+        triangles[i]->GetNormalBound( n );
+        area[i] = triangles[i]->SurfaceArea();
+        axis += area[i] * n;
+        m_area += area[i];
+        m_bbox.Union( triangles[i]->GetBBox() );
+    }
+    m_distribution = std::make_unique<AliasTable>( area.get() , cnt );
+
+    // the hierarchy is only used to find the triangle a ray hits when evaluating the pdf of a direction
+    std::vector<Point> centroids( cnt );
+    for( auto i = 0u ; i < cnt ; ++i ){
+        const auto& bbox = triangles[i]->GetBBox();
+        centroids[i] = ( bbox.m_Min + bbox.m_Max ) * 0.5f;
+    }
+    m_indices.resize( cnt );
+    for( auto i = 0u ; i < cnt ; ++i )
+        m_indices[i] = i;
+    m_nodes.clear();
+    buildNode( centroids , 0 , cnt );
+
+    // the emission cone degenerates to the whole sphere for closed meshes
+    m_cos_theta_o = -1.0f;
+    if( axis.Length() > 0.0f ){
+        m_axis = normalize( axis );
+        m_cos_theta_o = 1.0f;
+        for( const auto& triangle : triangles ){
+            Vector n;
+            triangle->GetNormalBound( n );
+            m_cos_theta_o = std::min( m_cos_theta_o , dot( m_axis , n ) );
+        }
+    }
+}
+
+Spectrum MeshLight::sample_l(const Point& ip, const LightSample* ls , Vector& dirToLight , float* distance , float* pdfW , float* emissionPdf , float* cosAtLight , Visibility& visibility ) const{
+    sAssert(IS_PTR_VALID(ls), LIGHT );
+    sAssert(IS_PTR_VALID(m_distribution), LIGHT );
+
+    // pick a triangle, the pdf of picking it cancels with the pdf w.r.t area of picking a point on it
+    const auto& triangle = m_visual->m_triangles[m_distribution->SampleDiscrete( ls->t , nullptr )];
+
+    Vector normal;
+    const Point ps = triangle->Sample_l( *ls , ip , dirToLight , normal , nullptr );
+
+    const Vector dlt = ps - ip;
+    const float len = dlt.Length();
+    const float cos = dot( -dirToLight , normal );
+
+    if( pdfW )
+        *pdfW = cos <= 0.0f ? 0.0f : dlt.SquaredLength() / ( m_area * cos );
+
+    // return if pdf is zero
+    if( cos <= 0.0f )
+        return 0.0f;
+
+    if( cosAtLight )
+        *cosAtLight = cos;
+
+    if( distance )
+        *distance = len;
+
+    // product of pdf of sampling a point w.r.t surface area and a direction w.r.t direction
+    if( emissionPdf )
+        *emissionPdf = UniformHemispherePdf() / m_area;
+
+    // setup visibility tester
+    const float delta = 0.01f;
+    visibility.ray = Ray( ip , dirToLight , 0 , delta , len - delta );
+
+    return intensity;
+}
+
+Spectrum MeshLight::sample_l( RenderContext& rc, const LightSample& ls , Ray& r , float* pdfW , float* pdfA , float* cosAtLight ) const{
+    sAssert(IS_PTR_VALID(m_distribution), LIGHT );
+
+    const auto& triangle = m_visual->m_triangles[m_distribution->SampleDiscrete( ls.t , nullptr )];
+
+    Vector n;
+    triangle->Sample_l( rc, ls , r , n , nullptr );
+
+    if( pdfW )
+        *pdfW = UniformHemispherePdf() / m_area;
+
+    if( pdfA )
+        *pdfA = 1.0f / m_area;
+
+    if( cosAtLight )
+        *cosAtLight = satDot( r.m_Dir , n );
+
+    // to avoid self intersection
+    r.m_fMin = 0.01f;
+
+    return intensity;
+}
+
+unsigned MeshLight::buildNode( const std::vector<Point>& centroids , unsigned start , unsigned end ){
+    const auto& triangles = m_visual->m_triangles;
+    const auto id = (unsigned)m_nodes.size();
+    m_nodes.emplace_back();
+
+    BBox bbox , inner;
+    for( auto i = start ; i < end ; ++i ){
+        bbox.Union( triangles[m_indices[i]]->GetBBox() );
+        inner.Union( centroids[m_indices[i]] );
+    }
+    m_nodes[id].m_bbox = bbox;
+
+    const auto axis = inner.MaxAxisId();
+    if( end - start <= MESH_LIGHT_BVH_LEAF_SIZE || inner.Delta( axis ) == 0.0f ){
+        m_nodes[id].m_offset = start;
+        m_nodes[id].m_count = end - start;
+        return id;
+    }
+
+    // split at the median so that the hierarchy stays balanced
+    const auto mid = ( start + end ) / 2;
+    std::nth_element( m_indices.begin() + start , m_indices.begin() + mid , m_indices.begin() + end ,
+                      [&]( unsigned a , unsigned b ){ return centroids[a][axis] < centroids[b][axis]; } );
+
+    buildNode( centroids , start , mid );
+    const auto right = buildNode( centroids , mid , end );
+    m_nodes[id].m_offset = right;
+    return id;
+}
+
+bool MeshLight::getIntersect( const Ray& ray , SurfaceInteraction& intersect ) const{
+    if( m_nodes.empty() )
+        return false;
+
+    ray.Prepare();
+
+    const auto& triangles = m_visual->m_triangles;
+    unsigned stack[MESH_LIGHT_BVH_STACK_SIZE];
+    auto top = 0u;
+    stack[top++] = 0;
+
+    auto found = false;
+    while( top > 0 ){
+        const auto id = stack[--top];
+        const auto& node = m_nodes[id];
+
+        const auto fmin = Intersect( ray , node.m_bbox );
+        if( fmin < 0.0f || fmin > intersect.t )
+            continue;
+
+        if( node.m_count > 0 ){
+            for( auto i = node.m_offset ; i < node.m_offset + node.m_count ; ++i )
+                found |= triangles[m_indices[i]]->GetIntersect( ray , &intersect );
+            continue;
+        }
+
+        sAssert( top + 2 <= MESH_LIGHT_BVH_STACK_SIZE , LIGHT );
+        stack[top++] = node.m_offset;
+        stack[top++] = id + 1;
+    }
+    return found;
+}
+
+float MeshLight::Pdf( const Point& p , const Vector& wi ) const{
+    SurfaceInteraction inter;
+    if( m_area == 0.0f || !getIntersect( Ray( p , wi ) , inter ) )
+        return 0.0f;
+
+    const auto delta = p - inter.intersect;
+    const auto cos = dot( normalize( delta ) , emissionNormal( inter ) );
+    if( cos <= 0.0f )
+        return 0.0f;
+    return delta.SquaredLength() / ( m_area * cos );
+}
+
+Spectrum MeshLight::Power() const{
+    return m_area * intensity.GetIntensity() * TWO_PI;
+}
+
+bool MeshLight::GetBounds( LightBounds& bounds ) const{
+    if( m_area == 0.0f )
+        return false;
+
+    bounds.bbox = m_bbox;
+    bounds.phi = Power().GetIntensity();
+    bounds.w = m_axis;
+    bounds.cos_theta_o = m_cos_theta_o;
+    bounds.cos_theta_e = 0.0f;
+    bounds.two_sided = false;
+    return true;
+}
+
+Spectrum MeshLight::Le( const SurfaceInteraction& intersect , const Vector& wo , float* directPdfA , float* emissionPdf ) const{
+    if( dot( wo , emissionNormal( intersect ) ) <= 0.0f )
+        return 0.0f;
+
+    if( directPdfA )
+        *directPdfA = 1.0f / m_area;
+
+    if( emissionPdf )
+        *emissionPdf = UniformHemispherePdf() / m_area;
+
+    return intensity;
+}
+
+bool MeshLight::Le( const Ray& ray , SurfaceInteraction* intersect , Spectrum& radiance ) const{
+    SurfaceInteraction inter;
+    auto& result = intersect ? *intersect : inter;
+    if( !getIntersect( ray , result ) )
+        return false;
+
+    radiance = Le( result , -ray.m_Dir , 0 , 0 );
+    return true;
+}
@@ -0,0 +1,159 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+
+    Copyright (c) 2011-2023 by Jiayin Cao - All rights reserved.
+
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "light.h"
+#include "core/samplemethod.h"
+
+class MeshVisual;
+
+//! @brief  Definition of mesh light source.
+/**
+ * An emissive triangle mesh is a light source with all of its triangles emitting the same radiance on the side its
+ * vertex normals point to. Triangles are picked through an alias table weighted by their surface area, which is also
+ * weighted by their power since the radiance is uniform across the mesh, and a point is then picked uniformly on the
+ * triangle. The resulting pdf w.r.t area is the same everywhere on the mesh, one over the total surface area.
+ */
+class   MeshLight : public Light{
+public:
+    //! @brief  Constructor.
+    //!
+    //! @param  visual      The mesh visual emitting light.
+    //! @param  radiance    The radiance emitted by the surface of the mesh.
+    MeshLight( const MeshVisual* visual , const Spectrum& radiance ) : m_visual( visual ) {
+        intensity = radiance;
+    }
+
+    //! @brief  Build the distribution of triangles.
+    //!
+    //! This needs to be called once the mesh is transformed to world space, since the area of triangles may change.
+    void    BuildDistribution();
+
+    //! @brief  Sample a direction given the intersection.
+    //!
+    //! @param  ip              The point where we are interested in shading at.
+    //! @param  ls              The light sample information.
+    //! @param  dirToLight      The resulting direction goes from the intersection to light source.
+    //! @param  distance        The distance from the intersected point to the sampled point.
+    //! @param  pdfw            The resulting pdf w.r.t solid angle to pick such a direction.
+    //! @param  emissionPdf     The pdf w.r.t solid angle if such a direction and position is picked by the light source.
+    //! @param  cosAtLight      The cos of the angle between the light out-going direction, the opposite of 'dirToLight'.
+    //! @param  visibility      The visibility data structured filled by the light source.
+    //! @return                 The radiance goes from the light source to the intersected point.
+    Spectrum sample_l(const Point& ip, const LightSample* ls , Vector& dirToLight , float* distance , float* pdfw , float* emissionPdf , float* cosAtLight , Visibility& visibility ) const override;
+
+    //! @brief      Sample a point and light out-going direction.
+    //!
+    //! @param  ls              The light sample.
+    //! @param  r               The resulting sampled ray.
+    //! @param  pdfW            The pdf w.r.t solid angle of picking such a light out-going ray.
+    //! @param  pdfA            The pdf w.r.t area of picking the origin of the ray.
+    //! @param  cosAtLight      The cos of the angle between the light out-going direction and the normal.
+    //! @return                 The radiance goes from the light source along the ray.
+    Spectrum sample_l( RenderContext& rc, const LightSample& ls , Ray& r , float* pdfW , float* pdfA , float* cosAtLight ) const override;
+
+    //! @brief  Get the radiance light starting from the light source and ending at the intersection point.
+    //!
+    //! @param  intersect       The intersection information.
+    //! @param  wo              The direction goes from the light source to the intersecion, NOT the ray points to the light source!
+    //! @param  directPdfA      The pdf w.r.t area to pick the point, intersection between the direction and the light source.
+    //! @param  emissionPdf     The pdf w.r.t solid angle to pick to sample such a position and direction goes to the intersection.
+    //! @return                 The radiance goes from the light source to the intersection, black if there is no intersection.
+    Spectrum Le( const SurfaceInteraction& intersect , const Vector& wo , float* directPdfA , float* emissionPdf ) const override;
+
+    //! @brief  Given a ray, sample the light source if there is any intersection between the ray and the light source.
+    //!
+    //! Triangles of the light are tested through a bounding volume hierarchy of the mesh.
+    //!
+    //! @param  ray             The ray to be evaluated.
+    //! @param  intersect       The intersection between the ray and the light source.
+    //! @param  radiance        The radiance goes from the light source to the ray origin.
+    //! @return                 Whether there is an intersection between the ray and the light source.
+    bool Le( const Ray& ray , SurfaceInteraction* intersect , Spectrum& radiance ) const override;
+
+    //! @brief  Approximation of total power of the light.
+    //!
+    //! @return     Approximation of the light power.
+    Spectrum Power() const override;
+
+    //! @brief  Whether mesh light is a delta light.
+    //!
+    //! @return     Always return 'False' for mesh light because it is not delta light.
+    bool    IsDelta() const override{
+        return false;
+    }
+
+    //! @brief  The pdf w.r.t solid angle if the ray starting from 'p', tracing through 'wi' hits the light source.
+    //!
+    //! @param  p       The point in world space to be shaded.
+    //! @param  wi      The direction pointing from the point.
+    //! @return         The pdf w.r.t solid angle if the ray starting from 'p', tracing through 'wi' hits the light source.
+    float Pdf( const Point& p , const Vector& wi ) const override;
+
+    //! @brief  Get the spatial and directional bounds of the light.
+    //!
+    //! The emission cone is the smallest cone around the average normal that bounds the normals of all triangles.
+    //!
+    //! @param  bounds  The bounds of the light.
+    //! @return         Whether the light has any triangle in it.
+    bool GetBounds( LightBounds& bounds ) const override;
+
+private:
+    /**< The mesh visual emitting light. */
+    const MeshVisual*               m_visual = nullptr;
+    /**< Alias table to pick a triangle based on its area. */
+    std::unique_ptr<AliasTable>     m_distribution;
+    /**< Total surface area of the mesh. */
+    float                           m_area = 0.0f;
+    /**< Bounding box of the mesh. */
+    BBox                            m_bbox;
+    /**< Axis of the cone bounding the normals of all triangles. */
+    Vector                          m_axis = Vector( 0.0f , 1.0f , 0.0f );
+    /**< Cosine of the spread angle of the cone bounding the normals of all triangles. */
+    float                           m_cos_theta_o = -1.0f;
+
+    //! @brief  Node of the bounding volume hierarchy of the triangles.
+    struct BvhNode {
+        BBox        m_bbox;             /**< Bounding box of the triangles in the node. */
+        unsigned    m_offset = 0;       /**< First triangle index of a leaf node, or the right child of an interior node. */
+        unsigned    m_count = 0;        /**< Number of triangles in a leaf node, zero for interior nodes. */
+    };
+
+    /**< Nodes of the bounding volume hierarchy, the left child of an interior node always follows it. */
+    std::vector<BvhNode>            m_nodes;
+    /**< Indices of triangles, ordered so that each leaf node references a consecutive range of them. */
+    std::vector<unsigned>           m_indices;
+
+    //! @brief  Recursively build the bounding volume hierarchy of a range of triangles.
+    //!
+    //! @param  centroids       Centroids of the bounding boxes of all triangles.
+    //! @param  start           The first triangle index of the range.
+    //! @param  end             One past the last triangle index of the range.
+    //! @return                 Index of the node holding the range.
+    unsigned    buildNode( const std::vector<Point>& centroids , unsigned start , unsigned end );
+
+    //! @brief  Find the closest intersection between a ray and the triangles of the mesh.
+    //!
+    //! @param  ray             The ray to be evaluated.
+    //! @param  intersect       The closest intersection.
+    //! @return                 Whether there is an intersection between the ray and the mesh.
+    bool    getIntersect( const Ray& ray , SurfaceInteraction& intersect ) const;
+};
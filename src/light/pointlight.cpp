@@ -76,3 +76,15 @@ Spectrum PointLight::sample_l( RenderContext& rc, const LightSample& ls , Ray& r
 
     return intensity;
 }
+
+bool PointLight::GetBounds( LightBounds& bounds ) const{
+    const auto light_pos = Point( m_light2world.matrix.m[3] , m_light2world.matrix.m[7] , m_light2world.matrix.m[11] );
+
+    // point light emits uniformly in all directions
+    bounds.bbox = BBox( light_pos , light_pos );
+    bounds.phi = Power().GetIntensity();
+    bounds.cos_theta_o = -1.0f;
+    bounds.cos_theta_e = 0.0f;
+    bounds.two_sided = false;
+    return true;
+}
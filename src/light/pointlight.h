@@ -75,5 +75,11 @@ public:
         return 1.0f;
     }
 
+    //! @brief  Get the spatial and directional bounds of the light.
+    //!
+    //! @param  bounds  The bounds of the light.
+    //! @return         Always true for point light.
+    bool GetBounds( LightBounds& bounds ) const override;
+
     friend class PointLightEntity;
 };
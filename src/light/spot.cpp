@@ -99,4 +99,18 @@ Spectrum SpotLight::sample_l( RenderContext& rc, const LightSample& ls , Ray& r
         return 0.0f;
 
     return intensity * d * d;
-}
\ No newline at end of file
+}
+
+bool SpotLight::GetBounds( LightBounds& bounds ) const{
+    const auto light_dir = Vector3f( m_light2world.matrix.m[1] , m_light2world.matrix.m[5] , m_light2world.matrix.m[9] );
+    const auto light_pos = Point( m_light2world.matrix.m[3] , m_light2world.matrix.m[7] , m_light2world.matrix.m[11] );
+
+    // full intensity within the fall-off start angle, it fades out in the rest of the range
+    bounds.bbox = BBox( light_pos , light_pos );
+    bounds.w = normalize( light_dir );
+    bounds.phi = Power().GetIntensity();
+    bounds.cos_theta_o = cos_falloff_start;
+    bounds.cos_theta_e = cos( std::max( 0.0f , acos( clamp( cos_total_range , -1.0f , 1.0f ) ) - acos( clamp( cos_falloff_start , -1.0f , 1.0f ) ) ) );
+    bounds.two_sided = false;
+    return true;
+}
@@ -76,6 +76,12 @@ public:
         return 1.0f;
     }
 
+    //! @brief  Get the spatial and directional bounds of the light.
+    //!
+    //! @param  bounds  The bounds of the light.
+    //! @return         Always true for spot light.
+    bool GetBounds( LightBounds& bounds ) const override;
+
 private:
     float   cos_falloff_start = Radians( 25.0f );
     float   cos_total_range = Radians( 30.0f );
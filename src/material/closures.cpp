@@ -186,7 +186,8 @@ namespace {
          void Process(const Tsl_Namespace::ClosureParamPtr param, const Tsl_Namespace::float3& w, ScatteringEvent& se, RenderContext& rc) const override {
              const auto weight = w;
              const auto sample_weight = ( weight.x + weight.y + weight.z ) / 3.0f;
-             auto& params = *(ClosureTypeDisney*)param;
+             // the parameters are copied since the closure tree could be shared by all shading points of a constant material
+             auto params = *(const ClosureTypeDisney*)param;
              auto& mfp = params.scatterDistance;
 
              // Ignore SSS if necessary
@@ -593,6 +594,31 @@ void ProcessSurfaceClosure(const ClosureTreeNodeBase* closure, const float3& w,
     }
 }
 
+void FlattenSurfaceClosure(const ClosureTreeNodeBase* closure, const float3& w, std::vector<SurfaceClosureLeaf>& leaves) {
+    if (!closure)
+        return;
+
+    switch (closure->m_id) {
+        case Tsl_Namespace::CLOSURE_ADD:
+            {
+                const ClosureTreeNodeAdd* closure_add = (const ClosureTreeNodeAdd*)closure;
+                FlattenSurfaceClosure(closure_add->m_closure0, w, leaves);
+                FlattenSurfaceClosure(closure_add->m_closure1, w, leaves);
+            }
+            break;
+        case Tsl_Namespace::CLOSURE_MUL:
+            {
+                const ClosureTreeNodeMul* closure_mul = (const ClosureTreeNodeMul*)closure;
+                const float3 weight = make_float3(w.x * closure_mul->m_weight, w.y * closure_mul->m_weight, w.z * closure_mul->m_weight);
+                FlattenSurfaceClosure(closure_mul->m_closure, weight, leaves);
+            }
+            break;
+        default:
+            leaves.push_back({ closure, w });
+            break;
+    }
+}
+
 void ProcessVolumeClosure(const ClosureTreeNodeBase* closure, const float3& w, MediumStack& mediumStack, const SE_Interaction flag, const MaterialBase* material, const Mesh* mesh, RenderContext& rc) {
     if (!closure)
         return;
@@ -19,6 +19,7 @@
 
 #include <tsl_system.h>
 #include <tsl_args.h>
+#include <vector>
 #include "spectrum/spectrum.h"
 #include "medium/medium.h"
 
@@ -28,6 +29,12 @@ class MediumStack;
 class MaterialBase;
 class Mesh;
 
+//! @brief  A closure leaf with the weight accumulated from all of its parent nodes in the closure tree.
+struct SurfaceClosureLeaf {
+    const Tsl_Namespace::ClosureTreeNodeBase*   closure = nullptr;  /**< The closure node that is not an add or mul node. */
+    Tsl_Namespace::float3                       weight;             /**< The accumulated weight of the closure. */
+};
+
 //! @brief  Register all closures supported by SORT.
 void RegisterClosures();
 
@@ -38,6 +45,15 @@ void RegisterClosures();
 //! @param  se              The result scattering event.
 void ProcessSurfaceClosure(const Tsl_Namespace::ClosureTreeNodeBase* closure, const Tsl_Namespace::float3& w, ScatteringEvent& se, RenderContext& rc);
 
+//! @brief  Flatten the closure tree into a list of weighted closure leaves.
+//!
+//! Processing the leaves one by one with their weights is equivalent to processing the whole closure tree.
+//!
+//! @param  closure         The closure tree in the tsl shader.
+//! @param  w               The weight of this closure tree, this also counts the weight inherits from the higher level tree nodes.
+//! @param  leaves          The container to hold the closure leaves.
+void FlattenSurfaceClosure(const Tsl_Namespace::ClosureTreeNodeBase* closure, const Tsl_Namespace::float3& w, std::vector<SurfaceClosureLeaf>& leaves);
+
 //! @brief  Process the closure tree result and populate the MediumStack.
 //!
 //! @param  closure         The closure tree in the tsl shader.
@@ -55,67 +55,72 @@ void Material::BuildMaterial(Tsl_Namespace::ShadingContext* context) {
             shader_valid = false;
             trying_building_shader_type = true;
 
-            for (const auto& shader : shader_data.m_sources)
-                shader_units[shader.name] = MatManager::GetSingleton().GetShaderUnitTemplate(shader.type);
-
-            // build the root shader
-            const auto root_shader_name = prefix + output_node_name;
-            if(auto shader_unit_template = context->begin_shader_unit_template(root_shader_name)){
-                // register tsl global
-                TslGlobal::shader_unit_register(shader_unit_template.get());
-
-                // compile the root shader
-                const auto ret = shader_unit_template->compile_shader_source(root_shader);
-                if (!ret)
-                    return;
-
-                // indicate the shader unit is done
-                context->end_shader_unit_template(shader_unit_template.get());
+            // identical shader graphs, commonly from duplicated materials, are only compiled once
+            shader_instance = MatManager::GetSingleton().AcquireShaderInstance(prefix + shader_data.m_key, [&]() -> std::shared_ptr<Tsl_Namespace::ShaderInstance> {
+                for (const auto& shader : shader_data.m_sources)
+                    shader_units[shader.name] = MatManager::GetSingleton().GetShaderUnitTemplate(shader.type);
+
+                // build the root shader
+                const auto root_shader_name = prefix + output_node_name;
+                if(auto shader_unit_template = context->begin_shader_unit_template(root_shader_name)){
+                    // register tsl global
+                    TslGlobal::shader_unit_register(shader_unit_template.get());
+
+                    // compile the root shader
+                    const auto ret = shader_unit_template->compile_shader_source(root_shader);
+                    if (!ret)
+                        return nullptr;
+
+                    // indicate the shader unit is done
+                    context->end_shader_unit_template(shader_unit_template.get());
+
+                    shader_units[root_shader_name] = shader_unit_template;
+                } else {
+                    return nullptr;
+                }
 
-                shader_units[root_shader_name] = shader_unit_template;
-            } else {
-                return;
-            }
+                // begin compiling shader group
+                auto shader_group = context->begin_shader_group_template(prefix + m_name);
+                if (!shader_group)
+                    return nullptr;
 
-            // begin compiling shader group
-            auto shader_group = context->begin_shader_group_template(prefix + m_name);
-            if (!shader_group)
-                return;
+                // register tsl global
+                TslGlobal::shader_unit_register(shader_group.get());
 
-            // register tsl global
-            TslGlobal::shader_unit_register(shader_group.get());
+                for (auto su : shader_units) {
+                    const auto is_root = su.first == root_shader_name;
+                    const auto ret = shader_group->add_shader_unit(su.first, su.second, is_root);
+                    if (!ret)
+                        return nullptr;
+                }
 
-            for (auto su : shader_units) {
-                const auto is_root = su.first == root_shader_name;
-                const auto ret = shader_group->add_shader_unit(su.first, su.second, is_root);
-                if (!ret)
-                    return;
-            }
+                // connect the shader units
+                for (auto connection : shader_data.m_connections) {
+                    const auto target_shader = connection.target_shader == output_node_name ? prefix + output_node_name : connection.target_shader;
+                    shader_group->connect_shader_units(connection.source_shader, connection.source_property, target_shader, connection.target_property);
+                }
 
-            // connect the shader units
-            for (auto connection : shader_data.m_connections) {
-                const auto target_shader = connection.target_shader == output_node_name ? prefix + output_node_name : connection.target_shader;
-                shader_group->connect_shader_units(connection.source_shader, connection.source_property, target_shader, connection.target_property);
-            }
+                // expose the shader interface
+                shader_group->expose_shader_argument(root_shader_name, "result", true, "out_bxdf");
 
-            // expose the shader interface
-            shader_group->expose_shader_argument(root_shader_name, "result", true, "out_bxdf");
+                // update default values
+                for (const auto& dv : m_paramDefaultValues)
+                    shader_group->init_shader_input(dv.shader_unit_name, dv.shader_unit_param_name, dv.default_value);
 
-            // update default values
-            for (const auto& dv : m_paramDefaultValues)
-                shader_group->init_shader_input(dv.shader_unit_name, dv.shader_unit_param_name, dv.default_value);
+                // end building the shader group
+                auto ret = context->end_shader_group_template(shader_group.get());
+                if (TSL_Resolving_Status::TSL_Resolving_Succeed != ret)
+                    return nullptr;
 
-            // end building the shader group
-            auto ret = context->end_shader_group_template(shader_group.get());
-            if (TSL_Resolving_Status::TSL_Resolving_Succeed != ret)
-                return;
+                auto instance = shader_group->make_shader_instance();
+                ret = instance->resolve_shader_instance();
+                if (TSL_Resolving_Status::TSL_Resolving_Succeed != ret)
+                    return nullptr;
 
-            shader_instance = shader_group->make_shader_instance();
-            ret = shader_instance->resolve_shader_instance();
-            if (TSL_Resolving_Status::TSL_Resolving_Succeed != ret)
-                return;
+                return instance;
+            });
 
-            shader_valid = true;
+            shader_valid = IS_PTR_VALID(shader_instance);
         }
     };
 
@@ -125,6 +130,19 @@ void Material::BuildMaterial(Tsl_Namespace::ShadingContext* context) {
     // build volume shader
     build_shader_type(m_volume_shader_data, surface_volume_root, "Volume", m_volume_shader_valid, tried_building_volume_shader, m_volume_shader_units, m_volume_shader);
 
+    // probe the extinction of the volume so that majorants of density can be turned into majorants of extinction
+    if (m_volume_shader_valid) {
+        for (auto i = 0u; i < 2; ++i) {
+            MediumSample ms;
+            EvaluateVolumeSample(m_volume_shader.get(), (float)i, ms);
+            m_volumeExtinction[i] = ms.basecolor * ms.extinction;
+        }
+    }
+
+    // surface shaders independent of shading inputs are executed only once
+    if (m_surface_shader_valid && isShaderConstant(m_surface_shader_data))
+        bakeConstantSurface();
+
     // if there is volume shader, but no surface shader, a special transparent material will be applied automatically
     // this will make the shader authoring a lot easier.
     if (!m_surface_shader_valid && m_volume_shader_valid && !tried_building_surface_shader)
@@ -157,6 +175,16 @@ void Material::Serialize(IStreamBase& stream){
     const auto message = "Parsing Material '" + m_name + "'";
     SORT_PROFILE(message.c_str());
 
+    // the output node is named after the material, it is excluded from the key so that identical shader graphs in different materials match
+    const auto output_node_name = "ShaderOutput_" + m_name;
+    auto append_key = [](TSL_ShaderData& shader_data, const std::string& str) {
+        shader_data.m_key += str;
+        shader_data.m_key += '\0';
+    };
+    auto append_key_value = [](TSL_ShaderData& shader_data, const float x) {
+        shader_data.m_key.append((const char*)&x, sizeof(x));
+    };
+
     auto parse_shader_type = [&](TSL_ShaderData& shader_data, bool& is_shader_valid) {
         is_shader_valid = true;
 
@@ -167,6 +195,8 @@ void Material::Serialize(IStreamBase& stream){
             // parse surface shader
             ShaderSource shader_source;
             stream >> shader_source.name >> shader_source.type;
+            append_key(shader_data, shader_source.name);
+            append_key(shader_data, shader_source.type);
 
             auto parameter_cnt = 0u;
             stream >> parameter_cnt;
@@ -176,21 +206,28 @@ void Material::Serialize(IStreamBase& stream){
                 stream >> default_value.shader_unit_param_name;
                 int channel_num = 0;
                 stream >> channel_num;
+                append_key(shader_data, default_value.shader_unit_param_name);
                 // currently only float and float3 are supported for now
                 if (channel_num == 1) {
                     float x;
                     stream >> x;
                     default_value.default_value = x;
+                    append_key_value(shader_data, x);
                 }
                 else if (channel_num == 3) {
                     float x, y, z;
                     stream >> x >> y >> z;
                     default_value.default_value = Tsl_Namespace::make_float3(x, y, z);
+                    append_key_value(shader_data, x);
+                    append_key_value(shader_data, y);
+                    append_key_value(shader_data, z);
                 }
                 else if (channel_num == 4) { // this is fairly ugly, but it works, I will find time to refactor it later.
                     std::string str;
                     stream >> str;
                     default_value.default_value = make_tsl_global_ref(str);
+                    shader_data.m_hasGlobalReference = true;
+                    append_key(shader_data, str);
                 }
 
                 m_paramDefaultValues.push_back(default_value);
@@ -206,6 +243,11 @@ void Material::Serialize(IStreamBase& stream){
             stream >> connection.source_shader >> connection.source_property;
             stream >> connection.target_shader >> connection.target_property;
             shader_data.m_connections.push_back(connection);
+
+            append_key(shader_data, connection.source_shader == output_node_name ? std::string() : connection.source_shader);
+            append_key(shader_data, connection.source_property);
+            append_key(shader_data, connection.target_shader == output_node_name ? std::string() : connection.target_shader);
+            append_key(shader_data, connection.target_property);
         }
     };
 
@@ -234,12 +276,26 @@ void Material::UpdateScatteringEvent( ScatteringEvent& se, RenderContext& rc ) c
         return;
     }
 
-    if( m_surface_shader_valid )
+    if (m_constant_surface) {
+        for (const auto& leaf : m_constantClosures)
+            ProcessSurfaceClosure(leaf.closure, leaf.weight, se, rc);
+    } else if( m_surface_shader_valid )
         ExecuteSurfaceShader(m_surface_shader.get() , se , rc);
     else if( m_special_transparent )
         se.AddBxdf(SORT_MALLOC(rc.m_memory_arena, Transparent)(rc));
 }
 
+void Material::UpdateScatteringEvents( ScatteringEvent* const* ses, const unsigned cnt, RenderContext& rc ) const {
+    // only the jitted shader benefits from running over the batch, the rest is cheap enough to be handled one by one
+    if (m_surface_shader_valid && !m_constant_surface && LIKELY(!MatManager::GetSingleton().IsNoMaterialMode())) {
+        ExecuteSurfaceShaders(m_surface_shader.get(), ses, cnt, rc);
+        return;
+    }
+
+    for (auto i = 0u; i < cnt; ++i)
+        UpdateScatteringEvent(*ses[i], rc);
+}
+
 void Material::UpdateMediumStack( const MediumInteraction& mi , const SE_Interaction flag , MediumStack& ms, RenderContext& rc ) const {
     if (m_volume_shader_valid)
         ExecuteVolumeShader(m_volume_shader.get(), mi, ms, flag, this, rc);
@@ -250,10 +306,66 @@ void Material::EvaluateMediumSample(const MediumInteraction& mi, MediumSample& m
         EvaluateVolumeSample(m_volume_shader.get(), mi, ms);
 }
 
+Spectrum Material::EvaluateTransparency(const SurfaceInteraction& intersection) const {
+    // this should happen most of the time in the absence of transparent node.
+    if (!m_hasTransparentNode)
+        return 0.0f;
+
+    if (m_special_transparent)
+        return 1.0f;
+
+    return m_constant_surface ? m_constantTransparency : ::EvaluateTransparency(m_surface_shader.get(), intersection);
+}
+
+bool Material::EvaluateTransparencyRange(const SurfaceInteraction* corners, const unsigned corner_cnt, Spectrum& lo, Spectrum& hi) const {
+    if (!m_hasTransparentNode || m_special_transparent || m_constant_surface) {
+        lo = hi = EvaluateTransparency(corners[0]);
+        return true;
+    }
+
+    return ::EvaluateTransparencyRange(m_surface_shader.get(), corners, corner_cnt, lo, hi);
+}
+
+bool Material::isShaderConstant(const TSL_ShaderData& shader_data) const {
+    if (shader_data.m_hasGlobalReference)
+        return false;
+
+    const auto& mat_manager = MatManager::GetSingleton();
+    for (const auto& shader : shader_data.m_sources) {
+        if (!mat_manager.IsShaderUnitConstant(shader.type))
+            return false;
+    }
+    return true;
+}
+
+void Material::bakeConstantSurface() {
+    const auto closure = BakeSurfaceShader(m_surface_shader.get(), m_constantArena);
+
+    // the weights of add and mul nodes are folded into the leaves so that no tree traversal is needed per hit
+    m_constantClosures.clear();
+    FlattenSurfaceClosure(closure, Tsl_Namespace::make_float3(1.0f, 1.0f, 1.0f), m_constantClosures);
+
+    const auto opacity = ProcessOpacity(closure, Tsl_Namespace::make_float3(1.0f, 1.0f, 1.0f));
+    m_constantTransparency = Spectrum(1.0f - opacity).Clamp(0.0f, 1.0f);
+
+    m_constant_surface = true;
+    slog(INFO, MATERIAL, "Surface shader of material %s is constant, its closures are evaluated once.", m_name.c_str());
+}
+
+float Material::GetVolumeMajorant(const float max_density) const {
+    // the extinction is bounded by its values at both ends of the density range
+    const auto extinction = m_volumeExtinction[0] + (m_volumeExtinction[1] - m_volumeExtinction[0]) * max_density;
+    return std::max(m_volumeExtinction[0].GetMaxComponent(), extinction.GetMaxComponent());
+}
+
 void MaterialProxy::UpdateScatteringEvent(ScatteringEvent& se, RenderContext& rc) const {
     return m_material.UpdateScatteringEvent(se, rc);
 }
 
+void MaterialProxy::UpdateScatteringEvents(ScatteringEvent* const* ses, const unsigned cnt, RenderContext& rc) const {
+    return m_material.UpdateScatteringEvents(ses, cnt, rc);
+}
+
 void MaterialProxy::UpdateMediumStack(const MediumInteraction& mi, const SE_Interaction flag, MediumStack& ms, RenderContext& rc) const {
     return m_material.UpdateMediumStack(mi, flag, ms, rc);
 }
@@ -272,6 +384,10 @@ Spectrum MaterialProxy::EvaluateTransparency(const SurfaceInteraction& intersect
     return m_material.EvaluateTransparency(intersection);
 }
 
+bool MaterialProxy::EvaluateTransparencyRange(const SurfaceInteraction* corners, const unsigned corner_cnt, Spectrum& lo, Spectrum& hi) const {
+    return m_material.EvaluateTransparencyRange(corners, corner_cnt, lo, hi);
+}
+
 bool MaterialProxy::HasTransparency() const {
     return m_material.HasTransparency();
 }
@@ -290,4 +406,8 @@ float MaterialProxy::GetVolumeStep() const {
 
 unsigned int MaterialProxy::GetVolumeStepCnt() const {
     return m_material.GetVolumeStepCnt();
-}
\ No newline at end of file
+}
+
+float MaterialProxy::GetVolumeMajorant(const float max_density) const {
+    return m_material.GetVolumeMajorant(max_density);
+}
@@ -22,6 +22,7 @@
 #include <vector>
 #include <string>
 #include "stream/stream.h"
+#include "core/memory.h"
 #include "tsl_system.h"
 
 struct SurfaceInteraction;
@@ -50,6 +51,10 @@ struct TSL_ShaderData {
     std::vector<ShaderSource>           m_sources;
     /**< Shader connections. */
     std::vector<ShaderConnection>       m_connections;
+    /**< Whether any of the input default values refers to a tsl global. */
+    bool                                m_hasGlobalReference = false;
+    /**< Key identifying the shader graph, identical shader graphs share the same compiled shader. */
+    std::string                         m_key;
 };
 
 //! @brief  Base interface for material.
@@ -63,6 +68,14 @@ public:
     //! @param      se              Scattering event to be returned.
     virtual void       UpdateScatteringEvent(ScatteringEvent& se, RenderContext& rc) const = 0;
 
+    //! @brief      Parse scattering events of a batch of shading points that share this material.
+    //!
+    //! This is the entry for batched shading, a material could evaluate its shader over the whole batch back to back.
+    //!
+    //! @param      ses             Scattering events to be returned.
+    //! @param      cnt             Number of scattering events in the batch.
+    virtual void       UpdateScatteringEvents(ScatteringEvent* const* ses, const unsigned cnt, RenderContext& rc) const = 0;
+
     //! @brief      Parse volume from the material shader.
     //!
     //! @param      mi              Interaction with the medium.
@@ -84,6 +97,15 @@ public:
     //! @return                     The transparency at the intersection.
     virtual Spectrum   EvaluateTransparency(const SurfaceInteraction& intersection) const = 0;
 
+    //! @brief      Bound the transparency in a convex region of a triangle.
+    //!
+    //! @param      corners         Interactions at the corners of the region.
+    //! @param      corner_cnt      Number of corners.
+    //! @param      lo              The lowest transparency in the region.
+    //! @param      hi              The highest transparency in the region.
+    //! @return                     Whether the bound is available.
+    virtual bool       EvaluateTransparencyRange(const SurfaceInteraction* corners, const unsigned corner_cnt, Spectrum& lo, Spectrum& hi) const = 0;
+
     //! @brief  Build shader in tsl.
     //!
     //! @param  context     Tsl context.
@@ -118,6 +140,12 @@ public:
     //!
     //! @return     Maximum steps to march during ray marching.
     virtual unsigned int GetVolumeStepCnt() const = 0;
+
+    //! @brief  Get an upper bound of the extinction coefficient in a region of the volume.
+    //!
+    //! @param  max_density     The maximum density in the region.
+    //! @return                 The majorant of extinction among all spectrum channels.
+    virtual float       GetVolumeMajorant(const float max_density) const = 0;
 };
 
 //! @brief  A thin layer of material definition.
@@ -137,6 +165,12 @@ public:
     //! @param      se              Scattering event to be returned.
     void        UpdateScatteringEvent( ScatteringEvent& se, RenderContext& rc ) const override;
 
+    //! @brief      Parse scattering events of a batch of shading points that share this material.
+    //!
+    //! @param      ses             Scattering events to be returned.
+    //! @param      cnt             Number of scattering events in the batch.
+    void        UpdateScatteringEvents( ScatteringEvent* const* ses, const unsigned cnt, RenderContext& rc ) const override;
+
     //! @brief      Parse volume from the material shader.
     //!
     //! @param      mi              Interaction with the medium.
@@ -156,13 +190,19 @@ public:
     //!
     //! @param      intersection    The intersection.
     //! @return                     The transparency at the intersection.
-    Spectrum    EvaluateTransparency( const SurfaceInteraction& intersection ) const override{
-        // this should happen most of the time in the absence of transparent node.
-        if (!m_hasTransparentNode)
-            return 0.0f;
-        
-        return m_special_transparent ? 1.0f : (::EvaluateTransparency(m_surface_shader.get(), intersection));
-    }
+    Spectrum    EvaluateTransparency( const SurfaceInteraction& intersection ) const override;
+
+    //! @brief      Bound the transparency in a convex region of a triangle.
+    //!
+    //! Materials without a transparent node and constant surface shaders have the same transparency everywhere,
+    //! otherwise the bound comes from the texture lookups of the shader, see 'EvaluateTransparencyRange' in tsl_system.h.
+    //!
+    //! @param      corners         Interactions at the corners of the region.
+    //! @param      corner_cnt      Number of corners.
+    //! @param      lo              The lowest transparency in the region.
+    //! @param      hi              The highest transparency in the region.
+    //! @return                     Whether the bound is available.
+    bool        EvaluateTransparencyRange( const SurfaceInteraction* corners , const unsigned corner_cnt , Spectrum& lo , Spectrum& hi ) const override;
 
     //! @brief  Serialization interface. Loading data from stream.
     //!
@@ -218,6 +258,16 @@ public:
         return m_volumeStepCnt;
     }
 
+    //! @brief  Get an upper bound of the extinction coefficient in a region of the volume.
+    //!
+    //! The volume shader is assumed to be linear in density, which is what the density node is usually
+    //! used for. The bound is extrapolated from the extinction probed at zero and unit density. Shaders that
+    //! are not linear could exceed it, the trackers stay unbiased in that case at the cost of extra variance.
+    //!
+    //! @param  max_density     The maximum density in the region.
+    //! @return                 The majorant of extinction among all spectrum channels.
+    float       GetVolumeMajorant(const float max_density) const override;
+
 private:
     /**< Whether this is a valid material */
     bool                            m_surface_shader_valid = false;
@@ -252,6 +302,27 @@ private:
 
     float                           m_volumeStep = 0.1f;
     unsigned int                    m_volumeStepCnt = 1024;
+
+    /**< Extinction of the volume shader at zero and unit density. */
+    Spectrum                        m_volumeExtinction[2];
+
+    /**< Whether the surface shader doesn't depend on any shading input, its closures are baked once if so. */
+    bool                            m_constant_surface = false;
+    /**< The flattened closure leaves of the constant surface shader. */
+    std::vector<SurfaceClosureLeaf> m_constantClosures;
+    /**< Transparency of the constant surface shader. */
+    Spectrum                        m_constantTransparency;
+    /**< Memory holding the baked closure tree of the constant surface shader. */
+    MemoryAllocator                 m_constantArena;
+
+    //! @brief  Check whether the shader doesn't read any tsl global nor texture.
+    //!
+    //! @param  shader_data     The shader data to be analyzed.
+    //! @return                 Whether the shader evaluates to the same closure tree everywhere.
+    bool        isShaderConstant(const TSL_ShaderData& shader_data) const;
+
+    //! @brief  Execute the constant surface shader once and cache its closures.
+    void        bakeConstantSurface();
 };
 
 //! @brief  MaterialProxy is nothing but a thin wrapper of another existed material.
@@ -272,6 +343,12 @@ public:
     //! @param      se              Scattering event to be returned.
     void       UpdateScatteringEvent(ScatteringEvent& se, RenderContext& rc) const override;
 
+    //! @brief      Parse scattering events of a batch of shading points that share this material.
+    //!
+    //! @param      ses             Scattering events to be returned.
+    //! @param      cnt             Number of scattering events in the batch.
+    void       UpdateScatteringEvents(ScatteringEvent* const* ses, const unsigned cnt, RenderContext& rc) const override;
+
     //! @brief      Parse volume from the material shader.
     //! @param      mi              Interaction with the medium.
     //! @param      flag            A flag indicates whether to add or remove the medium.
@@ -297,6 +374,15 @@ public:
     //! @return                     The transparency at the intersection.
     Spectrum   EvaluateTransparency(const SurfaceInteraction& intersection) const override;
 
+    //! @brief      Bound the transparency in a convex region of a triangle.
+    //!
+    //! @param      corners         Interactions at the corners of the region.
+    //! @param      corner_cnt      Number of corners.
+    //! @param      lo              The lowest transparency in the region.
+    //! @param      hi              The highest transparency in the region.
+    //! @return                     Whether the bound is available.
+    bool       EvaluateTransparencyRange(const SurfaceInteraction* corners, const unsigned corner_cnt, Spectrum& lo, Spectrum& hi) const override;
+
     //! @brief  This should be an empty method that does nothing
     //!
     //! @param  context     Tsl context.
@@ -332,6 +418,12 @@ public:
     //! @return Maximum steps to march during ray marching.
     unsigned int GetVolumeStepCnt() const override;
 
+    //! @brief  Get an upper bound of the extinction coefficient in a region of the volume.
+    //!
+    //! @param  max_density     The maximum density in the region.
+    //! @return                 The majorant of extinction among all spectrum channels.
+    float       GetVolumeMajorant(const float max_density) const override;
+
 private:
     /**< Material to be referred. */
     const MaterialBase& m_material;
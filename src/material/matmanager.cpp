@@ -26,7 +26,8 @@
 #include "texture/imagetexture2d.h"
 
 #ifdef ENABLE_ASYNC_TEXTURE_LOADING
-#include <future>
+#include <marl/defer.h>
+#include <marl/scheduler.h>
 #endif
 
 namespace {
@@ -34,13 +35,15 @@ namespace {
         std::string resource_handle_name;
         std::string shader_resource_name;
     };
-}
 
-#ifdef ENABLE_ASYNC_TEXTURE_LOADING
-static bool async_load_resource(Resource* resource, std::string filename) {
-    return resource->LoadResource(filename);
+    // Types of shader nodes reading tsl globals in their shader source. Any other shader unit only depends on its
+    // inputs and the shader resources bound to it. This needs to be kept in sync with the nodes in the Blender plugin.
+    const std::unordered_set<std::string> g_shading_input_node_types = {
+        "SORTNodeInputIntersection",
+        "SORTNodeInputFresnel",
+        "SORTNodeVolumeDensity",
+    };
 }
-#endif
 
 bool MatManager::IsNoMaterialMode() const {
     return m_no_material_mode;
@@ -53,10 +56,6 @@ std::vector<std::unique_ptr<MaterialBase>>& MatManager::ParseMatFile( IStreamBas
     auto resource_cnt = 0u;
     stream >> resource_cnt;
 
-#ifdef ENABLE_ASYNC_TEXTURE_LOADING
-    std::vector<std::future<bool>>      async_resource_reading;
-#endif
-
     for (auto i = 0u; i < resource_cnt; ++i) {
         std::string resource_file;
         StringID resource_type;
@@ -83,7 +82,17 @@ std::vector<std::unique_ptr<MaterialBase>>& MatManager::ParseMatFile( IStreamBas
             }
             else {
 #ifdef ENABLE_ASYNC_TEXTURE_LOADING
-                async_resource_reading.push_back(std::async(std::launch::async, async_load_resource, ptr_resource, resource_file));
+                // Resource loading is not needed until the very first shader execution. It is not waited here so that
+                // decoding textures will overlap with shader compilation and scene loading.
+                if (marl::Scheduler::get()) {
+                    m_resource_loading.add();
+                    marl::schedule([this](Resource* resource, std::string filename) {
+                        defer(m_resource_loading.done());
+                        resource->LoadResource(filename);
+                    }, ptr_resource, resource_file);
+                } else {
+                    ptr_resource->LoadResource(resource_file);
+                }
 #else
                 ptr_resource->LoadResource(resource_file);
 #endif
@@ -140,6 +149,12 @@ std::vector<std::unique_ptr<MaterialBase>>& MatManager::ParseMatFile( IStreamBas
             // push it if it compiles the shader successful
             if( ret )
                 m_shader_units[shader_node_type] = shader_unit_template;
+
+            // A shader unit evaluates to the same value everywhere unless its node type reads tsl globals or it samples
+            // textures, which always come with shader resources. Inputs referring to tsl globals are checked by the
+            // shader groups and materials using the unit.
+            if (m_shader_resources_binding.empty() && 0 == g_shading_input_node_types.count(shader_node_type))
+                m_constant_shader_units.insert(shader_node_type);
         }
         else if (material_type == SID("ShaderGroupTemplate")) {
             // The following logic is very similar with 
@@ -179,6 +194,7 @@ std::vector<std::unique_ptr<MaterialBase>>& MatManager::ParseMatFile( IStreamBas
                         std::string str;
                         stream >> str;
                         default_value.default_value = Tsl_Namespace::make_tsl_global_ref(str);
+                        shader_data.m_hasGlobalReference = true;
                     }
 
                     m_paramDefaultValues.push_back(default_value);
@@ -258,6 +274,13 @@ std::vector<std::unique_ptr<MaterialBase>>& MatManager::ParseMatFile( IStreamBas
             // push it if it compiles the shader successful
             if (Tsl_Namespace::TSL_Resolving_Status::TSL_Resolving_Succeed == ret)
                 m_shader_units[shader_template_type] = shader_group;
+
+            // a shader group is constant only if all of its shader units are
+            auto is_constant = !shader_data.m_hasGlobalReference;
+            for (const auto& shader : shader_data.m_sources)
+                is_constant &= IsShaderUnitConstant(shader.type);
+            if (is_constant)
+                m_constant_shader_units.insert(shader_template_type);
         }
         else if (material_type == SID("Material")) {
             // allocate a new material
@@ -281,11 +304,13 @@ std::vector<std::unique_ptr<MaterialBase>>& MatManager::ParseMatFile( IStreamBas
         }
     }
 
+    return m_matPool;
+}
+
+void MatManager::WaitForResourceLoading() {
 #ifdef ENABLE_ASYNC_TEXTURE_LOADING
-    std::for_each(async_resource_reading.begin(), async_resource_reading.end(), [](std::future<bool>& promise) { promise.wait(); });
+    m_resource_loading.wait();
 #endif
-
-    return m_matPool;
 }
 
 const Resource* MatManager::GetResource(const std::string& name) const {
@@ -305,4 +330,31 @@ std::shared_ptr<Tsl_Namespace::ShaderUnitTemplate> MatManager::GetShaderUnitTemp
     if (it == m_shader_units.end())
         return nullptr;
     return it->second;
-}
\ No newline at end of file
+}
+
+bool MatManager::IsShaderUnitConstant(const std::string& name) const {
+    return m_constant_shader_units.count(name) > 0;
+}
+
+std::shared_ptr<Tsl_Namespace::ShaderInstance> MatManager::AcquireShaderInstance(const std::string& key, const std::function<std::shared_ptr<Tsl_Namespace::ShaderInstance>()>& build) {
+    std::promise<std::shared_ptr<Tsl_Namespace::ShaderInstance>> promise;
+    ShaderInstanceFuture future;
+    auto first_request = false;
+    {
+        std::lock_guard<std::mutex> lock(m_shader_instances_mutex);
+        auto it = m_shader_instances.find(key);
+        if (it == m_shader_instances.end()) {
+            future = promise.get_future().share();
+            m_shader_instances[key] = future;
+            first_request = true;
+        } else {
+            future = it->second;
+        }
+    }
+
+    // the compilation happens outside the lock so that different shader graphs could be compiled in parallel
+    if (first_request)
+        promise.set_value(build());
+
+    return future.get();
+}
@@ -21,6 +21,13 @@
 #include <vector>
 #include <memory>
 #include <unordered_map>
+#include <unordered_set>
+#include <functional>
+#include <future>
+#include <mutex>
+#ifdef ENABLE_ASYNC_TEXTURE_LOADING
+#include <marl/waitgroup.h>
+#endif
 #include "core/singleton.h"
 #include "material/material.h"
 #include "core/resource.h"
@@ -60,6 +67,12 @@ public:
     // result           : the number of materials in the file
     std::vector<std::unique_ptr<MaterialBase>>&    ParseMatFile( class IStreamBase& stream, const bool no_mat, Tsl_Namespace::ShadingContext* shading_context);
 
+    //! @brief  Block until all resources requested in ParseMatFile are loaded.
+    //!
+    //! With async texture loading enabled, ParseMatFile returns before the resources are loaded. Anything that could
+    //! possibly execute a shader needs to call this first.
+    void        WaitForResourceLoading();
+
     //! @brief  Whether the renderer is in no material node
     bool        IsNoMaterialMode() const;
 
@@ -75,17 +88,45 @@ public:
     //! @return             The shader unit template returned, nullptr if it doesn't exist.
     std::shared_ptr<Tsl_Namespace::ShaderUnitTemplate> GetShaderUnitTemplate(const std::string& name) const;
 
+    //! @brief  Whether the shader unit template evaluates to the same result regardless of the shading point.
+    //!
+    //! A shader unit is constant if its node type doesn't read tsl globals and there is no shader resource bound
+    //! to it. Inputs referring to tsl globals are not taken into account here.
+    //!
+    //! @param  name        The name of the template.
+    //! @return             True if the shader unit reads neither tsl globals nor textures.
+    bool        IsShaderUnitConstant(const std::string& name) const;
+
+    //! @brief  Get the compiled shader instance of a shader graph, it is only compiled for the first request.
+    //!
+    //! Materials could be built on different threads at the same time, a request for a shader graph being
+    //! compiled on another thread blocks until the compilation is done.
+    //!
+    //! @param  key         The key uniquely identifying the shader graph.
+    //! @param  build       The function compiling the shader graph, it returns nullptr if the compilation fails.
+    //! @return             The compiled shader instance, nullptr if the compilation fails.
+    std::shared_ptr<Tsl_Namespace::ShaderInstance> AcquireShaderInstance(const std::string& key, const std::function<std::shared_ptr<Tsl_Namespace::ShaderInstance>()>& build);
+
 private:
     std::vector<std::unique_ptr<MaterialBase>>       m_matPool;         /**< Material pool holding all materials. */
 
     std::unordered_map<std::string, std::unique_ptr<Resource>>  m_resources;       /**< Resources used during BXDF evaluation. */
 
     std::unordered_map<std::string, std::shared_ptr<Tsl_Namespace::ShaderUnitTemplate>>     m_shader_units;
+    std::unordered_set<std::string>                                                         m_constant_shader_units;   /**< Shader unit templates independent of shading inputs. */
+
+    using ShaderInstanceFuture = std::shared_future<std::shared_ptr<Tsl_Namespace::ShaderInstance>>;
+    std::unordered_map<std::string, ShaderInstanceFuture>   m_shader_instances;         /**< Compiled shader instances keyed by their shader graphs. */
+    std::mutex                                              m_shader_instances_mutex;   /**< Mutex protecting the compiled shader instances. */
 
     /**< Shader unit default values. */
     std::vector<ShaderParamDefaultValue>        m_paramDefaultValues;
 
     bool    m_no_material_mode;
 
+#ifdef ENABLE_ASYNC_TEXTURE_LOADING
+    marl::WaitGroup     m_resource_loading;     /**< Signaled when all resources are loaded. */
+#endif
+
     friend class Singleton<MatManager>;
 };
@@ -0,0 +1,57 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+
+    Copyright (c) 2011-2023 by Jiayin Cao - All rights reserved.
+
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+
+#include <algorithm>
+#include "shading_batch.h"
+#include "material.h"
+#include "core/stats.h"
+
+SORT_STATS_DEFINE_COUNTER(sBatchedShadingPoints)
+SORT_STATS_DEFINE_COUNTER(sBatchedMaterialRuns)
+
+SORT_STATS_AVG_COUNT("Shading", "Average Shading Points per Material Run", sBatchedShadingPoints, sBatchedMaterialRuns);
+
+void ShadingBatch::Add(const MaterialBase* material, ScatteringEvent& se) {
+    m_requests.push_back({ material->GetUniqueID().m_sid, material, &se });
+}
+
+void ShadingBatch::Execute(RenderContext& rc) {
+    // stable sorting keeps the original order of shading points sharing the same material, which is usually spatially coherent
+    std::stable_sort(m_requests.begin(), m_requests.end(), [](const ShadingRequest& r0, const ShadingRequest& r1) {
+        return r0.material_id < r1.material_id;
+    });
+
+    auto begin = 0u;
+    const auto cnt = (unsigned)m_requests.size();
+    while (begin < cnt) {
+        const auto& request = m_requests[begin];
+
+        m_events.clear();
+        auto end = begin;
+        while (end < cnt && m_requests[end].material_id == request.material_id)
+            m_events.push_back(m_requests[end++].se);
+
+        request.material->UpdateScatteringEvents(m_events.data(), (unsigned)m_events.size(), rc);
+
+        SORT_STATS(++sBatchedMaterialRuns);
+        SORT_STATS(sBatchedShadingPoints += end - begin);
+        begin = end;
+    }
+
+    m_requests.clear();
+}
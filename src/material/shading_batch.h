@@ -0,0 +1,67 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+
+    Copyright (c) 2011-2023 by Jiayin Cao - All rights reserved.
+
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+
+#pragma once
+
+#include <vector>
+#include "core/strid.h"
+
+class MaterialBase;
+class ScatteringEvent;
+struct RenderContext;
+
+//! @brief  ShadingBatch collects shading points and evaluates them material by material.
+/**
+ * Shading hit by hit jumps between different jitted shaders and closure code in random order. Instead of
+ * updating scattering events right after intersection, integrators that trace many paths at the same time
+ * could defer them in a batch. Execute sorts the batch by the unique id of materials so that each material
+ * is evaluated over all of its shading points back to back, which is a lot friendlier to instruction cache.
+ */
+class ShadingBatch {
+public:
+    //! @brief  Defer the evaluation of a scattering event.
+    //!
+    //! The scattering event needs to stay alive until the batch is executed.
+    //!
+    //! @param  material    The material of the shading point.
+    //! @param  se          The scattering event to be populated.
+    void    Add(const MaterialBase* material, ScatteringEvent& se);
+
+    //! @brief  Populate all scattering events in the batch and empty the batch.
+    void    Execute(RenderContext& rc);
+
+    //! @brief  Number of shading points in the batch.
+    //!
+    //! @return     Number of scattering events not populated yet.
+    unsigned GetSize() const {
+        return (unsigned)m_requests.size();
+    }
+
+private:
+    //! @brief  A deferred scattering event.
+    struct ShadingRequest {
+        sid_t               material_id;    /**< Unique id of the material, used as the sorting key. */
+        const MaterialBase* material;       /**< The material of the shading point. */
+        ScatteringEvent*    se;             /**< The scattering event to be populated. */
+    };
+
+    /**< Shading points not evaluated yet. */
+    std::vector<ShadingRequest>     m_requests;
+    /**< Scattering events of the material being evaluated. */
+    std::vector<ScatteringEvent*>   m_events;
+};
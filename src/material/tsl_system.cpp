@@ -45,10 +45,89 @@ IMPLEMENT_TSLGLOBAL_END()
 // this by myself. But it also looks like Marl doesn't voilate this assumption too.
 static thread_local MemoryAllocator g_memory_arena;
 
+// Memory to hold the closure tree when baking a constant shader, it is only set during BakeSurfaceShader.
+static thread_local MemoryAllocator* g_baking_arena = nullptr;
+
+// Texture coordinate differentials of the shading point being evaluated. TSL doesn't pass anything about the shading
+// point to texture sampling callbacks, this is set right before shader execution for the same reason above.
+// The footprint is derived from the mesh uv, any uv manipulation in the shader is not taken into account.
+struct TexCoordDifferentials {
+    float dudx = 0.0f, dvdx = 0.0f, dudy = 0.0f, dvdy = 0.0f;
+};
+static thread_local TexCoordDifferentials g_tex_differentials;
+
+SORT_STATIC_FORCEINLINE void setTexCoordDifferentials(const SurfaceInteraction& intersection) {
+    g_tex_differentials.dudx = intersection.dudx;
+    g_tex_differentials.dvdx = intersection.dvdx;
+    g_tex_differentials.dudy = intersection.dudy;
+    g_tex_differentials.dvdy = intersection.dvdy;
+}
+
+// Texture lookups of a shader while its transparency is bounded in a region. The shader is first evaluated at the
+// corners of the region to record the footprint of each lookup, lookups then return the lowest or highest texels in
+// their footprints. Lookups are identified by the order in which the shader issues them.
+struct TextureLookupRange {
+    const ImageTexture2D*   texture = nullptr;
+    bool                    alpha = false;
+    float                   u0 = 0.0f, v0 = 0.0f, u1 = 0.0f, v1 = 0.0f;
+    Spectrum                color_min, color_max;
+    float                   alpha_min = 1.0f, alpha_max = 1.0f;
+};
+struct TextureLookupBound {
+    enum class Mode { Filter, RecordFirst, Record, Bound };
+    Mode                            mode = Mode::Filter;
+    std::vector<TextureLookupRange> lookups;
+    unsigned                        index = 0;          // index of the next lookup issued by the shader
+    unsigned                        highest = 0;        // the i-th lookup returns the highest texels if the i-th bit is set
+    bool                            consistent = true;  // whether the shader issues the same lookups everywhere
+};
+static thread_local TextureLookupBound g_lookup_bound;
+
+// Every combination of lowest and highest texels of the lookups is evaluated, shaders with more lookups are not bounded.
+static constexpr unsigned MAX_BOUNDED_LOOKUP_CNT = 4;
+
+// Replace a texture lookup with its bound, or record its footprint, returns false if the lookup needs to be filtered.
+SORT_STATIC_FORCEINLINE bool boundLookup(const ImageTexture2D* texture, const bool alpha, const float u, const float v, Spectrum& color, float& alpha_value) {
+    auto& bound = g_lookup_bound;
+    if (bound.mode == TextureLookupBound::Mode::Filter)
+        return false;
+
+    const auto index = bound.index++;
+    if (bound.mode == TextureLookupBound::Mode::RecordFirst) {
+        TextureLookupRange lookup;
+        lookup.texture = texture;
+        lookup.alpha = alpha;
+        lookup.u0 = lookup.u1 = u;
+        lookup.v0 = lookup.v1 = v;
+        bound.lookups.push_back(lookup);
+        return false;
+    }
+
+    if (index >= bound.lookups.size() || bound.lookups[index].texture != texture || bound.lookups[index].alpha != alpha) {
+        bound.consistent = false;
+        return false;
+    }
+
+    auto& lookup = bound.lookups[index];
+    if (bound.mode == TextureLookupBound::Mode::Record) {
+        lookup.u0 = std::min(lookup.u0, u);
+        lookup.v0 = std::min(lookup.v0, v);
+        lookup.u1 = std::max(lookup.u1, u);
+        lookup.v1 = std::max(lookup.v1, v);
+        return false;
+    }
+
+    const auto highest = (bound.highest >> index) & 1;
+    color = highest ? lookup.color_max : lookup.color_min;
+    alpha_value = highest ? lookup.alpha_max : lookup.alpha_min;
+    return true;
+}
+
 class TSL_ShadingSystemInterface : public ShadingSystemInterface {
 public:
     void*   allocate(unsigned int size) const override {
-        return new (g_memory_arena.Allocate<char>(size)) char[size];
+        auto& arena = g_baking_arena ? *g_baking_arena : g_memory_arena;
+        return new (arena.Allocate<char>(size)) char[size];
     }
 
     void    catch_debug(const TSL_DEBUG_LEVEL level, const char* error) const override {
@@ -59,18 +138,29 @@ public:
     void    sample_2d(const void* texture, float u, float v, float3& color) const override {
         auto resource = (const Resource*)texture;
         auto sort_texture = dynamic_cast<const ImageTexture2D*>(resource);
-        auto ret = sort_texture->GetColorFromUV(u, v);
+        Spectrum ret;
+        auto alpha = 1.0f;
+        if (!boundLookup(sort_texture, false, u, v, ret, alpha)) {
+            const auto& d = g_tex_differentials;
+            ret = sort_texture->GetColorFromUV(u, v, d.dudx, d.dvdx, d.dudy, d.dvdy);
+        }
         color = make_float3(ret.x, ret.y, ret.z);
     }
 
     void    sample_alpha_2d(const void* texture, float u, float v, float& alpha) const override {
         auto resource = (const Resource*)texture;
         auto sort_texture = dynamic_cast<const ImageTexture2D*>(resource);
-        alpha = sort_texture->GetAlphaFromtUV(u, v);
+        Spectrum color;
+        if (!boundLookup(sort_texture, true, u, v, color, alpha)) {
+            const auto& d = g_tex_differentials;
+            alpha = sort_texture->GetAlphaFromtUV(u, v, d.dudx, d.dvdx, d.dudy, d.dvdy);
+        }
     }
 };
 
-void ExecuteSurfaceShader( Tsl_Namespace::ShaderInstance* shader , ScatteringEvent& se , RenderContext& rc){
+using SurfaceShaderFunc = void(*)(ClosureTreeNodeBase**, TslGlobal*);
+
+SORT_STATIC_FORCEINLINE void executeSurfaceShader( SurfaceShaderFunc raw_function , ScatteringEvent& se , RenderContext& rc ){
     const SurfaceInteraction& intersection = se.GetInteraction();
     TslGlobal global;
     global.uvw = make_float3(intersection.u, intersection.v, 0.0f);
@@ -80,15 +170,25 @@ void ExecuteSurfaceShader( Tsl_Namespace::ShaderInstance* shader , ScatteringEve
 
     // shader execution
     ClosureTreeNodeBase* closure = nullptr;
-    auto raw_function = (void(*)(ClosureTreeNodeBase**, TslGlobal*))shader->get_function();
 
     g_memory_arena.Reset();
+    setTexCoordDifferentials(intersection);
     raw_function(&closure, &global);
 
     // parse the surface shader
     ProcessSurfaceClosure(closure, Tsl_Namespace::make_float3(1.0f, 1.0f, 1.0f) , se , rc);
 }
 
+void ExecuteSurfaceShader( Tsl_Namespace::ShaderInstance* shader , ScatteringEvent& se , RenderContext& rc){
+    executeSurfaceShader((SurfaceShaderFunc)shader->get_function(), se, rc);
+}
+
+void ExecuteSurfaceShaders( Tsl_Namespace::ShaderInstance* shader , ScatteringEvent* const* ses , const unsigned cnt , RenderContext& rc){
+    const auto raw_function = (SurfaceShaderFunc)shader->get_function();
+    for (auto i = 0u; i < cnt; ++i)
+        executeSurfaceShader(raw_function, *ses[i], rc);
+}
+
 void ExecuteVolumeShader(Tsl_Namespace::ShaderInstance* shader, const MediumInteraction& mi, MediumStack& ms, const SE_Interaction flag, const MaterialBase* material , RenderContext& rc) {
     //const SurfaceInteraction& intersection = se.GetInteraction();
     TslGlobal global;
@@ -99,19 +199,25 @@ void ExecuteVolumeShader(Tsl_Namespace::ShaderInstance* shader, const MediumInte
     auto raw_function = (void(*)(ClosureTreeNodeBase**, TslGlobal*))shader->get_function();
 
     g_memory_arena.Reset();
+    g_tex_differentials = TexCoordDifferentials();
     raw_function(&closure, &global);
 
     ProcessVolumeClosure(closure, Tsl_Namespace::make_float3(1.0f, 1.0f, 1.0f), ms, flag, material, mi.mesh, rc);
 }
 
 void EvaluateVolumeSample(Tsl_Namespace::ShaderInstance* shader, const MediumInteraction& mi, MediumSample& ms) {
+    EvaluateVolumeSample(shader, mi.mesh->SampleVolumeDensity(mi.intersect), ms);
+}
+
+void EvaluateVolumeSample(Tsl_Namespace::ShaderInstance* shader, const float density, MediumSample& ms) {
     TslGlobal global;
-    global.density = mi.mesh->SampleVolumeDensity(mi.intersect);
+    global.density = density;
 
     ClosureTreeNodeBase* closure = nullptr;
     auto raw_function = (void(*)(ClosureTreeNodeBase**, TslGlobal*))shader->get_function();
 
     g_memory_arena.Reset();
+    g_tex_differentials = TexCoordDifferentials();
     raw_function(&closure, &global);
 
     EvaluateVolumeSample(closure, Tsl_Namespace::make_float3(1.0f, 1.0f, 1.0f), ms);
@@ -130,6 +236,7 @@ Spectrum EvaluateTransparency(Tsl_Namespace::ShaderInstance* shader , const Surf
     auto raw_function = (void(*)(ClosureTreeNodeBase**, TslGlobal*))shader->get_function();
 
     g_memory_arena.Reset();
+    setTexCoordDifferentials(intersection);
     raw_function(&closure, &global);
 
     // parse the surface shader
@@ -137,6 +244,59 @@ Spectrum EvaluateTransparency(Tsl_Namespace::ShaderInstance* shader , const Surf
     return Spectrum(1.0f - opacity).Clamp(0.0f, 1.0f);
 }
 
+bool EvaluateTransparencyRange(Tsl_Namespace::ShaderInstance* shader, const SurfaceInteraction* corners, const unsigned corner_cnt, Spectrum& lo, Spectrum& hi) {
+    if (0 == corner_cnt)
+        return false;
+
+    auto& bound = g_lookup_bound;
+    bound.lookups.clear();
+    bound.consistent = true;
+
+    auto first = true;
+    const auto evaluate = [&](const SurfaceInteraction& intersection, const TextureLookupBound::Mode mode) {
+        bound.mode = mode;
+        bound.index = 0;
+        const auto transparency = EvaluateTransparency(shader, intersection);
+        bound.consistent &= bound.index == bound.lookups.size();
+        for (auto i = 0; i < 3; ++i) {
+            lo[i] = first ? transparency[i] : std::min(lo[i], transparency[i]);
+            hi[i] = first ? transparency[i] : std::max(hi[i], transparency[i]);
+        }
+        first = false;
+    };
+
+    // record the footprints of the texture lookups
+    for (auto i = 0u; i < corner_cnt && bound.consistent; ++i)
+        evaluate(corners[i], i == 0 ? TextureLookupBound::Mode::RecordFirst : TextureLookupBound::Mode::Record);
+
+    const auto lookup_cnt = (unsigned)bound.lookups.size();
+    if (bound.consistent && lookup_cnt <= MAX_BOUNDED_LOOKUP_CNT) {
+        for (auto& lookup : bound.lookups)
+            lookup.texture->GetTexelRange(lookup.u0, lookup.v0, lookup.u1, lookup.v1, lookup.color_min, lookup.color_max, lookup.alpha_min, lookup.alpha_max);
+
+        // everything else the shader reads is taken from the first corner, its transparency is in the bound already
+        for (bound.highest = 0; bound.highest < (1u << lookup_cnt) && bound.consistent; ++bound.highest)
+            evaluate(corners[0], TextureLookupBound::Mode::Bound);
+    }
+
+    bound.mode = TextureLookupBound::Mode::Filter;
+    return bound.consistent && lookup_cnt <= MAX_BOUNDED_LOOKUP_CNT;
+}
+
+const ClosureTreeNodeBase* BakeSurfaceShader(Tsl_Namespace::ShaderInstance* shader, MemoryAllocator& memory) {
+    TslGlobal global;
+
+    ClosureTreeNodeBase* closure = nullptr;
+    auto raw_function = (void(*)(ClosureTreeNodeBase**, TslGlobal*))shader->get_function();
+
+    g_baking_arena = &memory;
+    g_tex_differentials = TexCoordDifferentials();
+    raw_function(&closure, &global);
+    g_baking_arena = nullptr;
+
+    return closure;
+}
+
 void CreateTSLThreadContexts(){
     auto& shading_system = ShadingSystem::get_instance();
     shading_system.register_shadingsystem_interface(std::make_unique<TSL_ShadingSystemInterface>());
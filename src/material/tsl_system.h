@@ -34,6 +34,7 @@ class MediumStack;
 struct MediumInteraction;
 class Mesh;
 struct RenderContext;
+class MemoryAllocator;
 
 // In an ideal world, I should have used different memory layout for different type of shaders.
 // The following fields are obviously not valid in certain cases, like there is no normal in 
@@ -65,6 +66,16 @@ struct ShaderCompilingContext {
 //! @brief  Execute Jited shader code.
 void ExecuteSurfaceShader(Tsl_Namespace::ShaderInstance* shader, ScatteringEvent& se, RenderContext& rc);
 
+//! @brief  Execute Jited shader code over a batch of shading points back to back.
+//!
+//! TSL only generates scalar shaders for now, the batch is executed one shading point after another. This is
+//! where a vectorized version of the shader would be called once TSL is capable of generating one.
+//!
+//! @param  shader      The tsl shader to be executed.
+//! @param  ses         The scattering events to be populated.
+//! @param  cnt         Number of scattering events.
+void ExecuteSurfaceShaders(Tsl_Namespace::ShaderInstance* shader, ScatteringEvent* const* ses, const unsigned cnt, RenderContext& rc);
+
 //! @brief  Execute a shader and populate the medium stack
 //!
 //! @param  shader      The tsl shader to be evaluated.
@@ -81,12 +92,45 @@ void ExecuteVolumeShader(Tsl_Namespace::ShaderInstance* shader, const MediumInte
 //! @param  ms          The medium sample to be returned.
 void EvaluateVolumeSample(Tsl_Namespace::ShaderInstance* shader, const MediumInteraction& mi, MediumSample& ms);
 
+//! @brief  Evaluate the properties of the volume given a density.
+//!
+//! @param  shader      The tsl shader to be executed.
+//! @param  density     The density fed to the shader.
+//! @param  ms          The medium sample to be returned.
+void EvaluateVolumeSample(Tsl_Namespace::ShaderInstance* shader, const float density, MediumSample& ms);
+
 //! @brief  Evaluate the transparency of the intersection.
 //!
 //! @param  shader          The tsl shader to be evaluated.
 //! @param  intersection    The intersection of interest.
 Spectrum EvaluateTransparency(Tsl_Namespace::ShaderInstance* shader, const SurfaceInteraction& intersection);
 
+//! @brief  Bound the transparency in a convex region of a triangle.
+//!
+//! The shader is evaluated at the corners to find the footprint of each of its texture lookups, then again with every
+//! combination of the lookups returning the lowest and highest texels in their footprints. The footprint is exact as
+//! long as texture coordinates are affine in the region. Everything else the shader reads is taken at the corners, so
+//! the bound holds for shaders whose transparency only varies through texture lookups and monotonically in them.
+//!
+//! @param  shader          The tsl shader to be evaluated.
+//! @param  corners         Interactions at the corners of the region.
+//! @param  corner_cnt      Number of corners.
+//! @param  lo              The lowest transparency in the region.
+//! @param  hi              The highest transparency in the region.
+//! @return                 Whether the bound is available, it is not if the lookups change across the region or if
+//!                         there are too many of them.
+bool EvaluateTransparencyRange(Tsl_Namespace::ShaderInstance* shader, const SurfaceInteraction* corners, const unsigned corner_cnt, Spectrum& lo, Spectrum& hi);
+
+//! @brief  Execute a surface shader that doesn't depend on any shading input.
+//!
+//! The closure tree is allocated in the provided memory instead of the per-thread shader memory so that
+//! it stays valid after the shader execution and can be shared by all shading points.
+//!
+//! @param  shader          The tsl shader to be executed.
+//! @param  memory          The memory holding the closure tree.
+//! @return                 The closure tree of the shader.
+const Tsl_Namespace::ClosureTreeNodeBase* BakeSurfaceShader(Tsl_Namespace::ShaderInstance* shader, MemoryAllocator& memory);
+
 //! @brief  Create thread contexts
 void CreateTSLThreadContexts();
 
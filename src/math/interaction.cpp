@@ -15,9 +15,11 @@
     this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
  */
 
+#include <cmath>
 #include "interaction.h"
 #include "light/light.h"
 #include "core/primitive.h"
+#include "shape/shape.h"
 
 Spectrum SurfaceInteraction::Le( const Vector& wo , float* directPdfA , float* emissionPdf ) const{
     if(IS_PTR_INVALID(primitive))
@@ -26,3 +28,54 @@ Spectrum SurfaceInteraction::Le( const Vector& wo , float* directPdfA , float* e
     const auto light = primitive->GetLight();
     return light ? light->Le( *this , wo , directPdfA , emissionPdf ) : Spectrum(0.0f);
 }
+
+
+void SurfaceInteraction::ComputeDifferentials( const Ray& ray ){
+    dudx = dvdx = dudy = dvdy = 0.0f;
+    dpdx = dpdy = Vector( 0.0f );
+
+    if( !ray.m_hasDifferentials || IS_PTR_INVALID(primitive) )
+        return;
+
+    // intersect the auxiliary rays with the tangent plane of the intersection
+    const auto d = dot( gnormal , Vector( intersect.x , intersect.y , intersect.z ) );
+    const auto tx_denom = dot( gnormal , ray.m_rxDir );
+    const auto ty_denom = dot( gnormal , ray.m_ryDir );
+    if( tx_denom == 0.0f || ty_denom == 0.0f )
+        return;
+    const auto tx = ( d - dot( gnormal , Vector( ray.m_rxOri.x , ray.m_rxOri.y , ray.m_rxOri.z ) ) ) / tx_denom;
+    const auto ty = ( d - dot( gnormal , Vector( ray.m_ryOri.x , ray.m_ryOri.y , ray.m_ryOri.z ) ) ) / ty_denom;
+    if( std::isinf(tx) || std::isnan(tx) || std::isinf(ty) || std::isnan(ty) )
+        return;
+    dpdx = ( ray.m_rxOri + tx * ray.m_rxDir ) - intersect;
+    dpdy = ( ray.m_ryOri + ty * ray.m_ryDir ) - intersect;
+
+    Vector dpdu, dpdv;
+    const auto shape = primitive->GetShape();
+    if( IS_PTR_INVALID(shape) || !shape->GetTexCoordGradient( *this , dpdu , dpdv ) )
+        return;
+
+    // Solve the over-constrained linear system with the two dimensions with largest projection of the normal dropped.
+    int dim[2];
+    const auto ax = fabs( gnormal.x ) , ay = fabs( gnormal.y ) , az = fabs( gnormal.z );
+    if( ax > ay && ax > az ){
+        dim[0] = 1; dim[1] = 2;
+    }else if( ay > az ){
+        dim[0] = 0; dim[1] = 2;
+    }else{
+        dim[0] = 0; dim[1] = 1;
+    }
+
+    const float a[2][2] = { { dpdu[dim[0]] , dpdv[dim[0]] } , { dpdu[dim[1]] , dpdv[dim[1]] } };
+    const auto det = a[0][0] * a[1][1] - a[0][1] * a[1][0];
+    if( fabs( det ) < 1e-12f )
+        return;
+    const auto inv_det = 1.0f / det;
+
+    const float bx[2] = { dpdx[dim[0]] , dpdx[dim[1]] };
+    const float by[2] = { dpdy[dim[0]] , dpdy[dim[1]] };
+    dudx = ( a[1][1] * bx[0] - a[0][1] * bx[1] ) * inv_det;
+    dvdx = ( a[0][0] * bx[1] - a[1][0] * bx[0] ) * inv_det;
+    dudy = ( a[1][1] * by[0] - a[0][1] * by[1] ) * inv_det;
+    dvdy = ( a[0][0] * by[1] - a[1][0] * by[0] ) * inv_det;
+}
@@ -24,6 +24,7 @@
 class Primitive;
 class PhaseFunction;
 class Mesh;
+class Ray;
 
 /**
  * InteractionCommon keeps track of the common field shared by surface interfaction and
@@ -61,6 +62,19 @@ struct SurfaceInteraction : public InteractionCommon{
     // the intersected primitive
     const Primitive*  primitive = nullptr;
 
+    // Position and texture coordinate differentials w.r.t image space, they are all zero if the ray doesn't carry
+    // ray differentials, in which case textures are sampled at the finest resolution.
+    Vector  dpdx , dpdy;
+    float   dudx = 0.0f , dvdx = 0.0f , dudy = 0.0f , dvdy = 0.0f;
+
+    //! @brief  Evaluate the differentials of the intersection based on the ray differentials.
+    //!
+    //! This needs to be called after the intersection is fully filled, it does nothing if the ray doesn't carry
+    //! ray differentials or the intersected shape doesn't have a texture parameterization.
+    //!
+    //! @param  ray         The ray that hits this intersection.
+    void    ComputeDifferentials( const Ray& ray );
+
     //! @brief  Reset the intersection.
     //!
     //! Intersection has some input and output for primitive intersection test at the same time.
@@ -55,7 +55,15 @@ public:
     // para 'r' : the ray to transform
     // result   : transformed ray
     Ray operator * ( const Ray& r ) const{
-        return Ray( TransformPoint(r.m_Ori) , TransformVector( r.m_Dir ) , r.m_Depth , r.m_fMin , r.m_fMax );
+        Ray ret( TransformPoint(r.m_Ori) , TransformVector( r.m_Dir ) , r.m_Depth , r.m_fMin , r.m_fMax );
+        if( r.m_hasDifferentials ){
+            ret.m_hasDifferentials = true;
+            ret.m_rxOri = TransformPoint(r.m_rxOri);
+            ret.m_ryOri = TransformPoint(r.m_ryOri);
+            ret.m_rxDir = TransformVector(r.m_rxDir);
+            ret.m_ryDir = TransformVector(r.m_ryDir);
+        }
+        return ret;
     }
     Ray operator () ( const Ray& r ) const{
         return *this * r;
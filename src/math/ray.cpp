@@ -49,4 +49,11 @@ Ray::Ray( const Ray& r ){
     m_fPdfA = r.m_fPdfA;
     m_we = r.m_we;
     m_fCosAtCamera = r.m_fCosAtCamera;
+    m_hasDifferentials = r.m_hasDifferentials;
+    if( m_hasDifferentials ){
+        m_rxOri = r.m_rxOri;
+        m_ryOri = r.m_ryOri;
+        m_rxDir = r.m_rxDir;
+        m_ryDir = r.m_ryDir;
+    }
 }
\ No newline at end of file
@@ -88,6 +88,13 @@ public:
     // importance value of the ray
     Spectrum m_we;
 
+    // Ray differentials are two auxiliary rays offset by one pixel along x and y on the image plane. They are only
+    // used to estimate the footprint of the ray on surfaces for texture filtering, nothing in intersection tests
+    // takes them into account.
+    bool    m_hasDifferentials = false;
+    Point   m_rxOri , m_ryOri;
+    Vector  m_rxDir , m_ryDir;
+
     mutable int     m_local_x , m_local_y , m_local_z;  /**< Id used to identify axis in local coordinate. */
     mutable float   m_scale_x , m_scale_y , m_scale_z;  /**< Scaling along each axis in local coordinate. */
 };
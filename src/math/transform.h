@@ -213,5 +213,5 @@ SORT_FORCEINLINE Transform Transpose( const Transform& t )
 
 // transform a ray
 SORT_FORCEINLINE Ray  operator* ( const Transform& t , const Ray& r ){
-    return Ray( t.TransformPoint(r.m_Ori) , t.TransformVector(r.m_Dir) , r.m_Depth , r.m_fMin , r.m_fMax );
+    return t.matrix * r;
 }
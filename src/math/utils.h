@@ -18,6 +18,7 @@
 #pragma once
 
 #include <math.h>
+#include <string.h>
 #if defined(_MSC_VER) && (_MSC_VER >= 1800)
 #define NOMINMAX
 #  include <algorithm> // for std::min and std::max
@@ -32,6 +33,7 @@
 #define INV_PI          0.3183099f
 #define INV_TWOPI       0.15915494f
 #define INV_FOUR_PI     0.07957747f
+#define ONE_MINUS_EPSILON 0x1.fffffep-1f   // the largest float smaller than one
 
 #define SQR(x)      (Pow<2>(x))
 
@@ -129,4 +131,70 @@ SORT_FORCEINLINE float LinearToGamma( float value ){
 SORT_FORCEINLINE float GammaToLinear( float value ){
     if (value <= 0.04045f) return value * 1.f / 12.92f;
     return pow((value + 0.055f) * 1.f / 1.055f, (float)2.4f);
-}
\ No newline at end of file
+}
+
+//! @brief  Convert a single precision float to half precision float, rounding to nearest even.
+//!
+//! Values beyond the range of half float become infinity.
+//!
+//! @param  value   Single precision float.
+//! @return         Bits of the half precision float.
+SORT_FORCEINLINE unsigned short FloatToHalf( float value ){
+    unsigned int bits;
+    memcpy( &bits , &value , sizeof( bits ) );
+
+    const auto sign = bits & 0x80000000u;
+    bits ^= sign;
+
+    unsigned int ret;
+    if( bits >= ( 127u + 16u ) << 23 ){
+        // infinity or nan
+        ret = bits > 0x7f800000u ? 0x7e00u : 0x7c00u;
+    }else if( bits < 113u << 23 ){
+        // denormalized half float or zero, let the float unit do the rounding
+        const unsigned int magic_bits = ( ( 127u - 15u ) + ( 23u - 10u ) + 1u ) << 23;
+        float magic , f;
+        memcpy( &magic , &magic_bits , sizeof( magic ) );
+        memcpy( &f , &bits , sizeof( f ) );
+        f += magic;
+        memcpy( &bits , &f , sizeof( bits ) );
+        ret = bits - magic_bits;
+    }else{
+        const auto mantissa_odd = ( bits >> 13 ) & 1u;
+        bits += ( ( 15u - 127u ) << 23 ) + 0xfffu + mantissa_odd;
+        ret = bits >> 13;
+    }
+
+    return (unsigned short)( ret | ( sign >> 16 ) );
+}
+
+//! @brief  Convert a half precision float to single precision float.
+//!
+//! @param  value   Bits of the half precision float.
+//! @return         Single precision float.
+SORT_FORCEINLINE float HalfToFloat( unsigned short value ){
+    constexpr unsigned int shifted_exp = 0x7c00u << 13;
+
+    auto bits = ( (unsigned int)value & 0x7fffu ) << 13;
+    const auto exp = bits & shifted_exp;
+    bits += ( 127u - 15u ) << 23;
+
+    float ret;
+    if( exp == shifted_exp ){
+        // infinity or nan
+        bits += ( 128u - 16u ) << 23;
+        memcpy( &ret , &bits , sizeof( ret ) );
+    }else if( exp == 0 ){
+        // denormalized half float or zero
+        const unsigned int magic_bits = 113u << 23;
+        float magic;
+        memcpy( &magic , &magic_bits , sizeof( magic ) );
+        bits += 1u << 23;
+        memcpy( &ret , &bits , sizeof( ret ) );
+        ret -= magic;
+    }else{
+        memcpy( &ret , &bits , sizeof( ret ) );
+    }
+
+    return ( value & 0x8000u ) ? -ret : ret;
+}
@@ -21,6 +21,8 @@
 #include "core/render_context.h"
 #include "material/material.h"
 #include "phasefunction.h"
+#include "core/mesh.h"
+#include "core/stats.h"
 
 IMPLEMENT_CLOSURE_TYPE_BEGIN(ClosureTypeHeterogenous)
 IMPLEMENT_CLOSURE_TYPE_VAR(ClosureTypeHeterogenous, Tsl_float3, base_color)
@@ -30,105 +32,135 @@ IMPLEMENT_CLOSURE_TYPE_VAR(ClosureTypeHeterogenous, Tsl_float, scattering)
 IMPLEMENT_CLOSURE_TYPE_VAR(ClosureTypeHeterogenous, Tsl_float, anisotropy)
 IMPLEMENT_CLOSURE_TYPE_END(ClosureTypeHeterogenous)
 
-Spectrum HeterogenousMedium::Tr(const Ray& ray, const float max_t, RenderContext& rc) const {
-    // get the step size and count
-    auto        step_size = m_material->GetVolumeStep();
-    const auto  step_cnt = m_material->GetVolumeStepCnt();
-
-    auto t = 0.0f;
-    Spectrum exponent(0.0f);
-
-    // ray marching
-    for (auto i = 0u; i < step_cnt; ++i) {
-        const auto dt = t + step_size <= max_t ? step_size : max_t - t;
-        const auto new_t = t + dt * sort_rand<float>(rc);
+SORT_STATS_DEFINE_COUNTER(sTrackingCount)
+SORT_STATS_DEFINE_COUNTER(sTentativeCollisionCount)
 
-        // take a sample in the medium
-        MediumSample ms;
-        MediumInteraction tmp_mi;
-        tmp_mi.intersect = ray(new_t);
-        tmp_mi.mesh = m_mesh;
-        m_material->EvaluateMediumSample(tmp_mi, ms);
+SORT_STATS_COUNTER("Heterogeneous Medium", "Tracking Count", sTrackingCount);
+SORT_STATS_AVG_COUNT("Heterogeneous Medium", "Average Shader Evaluation per Tracking", sTentativeCollisionCount, sTrackingCount);
 
-        exponent -= ms.basecolor * ms.extinction * dt;
-
-        t += dt;
+// the majorant is not a strict bound for every volume shader, weights of null collisions could turn negative where the
+// extinction exceeds it, probabilities are driven by the magnitude of the weights then.
+static SORT_FORCEINLINE float averageAbs(const Spectrum& s) {
+    return (fabs(s[0]) + fabs(s[1]) + fabs(s[2])) / 3.0f;
+}
 
-        if (t >= max_t)
-            break;
+template<class Visitor>
+void HeterogenousMedium::traverseMajorants(const Ray& ray, const float max_t, Visitor&& visit) const {
+    const auto density = IS_PTR_VALID(m_mesh) ? m_mesh->GetVolumeDensity() : nullptr;
+    if (IS_PTR_INVALID(density)) {
+        // the density is zero everywhere without volume data
+        visit(0.0f, max_t, m_material->GetVolumeMajorant(0.0f));
+        return;
     }
 
-    return exponent.Exp();
+    const auto& world2volume = m_mesh->GetWorldToVolume();
+    const auto ori = world2volume.TransformPoint(ray.m_Ori);
+    const auto dir = world2volume.TransformVector(ray.m_Dir);
+    density->GetMajorantGrid().Traverse(ori, dir, max_t, [&](const float t0, const float t1, const float max_density) {
+        return visit(t0, t1, m_material->GetVolumeMajorant(max_density));
+    });
 }
 
-Spectrum HeterogenousMedium::Sample(const Ray& ray, const float max_t, MediumInteraction*& mi, Spectrum& emission, RenderContext& rc) const {
-    // Distance Sample, Jan Novak
-    // https://cs.dartmouth.edu/~wjarosz/publications/novak18monte-slides-3-distance-sampling.pdf
-
-    // get the step size and count
-    auto        step_size = m_material->GetVolumeStep();
-    const auto  step_cnt = m_material->GetVolumeStepCnt();
-
-    // always start from 0.0 regardless the min_t value setup in ray
-    auto t = 0.0f;
-
-    // a random value
-    auto r = sort_rand<float>(rc);
-
-    // accumulative transmittance
-    auto accum_transmittance = Spectrum(1.0f);
-
-    // maybe a better sampling algorithm for channel picking later
-    const auto ch = clamp((int)(sort_rand<float>(rc) * RGBSPECTRUM_SAMPLE), 0, RGBSPECTRUM_SAMPLE - 1);
-
-    // ray marching
-    for (auto i = 0u; i < step_cnt; ++i) {
-        const auto dt = t + step_size <= max_t ? step_size : max_t - t;
-        const auto new_t = t + dt * sort_rand<float>(rc);
-
-        // take a sample in the medium
-        MediumSample ms;
-        MediumInteraction tmp_mi;
-        tmp_mi.intersect = ray(new_t);
-        tmp_mi.mesh = m_mesh;
-        m_material->EvaluateMediumSample(tmp_mi, ms);
-
-        // beam transmittance along the ray through the short distance
-        const auto extinction = ms.basecolor * ms.extinction;
-        const auto exponent = -dt * extinction;
-        const auto beam_transmitancy = exponent.Exp();
-
-        if (1.0f - r >= beam_transmitancy[ch]) {
-            // sample a medium and scatter the ray
-            const auto new_dt = -log(1.0f - r) / extinction[ch];
-
-            mi = SORT_MALLOC(rc.m_memory_arena, MediumInteraction)();
-            mi->intersect = ray(t + new_dt);
-            mi->phaseFunction = SORT_MALLOC(rc.m_memory_arena, HenyeyGreenstein)(ms.anisotropy);
-            
-            const auto new_exponent = -new_dt * extinction;
-            const auto new_beam_transmitancy = new_exponent.Exp();
-            accum_transmittance *= new_beam_transmitancy;
-            const auto new_pdf = accum_transmittance * extinction;
-            const auto pdf = (new_pdf[0] + new_pdf[1] + new_pdf[2]) / 3.0f;
-            accum_transmittance /= pdf;
-
-            // This model is what is used in PBRT and different from 'Production Volume Rendering' by Disney.
-            emission = ms.emission * ms.basecolor * ms.absorption * accum_transmittance;
-
-            return accum_transmittance * ms.scattering * ms.basecolor;
-        } else {
-            accum_transmittance *= beam_transmitancy;
-            r = 1.0f - (1.0f - r) / beam_transmitancy[ch];
+Spectrum HeterogenousMedium::Tr(const Ray& ray, const float max_t, RenderContext& rc) const {
+    // Ratio tracking, every tentative collision attenuates the transmittance by the chance of it being a null collision.
+    // 'Residual Ratio Tracking for Estimating Attenuation in Participating Media', Novak et al. 2014
+    SORT_STATS(++sTrackingCount);
+
+    auto tr = Spectrum(1.0f);
+    traverseMajorants(ray, max_t, [&](const float t0, const float t1, const float majorant) {
+        // empty space is skipped all at once
+        if (majorant <= 0.0f)
+            return true;
+
+        auto t = t0;
+        while (true) {
+            t -= log(1.0f - sort_rand<float>(rc)) / majorant;
+            if (t >= t1)
+                return true;
+
+            SORT_STATS(++sTentativeCollisionCount);
+
+            MediumSample ms;
+            MediumInteraction tmp_mi;
+            tmp_mi.intersect = ray(t);
+            tmp_mi.mesh = m_mesh;
+            m_material->EvaluateMediumSample(tmp_mi, ms);
+
+            // the ratio is not clamped, a negative one where the extinction exceeds the majorant keeps the estimation unbiased
+            tr *= 1.0f - ms.basecolor * ms.extinction / majorant;
+
+            // russian roulette to terminate the tracking once the transmittance is low
+            const auto max_tr = std::max(fabs(tr[0]), std::max(fabs(tr[1]), fabs(tr[2])));
+            if (max_tr < 0.1f) {
+                const auto q = std::max(0.05f, 1.0f - max_tr);
+                if (sort_rand<float>(rc) < q) {
+                    tr = 0.0f;
+                    return false;
+                }
+                tr /= 1.0f - q;
+            }
         }
+    });
 
-        t += dt;
+    return tr;
+}
 
-        if (t >= max_t)
-            break;
-    }
+Spectrum HeterogenousMedium::Sample(const Ray& ray, const float max_t, MediumInteraction*& mi, Spectrum& emission, RenderContext& rc) const {
+    // Spectral tracking, the probability of a real collision follows the extinction weighted by the path throughput.
+    // 'Spectral and Decomposition Tracking for Rendering Heterogeneous Volumes', Kutz et al. 2017
+    SORT_STATS(++sTrackingCount);
+
+    auto weight = Spectrum(1.0f);
+    traverseMajorants(ray, max_t, [&](const float t0, const float t1, const float majorant) {
+        // empty space is skipped all at once
+        if (majorant <= 0.0f)
+            return true;
+
+        auto t = t0;
+        while (true) {
+            t -= log(1.0f - sort_rand<float>(rc)) / majorant;
+            if (t >= t1)
+                return true;
+
+            SORT_STATS(++sTentativeCollisionCount);
+
+            MediumSample ms;
+            MediumInteraction tmp_mi;
+            tmp_mi.intersect = ray(t);
+            tmp_mi.mesh = m_mesh;
+            m_material->EvaluateMediumSample(tmp_mi, ms);
+
+            const auto extinction = ms.basecolor * ms.extinction;
+            const auto null_extinction = majorant - extinction;
+
+            // this is weighted delta tracking wherever the extinction exceeds the majorant
+            const auto real = averageAbs(weight * extinction);
+            const auto null = averageAbs(weight * null_extinction);
+            if (real + null <= 0.0f) {
+                weight = 0.0f;
+                return false;
+            }
+
+            const auto real_pdf = real / (real + null);
+            if (sort_rand<float>(rc) < real_pdf) {
+                // sample a medium and scatter the ray
+                mi = SORT_MALLOC(rc.m_memory_arena, MediumInteraction)();
+                mi->intersect = tmp_mi.intersect;
+                mi->phaseFunction = SORT_MALLOC(rc.m_memory_arena, HenyeyGreenstein)(ms.anisotropy);
+
+                weight /= majorant * real_pdf;
+
+                // This model is what is used in PBRT and different from 'Production Volume Rendering' by Disney.
+                emission = ms.emission * ms.basecolor * ms.absorption * weight;
+
+                weight *= ms.scattering * ms.basecolor;
+                return false;
+            }
+
+            weight *= null_extinction / (majorant * (1.0f - real_pdf));
+        }
+    });
 
-    // sampling the surface behind the volume instead of the volume itself.
-    const auto pdf = (accum_transmittance[0] + accum_transmittance[1] + accum_transmittance[2]) / 3.0f;
-    return accum_transmittance / pdf;
-}
\ No newline at end of file
+    // without any real collision, the surface behind the volume is sampled instead of the volume itself.
+    return weight;
+}
@@ -54,6 +54,8 @@ public:
     //! Beam transmittance is how much percentage of radiance get attenuated during
     //! traveling through the medium. It is a spectrum dependent attenuation.
     //!
+    //! Ratio tracking is used to estimate the transmittance without bias, even where the extinction exceeds the majorant.
+    //!
     //! @param  ray         The ray, which it uses to evaluate beam transmittance.
     //! @param  max_t       The maximum distance to be considered, usually this is the distance the ray travels before it hits a surface.
     //! @return             The attenuation of each spectrum channel.
@@ -61,8 +63,9 @@ public:
 
     //! @brief  Importance sampling a point along the ray in the medium.
     //!
-    //! This is no way to use Delta-Tracking algorithm due to the lack of context of maximum density because
-    //! density is a shader driven property, there is no way to explictly evaluate the maximum value.
+    //! Spectral tracking, a chromatic variant of delta tracking, is used with the majorants from the density grid
+    //! of the mesh. The volume shader is only evaluated at tentative collisions, empty space is skipped. It falls back
+    //! to weighted delta tracking where the extinction exceeds the majorant.
     //!
     //! @param ray          The ray we use to take sample.
     //! @param max_t        The maximum distance to be considered, usually this is the distance the ray travels before it hits a surface.
@@ -72,5 +75,13 @@ public:
     Spectrum Sample(const Ray& ray, const float max_t, MediumInteraction*& mi, Spectrum& emission, RenderContext& rc) const override;
 
 private:
-    const Mesh* m_mesh;
+    const Mesh* m_mesh = nullptr;
+
+    //! @brief  Walk through the segments of the ray with constant majorant of extinction.
+    //!
+    //! @param ray          The ray to walk along.
+    //! @param max_t        The maximum distance to be walked.
+    //! @param visit        Callback taking the range of the segment and its majorant, returning false stops the walk.
+    template<class Visitor>
+    void traverseMajorants(const Ray& ray, const float max_t, Visitor&& visit) const;
 };
\ No newline at end of file
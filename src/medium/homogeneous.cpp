@@ -68,4 +68,25 @@ Spectrum HomogeneousMedium::Sample( const Ray& ray , const float max_t , MediumI
         emission = m_globalMediumSample.basecolor * m_globalMediumSample.emission * m_globalMediumSample.absorption * tr / pdf;
 
     return sample_medium ? ( tr * scattering / pdf ) : ( tr / pdf );
-}
\ No newline at end of file
+}
+
+float HomogeneousMedium::SamplePdf( const float t ) const{
+    // a channel is picked uniformly, the distance is then sampled proportional to its transmittance
+    const auto extinction = m_globalMediumSample.basecolor * m_globalMediumSample.extinction;
+    const auto density = extinction * ( extinction * (-t) ).Exp();
+
+    auto pdf = 0.0f;
+    for( auto i = 0u ; i < RGBSPECTRUM_SAMPLE ; ++i )
+        pdf += density[i];
+    return pdf / RGBSPECTRUM_SAMPLE;
+}
+
+Spectrum HomogeneousMedium::EvaluateScattering( const Ray& ray , const float t , MediumInteraction*& mi , RenderContext& rc ) const{
+    mi = SORT_MALLOC(rc.m_memory_arena, MediumInteraction)();
+    mi->intersect = ray(t);
+    mi->phaseFunction = SORT_MALLOC(rc.m_memory_arena, HenyeyGreenstein)(m_globalMediumSample.anisotropy);
+
+    const auto extinction = m_globalMediumSample.basecolor * m_globalMediumSample.extinction;
+    const auto scattering = m_globalMediumSample.basecolor * m_globalMediumSample.scattering;
+    return ( extinction * (-t) ).Exp() * scattering;
+}
@@ -61,4 +61,18 @@ public:
     //! @param emission     The emission contribution in RTE.
     //! @return             The beam transmittance between the ray origin and the interaction.
     Spectrum Sample( const Ray& ray, const float max_t, MediumInteraction*& mi , Spectrum& emission, RenderContext& rc ) const override;
+
+    //! @brief  Evaluate the density of taking a scattering sample at a distance along the ray through 'Sample'.
+    //!
+    //! @param  t           The distance along the ray.
+    //! @return             The density of sampling the distance.
+    float SamplePdf( const float t ) const override;
+
+    //! @brief  Evaluate the in-scattering at a distance along the ray.
+    //!
+    //! @param  ray         The ray along which the scattering is evaluated.
+    //! @param  t           The distance along the ray.
+    //! @param  mi          The interaction at the distance.
+    //! @return             The beam transmittance up to the distance times the scattering coefficient.
+    Spectrum EvaluateScattering( const Ray& ray , const float t , MediumInteraction*& mi , RenderContext& rc ) const override;
 };
\ No newline at end of file
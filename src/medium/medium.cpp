@@ -73,4 +73,16 @@ Spectrum MediumStack::Sample(const Ray& r, const float max_t , MediumInteraction
     const auto k = clamp((int)(sort_rand<float>(rc) * m_mediumCnt), 0, m_mediumCnt - 1);
     const Medium* medium = m_mediums[k];
     return medium->Sample(r, max_t, mi, emission, rc) * m_mediumCnt;
-}
\ No newline at end of file
+}
+
+float MediumStack::SamplePdf(const float t) const {
+    if (1 != m_mediumCnt)
+        return 0.0f;
+    return m_mediums[0]->SamplePdf(t);
+}
+
+Spectrum MediumStack::EvaluateScattering(const Ray& r, const float t, MediumInteraction*& mi, RenderContext& rc) const {
+    if (1 != m_mediumCnt)
+        return 0.0f;
+    return m_mediums[0]->EvaluateScattering(r, t, mi, rc);
+}
@@ -96,6 +96,29 @@ public:
     //! @return             The beam transmittance between the ray origin and the interaction.
     virtual Spectrum Sample( const Ray& ray , const float max_t , MediumInteraction*& interaction, Spectrum& emission, RenderContext& rc) const = 0;
 
+    //! @brief  Evaluate the density of taking a scattering sample at a distance along the ray through 'Sample'.
+    //!
+    //! Only mediums with closed form transmittance support it, combining other distance sampling techniques with
+    //! 'Sample' through MIS, like equiangular sampling, is not possible for the rest.
+    //!
+    //! @param  t           The distance along the ray.
+    //! @return             The density of sampling the distance, zero if it is not supported.
+    virtual float SamplePdf( const float t ) const {
+        return 0.0f;
+    }
+
+    //! @brief  Evaluate the in-scattering at a distance along the ray.
+    //!
+    //! This is the counterpart of 'Sample' for other distance sampling techniques. It is only supported when 'SamplePdf' is.
+    //!
+    //! @param  ray         The ray along which the scattering is evaluated.
+    //! @param  t           The distance along the ray.
+    //! @param  mi          The interaction at the distance.
+    //! @return             The beam transmittance up to the distance times the scattering coefficient.
+    virtual Spectrum EvaluateScattering( const Ray& ray , const float t , MediumInteraction*& mi , RenderContext& rc ) const {
+        return 0.0f;
+    }
+
     //! @brief    Get the material that spawns the medium.
     //!
     //! @return                The material that spawns the medium.
@@ -162,6 +185,22 @@ public:
     //! @return             Attenuation along the ray all the way to the sampled point.
     Spectrum    Sample(const Ray& r, const float max_t, MediumInteraction*& mi, Spectrum& emission, RenderContext& rc) const;
 
+    //! @brief  Evaluate the density of 'Sample' taking a scattering sample at a distance along the ray.
+    //!
+    //! This is only supported when there is a single medium in the stack, which is the common case.
+    //!
+    //! @param  t           The distance along the ray.
+    //! @return             The density of sampling the distance, zero if it is not supported.
+    float       SamplePdf(const float t) const;
+
+    //! @brief  Evaluate the in-scattering at a distance along the ray.
+    //!
+    //! @param  r           The ray along which the scattering is evaluated.
+    //! @param  t           The distance along the ray.
+    //! @param  mi          The interaction at the distance, null if it is not supported.
+    //! @return             The beam transmittance up to the distance times the scattering coefficient.
+    Spectrum    EvaluateScattering(const Ray& r, const float t, MediumInteraction*& mi, RenderContext& rc) const;
+
 public:
     /**< Mediums it holds. */
     const Medium*    m_mediums[MEDIUM_MAX_CNT] = { nullptr };
@@ -15,6 +15,7 @@
     this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
  */
 
+#include <algorithm>
 #include "mediumdata.h"
 #include "math/point.h"
 #include "stream/stream.h"
@@ -30,11 +31,68 @@ void MediumDensity::Serialize(IStreamBase& stream) {
     if (m_width == 0 || m_height == 0 || m_depth == 0)
         return;
 
-    const auto tex_cnt = m_width * m_height * m_depth;
+    // texels are streamed in one layer of bricks at a time so that the dense volume never lives in memory.
+    allocateBricks();
+    auto texels = std::make_unique<float[]>(m_width * m_height * BRICK_SIZE);
+    for (auto layer = 0u; layer < m_bricks_z; ++layer) {
+        const auto slice_cnt = std::min(BRICK_SIZE, m_depth - layer * BRICK_SIZE);
+        stream.Load((char*)texels.get(), sizeof(float) * m_width * m_height * slice_cnt);
+        setBrickLayer(layer, texels.get());
+    }
 
-    m_memory = std::make_unique<ImgMemory<float>>();
-    m_memory->m_texel = std::make_unique<float[]>(tex_cnt);
-    stream.Load((char*)m_memory->m_texel.get(), sizeof(float) * tex_cnt);
+    buildMajorantGrid();
+}
+
+void MediumDensity::buildMajorantGrid() {
+    m_majorants.Init(m_width, m_height, m_depth, BRICK_SIZE);
+
+    // trilinear filtering close to the border of a brick touches one layer of texels of its neighbors too.
+    // the neighbors are only scanned when their range of values could raise the majorant.
+    auto texel_range = [](int brick, int offset, unsigned res, unsigned& first, unsigned& last) {
+        if (offset < 0) {
+            first = last = brick * BRICK_SIZE - 1;
+        } else if (offset > 0) {
+            first = last = (brick + 1) * BRICK_SIZE;
+        } else {
+            first = brick * BRICK_SIZE;
+            last = std::min((brick + 1) * BRICK_SIZE, res) - 1;
+        }
+    };
+
+    for (auto bz = 0; bz < (int)m_bricks_z; ++bz) {
+        for (auto by = 0; by < (int)m_bricks_y; ++by) {
+            for (auto bx = 0; bx < (int)m_bricks_x; ++bx) {
+                auto max_density = brickMax(bx, by, bz);
+                for (auto nz = std::max(bz - 1, 0); nz <= std::min(bz + 1, (int)m_bricks_z - 1); ++nz) {
+                    for (auto ny = std::max(by - 1, 0); ny <= std::min(by + 1, (int)m_bricks_y - 1); ++ny) {
+                        for (auto nx = std::max(bx - 1, 0); nx <= std::min(bx + 1, (int)m_bricks_x - 1); ++nx) {
+                            if (brickMax(nx, ny, nz) <= max_density)
+                                continue;
+
+                            unsigned x0, x1, y0, y1, z0, z1;
+                            texel_range(bx, nx - bx, m_width, x0, x1);
+                            texel_range(by, ny - by, m_height, y0, y1);
+                            texel_range(bz, nz - bz, m_depth, z0, z1);
+                            for (auto z = z0; z <= z1; ++z)
+                                for (auto y = y0; y <= y1; ++y)
+                                    for (auto x = x0; x <= x1; ++x)
+                                        max_density = std::max(max_density, texel(x, y, z));
+                        }
+                    }
+                }
+                m_majorants.At(bx, by, bz) = max_density;
+            }
+        }
+    }
+}
+
+void MediumMajorantGrid::Init(unsigned width, unsigned height, unsigned depth, unsigned cell_size) {
+    const unsigned dim[3] = { width, height, depth };
+    for (auto i = 0; i < 3; ++i) {
+        m_res[i] = (dim[i] + cell_size - 1) / cell_size;
+        m_scale[i] = (float)dim[i] / (float)cell_size;
+    }
+    m_density = std::make_unique<float[]>(m_res[0] * m_res[1] * m_res[2]);
 }
 
 Spectrum MediumColor::Sample(const Point& uvw) const {
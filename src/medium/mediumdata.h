@@ -17,12 +17,66 @@
 
 #pragma once
 
+#include <cfloat>
 #include "core/define.h"
 #include "texture/imagetexture3d.h"
+#include "math/point.h"
 
-struct Point;
 class IStreamBase;
 
+//! @brief  Coarse grid keeping the maximum density of each brick of texels in a medium volume.
+/**
+ * The grid bounds the density that trilinear filtering could return anywhere inside a cell. Delta tracking
+ * and ratio tracking take steps as big as the bound allows and skip cells without density at all.
+ */
+class MediumMajorantGrid {
+public:
+    //! @brief  Allocate the grid, all cells are initialized to zero.
+    //!
+    //! Cells are aligned with the texels, the ones at the upper border of the volume are only partially covered by it
+    //! when the resolution of the volume is not a multiple of the cell size.
+    //!
+    //! @param  width       Number of texels along x axis.
+    //! @param  height      Number of texels along y axis.
+    //! @param  depth       Number of texels along z axis.
+    //! @param  cell_size   Number of texels along each axis of a cell.
+    void    Init(unsigned width, unsigned height, unsigned depth, unsigned cell_size);
+
+    //! @brief  Whether the grid has any cell.
+    bool    IsValid() const {
+        return IS_PTR_VALID(m_density);
+    }
+
+    //! @brief  Get the maximum density of a cell.
+    float&       At(unsigned x, unsigned y, unsigned z) {
+        return m_density[(z * m_res[1] + y) * m_res[0] + x];
+    }
+    const float& At(unsigned x, unsigned y, unsigned z) const {
+        return m_density[(z * m_res[1] + y) * m_res[0] + x];
+    }
+
+    //! @brief  Walk through the cells along a ray with a 3D DDA.
+    //!
+    //! The ray is in volume space, where the volume occupies the unit cube. Since the transformation to volume
+    //! space is affine, distances along the ray are the same as the ones in world space. The parts of the ray
+    //! outside the unit cube are visited with zero density.
+    //!
+    //! @param  ori     Origin of the ray in volume space.
+    //! @param  dir     Direction of the ray in volume space, it doesn't need to be normalized.
+    //! @param  max_t   The maximum distance to be walked.
+    //! @param  visit   Callback taking the range of the segment and its maximum density, returning false stops the walk.
+    template<class Visitor>
+    void    Traverse(const Point& ori, const Vector& dir, const float max_t, Visitor&& visit) const;
+
+private:
+    /**< Resolution of the grid. */
+    unsigned                    m_res[3] = { 0u, 0u, 0u };
+    /**< Number of cells covered by the volume along each axis, it is fractional if the last cell is partially covered. */
+    float                       m_scale[3] = { 0.0f, 0.0f, 0.0f };
+    /**< Maximum density of each cell. */
+    std::unique_ptr<float[]>    m_density;
+};
+
 //! @brief  Medium density data structure allows variation of density inside a medium volume.
 /**
  * Medium density is essentially a 3D texture.
@@ -40,6 +94,20 @@ public:
     //! @param  Stream  where the serialization data comes from. Depending on different situation,
     //!                 it could come from different places.
     void    Serialize(IStreamBase& stream);
+
+    //! @brief  Get the majorant grid of the density.
+    //!
+    //! @return         The coarse grid bounding the density.
+    const MediumMajorantGrid& GetMajorantGrid() const {
+        return m_majorants;
+    }
+
+private:
+    /**< Coarse grid bounding the density. */
+    MediumMajorantGrid  m_majorants;
+
+    //! @brief  Build the majorant grid from the texels.
+    void    buildMajorantGrid();
 };
 
 //! @brief  Medium color data structure allows variation of color inside a medium volume.
@@ -56,4 +124,76 @@ public:
     //! @param  Stream  where the serialization data comes from. Depending on different situation,
     //!                 it could come from different places.
     void    Serialize(IStreamBase& stream);
-};
\ No newline at end of file
+};
+
+template<class Visitor>
+void MediumMajorantGrid::Traverse(const Point& ori, const Vector& dir, const float max_t, Visitor&& visit) const {
+    // clip the ray against the unit cube
+    auto t_enter = 0.0f, t_exit = max_t;
+    for (auto i = 0; i < 3 && t_enter <= t_exit; ++i) {
+        if (dir[i] == 0.0f) {
+            if (ori[i] < 0.0f || ori[i] > 1.0f)
+                t_exit = -1.0f;
+            continue;
+        }
+        const auto inv_dir = 1.0f / dir[i];
+        auto t0 = -ori[i] * inv_dir;
+        auto t1 = (1.0f - ori[i]) * inv_dir;
+        if (t0 > t1)
+            std::swap(t0, t1);
+        t_enter = std::max(t_enter, t0);
+        t_exit = std::min(t_exit, t1);
+    }
+
+    // the ray doesn't overlap with the volume
+    if (!IsValid() || t_enter >= t_exit) {
+        visit(0.0f, max_t, 0.0f);
+        return;
+    }
+
+    if (t_enter > 0.0f && !visit(0.0f, t_enter, 0.0f))
+        return;
+
+    // setup the 3D DDA from the entering point, the walk stops at the volume border even inside a partial cell.
+    int     cell[3], step[3], end[3];
+    float   t_next[3], t_delta[3];
+    for (auto i = 0; i < 3; ++i) {
+        const auto res = (int)m_res[i];
+        const auto scale = m_scale[i];
+        const auto p = (ori[i] + dir[i] * t_enter) * scale;
+        cell[i] = clamp((int)p, 0, res - 1);
+        if (dir[i] > 0.0f) {
+            step[i] = 1;
+            end[i] = res;
+            t_delta[i] = 1.0f / (dir[i] * scale);
+            t_next[i] = t_enter + ((float)(cell[i] + 1) - p) * t_delta[i];
+        } else if (dir[i] < 0.0f) {
+            step[i] = -1;
+            end[i] = -1;
+            t_delta[i] = -1.0f / (dir[i] * scale);
+            t_next[i] = t_enter + (p - (float)cell[i]) * t_delta[i];
+        } else {
+            step[i] = 0;
+            end[i] = -1;
+            t_delta[i] = FLT_MAX;
+            t_next[i] = FLT_MAX;
+        }
+    }
+
+    auto t = t_enter;
+    while (t < t_exit) {
+        const auto axis = (t_next[0] < t_next[1]) ? (t_next[0] < t_next[2] ? 0 : 2) : (t_next[1] < t_next[2] ? 1 : 2);
+        const auto t_end = std::min(t_next[axis], t_exit);
+        if (t_end > t && !visit(t, t_end, At(cell[0], cell[1], cell[2])))
+            return;
+
+        t = t_end;
+        cell[axis] += step[axis];
+        if (cell[axis] == end[axis])
+            break;
+        t_next[axis] += t_delta[axis];
+    }
+
+    if (t_exit < max_t)
+        visit(t_exit, max_t, 0.0f);
+}
@@ -85,6 +85,8 @@ public:
     float                           img_u = 0.0f;
     float                           img_v = 0.0f;   // the range of the float2 should be (0,0) <-> (1,1)
     float                           dof_u , dof_v;  // the range of the float2 should be (-1,-1) <-> (1,1)
+    int                             pixel_x = 0;
+    int                             pixel_y = 0;    // the pixel that the sample belongs to
     std::unique_ptr<LightSample[]>  light_sample = nullptr;
     std::unique_ptr<BsdfSample[]>   bsdf_sample = nullptr;
     std::vector<unsigned>           light_dimension;
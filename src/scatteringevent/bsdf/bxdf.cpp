@@ -64,6 +64,12 @@ float Bxdf::pdf( const Vector& wo , const Vector& wi ) const{
     return CosHemispherePdf( wi );
 }
 
+Spectrum Bxdf::f_pdf( const Vector& wo , const Vector& wi , float* pPdf , float* pRevPdf ) const{
+    if( pPdf ) *pPdf = pdf( wo , wi );
+    if( pRevPdf ) *pRevPdf = pdf( wi , wo );
+    return f( wo , wi );
+}
+
 bool Bxdf::PointingUp( const Vector& v ) const {
     return dot( v , gnormal ) > 0.0f;
 }
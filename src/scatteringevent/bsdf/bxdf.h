@@ -105,6 +105,20 @@ public:
         return pdf( bsdfToBxdf(wo) , bsdfToBxdf(wi) );
     }
 
+    //! Evaluate the BXDF along with the PDFs of sampling either direction from the other one.
+    //!
+    //! This is equivalent to calling F, Pdf( wo , wi ) and Pdf( wi , wo ), except that the work shared by them, like
+    //! the transformation to shading coordinate, fresnel and the NDF, only happens once.
+    //!
+    //! @param  wo      The exitant direction in local space.
+    //! @param  wi      The incident direction in local space.
+    //! @param  pdf     The PDF w.r.t the solid angle to pick the incident direction (@param wi). It could be 'nullptr'.
+    //! @param  rev_pdf The PDF w.r.t the solid angle to pick the exitant direction (@param wo). It could be 'nullptr'.
+    //! @return         Evaluated BRDF by cos(\theta)
+    virtual Spectrum F_Pdf( const Vector& wo , const Vector& wi , float* pdf , float* rev_pdf ) const{
+        return f_pdf( bsdfToBxdf(wo) , bsdfToBxdf(wi) , pdf , rev_pdf );
+    }
+
     //! @brief  Check the type of the bxdf, it shouldn't be overridden by derived classes.
     //!
     //! @param type     The type to check.
@@ -120,6 +134,16 @@ public:
         return m_type;
     }
 
+    //! @brief  Get the roughness of the bxdf.
+    //!
+    //! Bxdfs with no notion of roughness are treated as fully rough. Integrators use this to tell near specular
+    //! lobes apart deterministically, which the type flags can't do since most bxdfs are flagged as diffuse.
+    //!
+    //! @return The roughness of the bxdf, zero for perfect specular.
+    virtual float GetRoughness() const {
+        return 1.0f;
+    }
+
     //! @brief  Hemispherical-Direcitonal reflectance
     //! 
     //! @param wo   Outgoing direction.
@@ -156,7 +180,19 @@ public:
     //! @param wi   Incident direction in shading coordinate.
     //! @return     The probability of choosing the out-going direction based on the Incident direction.
     virtual float pdf( const Vector& wo , const Vector& wi ) const;
-    
+
+    //! @brief  Evaluate the bxdf and the pdfs of both directions in a single pass.
+    //!
+    //! The default implementation simply falls back to 'f' and 'pdf', bxdfs sharing terms between them are
+    //! supposed to override it.
+    //!
+    //! @param wo       Exitant direction in shading coordinate.
+    //! @param wi       Incident direction in shading coordinate.
+    //! @param pdf      Probability density of choosing the incident direction, it could be 'nullptr'.
+    //! @param rev_pdf  Probability density of choosing the exitant direction, it could be 'nullptr'.
+    //! @return         The Evaluated BRDF value.
+    virtual Spectrum f_pdf( const Vector& wo , const Vector& wi , float* pdf , float* rev_pdf ) const;
+
 protected:
     //! @brief Evaluate the BRDF.
     //!
@@ -147,3 +147,48 @@ float Coat::Pdf( const Vector& wo , const Vector& wi ) const{
     const auto layer1_pdf = (tir_o || tir_i) ? 0.0f : bottom->Pdf_BSDF(-r_wo, -r_wi);
     return slerp( layer1_pdf , layer0_pdf , specProp );
 }
+
+Spectrum Coat::F_Pdf( const Vector& wo , const Vector& wi , float* pPdf , float* pRevPdf ) const{
+    if( pPdf ) *pPdf = 0.0f;
+    if( pRevPdf ) *pRevPdf = 0.0f;
+
+    if (!SameHemiSphere(wo, wi)) return 0.0f;
+    const auto up_o = PointingUp(wo);
+    const auto up_i = PointingUp(wi);
+    if (!up_o && !up_i) return 0.0f;
+
+    const auto swo = bsdfToBxdf( wo );
+    const auto swi = bsdfToBxdf( wi );
+
+    auto coat_pdf = 0.0f , coat_rev_pdf = 0.0f;
+    auto ret = coat.f_pdf(swo, swi, &coat_pdf, &coat_rev_pdf);
+
+    auto tir_o = false, tir_i = false;
+    const auto r_wo = refract(swo, DIR_UP, ior, 1.0f, tir_o);
+    const auto r_wi = refract(swi, DIR_UP, ior, 1.0f, tir_i);
+    const auto F_o = fresnel.Evaluate(cosTheta(swo));
+    const auto F_i = fresnel.Evaluate(cosTheta(swi));
+
+    auto bottom_pdf = 0.0f , bottom_rev_pdf = 0.0f;
+    if (!tir_o && !tir_i) {
+        // Bouguer-Lambert-Beer law
+        const auto attenuation = ( -thickness * sigma * (1.0f / absCosTheta(r_wo) + 1.0f / absCosTheta(r_wi))).Exp();
+        // Fresnel attenuation between the boundary across layer0 and layer1
+        const auto T12 = (1.0f - F_o);
+        const auto T21 = slerp( 1.0f - F_i, 1.0f, TIR_COMPENSATION);
+
+        ret += bottom->Evaluate_BSDF_Pdf( -r_wo , -r_wi , bottom_pdf , &bottom_rev_pdf ) * attenuation * T12 * T21 / ( ior * ior );
+    }
+
+    // the probability of sampling the top layer depends on which direction the sampling starts from
+    const auto specProp = [&]( const Vector& r_w , const Spectrum& F ){
+        const auto attenuation = ( -thickness * sigma * 2.0f / absCosTheta(r_w) ).Exp();
+        const auto I1 = F.GetIntensity();
+        const auto I2 = ( 1.0f - I1 ) * ( 1.0f - I1 ) * attenuation.GetIntensity() / ( ior * ior );
+        return I1 / ( I1 + I2 );
+    };
+    if( pPdf && up_o ) *pPdf = slerp( bottom_pdf , coat_pdf , specProp( r_wo , F_o ) );
+    if( pRevPdf && up_i ) *pRevPdf = slerp( bottom_rev_pdf , coat_rev_pdf , specProp( r_wi , F_i ) );
+
+    return up_o ? ret : 0.0f;
+}
@@ -79,6 +79,15 @@ public:
     //! @return     The probability of choosing the out-going direction based on the Incident direction.
     float Pdf( const Vector& wo , const Vector& wi ) const override;
 
+    //! @brief Evaluate the BRDF and the pdfs of both directions, the bottom layer is only visited once.
+    //!
+    //! @param wo       Exitant direction in shading coordinate.
+    //! @param wi       Incident direction in shading coordinate.
+    //! @param pdf      Probability density of choosing the incident direction, it could be 'nullptr'.
+    //! @param rev_pdf  Probability density of choosing the exitant direction, it could be 'nullptr'.
+    //! @return         The Evaluated BRDF value.
+    Spectrum F_Pdf( const Vector& wo , const Vector& wi , float* pdf , float* rev_pdf ) const override;
+
 private:
     const float thickness ;     /**< Thickness of the layer. */
     const float ior ;           /**< Index of refraction out side the surface where the normal points. */
@@ -102,4 +111,8 @@ private:
         sAssertMsg( false , MATERIAL , "This function shouldn't be called" );
         return 0.0f;
     }
+    Spectrum f_pdf( const Vector& wo , const Vector& wi , float* pdf , float* rev_pdf ) const override{
+        sAssertMsg( false , MATERIAL , "This function shouldn't be called" );
+        return 0.0f;
+    }
 };
@@ -74,6 +74,13 @@ public:
     //! @return     The Evaluated BRDF value.
     Spectrum sample_f(const Vector& wo, Vector& wi, const BsdfSample& bs, float* pdf) const override;
 
+    //! @brief  Get the roughness of the shared normal distribution.
+    //!
+    //! @return The roughness of the shared normal distribution.
+    float GetRoughness() const override {
+        return mf_reflect.GetRoughness();
+    }
+
     //! @brief Evaluate the pdf of an exitant direction given the Incident direction.
     //! @param wo   Exitant direction in shading coordinate.
     //! @param wi   Incident direction in shading coordinate.
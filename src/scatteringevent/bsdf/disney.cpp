@@ -67,6 +67,14 @@ SORT_STATIC_FORCEINLINE float SchlickR0FromEta( float rROI ){
     return SQR( ( rROI - 1.0f ) / ( rROI + 1.0f ) );
 }
 
+// Single scattering microfacet reflection with the NDF evaluated by the caller, both directions are expected to be above the surface.
+SORT_STATIC_FORCEINLINE Spectrum microfacetReflection( const Vector& wo , const Vector& wi , const Vector& wh , const float D , const Fresnel& fresnel , const MicroFacetDistribution& dist ){
+    const auto NoV = absCosTheta( wo );
+    if( NoV == 0.0f )
+        return 0.0f;
+    return fresnel.Evaluate( dot( wo , wh ) ) * ( D * dist.G( wo , wi ) / ( 4.0f * NoV ) );
+}
+
 constexpr float burley_max_cdf_calc( float max_r_d ){
     return 0.25f * ( 4.0f - exp_compile( -max_r_d ) - 3.0f * exp_compile( -max_r_d / 3.0f ) );
 }
@@ -92,6 +100,15 @@ Vector ClearcoatGGX::sample_f(const BsdfSample& bs) const {
     return sphericalVec(theta, phi);
 }
 
+Vector ClearcoatGGX::sample_f(const Vector& wo, const BsdfSample& bs) const {
+    // There is no analytical way to sample visible normals of GTR1, it falls back to sampling the NDF.
+    return sample_f(bs);
+}
+
+float ClearcoatGGX::Pdf(const Vector& wo, const Vector& wh, float d) const {
+    return d * absCosTheta(wh);
+}
+
 float ClearcoatGGX::G1(const Vector& v) const {
     if (absCosTheta(v) == 1.0f)
         return 0.0f;
@@ -179,6 +196,23 @@ float DisneyBssrdf::Max_Sr(int ch) const{
 }
 
 Spectrum DisneyBRDF::f( const Vector& wo , const Vector& wi ) const {
+    return evaluate( wo , wi , true , nullptr , nullptr );
+}
+
+float DisneyBRDF::pdf( const Vector& wo , const Vector& wi ) const {
+    auto ret = 0.0f;
+    evaluate( wo , wi , false , &ret , nullptr );
+    return ret;
+}
+
+Spectrum DisneyBRDF::f_pdf( const Vector& wo , const Vector& wi , float* pPdf , float* pRevPdf ) const {
+    return evaluate( wo , wi , true , pPdf , pRevPdf );
+}
+
+Spectrum DisneyBRDF::evaluate( const Vector& wo , const Vector& wi , bool evalValue , float* pPdf , float* pRevPdf ) const {
+    if( pPdf ) *pPdf = 0.0f;
+    if( pRevPdf ) *pRevPdf = 0.0f;
+
     const auto aspect = sqrt(sqrt(1.0f - anisotropic * 0.9f));
     const auto diffuseWeight = (1.0f - metallic) * (1.0 - specTrans);
 
@@ -188,12 +222,26 @@ Spectrum DisneyBRDF::f( const Vector& wo , const Vector& wi ) const {
 
     const auto luminance = basecolor.GetIntensity();
     const auto Ctint = luminance > 0.0f ? basecolor * (1.0f / luminance) : Spectrum(1.0f);
+    const auto min_specular_amount = SchlickR0FromEta(ior_ex / ior_in);
+    const auto Cspec0 = slerp(specular * min_specular_amount * slerp(Spectrum(1.0f), Ctint, specularTint), basecolor, metallic);
+    const auto hasSSS = !scatterDistance.IsBlack();
+
+    // weights of picking each lobe in 'sample_f'
+    const auto clearcoat_weight = clearcoat * 0.04f;
+    const auto specular_reflection_weight = Cspec0.GetIntensity() * specularPdfScale( roughness );
+    const auto specular_transmission_weight = luminance * (1.0f - metallic) * specTrans;
+    const auto diffuse_reflection_weight = hasSSS ? 0.0f : luminance * (1.0f - metallic) * (1.0f - specTrans) * (thinSurface ? (1.0f - diffTrans) : 1.0f);
+    const auto diffuse_transmission_weight = thinSurface ? luminance * (1.0f - metallic) * (1.0f - specTrans) * diffTrans : 0.0f;
+
+    const auto total_weight = clearcoat_weight + specular_reflection_weight + specular_transmission_weight + diffuse_reflection_weight + diffuse_transmission_weight;
+    const auto evalPdf = ( pPdf || pRevPdf ) && total_weight > 0.0f;
+    auto total_pdf = 0.0f , total_rev_pdf = 0.0f;
 
     auto ret = RGBSpectrum(0.0f);
 
     const auto evaluate_reflection = PointingUp( wo ) && PointingUp( wi );
 
-    if (diffuseWeight > 0.0f) {
+    if (evalValue && diffuseWeight > 0.0f) {
         const auto NoO = cosTheta(wo);
         const auto NoI = cosTheta(wi);
         const auto Clampped_NoI = saturate(NoI);
@@ -249,25 +297,55 @@ Spectrum DisneyBRDF::f( const Vector& wo , const Vector& wi ) const {
         }
     }
 
-    // Specular reflection term in Disney BRDF
+    if (evalPdf && diffuse_reflection_weight > 0.0f) {
+        // albedo doesn't matter here, we are only interested in light direction.
+        total_pdf += diffuse_reflection_weight * CosHemispherePdf(wi);
+        total_rev_pdf += diffuse_reflection_weight * CosHemispherePdf(wo);
+    }
+
+    // Specular reflection term in Disney BRDF, the NDF is shared by the BRDF and the pdfs.
     const GGX ggx(roughness / aspect, roughness * aspect);
-    const auto Cspec0 = slerp(specular * SchlickR0FromEta( ior_ex / ior_in ) * slerp(Spectrum(1.0f), Ctint, specularTint), basecolor, metallic);
-    if (!Cspec0.IsBlack() && evaluate_reflection) {
-        const FresnelSchlick<Spectrum> fresnel(Cspec0);
-        const MicroFacetReflection mf(rc, WHITE_SPECTRUM, &fresnel, &ggx, FULL_WEIGHT, nn);
-        ret += mf.f(wo, wi);
+    if ((evalValue && !Cspec0.IsBlack() && evaluate_reflection) || (evalPdf && specular_reflection_weight > 0.0f)) {
+        const auto D = ggx.D(wh);
+        if (evalValue && !Cspec0.IsBlack() && evaluate_reflection) {
+            const FresnelSchlick<Spectrum> fresnel(Cspec0);
+            ret += microfacetReflection(wo, wi, wh, D, fresnel, ggx);
+        }
+        if (evalPdf && specular_reflection_weight > 0.0f) {
+            total_pdf += specular_reflection_weight * ggx.Pdf(wo, wh, D) / (4.0f * absDot(wo, wh));
+            total_rev_pdf += specular_reflection_weight * ggx.Pdf(wi, wh, D) / (4.0f * absDot(wi, wh));
+        }
     }
 
     // Another layer of clear coat on top of everything below.
-    if (clearcoat > 0.0f && evaluate_reflection) {
+    if (clearcoat > 0.0f && ((evalValue && evaluate_reflection) || evalPdf)) {
         const ClearcoatGGX cggx(sqrt(slerp(0.1f, 0.001f, clearcoatGloss)));
-        const FresnelSchlick<float> fresnel(0.04f);
-        const MicroFacetReflection mf_clearcoat(rc, WHITE_SPECTRUM, &fresnel, &cggx, FULL_WEIGHT, nn);
-        ret += clearcoat * mf_clearcoat.f(wo, wi);
+        const auto D = cggx.D(wh);
+        if (evalValue && evaluate_reflection) {
+            const FresnelSchlick<float> fresnel(0.04f);
+            ret += clearcoat * microfacetReflection(wo, wi, wh, D, fresnel, cggx);
+        }
+        if (evalPdf) {
+            const auto pdf_h = clearcoat_weight * D * absCosTheta(wh) * 0.25f;
+            total_pdf += pdf_h / absDot(wo, wh);
+            total_rev_pdf += pdf_h / absDot(wi, wh);
+        }
     }
 
     // Specular transmission
     if (specTrans > 0.0f) {
+        const auto evaluate_transmission = [&](const MicroFacetRefraction& mr) {
+            auto mr_pdf = 0.0f, mr_rev_pdf = 0.0f;
+            if (evalValue) {
+                ret += specTrans * (1.0f - metallic) * mr.f_pdf(wo, wi, evalPdf ? &mr_pdf : nullptr, (evalPdf && pRevPdf) ? &mr_rev_pdf : nullptr);
+            } else if (evalPdf) {
+                mr_pdf = mr.pdf(wo, wi);
+                if (pRevPdf) mr_rev_pdf = mr.pdf(wi, wo);
+            }
+            total_pdf += specular_transmission_weight * mr_pdf;
+            total_rev_pdf += specular_transmission_weight * mr_rev_pdf;
+        };
+
         if (thinSurface) {
             // Scale roughness based on IOR (Burley 2015, Figure 15).
             const auto rscaled = (0.65f * inv_eta - 0.35f) * roughness;
@@ -275,20 +353,28 @@ Spectrum DisneyBRDF::f( const Vector& wo , const Vector& wi ) const {
             const auto rv = SQR(rscaled) * aspect;
             const GGX scaledDist(ru, rv);
 
-            MicroFacetRefraction mr(rc, basecolor.Sqrt(), &scaledDist, ior_ex, ior_in, FULL_WEIGHT, nn);
-            ret += specTrans * (1.0f - metallic) * mr.f(wo, wi);
+            evaluate_transmission(MicroFacetRefraction(rc, basecolor.Sqrt(), &scaledDist, ior_ex, ior_in, FULL_WEIGHT, nn));
         } else {
             // Microfacet Models for Refraction through Rough Surfaces
             // https://www.cs.cornell.edu/~srm/publications/EGSR07-btdf.pdf
-            MicroFacetRefraction mr(rc, basecolor, &ggx, ior_ex, ior_in, FULL_WEIGHT, nn);
-            ret += specTrans * (1.0f - metallic) * mr.f(wo, wi);
+            evaluate_transmission(MicroFacetRefraction(rc, basecolor, &ggx, ior_ex, ior_in, FULL_WEIGHT, nn));
         }
     }
 
     // Diffuse transmission
-    if ( thinSurface && diffTrans > 0.0f && diffuseWeight > 0.0f ) {
+    if (thinSurface && ((evalValue && diffTrans > 0.0f && diffuseWeight > 0.0f) || (evalPdf && diffuse_transmission_weight > 0.0f))) {
         LambertTransmission lambert_transmission(rc, basecolor, 1.0f, nn);
-        ret += diffTrans * diffuseWeight * lambert_transmission.f(wo, wi) ;
+        if (evalValue && diffTrans > 0.0f && diffuseWeight > 0.0f)
+            ret += diffTrans * diffuseWeight * lambert_transmission.f(wo, wi);
+        if (evalPdf && diffuse_transmission_weight > 0.0f) {
+            total_pdf += diffuse_transmission_weight * lambert_transmission.pdf(wo, wi);
+            total_rev_pdf += diffuse_transmission_weight * lambert_transmission.pdf(wi, wo);
+        }
+    }
+
+    if (evalPdf) {
+        if (pPdf) *pPdf = total_pdf / total_weight;
+        if (pRevPdf) *pRevPdf = total_rev_pdf / total_weight;
     }
 
     return ret;
@@ -334,7 +420,7 @@ Spectrum DisneyBRDF::sample_f(const Vector& wo, Vector& wi, const BsdfSample& bs
     }else if (r <= sr_w) {
         BsdfSample sample(rc);
         Vector wh;
-        wh = ggx.sample_f(sample);
+        wh = ggx.sample_f(wo, sample);
         wi = 2 * dot(wo, wh) * wh - wo;
     }else if (r <= st_w) {
         if (thinSurface) {
@@ -365,72 +451,7 @@ Spectrum DisneyBRDF::sample_f(const Vector& wo, Vector& wi, const BsdfSample& bs
         lambert_transmission.sample_f(wo, wi, bs, pPdf);
     }
 
-    if (pPdf) *pPdf = pdf(wo, wi);
-
-    auto ret = f( wo , wi );
-    return ret;
-}
-
-float DisneyBRDF::pdf( const Vector& wo , const Vector& wi ) const {
-    const auto aspect = sqrt(sqrt(1.0f - anisotropic * 0.9f));
-    const auto luminance = basecolor.GetIntensity();
-    const auto Ctint = luminance > 0.0f ? basecolor * (1.0f / luminance) : Spectrum(1.0f);
-    const auto min_specular_amount = SchlickR0FromEta(ior_ex / ior_in);
-    const auto Cspec0 = slerp(specular * min_specular_amount * slerp(Spectrum(1.0f), Ctint, specularTint), basecolor, metallic);
-    const auto hasSSS = !scatterDistance.IsBlack();
-
-    const auto base_color_intensity = basecolor.GetIntensity();
-    const auto clearcoat_weight = clearcoat * 0.04f;
-    const auto specular_reflection_weight = Cspec0.GetIntensity() * specularPdfScale( roughness );
-    const auto specular_transmission_weight = base_color_intensity * (1.0f - metallic) * specTrans;
-    const auto diffuse_reflection_weight = hasSSS ? 0.0f : base_color_intensity * (1.0f - metallic) * (1.0f - specTrans) * (thinSurface ? (1.0f - diffTrans) : 1.0f);
-    const auto diffuse_transmission_weight = thinSurface ? base_color_intensity * (1.0f - metallic) * (1.0f - specTrans) * diffTrans : 0.0f;
-    
-    const auto total_weight = clearcoat_weight + specular_reflection_weight + specular_transmission_weight + diffuse_reflection_weight + diffuse_transmission_weight;
-    if (total_weight <= 0.0f)
-        return 0.0f;
-
-    auto total_pdf = 0.0f;
-    const auto wh = normalize(wi + wo);
-    const GGX ggx(roughness / aspect, roughness * aspect);
-    if (clearcoat_weight > 0.0f) {
-        const ClearcoatGGX cggx(sqrt(slerp(0.1f, 0.001f, clearcoatGloss)));
-        total_pdf += clearcoat_weight * cggx.Pdf(wh) / (4.0f * absDot(wo, wh));
-    }
-    if (specular_reflection_weight > 0.0f) {
-        total_pdf += specular_reflection_weight * ggx.Pdf(wh) / (4.0f * absDot(wo, wh));
-    }
-    if (specular_transmission_weight > 0.0f) {
-        if (thinSurface) {
-            // Scale roughness based on IOR (Burley 2015, Figure 15).
-            const auto rscaled = (0.65f * inv_eta - 0.35f) * roughness;
-            const auto ru = SQR(rscaled) / aspect;
-            const auto rv = SQR(rscaled) * aspect;
-            const GGX scaledDist(ru, rv);
-
-            MicroFacetRefraction mr(rc, WHITE_SPECTRUM, &scaledDist, ior_ex, ior_in, FULL_WEIGHT, nn);
-            total_pdf += specular_transmission_weight * mr.pdf(wo, wi);
-        }
-        else {
-            // Sampling the transmission BTDF
-            MicroFacetRefraction mr(rc, WHITE_SPECTRUM, &ggx, ior_ex, ior_in, FULL_WEIGHT, nn);
-            total_pdf += specular_transmission_weight * mr.pdf(wo, wi);
-        }
-    }
-    if (diffuse_reflection_weight > 0.0f) {
-        // albedo doesn't matter here, we are only interested in light direction.
-        if( hasSSS ){
-            // No PDF should be returned, otherwise it will introduce bugs!!
-        }else{
-            total_pdf += diffuse_reflection_weight * CosHemispherePdf(wi);
-        }
-    }
-    if (diffuse_transmission_weight > 0.0f) {
-        LambertTransmission lambert_transmission(rc, basecolor, diffTrans, nn);
-        total_pdf += diffuse_transmission_weight * lambert_transmission.pdf(wo, wi);
-    }
-
-    return total_pdf / total_weight;
+    return evaluate( wo , wi , true , pPdf , nullptr );
 }
 
  float DisneyBRDF::Evaluate_Sampling_Weight( const ClosureTypeDisney& params ){
@@ -146,6 +146,14 @@ public:
     //! @return     The probability of choosing the out-going direction based on the Incident direction.
     float pdf( const Vector& wo , const Vector& wi ) const override;
 
+    //! @brief Evaluate the BRDF and the pdfs of both directions in a single pass.
+    //! @param wo       Exitant direction in shading coordinate.
+    //! @param wi       Incident direction in shading coordinate.
+    //! @param pdf      Probability density of choosing the incident direction, it could be 'nullptr'.
+    //! @param rev_pdf  Probability density of choosing the exitant direction, it could be 'nullptr'.
+    //! @return         The Evaluated BRDF value.
+    Spectrum f_pdf( const Vector& wo , const Vector& wi , float* pdf , float* rev_pdf ) const override;
+
     //! @brief Helper function to evaluate the sampline weight of disney brdf.
     //!
     //! @param  params      Parameters used to construct the class instance.
@@ -153,6 +161,15 @@ public:
     static float Evaluate_Sampling_Weight( const ClosureTypeDisney& params );
 
 private:
+    //! @brief All lobes of the BRDF are evaluated here, the shared terms between the value and the pdfs are only evaluated once.
+    //! @param wo           Exitant direction in shading coordinate.
+    //! @param wi           Incident direction in shading coordinate.
+    //! @param evalValue    Whether the value of the BRDF is needed, zero is returned if it is not.
+    //! @param pdf          Probability density of choosing the incident direction, it could be 'nullptr'.
+    //! @param rev_pdf      Probability density of choosing the exitant direction, it could be 'nullptr'.
+    //! @return             The Evaluated BRDF value.
+    Spectrum evaluate( const Vector& wo , const Vector& wi , bool evalValue , float* pdf , float* rev_pdf ) const;
+
     const Spectrum  basecolor;          /**< The surface color, usually supplied by texture maps. */
     const float     metallic;           /**< The metallic-ness (0 = dielectric, 1 = metallic). This is a linear blend between two different models. The metallic model has no diffuse component and also has a tinted incident specular, equal to the base color. */
     const float     specular;           /**< Incident specular amount. This is in lieu of an explicit index-of-refraction. */
@@ -186,6 +203,20 @@ public:
     //! @return     Sampled normal direction based on the NDF.
     Vector sample_f(const BsdfSample& bs) const override;
 
+    //! @brief Sampling a normal visible from the exitant direction, which simply samples the NDF.
+    //!
+    //! @param wo   Exitant direction in shading coordinate.
+    //! @param bs   Sample holding all necessary random variables.
+    //! @return     Sampled normal direction based on the NDF.
+    Vector sample_f(const Vector& wo, const BsdfSample& bs) const override;
+
+    //! @brief PDF of sampling a specific normal direction through 'sample_f( wo , bs )'.
+    //!
+    //! @param wo   Exitant direction in shading coordinate.
+    //! @param wh   Normal direction to be sampled.
+    //! @param d    NDF of the normal direction.
+    float Pdf(const Vector& wo, const Vector& wh, float d) const override;
+
 protected:
     //! @brief Smith shadow-masking function G1
     float G1(const Vector& v) const override;
@@ -57,3 +57,19 @@ float DoubleSided::pdf(const Vector& wo, const Vector& wi) const {
     if (back0) return m_se1 ? m_se1->Pdf_BSDF(-wo, -wi) : 0.0f;
     return 0.0f;
 }
+
+Spectrum DoubleSided::f_pdf(const Vector& wo, const Vector& wi, float* pPdf, float* pRevPdf) const {
+    if (pPdf) *pPdf = 0.0f;
+    if (pRevPdf) *pRevPdf = 0.0f;
+
+    const auto back0 = cosTheta(wo) < 0.0f;
+    const auto back1 = cosTheta(wi) < 0.0f;
+    if (back0 ^ back1) return 0.0f;
+
+    auto pdf = 0.0f;
+    Spectrum ret;
+    if (!back0 && m_se0) ret = m_se0->Evaluate_BSDF_Pdf(wo, wi, pdf, pRevPdf);
+    if (back0 && m_se1) ret = m_se1->Evaluate_BSDF_Pdf(-wo, -wi, pdf, pRevPdf);
+    if (pPdf) *pPdf = pdf;
+    return ret;
+}
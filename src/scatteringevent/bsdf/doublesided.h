@@ -59,6 +59,14 @@ public:
     //! @return     The probability of choosing the out-going direction based on the Incident direction.
     float pdf( const Vector& wo , const Vector& wi ) const override;
 
+    //! @brief Evaluate the BRDF and the pdfs of both directions, the scattering event of the facing side is only visited once.
+    //! @param wo       Exitant direction in shading coordinate.
+    //! @param wi       Incident direction in shading coordinate.
+    //! @param pdf      Probability density of choosing the incident direction, it could be 'nullptr'.
+    //! @param rev_pdf  Probability density of choosing the exitant direction, it could be 'nullptr'.
+    //! @return         The Evaluated BRDF value.
+    Spectrum f_pdf( const Vector& wo , const Vector& wi , float* pdf , float* rev_pdf ) const override;
+
 private:
     const ScatteringEvent* m_se0;      /**< Scattering event on the front side of the surface. */
     const ScatteringEvent* m_se1;      /**< Scattering event on the back side of the surface. */
@@ -67,4 +67,28 @@ float Fabric::pdf(const Vector& wo, const Vector& wi) const {
     const auto wh = normalize( wo + wi );
     const auto pdf_h = ( N + 1 ) * pow( 1.0f - fabs(wh.x) , N ) * INV_TWOPI;
     return pdf_h / ( 4.0f * dot( wo , wh ) );
-}
\ No newline at end of file
+}
+
+Spectrum Fabric::f_pdf( const Vector& wo , const Vector& wi , float* pPdf , float* pRevPdf ) const{
+    if( pPdf ) *pPdf = 0.0f;
+    if( pRevPdf ) *pRevPdf = 0.0f;
+
+    if (!SameHemiSphere(wo, wi)) return 0.0f;
+
+    const auto N = ceil(1 + 29 * SQR(1 - roughness));
+
+    // the distribution of the half vector is shared by the BRDF and the pdfs
+    const auto h = normalize( wo + wi );
+    const auto d = pow( 1.0f - fabs(h.x) , N );
+
+    const auto facing_o = doubleSided || PointingUp(wo);
+    const auto pdf_h = ( N + 1 ) * d * INV_TWOPI * 0.25f;
+    if( pPdf && facing_o ) *pPdf = pdf_h / dot( wo , h );
+    if( pRevPdf && ( doubleSided || PointingUp(wi) ) ) *pRevPdf = pdf_h / dot( wi , h );
+
+    if( !facing_o ) return 0.0f;
+
+    const auto i = (int)(( N / 30.0f ) * 255.0f);
+    const auto io = Io[i];
+    return baseColor * d * absCosTheta(wi) / io;
+}
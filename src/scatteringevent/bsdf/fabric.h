@@ -72,6 +72,14 @@ public:
     //! @return     The probability of choosing the out-going direction based on the Incident direction.
     float pdf( const Vector& wo , const Vector& wi ) const override;
 
+    //! @brief Evaluate the BRDF and the pdfs of both directions in a single pass.
+    //! @param wo       Exitant direction in shading coordinate.
+    //! @param wi       Incident direction in shading coordinate.
+    //! @param pdf      Probability density of choosing the incident direction, it could be 'nullptr'.
+    //! @param rev_pdf  Probability density of choosing the exitant direction, it could be 'nullptr'.
+    //! @return         The Evaluated BRDF value.
+    Spectrum f_pdf( const Vector& wo , const Vector& wi , float* pdf , float* rev_pdf ) const override;
+
 private:
     const Spectrum  baseColor;  /**< Direction-Hemisphere reflection or total reflection. */
     const float     roughness;  /**< Roughness of the fabric. */
@@ -139,6 +139,14 @@ Hair::Hair(RenderContext& rc, const Spectrum& absorption, const float lRoughness
 }
 
 Spectrum Hair::f( const Vector& wo , const Vector& wi ) const{
+    return f_pdf( wo , wi , nullptr , nullptr );
+}
+
+Spectrum Hair::f_pdf( const Vector& wo , const Vector& wi , float* pPdf , float* pRevPdf ) const{
+    // the reversed pdf depends on the attenuation along the other direction, there is nothing to share with it
+    if( pRevPdf ) *pRevPdf = pdf( wi , wo );
+    if( pPdf ) *pPdf = 0.0f;
+
     if( wo.y <= 0.0f || wi.y == 0.0f )
         return 0.0f;
 
@@ -173,7 +181,13 @@ Spectrum Hair::f( const Vector& wo , const Vector& wi ) const{
     Spectrum ap[PMAX + 1];
     Ap( cosThetaO , m_eta , cosGammaO , expT , ap );
 
+    // the pdf of picking each lobe is proportional to its attenuation, the same attenuation is used by the BSDF
+    auto sumY = 0.0f;
+    for( auto i = 0 ; i <= PMAX ; ++i )
+        sumY += ap[i].GetIntensity();
+
     Spectrum fsum(0.0f);
+    auto pdf = 0.0f;
     for( auto p = 0 ; p < PMAX ; ++p ){
 #ifndef DISABLE_ANGLE_TILT
         float sinThetaIp , cosThetaIp;
@@ -191,13 +205,18 @@ Spectrum Hair::f( const Vector& wo , const Vector& wi ) const{
             cosThetaIp = cosThetaI;
         }
         cosThetaIp = abs( cosThetaIp );
-        fsum += Mp( cosThetaIp , cosThetaO , sinThetaIp , sinThetaO , m_v[p] ) * ap[p] * Np( phi, p, m_scale, gammaO, gammaT );
+        const auto mn = Mp( cosThetaIp , cosThetaO , sinThetaIp , sinThetaO , m_v[p] ) * Np( phi, p, m_scale, gammaO, gammaT );
 #else
-        fsum += Mp( cosThetaI , cosThetaO , sinThetaI , sinThetaO , m_v[p] ) * ap[p] * Np( phi, p, m_scale, gammaO, gammaT );
+        const auto mn = Mp( cosThetaI , cosThetaO , sinThetaI , sinThetaO , m_v[p] ) * Np( phi, p, m_scale, gammaO, gammaT );
 #endif
+        fsum += mn * ap[p];
+        pdf += mn * ap[p].GetIntensity();
     }
-    fsum += Mp( cosThetaI, cosThetaO, sinThetaI, sinThetaO, m_v[PMAX] ) * ap[PMAX] * INV_TWOPI;
+    const auto m = Mp( cosThetaI, cosThetaO, sinThetaI, sinThetaO, m_v[PMAX] ) * INV_TWOPI;
+    fsum += m * ap[PMAX];
+    pdf += m * ap[PMAX].GetIntensity();
 
+    if( pPdf ) *pPdf = pdf / sumY;
     return fsum;
 }
 
@@ -92,6 +92,48 @@ IMPLEMENT_CLOSURE_TYPE_VAR(ClosureTypeMicrofacetRefractionBeckmann, Tsl_float3,
 IMPLEMENT_CLOSURE_TYPE_VAR(ClosureTypeMicrofacetRefractionBeckmann, Tsl_float3, normal)
 IMPLEMENT_CLOSURE_TYPE_END(ClosureTypeMicrofacetRefractionBeckmann)
 
+// PDF of the distribution of visible normals, D_wo(wh) = G1(wo) * max( 0 , dot( wo , wh ) ) * D(wh) / cos(wo)
+// An exitant direction below the surface sees the mirrored distribution, the sign of 'wh' doesn't matter either.
+SORT_STATIC_FORCEINLINE float visibleNormalPdf( const Vector& wo , const Vector& wh , const float d , const float g1 ){
+    const auto NoV = absCosTheta( wo );
+    const auto VoH = dot( wo , wh );
+    if( NoV == 0.0f || VoH * cosTheta( wo ) * cosTheta( wh ) <= 0.0f )
+        return 0.0f;
+    return g1 * fabs( VoH ) * d / NoV;
+}
+
+// Inverse of the error function
+// 'Approximating the erfinv function', Mike Giles
+SORT_STATIC_FORCEINLINE float erfInv( float x ){
+    x = clamp( x , -0.99999f , 0.99999f );
+    auto w = -std::log( ( 1.0f - x ) * ( 1.0f + x ) );
+    auto p = 0.0f;
+    if( w < 5.0f ){
+        w -= 2.5f;
+        p = 2.81022636e-08f;
+        p = 3.43273939e-07f + p * w;
+        p = -3.5233877e-06f + p * w;
+        p = -4.39150654e-06f + p * w;
+        p = 0.00021858087f + p * w;
+        p = -0.00125372503f + p * w;
+        p = -0.00417768164f + p * w;
+        p = 0.246640727f + p * w;
+        p = 1.50140941f + p * w;
+    }else{
+        w = std::sqrt( w ) - 3.0f;
+        p = -0.000200214257f;
+        p = 0.000100950558f + p * w;
+        p = 0.00134934322f + p * w;
+        p = -0.00367342844f + p * w;
+        p = 0.00573950773f + p * w;
+        p = -0.0076224613f + p * w;
+        p = 0.00943887047f + p * w;
+        p = 1.00167406f + p * w;
+        p = 2.83297682f + p * w;
+    }
+    return p * x;
+}
+
 float MicroFacetDistribution::E(const Vector& wo) const{
     return ::E(multi_scattering_ggs_no_fresnel::sample_cnt, roughness, wo.y, GetE_Lut());
 }
@@ -226,6 +268,76 @@ float Beckmann::G1( const Vector& v ) const {
     return ( 3.535f * a + 2.181f * a * a ) / ( 1.0f + 2.276f * a + 2.577f * a * a );
 }
 
+Vector Beckmann::sample_f( const Vector& wo , const BsdfSample& bs ) const {
+    // stretch the exitant direction so that the distribution becomes isotropic with alpha being 1
+    const auto v = cosTheta( wo ) < 0.0f ? -wo : wo;
+    const auto vs = normalize( Vector( alphaU * v.x , v.y , alphaV * v.z ) );
+
+    // sample the slopes of visible normals for the stretched direction, the first one has no closed form inverse CDF
+    // and is solved with a few Newton-bisection iterations starting from a fitted guess.
+    float slope_x , slope_z;
+    const auto cos_theta = cosTheta( vs );
+    if( cos_theta > 0.9999f ){
+        // special case of normal incidence, it is just the Beckmann distribution itself
+        const auto r = sqrt( -std::log( 1.0f - bs.u ) );
+        const auto phi = TWO_PI * bs.v;
+        slope_x = r * std::cos( phi );
+        slope_z = r * std::sin( phi );
+    }else{
+        constexpr auto inv_sqrt_pi = 0.56418958354f;
+        const auto tan_theta = sqrt( std::max( 0.0f , 1.0f - SQR( cos_theta ) ) ) / cos_theta;
+        const auto cot_theta = 1.0f / tan_theta;
+
+        const auto sample = std::max( bs.u , 1e-6f );
+        const auto theta = std::acos( cos_theta );
+        const auto fit = 1.0f + theta * ( -0.876f + theta * ( 0.4265f - 0.0594f * theta ) );
+        auto a = -1.0f , c = std::erf( cot_theta );
+        auto b = c - ( 1.0f + c ) * std::pow( 1.0f - sample , fit );
+
+        const auto normalization = 1.0f / ( 1.0f + c + inv_sqrt_pi * tan_theta * std::exp( -SQR( cot_theta ) ) );
+        for( auto i = 0 ; i < 10 ; ++i ){
+            if( !( b >= a && b <= c ) )
+                b = 0.5f * ( a + c );
+
+            const auto inv_erf = erfInv( b );
+            const auto value = normalization * ( 1.0f + b + inv_sqrt_pi * tan_theta * std::exp( -SQR( inv_erf ) ) ) - sample;
+            if( fabs( value ) < 1e-5f )
+                break;
+
+            if( value > 0.0f ) c = b;
+            else a = b;
+
+            const auto derivative = normalization * ( 1.0f - inv_erf * tan_theta );
+            b -= value / derivative;
+        }
+        slope_x = erfInv( b );
+        slope_z = erfInv( 2.0f * std::max( bs.v , 1e-6f ) - 1.0f );
+    }
+
+    // rotate the slopes around the stretched direction, unstretch them and convert them to a normal
+    const auto cos_phi = cosPhi( vs );
+    const auto sin_phi = sinPhi( vs );
+    const auto sx = cos_phi * slope_x - sin_phi * slope_z;
+    const auto sz = sin_phi * slope_x + cos_phi * slope_z;
+    return normalize( Vector( -alphaU * sx , 1.0f , -alphaV * sz ) );
+}
+
+float Beckmann::Pdf( const Vector& wo , const Vector& wh , float d ) const {
+    const auto absTan = fabs( tanTheta(wo) );
+    if( IsInf( absTan ) ) return 0.0f;
+
+    // visible normals are normalized by the exact Smith masking term, 'G1' is only a rational approximation of it
+    auto g1 = 1.0f;
+    if( absTan > 0.0f ){
+        constexpr auto inv_sqrt_pi = 0.56418958354f;
+        const auto cos_phi_sq = cosPhi2(wo);
+        const auto a = 1.0f / ( sqrt( cos_phi_sq * alphaU2 + ( 1.0f - cos_phi_sq ) * alphaV2 ) * absTan );
+        const auto lambda = 0.5f * ( std::erf( a ) - 1.0f ) + 0.5f * inv_sqrt_pi * std::exp( -a * a ) / a;
+        g1 = 1.0f / ( 1.0f + lambda );
+    }
+    return visibleNormalPdf( wo , wh , d , g1 );
+}
+
 GGX::GGX( float roughnessU , float roughnessV ): MicroFacetDistribution(roughnessU) {
     // UE4 style way to convert roughness to alpha used here because it still keeps sharp reflection with low value of roughness
     // http://graphicrants.blogspot.com/2013/08/specular-brdf-reference.html
@@ -283,6 +395,32 @@ float GGX::G1( const Vector& v ) const {
     return 2.0f / ( 1.0f + sqrt( 1.0f + alpha2 * tan_theta_sq ) );
 }
 
+Vector GGX::sample_f( const Vector& wo , const BsdfSample& bs ) const {
+    // stretch the exitant direction so that the distribution becomes a hemisphere
+    const auto v = cosTheta( wo ) < 0.0f ? -wo : wo;
+    const auto vh = normalize( Vector( alphaU * v.x , v.y , alphaV * v.z ) );
+
+    // orthonormal basis around the stretched direction, 't2' is the one pointing towards the normal
+    const auto len_sq = SQR( vh.x ) + SQR( vh.z );
+    const auto t1 = len_sq > 0.0f ? Vector( vh.z , 0.0f , -vh.x ) / sqrt( len_sq ) : Vector( 1.0f , 0.0f , 0.0f );
+    const auto t2 = cross( vh , t1 );
+
+    // uniformly sample a disk, with the half occluded by the hemisphere squeezed to the visible part
+    const auto r = sqrt( bs.u );
+    const auto phi = TWO_PI * bs.v;
+    const auto p1 = r * std::cos( phi );
+    const auto s = 0.5f * ( 1.0f + vh.y );
+    const auto p2 = ( 1.0f - s ) * sqrt( 1.0f - SQR( p1 ) ) + s * r * std::sin( phi );
+
+    // project the point onto the hemisphere and unstretch the normal
+    const auto nh = p1 * t1 + p2 * t2 + sqrt( std::max( 0.0f , 1.0f - SQR( p1 ) - SQR( p2 ) ) ) * vh;
+    return normalize( Vector( alphaU * nh.x , std::max( 0.0f , nh.y ) , alphaV * nh.z ) );
+}
+
+float GGX::Pdf( const Vector& wo , const Vector& wh , float d ) const {
+    return visibleNormalPdf( wo , wh , d , G1( wo ) );
+}
+
 Microfacet::Microfacet(RenderContext& rc, const MF_Dist_Type distType, float ru , float rv , const Spectrum& w, const BXDF_TYPE t , const Vector& n , bool doubleSided ) :
     Bxdf(rc, w, t, n, doubleSided ) {
     if(distType == MF_DIST_GGX)
@@ -332,8 +470,8 @@ Spectrum MicroFacetReflection::f( const Vector& wo , const Vector& wi ) const {
 }
 
 Spectrum MicroFacetReflection::sample_f( const Vector& wo , Vector& wi , const BsdfSample& bs , float* pPdf ) const {
-    // sampling the normal
-    const auto wh = distribution->sample_f( bs );
+    // sampling the normal visible from the exitant direction
+    const auto wh = distribution->sample_f( wo , bs );
 
     // reflect the incident direction
     wi = reflect( wo , wh );
@@ -352,7 +490,30 @@ float MicroFacetReflection::pdf( const Vector& wo , const Vector& wi ) const {
 
     const auto h = normalize( wo + wi );
     const auto EoH = absDot( wo , h );
-    return distribution->Pdf(h) / (4.0f * EoH);
+    return distribution->Pdf( wo , h , distribution->D(h) ) / (4.0f * EoH);
+}
+
+Spectrum MicroFacetReflection::f_pdf( const Vector& wo , const Vector& wi , float* pPdf , float* pRevPdf ) const {
+    if( pPdf ) *pPdf = 0.0f;
+    if( pRevPdf ) *pRevPdf = 0.0f;
+
+    if (!SameHemiSphere(wo, wi)) return 0.0f;
+
+    // both directions share the same half vector, so is the NDF
+    const auto wh = normalize(wi + wo);
+    const auto D = distribution->D(wh);
+    const auto facing_o = doubleSided || PointingUp(wo);
+    if (pPdf && facing_o) *pPdf = distribution->Pdf(wo, wh, D) / (4.0f * absDot(wo, wh));
+    if (pRevPdf && (doubleSided || PointingUp(wi))) *pRevPdf = distribution->Pdf(wi, wh, D) / (4.0f * absDot(wi, wh));
+
+    if (!facing_o) return 0.0f;
+
+    const auto NoV = absCosTheta( wo );
+    if (NoV == 0.f)
+        return Spectrum(0.f);
+
+    const auto F = fresnel->Evaluate( dot(wo,wh) );
+    return R * D * F * distribution->G(wo,wi) / ( 4.0f * NoV );
 }
 
 Spectrum MicroFacetReflectionMS::f( const Vector& wo , const Vector& wi ) const {
@@ -372,6 +533,16 @@ Spectrum MicroFacetReflectionMS::f( const Vector& wo , const Vector& wi ) const
     return single_scattering + multi_scattering;
 }
 
+Spectrum MicroFacetReflectionMS::f_pdf( const Vector& wo , const Vector& wi , float* pPdf , float* pRevPdf ) const {
+    const auto single_scattering = MicroFacetReflection::f_pdf( wo , wi , pPdf , pRevPdf );
+
+    if (!SameHemiSphere(wo, wi)) return 0.0f;
+    if (!doubleSided && !PointingUp(wo)) return 0.0f;
+    if (absCosTheta(wo) == 0.f) return 0.0f;
+
+    return single_scattering + MicrofacetMs(wo, wi, distribution, fresnel) * absCosTheta(wi);
+}
+
 MicroFacetRefraction::MicroFacetRefraction(RenderContext& rc, const ClosureTypeMicrofacetRefractionGGX&params, const Spectrum& weight):
     Microfacet(rc, MF_DIST_GGX , params.roughness_u , params.roughness_v , weight , (BXDF_TYPE)(BXDF_DIFFUSE | BXDF_REFLECTION), params.normal, true),
     T(params.transmittance), etaI(params.etaI) , etaT(params.etaT) , fresnel( params.etaI , params.etaT ) {
@@ -414,8 +585,8 @@ Spectrum MicroFacetRefraction::sample_f( const Vector& wo , Vector& wi , const B
     if( cosTheta( wo ) == 0.0f )
         return 0.0f;
 
-    // sampling the normal
-    const auto wh = distribution->sample_f( bs );
+    // sampling the normal visible from the exitant direction
+    const auto wh = distribution->sample_f( wo , bs );
 
     // try to get refracted ray
     auto total_reflection = false;
@@ -436,5 +607,44 @@ float MicroFacetRefraction::pdf( const Vector& wo , const Vector& wi ) const {
     // Compute change of variables _dwh\_dwi_ for microfacet transmission
     const auto sqrtDenom = dot(wo, wh) + eta * dot(wi, wh);
     const auto dwh_dwi = eta * eta * absDot(wi, wh) / (sqrtDenom * sqrtDenom);
-    return distribution->Pdf(wh) * dwh_dwi;
+    return distribution->Pdf( wo , wh , distribution->D(wh) ) * dwh_dwi;
+}
+
+Spectrum MicroFacetRefraction::f_pdf( const Vector& wo , const Vector& wi , float* pPdf , float* pRevPdf ) const {
+    const auto eta = cosTheta(wo) > 0 ? (etaT / etaI) : (etaI / etaT);
+
+    Vector3f wh = normalize(wo + wi * eta);
+    if( wh.y < 0.0f ) wh = -wh;
+
+    const auto sVoH = dot(wo, wh);
+    const auto sIoH = dot(wi, wh);
+    const auto sqrtDenom = sVoH + eta * sIoH;
+    const auto D = distribution->D(wh);
+
+    if( pPdf || pRevPdf ){
+        const auto transmission = !sameHemisphere( wo , wi );
+        const auto inv_denom_sq = 1.0f / ( sqrtDenom * sqrtDenom );
+        if( pPdf ) *pPdf = transmission ? distribution->Pdf( wo , wh , D ) * eta * eta * fabs(sIoH) * inv_denom_sq : 0.0f;
+        if( pRevPdf ){
+            // the reversed path sees the reciprocal of the IOR ratio, which leads to the same half vector
+            if( !transmission )
+                *pRevPdf = 0.0f;
+            else if( ( cosTheta(wi) > 0.0f ) != ( cosTheta(wo) > 0.0f ) )
+                *pRevPdf = distribution->Pdf( wi , wh , D ) * fabs(sVoH) * inv_denom_sq;
+            else
+                *pRevPdf = pdf( wi , wo );
+        }
+    }
+
+    if( SameHemiSphere(wi, wo) )
+        return Spectrum(0.f);
+
+    const auto NoV = cosTheta( wo );
+    if (NoV == 0.f)
+        return Spectrum(0.f);
+
+    // Fresnel term
+    const auto F = fresnel.Evaluate( sVoH );
+    const auto t = eta / sqrtDenom;
+    return (Spectrum(1.f) - F) * T * fabs(D * distribution->G(wo,wi) * t * t * sIoH * sVoH / NoV );
 }
@@ -137,13 +137,35 @@ public:
         return D( wh ) * absCosTheta(wh);
     }
 
+    //! @brief Sampling a normal visible from the exitant direction.
+    //!
+    //! Sampling the NDF alone wastes lots of samples on back-facing or heavily shadowed facets at grazing angles.
+    //! Distributions supporting it only sample normals visible from 'wo', proportional to their projected area.
+    //! The default implementation simply falls back to sampling the NDF.
+    //!
+    //! @param wo   Exitant direction in shading coordinate, it could be on either side of the surface.
+    //! @param bs   Sample holding all necessary random variables.
+    //! @return     Sampled normal direction, it is always in the upper hemisphere.
+    virtual Vector sample_f( const Vector& wo , const BsdfSample& bs ) const {
+        return sample_f( bs );
+    }
+
+    //! @brief PDF of sampling a specific normal direction through 'sample_f( wo , bs )'.
+    //!
+    //! @param wo   Exitant direction in shading coordinate.
+    //! @param wh   Normal direction to be sampled.
+    //! @param d    NDF of the normal direction, it is passed in since it is always evaluated by the callers already.
+    virtual float Pdf( const Vector& wo , const Vector& wh , float d ) const {
+        return d * absCosTheta(wh);
+    }
+
     //! @brief Get the roughness of the distribution
     float Roughness() const {
         return roughness;
     }
 
 protected:
-    //! @brief  Roughness of the distribution, this is merely for multi-scattering brdf
+    //! @brief  Roughness of the distribution, this is for multi-scattering brdf and telling near specular lobes apart
     const float roughness;
 
     //! @brief Smith shadow-masking function G1
@@ -203,6 +225,23 @@ public:
     //! @return     Sampled normal direction based on the NDF.
     Vector sample_f( const BsdfSample& bs ) const override;
 
+    //! @brief Sampling a normal visible from the exitant direction.
+    //!
+    //! 'An Improved Visible Normal Sampling Routine for the Beckmann Distribution', Jakob 2014
+    //! https://www.mitsuba-renderer.org/~wenzel/files/visnormal.pdf
+    //!
+    //! @param wo   Exitant direction in shading coordinate.
+    //! @param bs   Sample holding all necessary random variables.
+    //! @return     Sampled normal direction based on the distribution of visible normals.
+    Vector sample_f( const Vector& wo , const BsdfSample& bs ) const override;
+
+    //! @brief PDF of sampling a specific normal direction through 'sample_f( wo , bs )'.
+    //!
+    //! @param wo   Exitant direction in shading coordinate.
+    //! @param wh   Normal direction to be sampled.
+    //! @param d    NDF of the normal direction.
+    float Pdf( const Vector& wo , const Vector& wh , float d ) const override;
+
 private:
     float alphaU , alphaV;        /**< Internal data used for NDF calculation. */
     float alphaU2 , alphaV2 , alphaUV, alpha;
@@ -232,6 +271,23 @@ public:
     //! @return     Sampled normal direction based on the NDF.
     Vector sample_f( const BsdfSample& bs ) const override;
 
+    //! @brief Sampling a normal visible from the exitant direction.
+    //!
+    //! 'Sampling the GGX Distribution of Visible Normals', Heitz 2018
+    //! http://jcgt.org/published/0007/04/01/
+    //!
+    //! @param wo   Exitant direction in shading coordinate.
+    //! @param bs   Sample holding all necessary random variables.
+    //! @return     Sampled normal direction based on the distribution of visible normals.
+    Vector sample_f( const Vector& wo , const BsdfSample& bs ) const override;
+
+    //! @brief PDF of sampling a specific normal direction through 'sample_f( wo , bs )'.
+    //!
+    //! @param wo   Exitant direction in shading coordinate.
+    //! @param wh   Normal direction to be sampled.
+    //! @param d    NDF of the normal direction.
+    float Pdf( const Vector& wo , const Vector& wh , float d ) const override;
+
 protected:
     float alphaU , alphaV;        /**< Internal data used for NDF calculation. */
     float alphaU2 , alphaV2 , alphaUV , alpha;
@@ -268,6 +324,13 @@ public:
     //! @param t        Type of the bxdf
     Microfacet(RenderContext& rc, const MicroFacetDistribution* d, const Spectrum& w, const BXDF_TYPE t , const Vector& n , bool doubleSided) : Bxdf(rc, w, t, n, doubleSided) , distribution(d) {}
 
+    //! @brief  Get the roughness of the normal distribution.
+    //!
+    //! @return The roughness of the normal distribution.
+    float GetRoughness() const override {
+        return distribution ? distribution->Roughness() : 1.0f;
+    }
+
 protected:
     const MicroFacetDistribution* distribution = nullptr; /**< Normal distribution of micro facets. */
 };
@@ -338,6 +401,14 @@ public:
     //! @return     The probability of choosing the out-going direction based on the Incident direction.
     float pdf( const Vector& wo , const Vector& wi ) const override;
 
+    //! @brief Evaluate the BRDF and the pdfs of both directions, the NDF is only evaluated once.
+    //! @param wo       Exitant direction in shading coordinate.
+    //! @param wi       Incident direction in shading coordinate.
+    //! @param pdf      Probability density of choosing the incident direction, it could be 'nullptr'.
+    //! @param rev_pdf  Probability density of choosing the exitant direction, it could be 'nullptr'.
+    //! @return         The Evaluated BRDF value.
+    Spectrum f_pdf( const Vector& wo , const Vector& wi , float* pdf , float* rev_pdf ) const override;
+
 protected:
     const Spectrum R;                   /**< Direction-hemisphere reflection. */
     const Fresnel* fresnel = nullptr;   /**< Fresnel term. */
@@ -368,6 +439,14 @@ public:
     //! @param wi   Incident direction in shading coordinate.
     //! @return     The Evaluated BRDF value.
     Spectrum f( const Vector& wo , const Vector& wi ) const override;
+
+    //! @brief Evaluate the BRDF and the pdfs of both directions in a single pass.
+    //! @param wo       Exitant direction in shading coordinate.
+    //! @param wi       Incident direction in shading coordinate.
+    //! @param pdf      Probability density of choosing the incident direction, it could be 'nullptr'.
+    //! @param rev_pdf  Probability density of choosing the exitant direction, it could be 'nullptr'.
+    //! @return         The Evaluated BRDF value.
+    Spectrum f_pdf( const Vector& wo , const Vector& wi , float* pdf , float* rev_pdf ) const override;
 };
 
 //! @brief Microfacet Refraction BTDF.
@@ -436,6 +515,14 @@ public:
     //! @return     The probability of choosing the out-going direction based on the Incident direction.
     float pdf( const Vector& wo , const Vector& wi ) const override;
 
+    //! @brief Evaluate the BTDF and the pdfs of both directions, the NDF is only evaluated once.
+    //! @param wo       Exitant direction in shading coordinate.
+    //! @param wi       Incident direction in shading coordinate.
+    //! @param pdf      Probability density of choosing the incident direction, it could be 'nullptr'.
+    //! @param rev_pdf  Probability density of choosing the exitant direction, it could be 'nullptr'.
+    //! @return         The Evaluated BTDF value.
+    Spectrum f_pdf( const Vector& wo , const Vector& wi , float* pdf , float* rev_pdf ) const override;
+
 protected:
     const Spectrum            T;          /**< Direction-hemisphere transmittance. */
     float                     etaI;       /**< Index of refraction of the side that normal points. */
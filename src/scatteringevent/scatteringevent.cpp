@@ -117,8 +117,9 @@ Spectrum ScatteringEvent::Sample_BSDF( const Vector& wo , Vector& wi , const cla
     // setup pdf
     for( auto i = 0u; i < m_bxdfCnt ; ++i ){
         if( m_bxdfs[i] != bxdf ){
-            ret += m_bxdfs[i]->F(wo,wi) * m_bxdfs[i]->GetEvalWeight();
-            pdf += m_bxdfs[i]->Pdf(wo,wi) * m_bxdfs[i]->GetSampleWeight();
+            auto other_pdf = 0.0f;
+            ret += m_bxdfs[i]->F_Pdf( swo , wi , &other_pdf , nullptr ) * m_bxdfs[i]->GetEvalWeight();
+            pdf += other_pdf * m_bxdfs[i]->GetSampleWeight();
         }
     }
 
@@ -138,6 +139,31 @@ float ScatteringEvent::Pdf_BSDF( const Vector& wo , const Vector& wi ) const{
     return pdf;
 }
 
+Spectrum ScatteringEvent::Evaluate_BSDF_Pdf( const Vector& wo , const Vector& wi , float& pdf , float* rev_pdf ) const{
+    const auto lwo = worldToLocal( wo );
+    const auto lwi = worldToLocal( wi );
+
+    Spectrum r;
+    pdf = 0.0f;
+    if( rev_pdf ) *rev_pdf = 0.0f;
+    for( auto i = 0u ; i < m_bxdfCnt ; ++i ){
+        auto bxdf_pdf = 0.0f , bxdf_rev_pdf = 0.0f;
+        r += m_bxdfs[i]->F_Pdf( lwo , lwi , &bxdf_pdf , rev_pdf ? &bxdf_rev_pdf : nullptr ) * m_bxdfs[i]->GetEvalWeight();
+
+        const auto sample_weight = m_bxdfs[i]->GetSampleWeight();
+        pdf += bxdf_pdf * sample_weight;
+        if( rev_pdf ) *rev_pdf += bxdf_rev_pdf * sample_weight;
+    }
+    return r;
+}
+
+float ScatteringEvent::GetRoughness() const{
+    auto roughness = 0.0f;
+    for( auto i = 0u ; i < m_bxdfCnt ; ++i )
+        roughness = std::max( roughness , m_bxdfs[i]->GetRoughness() );
+    return roughness;
+}
+
 void ScatteringEvent::Sample_BSSRDF( const Scene& scene , const Vector& wo , const Point& po , BSSRDFIntersections& inter , float& pdf , RenderContext& rc) const{
     // Randomly pick a bssrdf
     sAssert( m_bssrdfTotalSampleWeight > 0.0f , MATERIAL );
@@ -134,6 +134,26 @@ public:
     //! @return             The probability of choosing the out-going direction based on the Incident direction.
     float       Pdf_BSDF( const Vector& wo , const Vector& wi ) const;
 
+    //! @brief Evaluate the value of BSDF and the pdfs of sampling both directions in a single pass.
+    //!
+    //! This produces the same result as 'Evaluate_BSDF', 'Pdf_BSDF( wo , wi )' and 'Pdf_BSDF( wi , wo )', it is
+    //! cheaper than calling them separately since each bxdf is only visited once.
+    //!
+    //! @param wo           Exitant direction in shading coordinate.
+    //! @param wi           Incident direction in shading coordinate.
+    //! @param pdf          Probability density of choosing the incident direction.
+    //! @param rev_pdf      Probability density of choosing the exitant direction, it could be 'nullptr'.
+    //! @return             The Evaluated value of the BSDF.
+    Spectrum    Evaluate_BSDF_Pdf( const Vector& wo , const Vector& wi , float& pdf , float* rev_pdf = nullptr ) const;
+
+    //! @brief  Get the roughness of the roughest bxdf in the scattering event.
+    //!
+    //! A scattering event is only as specular as its roughest lobe, an event without any bxdf is reported as
+    //! perfect specular since there is nothing for a non-specular technique to work with.
+    //!
+    //! @return             The largest roughness among all bxdfs, zero if there is no bxdf at all.
+    float       GetRoughness() const;
+
     //! @brief  Importance sample the incident direction and position.
     //!
     //! @param  scene       The scene where ray tracing happens.
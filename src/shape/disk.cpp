@@ -53,6 +53,11 @@ void Disk::Sample_l( RenderContext& rc, const LightSample& ls , Ray& r , Vector&
     if( pdf ) *pdf = 1.0f / ( radius * radius * PI * TWO_PI );
 }
 
+bool Disk::GetNormalBound( Vector& n ) const{
+    n = normalize( m_transform.TransformNormal( DIR_UP ) );
+    return true;
+}
+
 float Disk::SurfaceArea() const{
     return PI * radius * radius;
 }
@@ -86,6 +86,12 @@ public:
     //! @return     Surface area of the shape.
     float           SurfaceArea() const override;
 
+    //! @brief      Get the normal of the shape.
+    //!
+    //! @param n    The normalized normal of the shape in world space.
+    //! @return     Always true since the shape is flat.
+    bool            GetNormalBound( Vector& n ) const override;
+
     //! @brief      Set the radius of the disk.
     //!
     //! @param  r   Radius to be set for the disk.
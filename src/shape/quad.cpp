@@ -59,6 +59,11 @@ void Quad::Sample_l( RenderContext& rc, const LightSample& ls , Ray& r , Vector&
         *pdf = UniformHemispherePdf() / SurfaceArea();
 }
 
+bool Quad::GetNormalBound( Vector& n ) const{
+    n = normalize( m_transform.TransformNormal( DIR_UP ) );
+    return true;
+}
+
 float Quad::SurfaceArea() const{
     return sizeX * sizeY;
 }
@@ -41,6 +41,13 @@ enum SHAPE_TYPE{
     SHAPE_SPHERE    = 4,
 };
 
+//! @brief  Opacity of a region on a surface that is known without evaluating its material.
+enum OpacityClass : unsigned {
+    OPACITY_UNKNOWN = 0,    /**< The region is partially transparent or not classified, the material needs to be evaluated. */
+    OPACITY_OPAQUE  = 1,    /**< The region is fully opaque. */
+    OPACITY_CLEAR   = 2,    /**< The region is fully transparent. */
+};
+
 //! @brief Shape class defines basic interface of shape.
 /**
  * A shape class defines the very fundamental concept of shape supported in SORT.
@@ -146,6 +153,31 @@ public:
     //! @return     The type of the shape.
     virtual SHAPE_TYPE GetShapeType() const = 0;
 
+    //! @brief  Get the normal of the shape if it is flat.
+    //!
+    //! @param  n           The normalized normal of the shape in world space.
+    //! @return             Whether the shape is flat with a single normal.
+    virtual bool    GetNormalBound( Vector& n ) const { return false; }
+
+    //! @brief      Get the partial derivatives of position w.r.t the texture coordinate.
+    //!
+    //! This is only used to evaluate texture footprint with ray differentials. Shapes without a meaningful
+    //! texture parameterization simply return false, which disables texture filtering on them.
+    //!
+    //! @param inter    The intersection on the surface of the shape.
+    //! @param dpdu     Partial derivative of position w.r.t u.
+    //! @param dpdv     Partial derivative of position w.r.t v.
+    //! @return         Whether the derivatives are available.
+    virtual bool    GetTexCoordGradient( const SurfaceInteraction& inter , Vector& dpdu , Vector& dpdv ) const { return false; }
+
+    //! @brief      Classify the opacity at an intersection without evaluating the material.
+    //!
+    //! This is used by shadow rays to skip transparency evaluation of alpha tested surfaces where possible.
+    //!
+    //! @param inter    The intersection on the surface of the shape.
+    //! @return         The opacity class at the intersection, OPACITY_UNKNOWN if the material needs to be evaluated.
+    virtual OpacityClass ClassifyOpacity( const SurfaceInteraction& inter ) const { return OPACITY_UNKNOWN; }
+
 #if INTEL_EMBREE_ENABLED
     //! @brief      Construct instersection data from Embree intersection.
     //!
@@ -17,6 +17,14 @@
 
 #include "triangle.h"
 #include "entity/visual.h"
+#include "sampler/sample.h"
+#include "core/samplemethod.h"
+#include "material/material.h"
+
+// Resolution of the opacity micro-mask grid in barycentric space, two bits per cell need to fit in the 32 bits mask.
+static constexpr int OPACITY_MASK_RES = 4;
+
+static_assert( OPACITY_MASK_RES * OPACITY_MASK_RES * 2 <= 32 , "Opacity micro-mask doesn't fit in 32 bits." );
 
 SORT_STATIC_FORCEINLINE Vector3f Permute( const Vector3f& v , int ax , int ay , int az ){
     return Vector3f( v[ax] , v[ay] , v[az] );
@@ -152,6 +160,171 @@ float Triangle::SurfaceArea() const{
     return t.Length() * 0.5f;
 }
 
+// Uniformly sample a point on the triangle, the returned normal is the geometric one facing the side of vertex normals.
+SORT_STATIC_FORCEINLINE Point sampleTriangle( const MeshVertex& mv0 , const MeshVertex& mv1 , const MeshVertex& mv2 , float u , float v , Vector& n ){
+    const auto su = sqrt( u );
+    const auto b0 = 1.0f - su;
+    const auto b1 = v * su;
+    const auto b2 = 1.0f - b0 - b1;
+
+    n = normalize( cross( mv2.m_position - mv0.m_position , mv1.m_position - mv0.m_position ) );
+    if( dot( n , mv0.m_normal + mv1.m_normal + mv2.m_normal ) < 0.0f )
+        n = -n;
+
+    return b0 * mv0.m_position + b1 * mv1.m_position + b2 * mv2.m_position;
+}
+
+Point Triangle::Sample_l( const LightSample& ls , const Point& p , Vector& wi , Vector& n , float* pdf ) const{
+    const auto& mem = m_meshVisual->m_memory;
+    const auto& mv0 = mem->m_vertices[m_index.m_id[0]];
+    const auto& mv1 = mem->m_vertices[m_index.m_id[1]];
+    const auto& mv2 = mem->m_vertices[m_index.m_id[2]];
+
+    const auto lp = sampleTriangle( mv0 , mv1 , mv2 , ls.u , ls.v , n );
+    const auto delta = lp - p;
+    wi = normalize( delta );
+
+    if( pdf ){
+        const auto d = dot( -wi , n );
+        *pdf = d <= 0.0f ? 0.0f : delta.SquaredLength() / ( SurfaceArea() * d );
+    }
+
+    return lp;
+}
+
+void Triangle::Sample_l( RenderContext& rc, const LightSample& ls , Ray& r , Vector& n , float* pdf ) const{
+    const auto& mem = m_meshVisual->m_memory;
+    const auto& mv0 = mem->m_vertices[m_index.m_id[0]];
+    const auto& mv1 = mem->m_vertices[m_index.m_id[1]];
+    const auto& mv2 = mem->m_vertices[m_index.m_id[2]];
+
+    Vector t0, t1;
+    r.m_fMin = 0.0f;
+    r.m_fMax = FLT_MAX;
+    r.m_Ori = sampleTriangle( mv0 , mv1 , mv2 , ls.u , ls.v , n );
+    coordinateSystem( n , t0 , t1 );
+
+    // the hemisphere is sampled in a frame where 'y' is the normal
+    const auto dir = UniformSampleHemisphere( sort_rand<float>(rc) , sort_rand<float>(rc) );
+    r.m_Dir = dir.x * t0 + dir.y * n + dir.z * t1;
+
+    if( pdf )
+        *pdf = UniformHemispherePdf() / SurfaceArea();
+}
+
+bool Triangle::GetNormalBound( Vector& n ) const{
+    const auto& mem = m_meshVisual->m_memory;
+    const auto& mv0 = mem->m_vertices[m_index.m_id[0]];
+    const auto& mv1 = mem->m_vertices[m_index.m_id[1]];
+    const auto& mv2 = mem->m_vertices[m_index.m_id[2]];
+    sampleTriangle( mv0 , mv1 , mv2 , 0.0f , 0.0f , n );
+    return true;
+}
+
+bool Triangle::GetTexCoordGradient( const SurfaceInteraction& inter , Vector& dpdu , Vector& dpdv ) const{
+    const auto& mem = m_meshVisual->m_memory;
+    const auto& mv0 = mem->m_vertices[m_index.m_id[0]];
+    const auto& mv1 = mem->m_vertices[m_index.m_id[1]];
+    const auto& mv2 = mem->m_vertices[m_index.m_id[2]];
+
+    const auto du02 = mv0.m_texCoord.x - mv2.m_texCoord.x;
+    const auto du12 = mv1.m_texCoord.x - mv2.m_texCoord.x;
+    const auto dv02 = mv0.m_texCoord.y - mv2.m_texCoord.y;
+    const auto dv12 = mv1.m_texCoord.y - mv2.m_texCoord.y;
+    const auto det = du02 * dv12 - dv02 * du12;
+    if( fabs( det ) < 1e-12f )
+        return false;
+
+    const auto dp02 = mv0.m_position - mv2.m_position;
+    const auto dp12 = mv1.m_position - mv2.m_position;
+    const auto inv_det = 1.0f / det;
+    dpdu = ( dv12 * dp02 - dv02 * dp12 ) * inv_det;
+    dpdv = ( du02 * dp12 - du12 * dp02 ) * inv_det;
+    return true;
+}
+
+OpacityClass Triangle::ClassifyOpacity( const SurfaceInteraction& inter ) const{
+    const auto mask = m_index.m_opacityMask;
+    if( 0 == mask )
+        return OPACITY_UNKNOWN;
+
+    // recover the barycentric coordinate of the intersection, it is not kept during intersection tests
+    const auto& mem = m_meshVisual->m_memory;
+    const auto& p0 = mem->m_vertices[m_index.m_id[0]].m_position;
+    const auto& p1 = mem->m_vertices[m_index.m_id[1]].m_position;
+    const auto& p2 = mem->m_vertices[m_index.m_id[2]].m_position;
+
+    const auto e1 = p1 - p0;
+    const auto e2 = p2 - p0;
+    const auto d = inter.intersect - p0;
+    const auto d11 = dot( e1 , e1 );
+    const auto d12 = dot( e1 , e2 );
+    const auto d22 = dot( e2 , e2 );
+    const auto det = d11 * d22 - d12 * d12;
+    if( det <= 0.0f )
+        return OPACITY_UNKNOWN;
+
+    const auto d1 = dot( d , e1 );
+    const auto d2 = dot( d , e2 );
+    const auto u = ( d22 * d1 - d12 * d2 ) / det;
+    const auto v = ( d11 * d2 - d12 * d1 ) / det;
+
+    const auto cu = std::min( std::max( (int)( u * OPACITY_MASK_RES ) , 0 ) , OPACITY_MASK_RES - 1 );
+    const auto cv = std::min( std::max( (int)( v * OPACITY_MASK_RES ) , 0 ) , OPACITY_MASK_RES - 1 );
+    return (OpacityClass)( ( mask >> ( 2 * ( cu + cv * OPACITY_MASK_RES ) ) ) & 0x3 );
+}
+
+unsigned Triangle::BuildOpacityMask( const MaterialBase& material ) const{
+    const auto& mem = m_meshVisual->m_memory;
+    const auto& mv0 = mem->m_vertices[m_index.m_id[0]];
+    const auto& mv1 = mem->m_vertices[m_index.m_id[1]];
+    const auto& mv2 = mem->m_vertices[m_index.m_id[2]];
+    const auto gnormal = normalize( cross( mv2.m_position - mv0.m_position , mv1.m_position - mv0.m_position ) );
+
+    // interactions at the corners of the cells, adjacent cells share the corners on their borders
+    SurfaceInteraction lattice[OPACITY_MASK_RES + 1][OPACITY_MASK_RES + 1];
+    for( auto i = 0 ; i <= OPACITY_MASK_RES ; ++i ){
+        for( auto j = 0 ; i + j <= OPACITY_MASK_RES ; ++j ){
+            const auto u = (float)i / OPACITY_MASK_RES;
+            const auto v = (float)j / OPACITY_MASK_RES;
+            const auto w = 1.0f - u - v;
+
+            auto& inter = lattice[i][j];
+            inter.intersect = w * mv0.m_position + u * mv1.m_position + v * mv2.m_position;
+            inter.gnormal = gnormal;
+            inter.normal = ( w * mv0.m_normal + u * mv1.m_normal + v * mv2.m_normal ).Normalize();
+            inter.tangent = ( w * mv0.m_tangent + u * mv1.m_tangent + v * mv2.m_tangent ).Normalize();
+            inter.view = inter.normal;
+            const auto uv = w * mv0.m_texCoord + u * mv1.m_texCoord + v * mv2.m_texCoord;
+            inter.u = uv.x;
+            inter.v = uv.y;
+        }
+    }
+
+    // A cell is only classified if the bound of the transparency in it proves it, anything else is left unknown. Cells
+    // along the hypotenuse are cut in half by it, only the half inside the triangle is bounded.
+    auto mask = 0u;
+    for( auto cv = 0 ; cv < OPACITY_MASK_RES ; ++cv ){
+        for( auto cu = 0 ; cu + cv < OPACITY_MASK_RES ; ++cu ){
+            SurfaceInteraction corners[4] = { lattice[cu][cv] , lattice[cu + 1][cv] , lattice[cu][cv + 1] };
+            auto corner_cnt = 3u;
+            if( cu + cv + 1 < OPACITY_MASK_RES )
+                corners[corner_cnt++] = lattice[cu + 1][cv + 1];
+
+            Spectrum lo , hi;
+            auto cell = OPACITY_UNKNOWN;
+            if( material.EvaluateTransparencyRange( corners , corner_cnt , lo , hi ) ){
+                if( hi.IsBlack() )
+                    cell = OPACITY_OPAQUE;
+                else if( ( WHITE_SPECTRUM - lo ).IsBlack() )
+                    cell = OPACITY_CLEAR;
+            }
+            mask |= (unsigned)cell << ( 2 * ( cu + cv * OPACITY_MASK_RES ) );
+        }
+    }
+    return mask;
+}
+
 bool Triangle::GetIntersect(const BBox& box) const{
     // Project vertex along specific axis
     static const auto Project = [](const Point* points, int count , const Vector& axis, float& min, float& max){
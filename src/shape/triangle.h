@@ -22,6 +22,7 @@
 #include "simd/simd_wrapper.h"
 
 class   MeshVisual;
+class   MaterialBase;
 struct  MeshFaceIndex;
 
 //! @brief Triangle class defines the basic behavior of triangle.
@@ -47,10 +48,7 @@ public:
     //! @param wi       The vector from shading point to sampled point, it is normalized.
     //! @param pdf      The pdf w.r.t solid angle ( not surface area ) of picking the sampled point.
     //! @return         The sampled point on the surface of the shape.
-    Point           Sample_l( const LightSample& ls , const Point& p , Vector& wi , Vector& n, float* pdf ) const override{
-        // to be implemented
-        return Point();
-    }
+    Point           Sample_l( const LightSample& ls , const Point& p , Vector& wi , Vector& n, float* pdf ) const override;
 
     //! @brief Sample a ray from the light source without a given shading point.
     //!
@@ -61,9 +59,7 @@ public:
     //!                 the direction of the ray will point outward depending on the normal.
     //! @param n        The normal at the surface where the ray shoots from.
     //! @param pdf      The pdf w.r.t solid angle of picking the ray.
-    void            Sample_l( RenderContext& rc, const LightSample& ls , Ray& r , Vector& n , float* pdf ) const override{
-        // to be implemented.
-    }
+    void            Sample_l( RenderContext& rc, const LightSample& ls , Ray& r , Vector& n , float* pdf ) const override;
 
     //! @brief      Get intersected point between the ray and the shape.
     //!
@@ -108,6 +104,41 @@ public:
         return SHAPE_TRIANGLE;
     }
 
+    //! @brief      Get the normal of the triangle.
+    //!
+    //! The geometric normal is flipped to the side the vertex normals point to, which is the side the triangle emits
+    //! light to when it belongs to an emissive mesh.
+    //!
+    //! @param n    The normalized normal of the shape in world space.
+    //! @return     Always true since the shape is flat.
+    bool            GetNormalBound( Vector& n ) const override;
+
+    //! @brief      Get the partial derivatives of position w.r.t the texture coordinate.
+    //!
+    //! Since position and texture coordinate are both linear across a triangle, the derivatives are constant.
+    //!
+    //! @param inter    The intersection on the surface of the shape.
+    //! @param dpdu     Partial derivative of position w.r.t u.
+    //! @param dpdv     Partial derivative of position w.r.t v.
+    //! @return         Whether the derivatives are available, degenerated uv mapping will return false.
+    bool            GetTexCoordGradient( const SurfaceInteraction& inter , Vector& dpdu , Vector& dpdv ) const override;
+
+    //! @brief      Classify the opacity at an intersection with the opacity micro-mask of the triangle.
+    //!
+    //! @param inter    The intersection on the surface of the triangle.
+    //! @return         The opacity class of the cell the intersection falls in.
+    OpacityClass    ClassifyOpacity( const SurfaceInteraction& inter ) const override;
+
+    //! @brief      Build the opacity micro-mask of the triangle.
+    //!
+    //! The triangle is subdivided into a grid of cells in barycentric space. A cell is only classified as opaque or
+    //! clear if the bound of the transparency of the material in the cell proves it, texture lookups are bounded by
+    //! the range of texels in their footprints so that details thinner than a cell are not missed.
+    //!
+    //! @param material     The material attached to the triangle.
+    //! @return             The opacity micro-mask, two bits for each cell.
+    unsigned        BuildOpacityMask( const MaterialBase& material ) const;
+
 #if INTEL_EMBREE_ENABLED
     //! @brief      Construct instersection data from Embree intersection.
     //!
@@ -56,6 +56,7 @@ int RunSORT(int argc, char** argv) {
         slog(INFO, GENERAL, "  --unittest           Run unit tests.");
         slog(INFO, GENERAL, "  --nomaterial         Disable materials in SORT.");
         slog(INFO, GENERAL, "  --profiling:<on|off> Toggling profiling option, false by default.");
+        slog(INFO, GENERAL, "  --opacitymask:<on|off> Bake opacity masks for shadow rays, false by default.");
         return -1;
     }
     else {
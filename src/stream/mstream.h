@@ -329,7 +329,7 @@ public:
         if( m_pos + size > m_capacity ){
             memset( data , 0 , size );
         }else{
-            memcpy( data , m_data.get() , size );
+            memcpy( data , m_data.get() + m_pos , size );
             m_pos += size;
         }
         return *this;
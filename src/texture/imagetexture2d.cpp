@@ -17,8 +17,13 @@
 
 #include "core/define.h"
 #include <regex>
+#include <array>
+#include <cmath>
+#include <cstring>
 #include "imagetexture2d.h"
 #include "core/sassert.h"
+#include "math/utils.h"
+#include "core/log.h"
 
 BEGIN_EXTERNAL_INCLUDES
 
@@ -30,127 +35,683 @@ BEGIN_EXTERNAL_INCLUDES
 
 END_EXTERNAL_INCLUDES
 
-Spectrum ImageTexture2D::GetColor( int x , int y ) const{
-    // if there is no image, just crash
-    sAssertMsg(IS_PTR_VALID(m_memory) && IS_PTR_VALID(m_memory->m_rgb) , IMAGE , "Texture %s not loaded!" , m_name.c_str() );
+// Textures are filtered with a pyramid of box filtered images.
+// Anisotropy is clamped so that the number of texels touched by EWA filter stays bounded.
+static constexpr float MAX_ANISOTROPY = 8.0f;
+
+// Fall-off of the Gaussian weight in EWA filter.
+static constexpr float EWA_ALPHA = 2.0f;
+
+// Texel ranges are kept for square blocks of texels, this is the size of the blocks at the finest level of their pyramid.
+static constexpr int TEXEL_RANGE_BLOCK_SIZE = 8;
+
+// Largest finite half float, texels in HDR images beyond it in either direction are clamped to it.
+static constexpr float HALF_MAX = 65504.0f;
+
+// 8 bits channels are mapped to [0,1] through a lookup table. Color space conversion, if needed, is done by shaders
+// since the same image could be used as either color or data.
+static const auto g_ldr_lut = [](){
+    std::array<float, 256> lut;
+    for( auto i = 0u ; i < lut.size() ; ++i )
+        lut[i] = (float)i / 255.0f;
+    return lut;
+}();
+
+SORT_STATIC_FORCEINLINE float loadHalf( const unsigned char* src ){
+    unsigned short h;
+    memcpy( &h , src , sizeof( h ) );
+    return HalfToFloat( h );
+}
+
+SORT_STATIC_FORCEINLINE void storeHalf( unsigned char* dst , float value ){
+    const auto h = FloatToHalf( clamp( value , -HALF_MAX , HALF_MAX ) );
+    memcpy( dst , &h , sizeof( h ) );
+}
+
+SORT_STATIC_FORCEINLINE unsigned char quantize( float value ){
+    return (unsigned char)clamp( value * 255.0f + 0.5f , 0.0f , 255.0f );
+}
+
+template<>
+Spectrum ImageTexture2D::texel<Spectrum>( unsigned level , int x , int y ) const{
+    const auto& mip = m_levels[level];
 
     // filter the texture coordinate
-    texCoordFilter( x , y );
+    texCoordFilter( x , y , mip.m_width , mip.m_height );
 
-    // get the offset
-    int offset = ( m_iTexHeight - 1 - y ) * m_iTexWidth + x;
+    // locate the tile holding the texel, rows are stored from top to bottom
+    const auto row = mip.m_height - 1 - y;
+    const auto* tile = TextureCache::GetSingleton().GetTile( *this , mip.m_first_slot + ( row / TEXTURE_TILE_SIZE ) * mip.m_tiles_x + x / TEXTURE_TILE_SIZE );
 
     // get the color
-    return m_memory->m_rgb[ offset ];
+    const auto* src = tile->m_texels.get() + TextureTileTexelIndex( x % TEXTURE_TILE_SIZE , row % TEXTURE_TILE_SIZE ) * m_texel_bytes;
+    if( m_format == TexelFormat::LDR )
+        return Spectrum( g_ldr_lut[src[0]] , g_ldr_lut[src[1]] , g_ldr_lut[src[2]] );
+    return Spectrum( loadHalf( src ) , loadHalf( src + 2 ) , loadHalf( src + 4 ) );
 }
 
-float ImageTexture2D::GetAlpha( int x , int y ) const{
-    // if there is no image, just crash
-    sAssertMsg(IS_PTR_VALID(m_memory), IMAGE , "Texture %s not loaded!" , m_name.c_str() );
-
+template<>
+float ImageTexture2D::texel<float>( unsigned level , int x , int y ) const{
     // in case of acquiring alpha value in a texture without this channel, 1.0 is returned by default.
-    if(IS_PTR_INVALID(m_memory->m_a))
+    if( !m_has_alpha )
         return 1.0f;
 
+    const auto& mip = m_levels[level];
+
     // filter the texture coordinate
-    texCoordFilter( x , y );
+    texCoordFilter( x , y , mip.m_width , mip.m_height );
 
-    // get the offset
-    int offset = ( m_iTexHeight - 1 - y ) * m_iTexWidth + x;
+    // locate the tile holding the texel, rows are stored from top to bottom
+    const auto row = mip.m_height - 1 - y;
+    const auto* tile = TextureCache::GetSingleton().GetTile( *this , mip.m_first_slot + ( row / TEXTURE_TILE_SIZE ) * mip.m_tiles_x + x / TEXTURE_TILE_SIZE );
 
-    // get the color
-    return m_memory->m_a[ offset ];
+    // get the alpha, it always comes after the color
+    const auto* src = tile->m_texels.get() + TextureTileTexelIndex( x % TEXTURE_TILE_SIZE , row % TEXTURE_TILE_SIZE ) * m_texel_bytes;
+    if( m_format == TexelFormat::LDR )
+        return g_ldr_lut[src[3]];
+    return loadHalf( src + 6 );
+}
+
+ImageTexture2D::~ImageTexture2D(){
+    if( m_tile_file )
+        fclose( m_tile_file );
+}
+
+Spectrum ImageTexture2D::GetColor( int x , int y ) const{
+    // if there is no image, just crash
+    sAssertMsg(IsValid() , IMAGE , "Texture %s not loaded!" , m_name.c_str() );
+
+    return texel<Spectrum>( 0 , x , y );
+}
+
+float ImageTexture2D::GetAlpha( int x , int y ) const{
+    // if there is no image, just crash
+    sAssertMsg(IsValid(), IMAGE , "Texture %s not loaded!" , m_name.c_str() );
+
+    return texel<float>( 0 , x , y );
+}
+
+Spectrum ImageTexture2D::GetColorFromUV( float u , float v , float dudx , float dvdx , float dudy , float dvdy ) const{
+    // if there is no image, just crash
+    sAssertMsg(IsValid() , IMAGE , "Texture %s not loaded!" , m_name.c_str() );
+
+    return lookup<Spectrum>( u , v , dudx , dvdx , dudy , dvdy );
+}
+
+float ImageTexture2D::GetAlphaFromtUV( float u , float v , float dudx , float dvdx , float dudy , float dvdy ) const{
+    // if there is no image, just crash
+    sAssertMsg(IsValid(), IMAGE , "Texture %s not loaded!" , m_name.c_str() );
+
+    return lookup<float>( u , v , dudx , dvdx , dudy , dvdy );
+}
+
+template<class T>
+T ImageTexture2D::bilinear( unsigned level , float u , float v ) const{
+    const auto& mip = m_levels[level];
+    const auto fu = u * mip.m_width - 0.5f;
+    const auto fv = v * mip.m_height - 0.5f;
+    const auto iu = (int)floor( fu );
+    const auto iv = (int)floor( fv );
+    const auto _fu = fu - iu;
+    const auto _fv = fv - iv;
+
+    return  texel<T>(level, iu, iv) * ( (1.0f - _fu) * (1.0f - _fv) ) + texel<T>(level, iu + 1, iv) * ( _fu * (1.0f - _fv) ) +
+            texel<T>(level, iu, iv + 1) * ( (1.0f - _fu) * _fv ) + texel<T>(level, iu + 1, iv + 1) * ( _fu * _fv );
+}
+
+template<class T>
+T ImageTexture2D::ewa( unsigned level , float u , float v , float du0 , float dv0 , float du1 , float dv1 ) const{
+    const auto& mip = m_levels[level];
+
+    // convert the ellipse axes to texel units of this level
+    const auto sx = (float)mip.m_width / (float)m_iTexWidth;
+    const auto sy = (float)mip.m_height / (float)m_iTexHeight;
+    du0 *= sx; du1 *= sx;
+    dv0 *= sy; dv1 *= sy;
+
+    const auto s = u * mip.m_width - 0.5f;
+    const auto t = v * mip.m_height - 0.5f;
+
+    // implicit equation of the ellipse, A * s^2 + B * s * t + C * t^2 = 1, one texel is added to the axes so that
+    // the ellipse always covers at least one texel.
+    auto A = dv0 * dv0 + dv1 * dv1 + 1.0f;
+    auto B = -2.0f * ( du0 * dv0 + du1 * dv1 );
+    auto C = du0 * du0 + du1 * du1 + 1.0f;
+    const auto inv_f = 1.0f / ( A * C - B * B * 0.25f );
+    A *= inv_f;
+    B *= inv_f;
+    C *= inv_f;
+
+    // bounding box of the ellipse
+    const auto det = -B * B + 4.0f * A * C;
+    const auto inv_det = 1.0f / det;
+    const auto u_sqrt = std::sqrt( det * C );
+    const auto v_sqrt = std::sqrt( A * det );
+    const auto s0 = (int)std::ceil( s - 2.0f * inv_det * u_sqrt );
+    const auto s1 = (int)std::floor( s + 2.0f * inv_det * u_sqrt );
+    const auto t0 = (int)std::ceil( t - 2.0f * inv_det * v_sqrt );
+    const auto t1 = (int)std::floor( t + 2.0f * inv_det * v_sqrt );
+
+    const auto weight_offset = std::exp( -EWA_ALPHA );
+
+    T sum = T( 0.0f );
+    auto total_weight = 0.0f;
+    for( auto it = t0 ; it <= t1 ; ++it ){
+        const auto tt = it - t;
+        for( auto is = s0 ; is <= s1 ; ++is ){
+            const auto ss = is - s;
+            const auto r2 = A * ss * ss + B * ss * tt + C * tt * tt;
+            if( r2 < 1.0f ){
+                const auto weight = std::exp( -EWA_ALPHA * r2 ) - weight_offset;
+                sum += texel<T>( level , is , it ) * weight;
+                total_weight += weight;
+            }
+        }
+    }
+
+    return total_weight > 0.0f ? sum / total_weight : bilinear<T>( level , u , v );
 }
 
-// load image from file
+template<class T>
+T ImageTexture2D::lookup( float u , float v , float dudx , float dvdx , float dudy , float dvdy ) const{
+    const auto level_cnt = (unsigned)m_levels.size();
+
+    // axes of the footprint ellipse in texel units of the first level
+    auto du0 = dudx * m_iTexWidth , dv0 = dvdx * m_iTexHeight;
+    auto du1 = dudy * m_iTexWidth , dv1 = dvdy * m_iTexHeight;
+    auto major = std::sqrt( du0 * du0 + dv0 * dv0 );
+    auto minor = std::sqrt( du1 * du1 + dv1 * dv1 );
+    if( major < minor ){
+        std::swap( du0 , du1 );
+        std::swap( dv0 , dv1 );
+        std::swap( major , minor );
+    }
+
+    // footprint smaller than a texel, or no footprint at all, there is no need for any pre-filtering
+    if( level_cnt == 1 || major <= 1.0f )
+        return bilinear<T>( 0 , u , v );
+
+    // Nearly isotropic footprint goes through trilinear filtering, it is a lot cheaper than EWA.
+    if( major < 2.0f * minor ){
+        const auto lod = clamp( std::log2( major ) , 0.0f , (float)( level_cnt - 1 ) );
+        const auto l0 = (unsigned)lod;
+        if( l0 == level_cnt - 1 )
+            return bilinear<T>( l0 , u , v );
+        const auto delta = lod - l0;
+        return bilinear<T>( l0 , u , v ) * ( 1.0f - delta ) + bilinear<T>( l0 + 1 , u , v ) * delta;
+    }
+
+    // Clamp the eccentricity of the ellipse so that EWA doesn't touch too many texels.
+    if( minor * MAX_ANISOTROPY < major ){
+        const auto scale = major / ( minor * MAX_ANISOTROPY );
+        if( minor > 0.0f ){
+            du1 *= scale;
+            dv1 *= scale;
+        }else{
+            // degenerated footprint, pick the minor axis perpendicular to the major one
+            const auto len = major / MAX_ANISOTROPY;
+            du1 = -dv0 / major * len;
+            dv1 = du0 / major * len;
+        }
+        minor = major / MAX_ANISOTROPY;
+    }
+
+    // the minor axis determines the resolution, the major axis is handled by EWA itself.
+    const auto lod = clamp( std::log2( std::max( minor , 1.0f ) ) , 0.0f , (float)( level_cnt - 1 ) );
+    const auto l0 = (unsigned)lod;
+    if( l0 == level_cnt - 1 )
+        return ewa<T>( l0 , u , v , du0 , dv0 , du1 , dv1 );
+    const auto delta = lod - l0;
+    return ewa<T>( l0 , u , v , du0 , dv0 , du1 , dv1 ) * ( 1.0f - delta ) + ewa<T>( l0 + 1 , u , v , du0 , dv0 , du1 , dv1 ) * delta;
+}
+
+// Decoding a texture holds the whole image and all of its mip levels as floats in memory, which is far more than its
+// compact tiles take. Textures are decoded one at a time so that this doesn't grow with the number of threads.
+static std::mutex g_decode_mutex;
+
+// copy the interleaved RGBA texels decoded by stb_image into a mip level
+template<class Img, class T>
+static void unpackTexels( Img& mip , const T* data , float scale , bool has_alpha ){
+    const auto total = mip.m_width * mip.m_height;
+    mip.m_rgb = std::make_unique<Spectrum[]>(total);
+    for (auto k = 0; k < total; ++k) {
+        auto& color = mip.m_rgb[k];
+        color.r = data[4 * k] * scale;
+        color.g = data[4 * k + 1] * scale;
+        color.b = data[4 * k + 2] * scale;
+    }
+
+    if (has_alpha) {
+        mip.m_a = std::make_unique<float[]>(total);
+        for (auto k = 0; k < total; ++k)
+            mip.m_a[k] = data[4 * k + 3] * scale;
+    }
+}
+
+// allocate an empty tile
+static std::shared_ptr<TextureTile> makeTile( size_t tile_bytes ){
+    auto tile = std::make_shared<TextureTile>();
+    tile->m_texels = std::make_unique<unsigned char[]>( tile_bytes );
+    return tile;
+}
+
+// load image header from file, texels are loaded lazily
 bool ImageTexture2D::LoadResource( const std::string str ){
     static const std::regex exr_reg(".*\\.exr$", std::regex_constants::icase);
 
-    m_memory = std::make_unique<ImgMemory>();
+    m_levels.clear();
     m_name = str;
+    m_has_alpha = false;
+
     if (std::regex_match(m_name, exr_reg)) {
-        float* out = nullptr;
-        const char* err;
+        EXRVersion version;
+        if (ParseEXRVersionFromFile(&version, m_name.c_str()) != TINYEXR_SUCCESS)
+            return false;
+
+        EXRHeader header;
+        InitEXRHeader(&header);
+
+        const char* err = nullptr;
+        if (ParseEXRHeaderFromFile(&header, &version, m_name.c_str(), &err) != TINYEXR_SUCCESS) {
+            if (err)
+                FreeEXRErrorMessage(err);
+            return false;
+        }
+
+        m_iTexWidth = header.data_window[2] - header.data_window[0] + 1;
+        m_iTexHeight = header.data_window[3] - header.data_window[1] + 1;
+        FreeEXRHeader(&header);
 
-        const auto ret = LoadEXR(&out, &m_iTexWidth, &m_iTexHeight, m_name.c_str(), &err);
+        m_format = TexelFormat::HDR;
+    } else {
+        auto comp = 0;
+        if (!stbi_info(m_name.c_str(), &m_iTexWidth, &m_iTexHeight, &comp))
+            return false;
 
-        if (ret >= 0) {
-            const auto total = m_iTexWidth * m_iTexHeight;
-            m_memory->m_rgb = std::make_unique<Spectrum[]>(total);
-            for (auto i = 0; i < total; i++)
-                m_memory->m_rgb[i] = Spectrum(out[4 * i], out[4 * i + 1], out[4 * i + 2]);
+        // there is alpha channel in the texture.
+        m_has_alpha = comp == STBI_rgb_alpha;
 
-            free(out);
+        // 16 bits images would lose precision with 8 bits per channel, they are stored as half floats too.
+        const auto high_precision = stbi_is_hdr(m_name.c_str()) || stbi_is_16_bit(m_name.c_str());
+        m_format = high_precision ? TexelFormat::HDR : TexelFormat::LDR;
+    }
 
-            average();
-            return true;
-        }
+    m_texel_bytes = ( m_has_alpha ? 4 : 3 ) * ( m_format == TexelFormat::LDR ? 1 : 2 );
 
+    if (m_iTexWidth <= 0 || m_iTexHeight <= 0)
         return false;
+
+    // Lay out the tiles of all mip levels. Each level is half the resolution of the previous one, with odd
+    // resolution rounded up.
+    auto slot_cnt = 0u;
+    auto width = m_iTexWidth , height = m_iTexHeight;
+    while (true) {
+        MipLevel level;
+        level.m_width = width;
+        level.m_height = height;
+        level.m_tiles_x = ( width + TEXTURE_TILE_SIZE - 1 ) / TEXTURE_TILE_SIZE;
+        level.m_first_slot = slot_cnt;
+        slot_cnt += level.m_tiles_x * ( ( height + TEXTURE_TILE_SIZE - 1 ) / TEXTURE_TILE_SIZE );
+        m_levels.push_back(level);
+
+        if (width == 1 && height == 1)
+            break;
+        width = std::max( 1 , ( width + 1 ) / 2 );
+        height = std::max( 1 , ( height + 1 ) / 2 );
+    }
+
+    allocateTileSlots( slot_cnt , TEXTURE_TILE_TEXEL_CNT * m_texel_bytes );
+    return true;
+}
+
+bool ImageTexture2D::decodeImage( ImgMemory& mip ) const{
+    static const std::regex exr_reg(".*\\.exr$", std::regex_constants::icase);
+
+    if (std::regex_match(m_name, exr_reg)) {
+        float* out = nullptr;
+        const char* err = nullptr;
+
+        const auto ret = LoadEXR(&out, &mip.m_width, &mip.m_height, m_name.c_str(), &err);
+        if (ret < 0) {
+            if (err)
+                FreeEXRErrorMessage(err);
+            return false;
+        }
+
+        const auto total = mip.m_width * mip.m_height;
+        mip.m_rgb = std::make_unique<Spectrum[]>(total);
+        for (auto i = 0; i < total; i++)
+            mip.m_rgb[i] = Spectrum(out[4 * i], out[4 * i + 1], out[4 * i + 2]);
+
+        free(out);
+        return mip.m_width == m_iTexWidth && mip.m_height == m_iTexHeight;
+    }
+
+    // 16 bits images have to be loaded explicitly, stbi_loadf would reduce them to 8 bits first.
+    if (stbi_is_16_bit(m_name.c_str())) {
+        auto comp = 0;
+        auto* data = stbi_load_16(m_name.c_str(), &mip.m_width, &mip.m_height, &comp, STBI_rgb_alpha);
+        if (!data)
+            return false;
+
+        const auto ret = mip.m_width == m_iTexWidth && mip.m_height == m_iTexHeight;
+        if (ret)
+            unpackTexels( mip , data , 1.0f / 65535.0f , m_has_alpha );
+        stbi_image_free(data);
+        return ret;
     }
 
     stbi_ldr_to_hdr_gamma(1.0f);
     stbi_ldr_to_hdr_scale(1.0f);
 
     auto comp = 0;
-    const auto* data = stbi_loadf(m_name.c_str(), &m_iTexWidth, &m_iTexHeight, &comp, STBI_rgb_alpha);
+    auto* data = stbi_loadf(m_name.c_str(), &mip.m_width, &mip.m_height, &comp, STBI_rgb_alpha);
+    if (!data)
+        return false;
 
-    if (data) {
-        if( m_iTexWidth > 0 && m_iTexHeight > 0 ){
-            m_memory->m_rgb = std::make_unique<Spectrum[]>(m_iTexWidth*m_iTexHeight);
-            for (auto i = 0; i < m_iTexHeight; ++i) {
-                for (auto j = 0; j < m_iTexWidth; ++j) {
-                    const auto k = i * m_iTexWidth + j;
+    const auto ret = mip.m_width == m_iTexWidth && mip.m_height == m_iTexHeight;
+    if (ret)
+        unpackTexels( mip , data , 1.0f , m_has_alpha );
+    stbi_image_free(data);
+    return ret;
+}
 
-                    auto& color = m_memory->m_rgb[i * m_iTexWidth + j];
+ImageTexture2D::ImgMemory ImageTexture2D::downsample( const ImgMemory& prev ){
+    // Each level is a 2x2 box filtered version of the previous one. Odd resolution is rounded up by clamping at the
+    // border, which is good enough for pre-filtering purpose.
+    ImgMemory mip;
+    mip.m_width = std::max( 1 , ( prev.m_width + 1 ) / 2 );
+    mip.m_height = std::max( 1 , ( prev.m_height + 1 ) / 2 );
+    mip.m_rgb = std::make_unique<Spectrum[]>( mip.m_width * mip.m_height );
+    if( IS_PTR_VALID(prev.m_a) )
+        mip.m_a = std::make_unique<float[]>( mip.m_width * mip.m_height );
+
+    for( auto i = 0 ; i < mip.m_height ; ++i ){
+        const auto i0 = std::min( 2 * i , prev.m_height - 1 );
+        const auto i1 = std::min( 2 * i + 1 , prev.m_height - 1 );
+        for( auto j = 0 ; j < mip.m_width ; ++j ){
+            const auto j0 = std::min( 2 * j , prev.m_width - 1 );
+            const auto j1 = std::min( 2 * j + 1 , prev.m_width - 1 );
+
+            const auto k00 = i0 * prev.m_width + j0;
+            const auto k01 = i0 * prev.m_width + j1;
+            const auto k10 = i1 * prev.m_width + j0;
+            const auto k11 = i1 * prev.m_width + j1;
+
+            const auto k = i * mip.m_width + j;
+            mip.m_rgb[k] = ( prev.m_rgb[k00] + prev.m_rgb[k01] + prev.m_rgb[k10] + prev.m_rgb[k11] ) * 0.25f;
+            if( IS_PTR_VALID(mip.m_a) )
+                mip.m_a[k] = ( prev.m_a[k00] + prev.m_a[k01] + prev.m_a[k10] + prev.m_a[k11] ) * 0.25f;
+        }
+    }
 
-                    color.r = data[4 * k];
-                    color.g = data[4 * k + 1];
-                    color.b = data[4 * k + 2];
-                }
-            }
+    return mip;
+}
+
+void ImageTexture2D::encodeTexel( unsigned char* dst , const Spectrum& color , float alpha ) const{
+    if( m_format == TexelFormat::LDR ){
+        dst[0] = quantize( color.r );
+        dst[1] = quantize( color.g );
+        dst[2] = quantize( color.b );
+        if( m_has_alpha )
+            dst[3] = quantize( alpha );
+    }else{
+        storeHalf( dst , color.r );
+        storeHalf( dst + 2 , color.g );
+        storeHalf( dst + 4 , color.b );
+        if( m_has_alpha )
+            storeHalf( dst + 6 , alpha );
+    }
+}
+
+bool ImageTexture2D::decodeBaseLevel( ImgMemory& mip ) const{
+    if( decodeImage( mip ) )
+        return true;
+
+    // fall back to a black image so that the texture is still usable
+    mip.m_width = m_iTexWidth;
+    mip.m_height = m_iTexHeight;
+    mip.m_rgb = std::make_unique<Spectrum[]>( m_iTexWidth * m_iTexHeight );
+    mip.m_a = nullptr;
+    if( m_has_alpha ){
+        mip.m_a = std::make_unique<float[]>( m_iTexWidth * m_iTexHeight );
+        std::fill( mip.m_a.get() , mip.m_a.get() + m_iTexWidth * m_iTexHeight , 1.0f );
+    }
+    return false;
+}
+
+void ImageTexture2D::encodeTile( unsigned char* dst , const ImgMemory& mip , int tx , int ty ) const{
+    // texels outside the image are clamped to the border, they are never fetched anyway.
+    for( auto r = 0 ; r < TEXTURE_TILE_SIZE ; ++r ){
+        const auto row = std::min( ty * TEXTURE_TILE_SIZE + r , mip.m_height - 1 );
+        for( auto c = 0 ; c < TEXTURE_TILE_SIZE ; ++c ){
+            const auto col = std::min( tx * TEXTURE_TILE_SIZE + c , mip.m_width - 1 );
+            const auto k = row * mip.m_width + col;
+            encodeTexel( dst + TextureTileTexelIndex( c , r ) * m_texel_bytes , mip.m_rgb[k] , m_has_alpha ? mip.m_a[k] : 1.0f );
         }
+    }
+}
 
-        // there is alpha channel in the texture.
-        if( comp == STBI_rgb_alpha ){
-            m_memory->m_a = std::make_unique<float[]>(m_iTexWidth*m_iTexHeight);
-            for (auto i = 0; i < m_iTexHeight; ++i) {
-                for (auto j = 0; j < m_iTexWidth; ++j) {
-                    const auto k = i * m_iTexWidth + j;
+void ImageTexture2D::buildTiles() const{
+    std::lock_guard<std::mutex> lock( g_decode_mutex );
 
-                    auto& alpha = m_memory->m_a[i * m_iTexWidth + j];
+    ImgMemory mip;
+    if( !decodeBaseLevel( mip ) )
+        slog( WARNING , IMAGE , "Failed to decode texture %s, it will be black." , m_name.c_str() );
 
-                    alpha = data[4 * k + 3];
-                }
+    // compute average radiance
+    Spectrum average;
+    for( auto i = 0 ; i < mip.m_width * mip.m_height ; ++i )
+        average += mip.m_rgb[i];
+    m_average = average / (float)( mip.m_width * mip.m_height );
+
+    // Tiles are written to a temporary file so that they can be brought back after being evicted by the texture cache,
+    // image formats like png or scanline exr can't be decoded partially.
+    m_tile_file = std::tmpfile();
+    if( !m_tile_file ){
+        slog( WARNING , IMAGE , "Failed to create tile file for texture %s, its tiles will be decoded from the image every time they are loaded." , m_name.c_str() );
+        return;
+    }
+
+    const auto tile_bytes = TEXTURE_TILE_TEXEL_CNT * m_texel_bytes;
+    auto texels = std::make_unique<unsigned char[]>( tile_bytes );
+    for( auto level = 0u ; level < m_levels.size() ; ++level ){
+        if( level > 0 )
+            mip = downsample( mip );
+
+        const auto& layout = m_levels[level];
+        const auto tiles_y = ( layout.m_height + TEXTURE_TILE_SIZE - 1 ) / TEXTURE_TILE_SIZE;
+        for( auto ty = 0 ; ty < tiles_y ; ++ty ){
+            for( auto tx = 0 ; tx < layout.m_tiles_x ; ++tx ){
+                encodeTile( texels.get() , mip , tx , ty );
+                if( fwrite( texels.get() , 1 , tile_bytes , m_tile_file ) == tile_bytes )
+                    continue;
+
+                slog( WARNING , IMAGE , "Failed to write tile file for texture %s, its tiles will be decoded from the image every time they are loaded." , m_name.c_str() );
+                fclose( m_tile_file );
+                m_tile_file = nullptr;
+                return;
             }
         }
+    }
 
-        stbi_image_free((void*)data);
+    fflush( m_tile_file );
+}
 
-        average();
-        return true;
+void ImageTexture2D::decodeTile( unsigned slot , unsigned char* dst ) const{
+    std::lock_guard<std::mutex> lock( g_decode_mutex );
+
+    ImgMemory mip;
+    decodeBaseLevel( mip );
+
+    auto level = 0u;
+    while( level + 1 < m_levels.size() && m_levels[level + 1].m_first_slot <= slot ){
+        mip = downsample( mip );
+        ++level;
     }
-    return false;
+
+    const auto& layout = m_levels[level];
+    const auto local = (int)( slot - layout.m_first_slot );
+    encodeTile( dst , mip , local % layout.m_tiles_x , local / layout.m_tiles_x );
+}
+
+std::shared_ptr<TextureTile> ImageTexture2D::LoadTile( unsigned slot ) const{
+    std::call_once( m_build_flag , [this](){ buildTiles(); } );
+
+    const auto tile_bytes = TEXTURE_TILE_TEXEL_CNT * m_texel_bytes;
+    auto tile = makeTile( tile_bytes );
+
+    // Without the tile file, the tile is generated from the image again. This is slow, but the tile is still owned by
+    // the texture cache like any other tile, instead of staying in memory outside of its budget.
+    if( !m_tile_file ){
+        decodeTile( slot , tile->m_texels.get() );
+        return tile;
+    }
+
+    // The texture cache never loads tiles of the same texture on multiple threads simultaneously, there is no need
+    // to protect the file here.
+    const auto offset = (long long)slot * (long long)tile_bytes;
+#ifdef SORT_IN_WINDOWS
+    auto succeed = _fseeki64( m_tile_file , offset , SEEK_SET ) == 0;
+#else
+    auto succeed = fseeko( m_tile_file , (off_t)offset , SEEK_SET ) == 0;
+#endif
+    succeed = succeed && fread( tile->m_texels.get() , 1 , tile_bytes , m_tile_file ) == tile_bytes;
+    if( !succeed ){
+        slog( WARNING , IMAGE , "Failed to read tile %d of texture %s, decoding it from the image." , slot , m_name.c_str() );
+        decodeTile( slot , tile->m_texels.get() );
+    }
+
+    return tile;
 }
 
 Spectrum ImageTexture2D::GetAverage() const{
+    if( IsValid() )
+        std::call_once( m_build_flag , [this](){ buildTiles(); } );
     return m_average;
 }
 
-void ImageTexture2D::average(){
+void ImageTexture2D::GetTexelRange( float u0 , float v0 , float u1 , float v1 , Spectrum& color_min , Spectrum& color_max , float& alpha_min , float& alpha_max ) const{
     // if there is no image, just crash
-    if(IS_PTR_INVALID(m_memory) || IS_PTR_INVALID(m_memory->m_rgb))
-        return;
+    sAssertMsg(IsValid(), IMAGE , "Texture %s not loaded!" , m_name.c_str() );
+
+    std::call_once( m_range_flag , [this](){ buildTexelRanges(); } );
+
+    // texels touched by bilinear filtering anywhere inside the rectangle, rows are stored from top to bottom
+    auto level = 0u;
+    int c0 = 0 , c1 = 0 , r0 = 0 , r1 = 0;
+    const auto inside = u0 >= 0.0f && v0 >= 0.0f && u1 <= 1.0f && v1 <= 1.0f;
+    const auto x0 = inside ? (int)floor( u0 * m_iTexWidth - 0.5f ) : -1;
+    const auto x1 = inside ? (int)floor( u1 * m_iTexWidth - 0.5f ) + 1 : -1;
+    const auto y0 = inside ? (int)floor( v0 * m_iTexHeight - 0.5f ) : -1;
+    const auto y1 = inside ? (int)floor( v1 * m_iTexHeight - 0.5f ) + 1 : -1;
+    if( x0 < 0 || y0 < 0 || x1 >= m_iTexWidth || y1 >= m_iTexHeight ){
+        // texels beyond the border are wrapped, mirrored or clamped, they are all somewhere in the texture
+        level = (unsigned)m_range_levels.size() - 1;
+    }else{
+        c0 = x0 / TEXEL_RANGE_BLOCK_SIZE;
+        c1 = x1 / TEXEL_RANGE_BLOCK_SIZE;
+        r0 = ( m_iTexHeight - 1 - y1 ) / TEXEL_RANGE_BLOCK_SIZE;
+        r1 = ( m_iTexHeight - 1 - y0 ) / TEXEL_RANGE_BLOCK_SIZE;
+
+        // go up the pyramid until a handful of blocks cover the rectangle
+        while( level + 1 < m_range_levels.size() && ( c1 - c0 > 1 || r1 - r0 > 1 ) ){
+            c0 >>= 1;
+            c1 >>= 1;
+            r0 >>= 1;
+            r1 >>= 1;
+            ++level;
+        }
+    }
 
-    Spectrum average;
-    for (auto i = 0; i < m_iTexHeight; ++i) {
-        for (auto j = 0; j < m_iTexWidth; ++j) {
-            // get the offset
-            int offset = i * m_iTexWidth + j;
-            // get the color
-            average += m_memory->m_rgb[offset];
+    const auto& range_level = m_range_levels[level];
+    c1 = std::min( c1 , range_level.m_width - 1 );
+    r1 = std::min( r1 , range_level.m_height - 1 );
+
+    const auto& first = range_level.m_ranges[r0 * range_level.m_width + c0];
+    color_min = first.m_color_min;
+    color_max = first.m_color_max;
+    alpha_min = first.m_alpha_min;
+    alpha_max = first.m_alpha_max;
+    for( auto r = r0 ; r <= r1 ; ++r ){
+        for( auto c = c0 ; c <= c1 ; ++c ){
+            const auto& range = range_level.m_ranges[r * range_level.m_width + c];
+            for( auto i = 0 ; i < 3 ; ++i ){
+                color_min[i] = std::min( color_min[i] , range.m_color_min[i] );
+                color_max[i] = std::max( color_max[i] , range.m_color_max[i] );
+            }
+            alpha_min = std::min( alpha_min , range.m_alpha_min );
+            alpha_max = std::max( alpha_max , range.m_alpha_max );
         }
     }
+}
+
+void ImageTexture2D::buildTexelRanges() const{
+    ImgMemory mip;
+    {
+        std::lock_guard<std::mutex> lock( g_decode_mutex );
+        decodeBaseLevel( mip );
+    }
 
-    m_average = average / (float)( m_iTexWidth * m_iTexHeight );
+    // the ranges are of the texels as they are stored, which could be quantized
+    const auto stored = [&]( int k , Spectrum& color , float& alpha ){
+        unsigned char encoded[8];
+        encodeTexel( encoded , mip.m_rgb[k] , m_has_alpha ? mip.m_a[k] : 1.0f );
+        if( m_format == TexelFormat::LDR ){
+            color = Spectrum( g_ldr_lut[encoded[0]] , g_ldr_lut[encoded[1]] , g_ldr_lut[encoded[2]] );
+            alpha = m_has_alpha ? g_ldr_lut[encoded[3]] : 1.0f;
+        }else{
+            color = Spectrum( loadHalf( encoded ) , loadHalf( encoded + 2 ) , loadHalf( encoded + 4 ) );
+            alpha = m_has_alpha ? loadHalf( encoded + 6 ) : 1.0f;
+        }
+    };
+
+    RangeLevel finest;
+    finest.m_width = ( mip.m_width + TEXEL_RANGE_BLOCK_SIZE - 1 ) / TEXEL_RANGE_BLOCK_SIZE;
+    finest.m_height = ( mip.m_height + TEXEL_RANGE_BLOCK_SIZE - 1 ) / TEXEL_RANGE_BLOCK_SIZE;
+    finest.m_ranges = std::make_unique<TexelRange[]>( finest.m_width * finest.m_height );
+    for( auto row = 0 ; row < mip.m_height ; ++row ){
+        for( auto col = 0 ; col < mip.m_width ; ++col ){
+            Spectrum color;
+            auto alpha = 1.0f;
+            stored( row * mip.m_width + col , color , alpha );
+
+            auto& range = finest.m_ranges[( row / TEXEL_RANGE_BLOCK_SIZE ) * finest.m_width + col / TEXEL_RANGE_BLOCK_SIZE];
+            const auto first = row % TEXEL_RANGE_BLOCK_SIZE == 0 && col % TEXEL_RANGE_BLOCK_SIZE == 0;
+            for( auto i = 0 ; i < 3 ; ++i ){
+                range.m_color_min[i] = first ? color[i] : std::min( range.m_color_min[i] , color[i] );
+                range.m_color_max[i] = first ? color[i] : std::max( range.m_color_max[i] , color[i] );
+            }
+            range.m_alpha_min = first ? alpha : std::min( range.m_alpha_min , alpha );
+            range.m_alpha_max = first ? alpha : std::max( range.m_alpha_max , alpha );
+        }
+    }
+    m_range_levels.push_back( std::move( finest ) );
+
+    // each coarser level merges 2x2 blocks of the previous one, until a single block covers the whole texture
+    while( m_range_levels.back().m_width > 1 || m_range_levels.back().m_height > 1 ){
+        const auto& prev = m_range_levels.back();
+        RangeLevel level;
+        level.m_width = ( prev.m_width + 1 ) / 2;
+        level.m_height = ( prev.m_height + 1 ) / 2;
+        level.m_ranges = std::make_unique<TexelRange[]>( level.m_width * level.m_height );
+        for( auto r = 0 ; r < level.m_height ; ++r ){
+            for( auto c = 0 ; c < level.m_width ; ++c ){
+                auto& range = level.m_ranges[r * level.m_width + c];
+                range = prev.m_ranges[( 2 * r ) * prev.m_width + 2 * c];
+                for( auto k = 1 ; k < 4 ; ++k ){
+                    const auto pr = std::min( 2 * r + ( k >> 1 ) , prev.m_height - 1 );
+                    const auto pc = std::min( 2 * c + ( k & 1 ) , prev.m_width - 1 );
+                    const auto& child = prev.m_ranges[pr * prev.m_width + pc];
+                    for( auto i = 0 ; i < 3 ; ++i ){
+                        range.m_color_min[i] = std::min( range.m_color_min[i] , child.m_color_min[i] );
+                        range.m_color_max[i] = std::max( range.m_color_max[i] , child.m_color_max[i] );
+                    }
+                    range.m_alpha_min = std::min( range.m_alpha_min , child.m_alpha_min );
+                    range.m_alpha_max = std::max( range.m_alpha_max , child.m_alpha_max );
+                }
+            }
+        }
+        m_range_levels.push_back( std::move( level ) );
+    }
 }
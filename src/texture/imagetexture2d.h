@@ -17,23 +17,46 @@
 
 #pragma once
 
+#include <cstdio>
 #include <memory>
+#include <mutex>
+#include <vector>
 #include "core/resource.h"
 #include "texturebase.h"
+#include "texture_cache.h"
 
 //! @brief  Image texture.
 /**
  * Image texture is the most commonly used texture. It is just a two dimensional set of pixels.
- * There is no mip-map solution for now.
+ * A mip-map pyramid is built right after loading, lookups with a texture footprint are filtered
+ * either trilinearly or with an EWA filter, depending on how anisotropic the footprint is.
+ *
+ * Texels are not kept in memory by the texture itself. Each mip level is split into square tiles
+ * that are loaded on demand through the texture cache, which evicts them once the memory budget
+ * is exceeded.
+ *
+ * Texels are stored compactly. Low dynamic range images keep their 8 bits per channel, 16 bits
+ * and high dynamic range images are stored as half floats. Alpha, if available, is interleaved with color.
  */
-class ImageTexture2D : public Texture2DBase, public Resource{
+class ImageTexture2D : public Texture2DBase, public Resource, public TextureTileSource{
 public:
+    //! @brief  Destructor closes the tile file.
+    ~ImageTexture2D() override;
+
     //! @brief  Load the resource from file.
     //!
+    //! Only the header of the image is read here, the texels won't be touched until they are needed.
+    //!
     //! @param  filename        Name of the external file holding the data.
     //! @return                 Whether the file has been loaded successfully.
     bool LoadResource(const std::string filename) override;
 
+    //! @brief  Load a tile of the texture.
+    //!
+    //! @param  slot            Index of the tile across all mip levels.
+    //! @return                 The loaded tile.
+    std::shared_ptr<TextureTile> LoadTile( unsigned slot ) const override;
+
     //! @brief  Get the color at a specific position.
     //!
     //! @param  x           X coordinate. If out of range, it will be filtered.
@@ -48,11 +71,45 @@ public:
     //! @return             The alpha at the specific position, it will return 1.0 for textures without alpha channel.
     float GetAlpha( int x , int y ) const override;
 
+    //! @brief  Get the filtered color given a texture coordinate and its screen space derivatives.
+    //!
+    //! Zero derivatives fall back to bilinear filtering at the finest level.
+    //!
+    //! @param  u           U coordinate. If out of range, it will be filtered.
+    //! @param  v           V coordinate. If out of range, it will be filtered.
+    //! @param  dudx        Derivative of u along x axis in image space.
+    //! @param  dvdx        Derivative of v along x axis in image space.
+    //! @param  dudy        Derivative of u along y axis in image space.
+    //! @param  dvdy        Derivative of v along y axis in image space.
+    //! @return             The filtered color at the specific texture coordinate.
+    Spectrum GetColorFromUV( float u , float v , float dudx , float dvdx , float dudy , float dvdy ) const;
+
+    //! @brief  Get the filtered alpha given a texture coordinate and its screen space derivatives.
+    //!
+    //! @param  u           U coordinate. If out of range, it will be filtered.
+    //! @param  v           V coordinate. If out of range, it will be filtered.
+    //! @param  dudx        Derivative of u along x axis in image space.
+    //! @param  dvdx        Derivative of v along x axis in image space.
+    //! @param  dudy        Derivative of u along y axis in image space.
+    //! @param  dvdy        Derivative of v along y axis in image space.
+    //! @return             The filtered alpha at the specific texture coordinate.
+    float GetAlphaFromtUV( float u , float v , float dudx , float dvdx , float dudy , float dvdy ) const;
+
+    using Texture2DBase::GetColorFromUV;
+    using Texture2DBase::GetAlphaFromtUV;
+
     //! @brief  Whether the 2d texture is valid or not.
     //!
     //! @return             True if the texture is valid.
     bool IsValid() const override { 
-        return IS_PTR_VALID(m_memory); 
+        return !m_levels.empty(); 
+    }
+
+    //! @brief  Get the number of levels in the mip-map pyramid.
+    //!
+    //! @return             Number of mip levels, 0 if the texture is not loaded.
+    unsigned GetMipLevelCount() const {
+        return (unsigned)m_levels.size();
     }
 
     //! @brief  Get the average color of the texture.
@@ -60,22 +117,126 @@ public:
     //! @return             The average color of the texture.
     Spectrum GetAverage() const;
 
+    //! @brief  Get the range of texels bilinear filtering at the finest level could return inside a rectangle.
+    //!
+    //! The range is conservative, it covers all texels touched by any lookup inside the rectangle, and possibly more.
+    //! Rectangles crossing the border of the texture get the range of the whole texture.
+    //!
+    //! @param  u0          Lower bound of U coordinate.
+    //! @param  v0          Lower bound of V coordinate.
+    //! @param  u1          Upper bound of U coordinate.
+    //! @param  v1          Upper bound of V coordinate.
+    //! @param  color_min   Lowest value of each color channel.
+    //! @param  color_max   Highest value of each color channel.
+    //! @param  alpha_min   Lowest alpha, it is 1.0 for textures without alpha channel.
+    //! @param  alpha_max   Highest alpha, it is 1.0 for textures without alpha channel.
+    void GetTexelRange( float u0 , float v0 , float u1 , float v1 , Spectrum& color_min , Spectrum& color_max , float& alpha_min , float& alpha_max ) const;
+
 private:
-    class ImgMemory{
-    public:
-        std::unique_ptr<Spectrum[]>     m_rgb = nullptr;   /**< RGB Channels. */
-        std::unique_ptr<float[]>        m_a  = nullptr;   /**< Alpha Channel. */
+    //! @brief  Layout of a mip level in tiles.
+    struct MipLevel{
+        int         m_width = 0;        /**< Width of this level. */
+        int         m_height = 0;       /**< Height of this level. */
+        int         m_tiles_x = 0;      /**< Number of tiles along a row. */
+        unsigned    m_first_slot = 0;   /**< Index of the first tile of this level. */
+    };
+
+    //! @brief  Texels of a whole mip level, only used while building the tiles.
+    struct ImgMemory{
+        int                             m_width = 0;        /**< Width of this level. */
+        int                             m_height = 0;       /**< Height of this level. */
+        std::unique_ptr<Spectrum[]>     m_rgb = nullptr;    /**< RGB Channels. */
+        std::unique_ptr<float[]>        m_a  = nullptr;     /**< Alpha Channel. */
+    };
+
+    // layout of the mip-map pyramid, the first one is the original image
+    std::vector<MipLevel>       m_levels;
+
+    //! @brief  Range of the texels in a block.
+    struct TexelRange{
+        Spectrum    m_color_min;            /**< Lowest value of each color channel. */
+        Spectrum    m_color_max;            /**< Highest value of each color channel. */
+        float       m_alpha_min = 1.0f;     /**< Lowest alpha. */
+        float       m_alpha_max = 1.0f;     /**< Highest alpha. */
     };
 
-    // array saving the color of image
-    std::unique_ptr<ImgMemory>  m_memory = nullptr;
+    //! @brief  A level in the pyramid of texel ranges, blocks double their size along both axes from one level to the next.
+    struct RangeLevel{
+        int                             m_width = 0;        /**< Number of blocks along a row. */
+        int                             m_height = 0;       /**< Number of blocks along a column. */
+        std::unique_ptr<TexelRange[]>   m_ranges;           /**< Range of each block, rows are from top to bottom. */
+    };
+
+    // pyramid of texel ranges, it is only built for textures that are asked about it
+    mutable std::vector<RangeLevel> m_range_levels;
+
+    // texel ranges are built the first time they are needed
+    mutable std::once_flag          m_range_flag;
+
+    //! @brief  Storage format of texels.
+    enum class TexelFormat : unsigned char {
+        LDR,        /**< 8 bits unsigned normalized integer per channel. */
+        HDR         /**< 16 bits float per channel. */
+    };
+
+    // storage format of the texels
+    TexelFormat m_format = TexelFormat::LDR;
 
-    // the average radiance of the texture
-    Spectrum    m_average;
+    // whether there is alpha channel in the texture
+    bool        m_has_alpha = false;
+
+    // size of a texel in bytes
+    unsigned    m_texel_bytes = 0;
+
+    // the average radiance of the texture, it is only available after the tiles are built
+    mutable Spectrum    m_average;
 
     // texture name
     std::string m_name;
 
-    // compute average radiance
-    void    average();
+    // tiles are built the first time any of them is needed
+    mutable std::once_flag  m_build_flag;
+
+    // temporary file holding all tiles of the texture, tiles are decoded from the image again if it is not available
+    mutable FILE*           m_tile_file = nullptr;
+
+    // decode the whole image and split all mip levels into tiles
+    void    buildTiles() const;
+
+    // decode the whole image again, only to generate a single tile
+    void    decodeTile( unsigned slot , unsigned char* dst ) const;
+
+    // decode the whole image again to build the pyramid of texel ranges
+    void    buildTexelRanges() const;
+
+    // decode the image into the first mip level
+    bool    decodeImage( ImgMemory& mip ) const;
+
+    // decode the image into the first mip level, the image is black if it fails to be decoded
+    bool    decodeBaseLevel( ImgMemory& mip ) const;
+
+    // encode a tile of a mip level in the storage format of the texture
+    void    encodeTile( unsigned char* dst , const ImgMemory& mip , int tx , int ty ) const;
+
+    // generate the next mip level from the previous one
+    static ImgMemory    downsample( const ImgMemory& prev );
+
+    // encode a texel in the storage format of the texture
+    void    encodeTexel( unsigned char* dst , const Spectrum& color , float alpha ) const;
+
+    // fetch a texel from a specific mip level, T is either Spectrum for color or float for alpha
+    template<class T>
+    T       texel( unsigned level , int x , int y ) const;
+
+    // bilinear filtering in a specific mip level
+    template<class T>
+    T       bilinear( unsigned level , float u , float v ) const;
+
+    // EWA filtering in a specific mip level, the axes of the ellipse are in texel units of the first level
+    template<class T>
+    T       ewa( unsigned level , float u , float v , float du0 , float dv0 , float du1 , float dv1 ) const;
+
+    // pick the filter based on the footprint
+    template<class T>
+    T       lookup( float u , float v , float dudx , float dvdx , float dudy , float dvdy ) const;
 };
@@ -15,18 +15,100 @@
     this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
  */
 
+#include <algorithm>
 #include "imagetexture3d.h"
 
 template class ImageTexture3D<float>;
 template class ImageTexture3D<Spectrum>;
 
+// range of values of texels, spectrum is bounded per channel.
+SORT_STATIC_FORCEINLINE float texelMin(const float t0, const float t1) {
+    return std::min(t0, t1);
+}
+SORT_STATIC_FORCEINLINE float texelMax(const float t0, const float t1) {
+    return std::max(t0, t1);
+}
+SORT_STATIC_FORCEINLINE bool texelEqual(const float t0, const float t1) {
+    return t0 == t1;
+}
+SORT_STATIC_FORCEINLINE Spectrum texelMin(const Spectrum& t0, const Spectrum& t1) {
+    return Spectrum(std::min(t0[0], t1[0]), std::min(t0[1], t1[1]), std::min(t0[2], t1[2]));
+}
+SORT_STATIC_FORCEINLINE Spectrum texelMax(const Spectrum& t0, const Spectrum& t1) {
+    return Spectrum(std::max(t0[0], t1[0]), std::max(t0[1], t1[1]), std::max(t0[2], t1[2]));
+}
+SORT_STATIC_FORCEINLINE bool texelEqual(const Spectrum& t0, const Spectrum& t1) {
+    return t0[0] == t1[0] && t0[1] == t1[1] && t0[2] == t1[2];
+}
+
+template<class T>
+void ImageTexture3D<T>::allocateBricks() {
+    m_bricks_x = (Texture3DBase<T>::m_width + BRICK_MASK) >> BRICK_SHIFT;
+    m_bricks_y = (Texture3DBase<T>::m_height + BRICK_MASK) >> BRICK_SHIFT;
+    m_bricks_z = (Texture3DBase<T>::m_depth + BRICK_MASK) >> BRICK_SHIFT;
+
+    m_bricks = std::make_unique<Brick[]>(m_bricks_x * m_bricks_y * m_bricks_z);
+    m_pool.clear();
+}
+
+template<class T>
+void ImageTexture3D<T>::setBrickLayer(unsigned layer, const T* texels) {
+    const auto width    = Texture3DBase<T>::m_width;
+    const auto height   = Texture3DBase<T>::m_height;
+    const auto depth    = Texture3DBase<T>::m_depth;
+
+    // partial bricks at the border are padded, the padding is never fetched.
+    const auto z0 = layer << BRICK_SHIFT;
+    const auto slice_cnt = std::min(BRICK_SIZE, depth - z0);
+
+    T brick_texels[BRICK_TEXEL_CNT];
+    for (auto by = 0u; by < m_bricks_y; ++by) {
+        const auto y0 = by << BRICK_SHIFT;
+        const auto row_cnt = std::min(BRICK_SIZE, height - y0);
+        for (auto bx = 0u; bx < m_bricks_x; ++bx) {
+            const auto x0 = bx << BRICK_SHIFT;
+            const auto column_cnt = std::min(BRICK_SIZE, width - x0);
+
+            auto& brick = m_bricks[brickIndex(bx, by, layer)];
+            brick.min = brick.max = texels[y0 * width + x0];
+            for (auto z = 0u; z < slice_cnt; ++z) {
+                for (auto y = 0u; y < row_cnt; ++y) {
+                    for (auto x = 0u; x < column_cnt; ++x) {
+                        const auto& t = texels[(z * height + y0 + y) * width + x0 + x];
+                        brick_texels[texelOffset(x, y, z)] = t;
+                        brick.min = texelMin(brick.min, t);
+                        brick.max = texelMax(brick.max, t);
+                    }
+                }
+            }
+
+            // bricks with a single value don't need any texel in the pool
+            if (texelEqual(brick.min, brick.max)) {
+                brick.offset = CONSTANT_BRICK;
+                continue;
+            }
+
+            brick.offset = (unsigned)m_pool.size();
+            m_pool.insert(m_pool.end(), brick_texels, brick_texels + BRICK_TEXEL_CNT);
+        }
+    }
+}
+
+template<class T>
+void ImageTexture3D<T>::setTexels(const T* texels) {
+    allocateBricks();
+
+    const auto slice_size = Texture3DBase<T>::m_width * Texture3DBase<T>::m_height;
+    for (auto layer = 0u; layer < m_bricks_z; ++layer)
+        setBrickLayer(layer, texels + (layer << BRICK_SHIFT) * slice_size);
+}
+
 template<class T>
 T ImageTexture3D<T>::Sample(int x, int y, int z) const {
     if (x < 0 || x >= (int)Texture3DBase<T>::m_width || y < 0 || y >= (int)Texture3DBase<T>::m_height || z < 0 || z >= (int)Texture3DBase<T>::m_depth)
         return 0.0f;
 
-    const auto offset = z * Texture3DBase<T>::m_width * Texture3DBase<T>::m_height + y * Texture3DBase<T>::m_width + x;
-    return m_memory->m_texel[offset];
+    return texel(x, y, z);
 }
 
 template<class T>
@@ -34,16 +116,17 @@ T ImageTexture3D<T>::Sample(float u, float v, float w) const{
     // There should have been proper filtering algorithms
     // However, since this is mainly for medium density for now, there will be no filter supported.
     // If the uvw is out of range, just retuen 0.0.
-    if (u < 0.0f || u >= 1.0f || v < 0.0f || v >= 1.0f || w < 0.0f || w >= 1.0f)
+    if (IS_PTR_INVALID(m_bricks) || u < 0.0f || u >= 1.0f || v < 0.0f || v >= 1.0f || w < 0.0f || w >= 1.0f)
         return 0.0f;
 
     const auto width    = Texture3DBase<T>::m_width;
     const auto height   = Texture3DBase<T>::m_height;
     const auto depth    = Texture3DBase<T>::m_depth;
 
-    const auto fx = u * width - 0.5f;
-    const auto fy = v * height - 0.5f;
-    const auto fz = w * depth - 0.5f;
+    // clamp to the edge instead of extrapolating within half a texel from the lower border.
+    const auto fx = std::max(0.0f, u * width - 0.5f);
+    const auto fy = std::max(0.0f, v * height - 0.5f);
+    const auto fz = std::max(0.0f, w * depth - 0.5f);
 
     const auto x = (unsigned)(fx);
     const auto y = (unsigned)(fy);
@@ -53,23 +136,31 @@ T ImageTexture3D<T>::Sample(float u, float v, float w) const{
     const auto dy = fy - y;
     const auto dz = fz - z;
 
-    const auto slice_strand = width * height;
-    const auto offset00 = z * slice_strand + y * width + x;
-    const auto offset01 = (x < width - 1) ? offset00 + 1 : offset00;
-    const auto offset10 = (z < depth - 1) ? offset00 + slice_strand : offset00;
-    const auto offset11 = (x < width - 1) ? offset10 + 1 : offset10;
-    const auto offset20 = (y < height - 1) ? offset00 + width : offset00;
-    const auto offset21 = (x < width - 1) ? offset20 + 1 : offset20;
-    const auto offset30 = (z < depth - 1) ? offset20 + slice_strand : offset20;
-    const auto offset31 = (x < width - 1) ? offset30 + 1 : offset30;
-
-    const auto t0 = slerp(m_memory->m_texel[offset00], m_memory->m_texel[offset01], dx);
-    const auto t1 = slerp(m_memory->m_texel[offset10], m_memory->m_texel[offset11], dx);
-    const auto t2 = slerp(m_memory->m_texel[offset20], m_memory->m_texel[offset21], dx);
-    const auto t3 = slerp(m_memory->m_texel[offset30], m_memory->m_texel[offset31], dx);
-
-    const auto t02 = slerp(t0, t2, dy);
-    const auto t13 = slerp(t1, t3, dy);
-    
-    return slerp(t02, t13, dz);
-}
\ No newline at end of file
+    const auto x1 = (x < width - 1) ? x + 1 : x;
+    const auto y1 = (y < height - 1) ? y + 1 : y;
+    const auto z1 = (z < depth - 1) ? z + 1 : z;
+
+    auto filter = [&](auto fetch) -> T {
+        const auto t0 = slerp(fetch(x, y, z), fetch(x1, y, z), dx);
+        const auto t1 = slerp(fetch(x, y, z1), fetch(x1, y, z1), dx);
+        const auto t2 = slerp(fetch(x, y1, z), fetch(x1, y1, z), dx);
+        const auto t3 = slerp(fetch(x, y1, z1), fetch(x1, y1, z1), dx);
+
+        const auto t02 = slerp(t0, t2, dy);
+        const auto t13 = slerp(t1, t3, dy);
+
+        return slerp(t02, t13, dz);
+    };
+
+    // most of the time, all texels are in the same brick, which could hold a single value too.
+    if ((x >> BRICK_SHIFT) == (x1 >> BRICK_SHIFT) && (y >> BRICK_SHIFT) == (y1 >> BRICK_SHIFT) && (z >> BRICK_SHIFT) == (z1 >> BRICK_SHIFT)) {
+        const auto& brick = m_bricks[brickIndex(x >> BRICK_SHIFT, y >> BRICK_SHIFT, z >> BRICK_SHIFT)];
+        if (brick.offset == CONSTANT_BRICK)
+            return brick.min;
+
+        const auto texels = m_pool.data() + brick.offset;
+        return filter([&](unsigned tx, unsigned ty, unsigned tz) -> const T& { return texels[texelOffset(tx, ty, tz)]; });
+    }
+
+    return filter([&](unsigned tx, unsigned ty, unsigned tz) -> const T& { return texel(tx, ty, tz); });
+}
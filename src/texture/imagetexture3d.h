@@ -17,15 +17,27 @@
 
 #pragma once
 
+#include <vector>
 #include "texturebase.h"
 
 //! @brief  3D image texture.
 /**
  * 3D image texture is a three dimentional set of pixel data.
+ *
+ * Texels are stored in a sparse way similar to VDB. The texture is split into bricks of 8x8x8 texels, a top level
+ * array keeps the range of values of each brick. Bricks holding a single value, like the empty space around a
+ * smoke simulation, only take the top level entry. The texels of the rest bricks are kept in a pool, close to
+ * each other in memory so that trilinear filtering mostly touches a single brick.
  */
 template<class T>
 class ImageTexture3D : public Texture3DBase<T>{
 public:
+    /**< Bricks are 8x8x8 texels. */
+    static constexpr unsigned BRICK_SHIFT = 3;
+    static constexpr unsigned BRICK_SIZE = 1u << BRICK_SHIFT;
+    static constexpr unsigned BRICK_MASK = BRICK_SIZE - 1;
+    static constexpr unsigned BRICK_TEXEL_CNT = BRICK_SIZE * BRICK_SIZE * BRICK_SIZE;
+
     //! @brief  Default constructor.
     ImageTexture3D() : Texture3DBase<T>(0u, 0u, 0u) {}
 
@@ -43,13 +55,81 @@ public:
     //! @param w        W coordinate.
     T Sample(float u, float v, float w) const override;
 
+    //! @brief  Get the number of bricks holding more than a single value.
+    //!
+    //! @return         The number of occupied bricks.
+    unsigned GetOccupiedBrickCount() const {
+        return (unsigned)(m_pool.size() / BRICK_TEXEL_CNT);
+    }
+
 protected:
-    template<class D>
-    class ImgMemory {
-    public:
-        std::unique_ptr<D[]>     m_texel = nullptr;   /**< RGB Channels. */
+    //! @brief  Allocate the top level of the bricks, the size of the texture needs to be set before this.
+    void    allocateBricks();
+
+    //! @brief  Fill a layer of bricks along z axis with texels.
+    //!
+    //! Layers are expected to be filled in order so that texture data can be streamed in without a dense copy.
+    //!
+    //! @param  layer   Index of the layer of bricks.
+    //! @param  texels  Texels of the slices covered by the layer in slice order, x changes the fastest, followed by y and then z.
+    void    setBrickLayer( unsigned layer , const T* texels );
+
+    //! @brief  Fill the texture with texels, the size of the texture needs to be set before this.
+    //!
+    //! @param  texels  Texels in slice order, x changes the fastest, followed by y and then z.
+    void    setTexels( const T* texels );
+
+    //! @brief  Get a texel, the position has to be inside the texture.
+    //!
+    //! @param  x       X coordinate position.
+    //! @param  y       Y coordinate position.
+    //! @param  z       Z coordinate position.
+    //! @return         The texel at the position.
+    const T& texel( unsigned x , unsigned y , unsigned z ) const {
+        const auto& brick = m_bricks[ brickIndex( x >> BRICK_SHIFT , y >> BRICK_SHIFT , z >> BRICK_SHIFT ) ];
+        if( brick.offset == CONSTANT_BRICK )
+            return brick.min;
+        return m_pool[ brick.offset + texelOffset( x , y , z ) ];
+    }
+
+    //! @brief  Get the minimum value of the texels in a brick.
+    const T& brickMin( unsigned bx , unsigned by , unsigned bz ) const {
+        return m_bricks[ brickIndex( bx , by , bz ) ].min;
+    }
+
+    //! @brief  Get the maximum value of the texels in a brick.
+    const T& brickMax( unsigned bx , unsigned by , unsigned bz ) const {
+        return m_bricks[ brickIndex( bx , by , bz ) ].max;
+    }
+
+    /**< Number of bricks along each axis. */
+    unsigned m_bricks_x = 0u;
+    unsigned m_bricks_y = 0u;
+    unsigned m_bricks_z = 0u;
+
+private:
+    /**< Offset of bricks that hold a single value and no texels in the pool. */
+    static constexpr unsigned CONSTANT_BRICK = 0xffffffff;
+
+    //! @brief  An entry in the top level of bricks.
+    struct Brick {
+        T           min;                        /**< Minimum value of the texels in the brick. */
+        T           max;                        /**< Maximum value of the texels in the brick. */
+        unsigned    offset = CONSTANT_BRICK;    /**< Offset of the first texel of the brick in the pool. */
     };
 
-    /**< 3d texture memory. */
-    std::unique_ptr<ImgMemory<T>>  m_memory = nullptr;
-};
\ No newline at end of file
+    /**< Top level of the bricks. */
+    std::unique_ptr<Brick[]>    m_bricks;
+    /**< Texels of the bricks holding more than a single value. */
+    std::vector<T>              m_pool;
+
+    //! @brief  Index of a brick in the top level.
+    unsigned brickIndex( unsigned bx , unsigned by , unsigned bz ) const {
+        return ( bz * m_bricks_y + by ) * m_bricks_x + bx;
+    }
+
+    //! @brief  Offset of a texel inside its brick.
+    static unsigned texelOffset( unsigned x , unsigned y , unsigned z ) {
+        return ( ( z & BRICK_MASK ) << ( 2 * BRICK_SHIFT ) ) | ( ( y & BRICK_MASK ) << BRICK_SHIFT ) | ( x & BRICK_MASK );
+    }
+};
@@ -0,0 +1,128 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+
+    Copyright (c) 2011-2023 by Jiayin Cao - All rights reserved.
+
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+
+#include "texture_cache.h"
+#include "core/stats.h"
+#include "core/sassert.h"
+
+SORT_STATS_DEFINE_COUNTER(sTextureTileRequest)
+SORT_STATS_DEFINE_COUNTER(sTextureTileThreadCacheHit)
+SORT_STATS_DEFINE_COUNTER(sTextureTileLoaded)
+SORT_STATS_DEFINE_COUNTER(sTextureTileEvicted)
+
+SORT_STATS_COUNTER("Texture Cache", "Tile Requests", sTextureTileRequest);
+SORT_STATS_COUNTER("Texture Cache", "Tiles Loaded", sTextureTileLoaded);
+SORT_STATS_COUNTER("Texture Cache", "Tiles Evicted", sTextureTileEvicted);
+SORT_STATS_RATIO("Texture Cache", "Thread Lookup Cache Hit Rate", sTextureTileThreadCacheHit, sTextureTileRequest);
+
+// Number of entries in the per-thread lookup cache, it has to be a power of two.
+static constexpr unsigned THREAD_LOOKUP_CACHE_SIZE = 64;
+
+static std::atomic<unsigned> g_texture_source_id( 0 );
+
+TextureTileSource::TextureTileSource() : m_source_id( g_texture_source_id++ ) {
+}
+
+void TextureTileSource::allocateTileSlots( unsigned slot_cnt , size_t tile_bytes ){
+    auto table = std::make_shared<TextureTileTable>();
+    table->m_slots = std::make_unique<TextureTileSlot[]>( slot_cnt );
+    table->m_slot_cnt = slot_cnt;
+    table->m_tile_bytes = tile_bytes;
+    m_tile_table = table;
+}
+
+void TextureCache::SetMemoryBudget( size_t bytes ){
+    std::lock_guard<std::mutex> lock( m_mutex );
+    m_memory_budget = bytes;
+}
+
+const TextureTile* TextureCache::GetTile( const TextureTileSource& source , unsigned slot ){
+    // The per-thread lookup cache holds a reference of the tile, tiles in it are still valid even if they got evicted
+    // from the texture cache in the mean time.
+    struct LookupEntry {
+        unsigned                            m_source_id = ~0u;
+        unsigned                            m_slot = ~0u;
+        std::shared_ptr<const TextureTile>  m_tile;
+    };
+    static thread_local LookupEntry t_lookup_cache[THREAD_LOOKUP_CACHE_SIZE];
+
+    SORT_STATS(++sTextureTileRequest);
+
+    auto& entry = t_lookup_cache[ ( source.m_source_id * 0x9E3779B1u + slot ) & ( THREAD_LOOKUP_CACHE_SIZE - 1 ) ];
+    if( entry.m_source_id == source.m_source_id && entry.m_slot == slot ){
+        SORT_STATS(++sTextureTileThreadCacheHit);
+        return entry.m_tile.get();
+    }
+
+    sAssert( slot < source.m_tile_table->m_slot_cnt , IMAGE );
+    auto& tile_slot = source.m_tile_table->m_slots[slot];
+
+    auto tile = std::atomic_load( &tile_slot.m_tile );
+    if( !tile ){
+        std::lock_guard<std::mutex> lock( source.m_loading_mutex );
+
+        // some other thread may have loaded the tile while this thread is waiting for the lock
+        tile = std::atomic_load( &tile_slot.m_tile );
+        if( !tile ){
+            tile = source.LoadTile( slot );
+            std::atomic_store( &tile_slot.m_tile , tile );
+            tile_slot.m_referenced.store( true , std::memory_order_relaxed );
+
+            registerTile( source.m_tile_table , slot );
+
+            SORT_STATS(++sTextureTileLoaded);
+        }
+    }else if( !tile_slot.m_referenced.load( std::memory_order_relaxed ) ){
+        tile_slot.m_referenced.store( true , std::memory_order_relaxed );
+    }
+
+    entry.m_source_id = source.m_source_id;
+    entry.m_slot = slot;
+    entry.m_tile = tile;
+    return tile.get();
+}
+
+void TextureCache::registerTile( const std::shared_ptr<TextureTileTable>& table , unsigned slot ){
+    std::lock_guard<std::mutex> lock( m_mutex );
+
+    m_resident_tiles.push_back( { table , slot } );
+    m_resident_bytes += table->m_tile_bytes;
+
+    // Clock sweep, tiles touched since the last sweep get a second chance. Since each pass clears the flags, this
+    // takes at most two passes over the resident tiles.
+    while( m_resident_bytes > m_memory_budget && m_resident_tiles.size() > 1 ){
+        if( m_clock_hand >= m_resident_tiles.size() )
+            m_clock_hand = 0;
+
+        auto& resident = m_resident_tiles[m_clock_hand];
+        auto& tile_slot = resident.m_table->m_slots[resident.m_slot];
+        if( tile_slot.m_referenced.exchange( false , std::memory_order_relaxed ) ){
+            ++m_clock_hand;
+            continue;
+        }
+
+        // Threads still holding the tile in their lookup cache keep it alive until they are done with it.
+        std::atomic_store( &tile_slot.m_tile , std::shared_ptr<const TextureTile>() );
+        m_resident_bytes -= resident.m_table->m_tile_bytes;
+
+        resident = std::move( m_resident_tiles.back() );
+        m_resident_tiles.pop_back();
+
+        SORT_STATS(++sTextureTileEvicted);
+    }
+}
@@ -0,0 +1,161 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+
+    Copyright (c) 2011-2023 by Jiayin Cao - All rights reserved.
+
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "core/define.h"
+#include "core/singleton.h"
+
+//! Resolution of a square texture tile.
+static constexpr int        TEXTURE_TILE_SIZE = 64;
+static constexpr unsigned   TEXTURE_TILE_TEXEL_CNT = TEXTURE_TILE_SIZE * TEXTURE_TILE_SIZE;
+
+//! @brief  Spread the lower 8 bits of an integer so that there is an empty bit between each two of them.
+SORT_FORCEINLINE unsigned spreadBits( unsigned v ){
+    v &= 0xffu;
+    v = ( v | ( v << 4 ) ) & 0x0f0fu;
+    v = ( v | ( v << 2 ) ) & 0x3333u;
+    v = ( v | ( v << 1 ) ) & 0x5555u;
+    return v;
+}
+
+//! @brief  Index of a texel inside a tile.
+//!
+//! Texels are stored in Morton order inside a tile so that texels close to each other in the image stay close to
+//! each other in memory regardless of the direction.
+//!
+//! @param  x       Column of the texel inside the tile.
+//! @param  y       Row of the texel inside the tile.
+//! @return         Index of the texel in the tile.
+SORT_FORCEINLINE unsigned TextureTileTexelIndex( unsigned x , unsigned y ){
+    static_assert( TEXTURE_TILE_SIZE <= 256 , "Tile is too large for Morton order indexing." );
+    return spreadBits( x ) | ( spreadBits( y ) << 1 );
+}
+
+//! Default texture memory budget, it could be overwritten through command line argument.
+static constexpr size_t     DEFAULT_TEXTURE_MEMORY_BUDGET = 2048ull * 1024ull * 1024ull;
+
+//! @brief  A square block of texels in one mip level of a texture.
+//!
+//! The cache doesn't care about the format of the texels, it is up to the texture to interpret them.
+struct TextureTile {
+    std::unique_ptr<unsigned char[]>    m_texels;   /**< Texels of the tile, channels of a texel are interleaved. */
+};
+
+//! @brief  Residency information of a tile.
+struct TextureTileSlot {
+    std::shared_ptr<const TextureTile>  m_tile;                 /**< The tile, nullptr if it is not resident. Only accessed atomically. */
+    std::atomic<bool>                   m_referenced = false;   /**< Whether the tile is touched since the last eviction sweep. */
+};
+
+//! @brief  All tile slots of a texture.
+/**
+ * This is shared between the texture and the texture cache so that the cache never needs to worry about the life time
+ * of the texture itself.
+ */
+struct TextureTileTable {
+    std::unique_ptr<TextureTileSlot[]>  m_slots;            /**< Slots of all tiles in all mip levels. */
+    unsigned                            m_slot_cnt = 0;     /**< Number of tiles. */
+    size_t                              m_tile_bytes = 0;   /**< Size of a tile in bytes. */
+};
+
+//! @brief  Interface for textures whose texels are managed by texture cache.
+/**
+ * A tile source knows how to load any of its tiles from scratch. The cache only decides which tiles stay in memory.
+ */
+class TextureTileSource {
+public:
+    //! @brief  Default constructor assigns an unique id for the source.
+    TextureTileSource();
+
+    //! @brief  Virtual destructor.
+    virtual ~TextureTileSource() = default;
+
+    //! @brief  Load a tile, this is called by texture cache when a tile that is not resident is requested.
+    //!
+    //! This has to be thread safe, though texture cache guarantees the same source won't be asked to load tiles
+    //! from different threads at the same time.
+    //!
+    //! @param  slot        Index of the tile.
+    //! @return             The loaded tile.
+    virtual std::shared_ptr<TextureTile> LoadTile( unsigned slot ) const = 0;
+
+protected:
+    //! @brief  Allocate the tile slots, no tile will be loaded at this point.
+    //!
+    //! @param  slot_cnt    Number of tiles in all mip levels of the texture.
+    //! @param  tile_bytes  Size of each tile in bytes.
+    void    allocateTileSlots( unsigned slot_cnt , size_t tile_bytes );
+
+private:
+    const unsigned                      m_source_id;        /**< Unique id of the tile source. */
+    std::shared_ptr<TextureTileTable>   m_tile_table;       /**< Tiles of the source. */
+    mutable std::mutex                  m_loading_mutex;    /**< Only one thread could load tiles for a source at a time. */
+
+    friend class TextureCache;
+};
+
+//! @brief  Texture cache keeps track of all resident texture tiles.
+/**
+ * Tiles are loaded on demand when they are first touched during shading. Once the total size of resident tiles goes
+ * beyond the memory budget, tiles that are not recently used are evicted with a clock sweep. Each thread has a small
+ * direct mapped lookup cache in front of it so that lookups hitting the same tiles over and over again don't touch
+ * any shared data at all.
+ */
+class TextureCache : public Singleton<TextureCache> {
+public:
+    //! @brief  Update the memory budget of the texture cache.
+    //!
+    //! @param  bytes       Maximum number of bytes all resident tiles could take.
+    void    SetMemoryBudget( size_t bytes );
+
+    //! @brief  Get a tile of a texture, it will be loaded if it is not resident.
+    //!
+    //! The returned tile stays alive until the same thread asks for a few more tiles, it is not supposed to be
+    //! kept by the caller.
+    //!
+    //! @param  source      The texture that owns the tile.
+    //! @param  slot        Index of the tile in the texture.
+    //! @return             The tile of interest.
+    const TextureTile*  GetTile( const TextureTileSource& source , unsigned slot );
+
+private:
+    //! @brief  Make the constructor private.
+    TextureCache() = default;
+
+    //! @brief  Record a newly loaded tile and evict tiles if the budget is exceeded.
+    void    registerTile( const std::shared_ptr<TextureTileTable>& table , unsigned slot );
+
+    //! @brief  A resident tile.
+    struct ResidentTile {
+        std::shared_ptr<TextureTileTable>   m_table;
+        unsigned                            m_slot;
+    };
+
+    std::mutex                  m_mutex;                                    /**< Mutex protecting the resident tile list. */
+    std::vector<ResidentTile>   m_resident_tiles;                           /**< All resident tiles. */
+    size_t                      m_clock_hand = 0;                           /**< Current position of the clock sweep. */
+    size_t                      m_resident_bytes = 0;                       /**< Total size of resident tiles. */
+    size_t                      m_memory_budget = DEFAULT_TEXTURE_MEMORY_BUDGET;  /**< Memory budget of resident tiles. */
+
+    friend class Singleton<TextureCache>;
+};
@@ -57,32 +57,36 @@ bool Texture2DBase::Output( const std::string& name ){
 }
 
 void Texture2DBase::texCoordFilter( int& x , int& y ) const{
+    texCoordFilter( x , y , m_iTexWidth , m_iTexHeight );
+}
+
+void Texture2DBase::texCoordFilter( int& x , int& y , int w , int h ) const{
     switch( m_TexCoordFilter ){
     case TCF_WARP:
         if( x >= 0 )
-            x = x % m_iTexWidth;
+            x = x % w;
         else
-            x = m_iTexWidth - ( -x ) % m_iTexWidth - 1;
+            x = w - ( -x ) % w - 1;
         if( y >= 0 )
-            y = y % m_iTexHeight;
+            y = y % h;
         else
-            y = m_iTexHeight - ( -y ) % m_iTexHeight - 1;
+            y = h - ( -y ) % h - 1;
         break;
     case TCF_CLAMP:
-        x = std::min( (int)m_iTexWidth - 1 , std::max( x , 0 ) );
-        y = std::min( (int)m_iTexHeight - 1 , std::max( y , 0 ) );
+        x = std::min( w - 1 , std::max( x , 0 ) );
+        y = std::min( h - 1 , std::max( y , 0 ) );
         break;
     case TCF_MIRROR:
         x = ( x >= 0 )?x:(1-x);
-        x = x % ( 2 * m_iTexWidth );
-        x -= m_iTexWidth;
+        x = x % ( 2 * w );
+        x -= w;
         x = ( x >= 0 )?x:(1-x);
-        x = m_iTexWidth - 1 - x;
+        x = w - 1 - x;
         y = ( y >= 0 )?y:(1-y);
-        y = y % ( 2 * m_iTexHeight );
-        y -= m_iTexHeight;
+        y = y % ( 2 * h );
+        y -= h;
         y = ( y >= 0 )?y:(1-y);
-        y = m_iTexHeight - 1 - y;
+        y = h - 1 - y;
         break;
     }
 }
@@ -122,6 +122,14 @@ protected:
     //! @return u       U coordinate.
     //! @return v       V coordinate.
     void texCoordFilter( int& u , int&v ) const;
+
+    //! @brief  Apply texture coordinate filter with a specific resolution, this is for mip levels.
+    //!
+    //! @return u       U coordinate.
+    //! @return v       V coordinate.
+    //! @param  w       Width of the texture level.
+    //! @param  h       Height of the texture level.
+    void texCoordFilter( int& u , int&v , int w , int h ) const;
 };
 
 //! @brief  Base interface of 3D texture.
@@ -119,6 +119,27 @@ void checkPdf( const Bxdf* bxdf ){
     }
 }
 
+// Evaluating the BXDF along with its PDFs in a single pass should match evaluating them separately
+void checkFusedEvaluation( const Bxdf* bxdf ){
+    const auto check = []( const float expected , const float actual ){
+        EXPECT_NEAR( expected , actual , 0.001f * std::max( 1.0f , fabs( expected ) ) );
+    };
+
+    for( auto i = 0 ; i < 1024 ; ++i ){
+        const Vector wo = UniformSampleSphere(sort_rand_float(), sort_rand_float());
+        const Vector wi = UniformSampleSphere(sort_rand_float(), sort_rand_float());
+
+        float pdf = -1.0f , rev_pdf = -1.0f;
+        const auto f0 = bxdf->F_Pdf( wo , wi , &pdf , &rev_pdf );
+        const auto f1 = bxdf->F( wo , wi );
+        check( f1.r , f0.r );
+        check( f1.g , f0.g );
+        check( f1.b , f0.b );
+        check( bxdf->Pdf( wo , wi ) , pdf );
+        check( bxdf->Pdf( wi , wo ) , rev_pdf );
+    }
+}
+
 void checkAll( const Bxdf* bxdf , bool cPdf = true , bool cReciprocity = true , bool cEnergyConservation = true ){
     if(cPdf)
         checkPdf( bxdf );
@@ -311,6 +332,37 @@ TEST(BXDF, DISABLED_HairSamplingConsistance) {
     }
 }
 
+TEST(BXDF, FusedEvaluation) {
+    auto& rc = GetRenderContext();
+
+    Lambert lambert( rc, WHITE_SPECTRUM , WHITE_SPECTRUM , DIR_UP );
+    checkFusedEvaluation( &lambert );
+
+    const FresnelConductor fresnel( 1.0f , 1.5f );
+    const GGX ggx( 0.3f , 0.6f );
+    const Beckmann beckmann( 0.5f , 0.5f );
+    MicroFacetReflection mf_ggx( rc, WHITE_SPECTRUM , &fresnel , &ggx , FULL_WEIGHT , DIR_UP );
+    checkFusedEvaluation( &mf_ggx );
+    MicroFacetReflection mf_beckmann( rc, WHITE_SPECTRUM , &fresnel , &beckmann , FULL_WEIGHT , DIR_UP );
+    checkFusedEvaluation( &mf_beckmann );
+
+    MicroFacetRefraction mr( rc, WHITE_SPECTRUM , &ggx , 1.0f , 1.5f , FULL_WEIGHT , DIR_UP );
+    checkFusedEvaluation( &mr );
+
+    for( auto thin_surface = 0 ; thin_surface <= 1 ; ++thin_surface ){
+        DisneyBRDF disney(rc, WHITE_SPECTRUM , sort_rand_float() , sort_rand_float() , sort_rand_float() , sort_rand_float() , sort_rand_float() ,
+                          sort_rand_float() , sort_rand_float() , sort_rand_float() , sort_rand_float() , sort_rand_float() , 0.0f ,
+                          sort_rand_float() , sort_rand_float() , thin_surface , FULL_WEIGHT , DIR_UP );
+        checkFusedEvaluation( &disney );
+    }
+
+    Fabric fabric( rc, WHITE_SPECTRUM , 0.5f , FULL_WEIGHT , DIR_UP );
+    checkFusedEvaluation( &fabric );
+
+    Hair hair( rc, 0.5f , 0.3f , 0.3f , 1.55f , FULL_WEIGHT );
+    checkFusedEvaluation( &hair );
+}
+
 TEST(BXDF, KylinPrinciple) {
     auto& rc = GetRenderContext();
     ClosureTypeKylinPrinciple params;
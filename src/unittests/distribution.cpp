@@ -53,6 +53,35 @@ void checkAll( const MicroFacetDistribution* dist ){
     checkDist( dist );
 }
 
+// Check that visible normals are sampled as often as their pdf indicates, the average of sampled normals should match
+// the one integrated with the pdf, which itself should integrate to one over the hemisphere.
+void checkVisibleNormals( const MicroFacetDistribution* dist ){
+    for( const auto cos_theta_o : { 0.9f , 0.5f , 0.1f , -0.4f } ){
+        const auto sin_theta_o = sqrt( 1.0f - SQR( cos_theta_o ) );
+        const Vector wo( 0.6f * sin_theta_o , cos_theta_o , 0.8f * sin_theta_o );
+
+        const auto integrate = [&]( const std::function<double(const Vector&)>& func ){
+            return ParrallReduction<double, 1, 1024 * 1024>( [&](){
+                auto& rc = GetRenderContext();
+                const auto wh = CosSampleHemisphere( sort_rand<float>(rc) , sort_rand<float>(rc) );
+                return func( wh ) * dist->Pdf( wo , wh , dist->D( wh ) ) / CosHemispherePdf( wh );
+            } );
+        };
+
+        const auto total = integrate( []( const Vector& ){ return 1.0; } );
+        EXPECT_NEAR( total , 1.0 , 0.01 );
+
+        for( auto axis = 0u ; axis < 3 ; ++axis ){
+            const double sampled = ParrallReduction<double, 1, 1024 * 1024>( [&](){
+                const auto wh = dist->sample_f( wo , BsdfSample( GetRenderContext() ) );
+                return wh.y >= 0.0f ? wh[axis] : 10.0f;
+            } );
+            const auto integrated = integrate( [&]( const Vector& wh ){ return wh[axis]; } ) / total;
+            EXPECT_NEAR( sampled , integrated , 0.01 );
+        }
+    }
+}
+
 // Somehow, this unit test always fails. Need to investigate.
 TEST(DISTRIBUTION, DISABLED_GGX) {
     const GGX ggx(0.5f,0.5f);
@@ -65,6 +94,16 @@ TEST(DISTRIBUTION, DISABLED_Beckmann) {
     checkAll(&beckmann);
 }
 
+TEST(DISTRIBUTION, GGX_VisibleNormals) {
+    const GGX ggx(0.4f,0.8f);
+    checkVisibleNormals(&ggx);
+}
+
+TEST(DISTRIBUTION, Beckmann_VisibleNormals) {
+    const Beckmann beckmann(0.5f,0.7f);
+    checkVisibleNormals(&beckmann);
+}
+
 // Somehow, this unit test always fails. Need to investigate.
 TEST(DISTRIBUTION, DISABLED_Blinn) {
     const Blinn blinn(0.5f,0.5f);
@@ -78,3 +117,111 @@ TEST(DISTRIBUTION, ClearcoatGGX) {
     checkAll(&cggx);
 }
 #endif
+
+// Check that the alias table picks entries as often as their weights indicate
+TEST(DISTRIBUTION, AliasTable) {
+    const float weights[] = { 1.0f , 0.0f , 3.0f , 0.5f , 7.5f , 2.0f , 0.0f , 1.0f };
+    constexpr unsigned n = sizeof( weights ) / sizeof( weights[0] );
+    const AliasTable table( weights , n );
+
+    const auto sum = table.GetSum();
+    EXPECT_NEAR( sum , 15.0f , 0.0001f );
+
+    constexpr unsigned sample_cnt = 1024 * 1024;
+    unsigned counts[n] = { 0 };
+    for( auto i = 0u ; i < sample_cnt ; ++i ){
+        float pdf = 0.0f , remapped = 0.0f;
+        const auto u = ( i + 0.5f ) / sample_cnt;
+        const auto k = table.SampleDiscrete( u , &pdf , &remapped );
+        ASSERT_LT( k , n );
+        EXPECT_NEAR( pdf , weights[k] / sum , 0.0001f );
+        EXPECT_GE( remapped , 0.0f );
+        EXPECT_LT( remapped , 1.0f );
+        ++counts[k];
+    }
+
+    for( auto i = 0u ; i < n ; ++i ){
+        EXPECT_NEAR( table.GetProperty( i ) , weights[i] / sum , 0.0001f );
+        EXPECT_NEAR( (float)counts[i] / sample_cnt , weights[i] / sum , 0.001f );
+    }
+}
+
+// Check that entries without weight are never picked, even with floating point error left over while building the table
+TEST(DISTRIBUTION, AliasTableZeroWeight) {
+    constexpr unsigned n = 1000;
+    float weights[n];
+    for( auto i = 0u ; i < n ; ++i )
+        weights[i] = ( i % 3 == 0 ) ? 0.0f : 0.1f + 0.01f * ( i % 7 );
+    const AliasTable table( weights , n );
+
+    constexpr unsigned sample_cnt = 1024 * 1024;
+    for( auto i = 0u ; i < sample_cnt ; ++i ){
+        float pdf = 0.0f;
+        const auto k = table.SampleDiscrete( ( i + 0.5f ) / sample_cnt , &pdf );
+        EXPECT_GT( weights[k] , 0.0f );
+        EXPECT_GT( pdf , 0.0f );
+    }
+}
+
+// Check that inverting the cdf keeps the order of the canonical random variables and matches the pdf
+TEST(DISTRIBUTION, Distribution1DInvert) {
+    const float weights[] = { 1.0f , 0.0f , 3.0f , 0.5f , 7.5f , 2.0f , 0.0f , 1.0f };
+    constexpr unsigned n = sizeof( weights ) / sizeof( weights[0] );
+    const Distribution1D dist( weights , n );
+
+    constexpr unsigned sample_cnt = 1024 * 64;
+    auto prev = 0.0f;
+    for( auto i = 0u ; i < sample_cnt ; ++i ){
+        float pdf = 0.0f;
+        const auto x = dist.InvertContinuous( ( i + 0.5f ) / sample_cnt , &pdf );
+        ASSERT_GE( x , 0.0f );
+        ASSERT_LT( x , 1.0f );
+        EXPECT_GE( x , prev );
+        prev = x;
+
+        const auto k = std::min( (unsigned)( x * n ) , n - 1 );
+        EXPECT_GT( weights[k] , 0.0f );
+        EXPECT_NEAR( pdf , dist.GetProperty( k ) * n , 0.0001f );
+        EXPECT_TRUE( dist.InvertDiscrete( ( i + 0.5f ) / sample_cnt , nullptr ) == (int)k );
+    }
+}
+
+// Check that the pdf of samples taken from a 2D distribution matches the evaluated pdf
+TEST(DISTRIBUTION, Distribution2D) {
+    constexpr unsigned nu = 16 , nv = 8;
+    float data[nu * nv];
+    for( auto i = 0u ; i < nu * nv ; ++i )
+        data[i] = ( i % 5 == 0 ) ? 0.0f : (float)( ( i * 7 ) % 13 );
+    Distribution2D dist( data , nu , nv );
+
+    auto& rc = GetRenderContext();
+    for( auto i = 0u ; i < 4096 ; ++i ){
+        float uv[2] , pdf = 0.0f;
+        dist.SampleContinuous( sort_rand<float>(rc) , sort_rand<float>(rc) , uv , &pdf );
+        ASSERT_GE( uv[0] , 0.0f );
+        ASSERT_LT( uv[0] , 1.0f );
+        ASSERT_GE( uv[1] , 0.0f );
+        ASSERT_LT( uv[1] , 1.0f );
+        EXPECT_GT( pdf , 0.0f );
+        EXPECT_NEAR( pdf , dist.Pdf( uv[0] , uv[1] ) , 0.001f * pdf );
+    }
+}
+
+// Check that equiangular sampling matches its pdf and the pdf integrates to one over the segment
+TEST(DISTRIBUTION, Equiangular) {
+    constexpr float delta = 1.5f , d = 0.2f , t0 = 0.0f , t1 = 4.0f;
+
+    constexpr unsigned sample_cnt = 1024 * 1024;
+    auto inv_pdf_sum = 0.0;
+    for( auto i = 0u ; i < sample_cnt ; ++i ){
+        float pdf = 0.0f;
+        const auto t = EquiangularSample( ( i + 0.5f ) / sample_cnt , delta , d , t0 , t1 , &pdf );
+        ASSERT_GE( t , t0 );
+        ASSERT_LE( t , t1 );
+        EXPECT_NEAR( pdf , EquiangularPdf( t , delta , d , t0 , t1 ) , 0.001f * pdf );
+        inv_pdf_sum += 1.0 / pdf;
+    }
+
+    // the expected value of the inverse pdf is the length of the segment
+    EXPECT_NEAR( inv_pdf_sum / sample_cnt , t1 - t0 , 0.001f );
+}
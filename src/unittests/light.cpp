@@ -0,0 +1,117 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+
+    Copyright (c) 2011-2023 by Jiayin Cao - All rights reserved.
+
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+
+#include "thirdparty/gtest/gtest.h"
+#include "unittest_common.h"
+#include "light/light.h"
+#include "light/light_bvh.h"
+
+using namespace unittest;
+
+namespace {
+    // A light with nothing but bounds, it is only used to test light hierarchy.
+    class BoundedLight : public Light{
+    public:
+        BoundedLight( const Point& p , const Vector& w , float cos_theta_o , float phi ){
+            m_bounds.bbox = BBox( p , p );
+            m_bounds.w = w;
+            m_bounds.cos_theta_o = cos_theta_o;
+            m_bounds.phi = phi;
+        }
+
+        Spectrum Power() const override { return m_bounds.phi; }
+        float Pdf( const Point& p , const Vector& wi ) const override { return 1.0f; }
+        Spectrum sample_l( const Point& ip , const LightSample* ls , Vector& dirToLight , float* distance , float* pdfw , float* emissionPdf , float* cosAtLight , Visibility& visibility ) const override { return 0.0f; }
+        Spectrum sample_l( RenderContext& rc , const LightSample& ls , Ray& r , float* pdfW , float* pdfA , float* cosAtLight ) const override { return 0.0f; }
+        bool GetBounds( LightBounds& bounds ) const override {
+            bounds = m_bounds;
+            return true;
+        }
+
+    private:
+        LightBounds m_bounds;
+    };
+
+    // A light without bounds, like sky light.
+    class InfiniteLight : public Light{
+    public:
+        Spectrum Power() const override { return 1.0f; }
+        bool IsInfinite() const override { return true; }
+        float Pdf( const Point& p , const Vector& wi ) const override { return 1.0f; }
+        Spectrum sample_l( const Point& ip , const LightSample* ls , Vector& dirToLight , float* distance , float* pdfw , float* emissionPdf , float* cosAtLight , Visibility& visibility ) const override { return 0.0f; }
+        Spectrum sample_l( RenderContext& rc , const LightSample& ls , Ray& r , float* pdfW , float* pdfA , float* cosAtLight ) const override { return 0.0f; }
+    };
+
+    struct LightSet{
+        std::vector<std::unique_ptr<Light>> owned;
+        std::vector<Light*>                 lights;
+
+        LightSet( bool with_infinite_light ){
+            auto& rc = GetRenderContext();
+            for( auto i = 0 ; i < 100 ; ++i ){
+                const auto p = Point( sort_rand<float>(rc) * 20.0f - 10.0f , sort_rand<float>(rc) * 20.0f - 10.0f , sort_rand<float>(rc) * 20.0f - 10.0f );
+                const auto w = normalize( Vector( sort_rand<float>(rc) - 0.5f , sort_rand<float>(rc) - 0.5f , sort_rand<float>(rc) - 0.5f ) );
+                const auto cos_theta_o = i % 2 ? -1.0f : 0.5f;
+                add( std::make_unique<BoundedLight>( p , w , cos_theta_o , 0.1f + sort_rand<float>(rc) ) );
+            }
+            if( with_infinite_light )
+                add( std::make_unique<InfiniteLight>() );
+        }
+
+        void add( std::unique_ptr<Light> light ){
+            lights.push_back( light.get() );
+            owned.push_back( std::move( light ) );
+        }
+    };
+
+    void checkLightBVH( bool with_infinite_light ){
+        LightSet set( with_infinite_light );
+        LightBVH bvh;
+        bvh.Build( set.lights );
+
+        auto& rc = GetRenderContext();
+        for( auto k = 0 ; k < 16 ; ++k ){
+            const auto p = Point( sort_rand<float>(rc) * 30.0f - 15.0f , sort_rand<float>(rc) * 30.0f - 15.0f , sort_rand<float>(rc) * 30.0f - 15.0f );
+            const auto n = normalize( Vector( sort_rand<float>(rc) - 0.5f , sort_rand<float>(rc) - 0.5f , sort_rand<float>(rc) - 0.5f ) );
+
+            // Probabilities of all lights never sum up to more than one. It could be less than one since the bounds
+            // of a node are conservative, it is possible that none of its children could contribute.
+            auto total = 0.0f;
+            for( const auto light : set.lights )
+                total += bvh.Pmf( p , n , light );
+            EXPECT_LE( total , 1.001f );
+
+            // the probability returned by sampling matches the one evaluated separately
+            for( auto i = 0 ; i < 64 ; ++i ){
+                auto pmf = 0.0f;
+                const auto light = bvh.Sample( p , n , sort_rand<float>(rc) , &pmf );
+                if( !light )
+                    continue;
+                EXPECT_NEAR( pmf , bvh.Pmf( p , n , light ) , 0.0001f );
+            }
+        }
+    }
+}
+
+TEST(LIGHT, LightBVH_PMF) {
+    checkLightBVH( false );
+}
+
+TEST(LIGHT, LightBVH_PMF_With_Infinite_Light) {
+    checkLightBVH( true );
+}
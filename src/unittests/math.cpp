@@ -19,6 +19,7 @@
 #include "core/define.h"
 #include "thirdparty/gtest/gtest.h"
 #include "math/exp.h"
+#include "math/utils.h"
 #include "unittest_common.h"
 
 using namespace unittest;
@@ -49,4 +50,23 @@ TEST(MATH, EXP_NEGATIVE) {
     exp_accuracy_test( -4.0 );
     exp_accuracy_test( -128.0 );
     exp_accuracy_test( -256.0 );
-}
\ No newline at end of file
+}
+
+TEST(MATH, HALF_ROUND_TRIP) {
+    // every finite half float should survive the round trip exactly
+    for( auto i = 0u ; i < 0x10000u ; ++i ){
+        const auto h = (unsigned short)i;
+        const auto f = HalfToFloat( h );
+        if( isnan( f ) )
+            continue;
+        EXPECT_EQ( h , FloatToHalf( f ) );
+    }
+}
+
+TEST(MATH, HALF_ACCURACY) {
+    EXPECT_EQ( 1.0f , HalfToFloat( FloatToHalf( 1.0f ) ) );
+    EXPECT_EQ( -2.5f , HalfToFloat( FloatToHalf( -2.5f ) ) );
+    EXPECT_EQ( 65504.0f , HalfToFloat( FloatToHalf( 65504.0f ) ) );
+    EXPECT_NEAR( 0.1f , HalfToFloat( FloatToHalf( 0.1f ) ) , 0.0001f );
+    EXPECT_TRUE( isinf( HalfToFloat( FloatToHalf( 1e6f ) ) ) );
+}
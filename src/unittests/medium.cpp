@@ -0,0 +1,104 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+
+    Copyright (c) 2011-2023 by Jiayin Cao - All rights reserved.
+
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+
+#include "thirdparty/gtest/gtest.h"
+#include "medium/mediumdata.h"
+#include "stream/mstream.h"
+#include "unittest_common.h"
+
+using namespace unittest;
+
+// The majorant grid needs to bound the filtered density everywhere along a ray and to cover the whole ray without gaps.
+TEST(MEDIUM, MajorantGridBound) {
+    auto& rc = GetRenderContext();
+
+    // isolated spikes in an otherwise empty density so that neighboring cells end up with very different majorants,
+    // the resolution is not a multiple of the cell size on purpose, cells at the upper border are partially covered.
+    constexpr unsigned w = 37, h = 20, d = 13;
+    OMemoryStream ostream;
+    ostream << w << h << d;
+    auto texels = std::make_unique<float[]>(w * h * d);
+    for (auto i = 0u; i < w * h * d; ++i)
+        texels[i] = sort_rand<float>(rc) < 0.005f ? 1.0f + sort_rand<float>(rc) * 10.0f : 0.0f;
+    ostream.Write((char*)texels.get(), sizeof(float) * w * h * d);
+
+    IMemoryStream istream(ostream.GetData(), ostream.GetDataSize());
+    MediumDensity density;
+    density.Serialize(istream);
+    EXPECT_TRUE(density.GetMajorantGrid().IsValid());
+
+    for (auto i = 0; i < 1024; ++i) {
+        // rays start both inside and outside of the volume
+        const auto ori = Point(sort_rand<float>(rc) * 2.0f - 0.5f, sort_rand<float>(rc) * 2.0f - 0.5f, sort_rand<float>(rc) * 2.0f - 0.5f);
+        const auto dir = Vector(sort_rand<float>(rc) * 2.0f - 1.0f, sort_rand<float>(rc) * 2.0f - 1.0f, sort_rand<float>(rc) * 2.0f - 1.0f);
+        const auto max_t = 1.0f + 2.0f * sort_rand<float>(rc);
+
+        auto covered = 0.0f;
+        density.GetMajorantGrid().Traverse(ori, dir, max_t, [&](const float t0, const float t1, const float max_density) {
+            EXPECT_NEAR(t0, covered, 1e-4f);
+            EXPECT_GE(t1, t0);
+            covered = t1;
+
+            for (auto j = 0; j < 64; ++j) {
+                const auto t = t0 + (t1 - t0) * sort_rand<float>(rc);
+                EXPECT_LE(density.Sample(ori + dir * t), max_density + 1e-4f);
+            }
+            return true;
+        });
+        EXPECT_NEAR(covered, max_t, 1e-4f);
+    }
+}
+
+// Sparse bricks need to return exactly what a dense volume would, while bricks of empty space take no texel memory.
+TEST(MEDIUM, SparseDensity) {
+    auto& rc = GetRenderContext();
+
+    // a single blob in the corner of a mostly empty volume
+    constexpr unsigned w = 45, h = 30, d = 21;
+    OMemoryStream ostream;
+    ostream << w << h << d;
+    auto texels = std::make_unique<float[]>(w * h * d);
+    for (auto z = 0u; z < d; ++z)
+        for (auto y = 0u; y < h; ++y)
+            for (auto x = 0u; x < w; ++x)
+                texels[(z * h + y) * w + x] = (x < 12 && y < 10 && z < 9) ? sort_rand<float>(rc) : 0.0f;
+    ostream.Write((char*)texels.get(), sizeof(float) * w * h * d);
+
+    IMemoryStream istream(ostream.GetData(), ostream.GetDataSize());
+    MediumDensity density;
+    density.Serialize(istream);
+    EXPECT_EQ(density.GetOccupiedBrickCount(), 8u);
+
+    // trilinear filtering of the dense volume, clamped to the edge
+    auto texel = [&](unsigned x, unsigned y, unsigned z) {
+        return texels[(std::min(z, d - 1) * h + std::min(y, h - 1)) * w + std::min(x, w - 1)];
+    };
+    for (auto i = 0; i < 16384; ++i) {
+        const auto uvw = Point(sort_rand<float>(rc), sort_rand<float>(rc), sort_rand<float>(rc));
+        const auto fx = std::max(0.0f, uvw.x * w - 0.5f), fy = std::max(0.0f, uvw.y * h - 0.5f), fz = std::max(0.0f, uvw.z * d - 0.5f);
+        const auto x = (unsigned)fx, y = (unsigned)fy, z = (unsigned)fz;
+        const auto dx = fx - x, dy = fy - y, dz = fz - z;
+
+        auto expected = 0.0f;
+        for (auto j = 0u; j < 8; ++j) {
+            const auto ox = j & 1, oy = (j >> 1) & 1, oz = j >> 2;
+            expected += texel(x + ox, y + oy, z + oz) * (ox ? dx : 1.0f - dx) * (oy ? dy : 1.0f - dy) * (oz ? dz : 1.0f - dz);
+        }
+        EXPECT_NEAR(density.Sample(uvw), expected, 1e-5f);
+    }
+}
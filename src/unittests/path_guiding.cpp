@@ -0,0 +1,69 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+
+    Copyright (c) 2011-2023 by Jiayin Cao - All rights reserved.
+
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+
+#include "thirdparty/gtest/gtest.h"
+#include "integrator/path_guiding.h"
+#include "core/samplemethod.h"
+#include "unittest_common.h"
+
+using namespace unittest;
+
+// Learn a distribution with most of the energy around one direction.
+static DirectionalTree learnDirectionalTree(){
+    const auto peak = normalize( Vector( 0.3f , 0.8f , -0.5f ) );
+
+    DirectionalTree tree;
+    for( auto pass = 0 ; pass < 4 ; ++pass ){
+        for( auto i = 0 ; i < 64 * 1024 ; ++i ){
+            const auto wi = UniformSampleSphere( sort_rand_float() , sort_rand_float() );
+            const auto d = std::max( 0.0f , dot( wi , peak ) );
+            tree.Record( wi , ( 0.01f + d * d * d * d * d * d * d * d ) / UniformSpherePdf() , 1.0f );
+        }
+        if( pass < 3 )
+            tree.Refine();
+    }
+    return tree;
+}
+
+TEST(PATH_GUIDING, DirectionalTreePdfIntegration) {
+    const auto tree = learnDirectionalTree();
+    EXPECT_TRUE( tree.HasEnergy() );
+
+    // the pdf w.r.t solid angle should integrate to one over the sphere
+    const auto total = ParrallReduction<double, 8, 128 * 1024>( [&](){
+        const auto wi = UniformSampleSphere( sort_rand_float() , sort_rand_float() );
+        return tree.Pdf( wi ) / UniformSpherePdf();
+    } );
+    EXPECT_NEAR( total , 1.0 , 0.01 );
+}
+
+TEST(PATH_GUIDING, DirectionalTreeSample) {
+    const auto tree = learnDirectionalTree();
+
+    // directions are sampled only where the pdf is not zero and the learned peak is sampled more often
+    const auto peak = normalize( Vector( 0.3f , 0.8f , -0.5f ) );
+    auto around_peak = 0;
+    for( auto i = 0 ; i < 64 * 1024 ; ++i ){
+        const auto wi = tree.Sample( GetRenderContext() );
+        EXPECT_NEAR( wi.Length() , 1.0f , 0.001f );
+        EXPECT_GT( tree.Pdf( wi ) , 0.0f );
+        if( dot( wi , peak ) > 0.8f )
+            ++around_peak;
+    }
+    EXPECT_GT( around_peak , 32 * 1024 );
+}
@@ -0,0 +1,62 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+
+    Copyright (c) 2011-2023 by Jiayin Cao - All rights reserved.
+
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+
+#include "thirdparty/gtest/gtest.h"
+#include "integrator/radiance_cache.h"
+#include "unittest_common.h"
+
+using namespace unittest;
+
+TEST(RADIANCE_CACHE, ConcurrentRecord) {
+    RadianceCache cache( BBox( Point( -1.0f , -1.0f , -1.0f ) , Point( 1.0f , 1.0f , 1.0f ) ) );
+    const auto n = Vector( 0.0f , 1.0f , 0.0f );
+
+    // nothing is cached before enough samples are recorded
+    Spectrum radiance;
+    EXPECT_FALSE( cache.Lookup( Point( 0.5f , 0.5f , 0.5f ) , n , radiance ) );
+
+    // all threads record in the same cell
+    ParrallRun<8, 1024>( [&](){
+        cache.Record( Point( 0.5f , 0.5f , 0.5f ) , n , Spectrum( 1.0f , 2.0f , 3.0f ) );
+    } );
+
+    EXPECT_TRUE( cache.Lookup( Point( 0.5f , 0.5f , 0.5f ) , n , radiance ) );
+    EXPECT_NEAR( radiance[0] , 1.0f , 0.001f );
+    EXPECT_NEAR( radiance[1] , 2.0f , 0.001f );
+    EXPECT_NEAR( radiance[2] , 3.0f , 0.001f );
+
+    // the other side of the surface doesn't share the cell
+    EXPECT_FALSE( cache.Lookup( Point( 0.5f , 0.5f , 0.5f ) , -n , radiance ) );
+}
+
+TEST(RADIANCE_CACHE, ConcurrentCells) {
+    RadianceCache cache( BBox( Point( -1.0f , -1.0f , -1.0f ) , Point( 1.0f , 1.0f , 1.0f ) ) );
+    const auto n = Vector( 0.0f , 0.0f , -1.0f );
+
+    // threads claim cells concurrently, each point keeps its own average
+    ParrallRun<8, 64 * 1024>( [&](){
+        const auto x = (int)( sort_rand_float() * 64.0f );
+        cache.Record( Point( -1.0f + x / 32.0f , 0.0f , 0.0f ) , n , Spectrum( (float)x ) );
+    } );
+
+    for( auto x = 0 ; x < 64 ; ++x ){
+        Spectrum radiance;
+        EXPECT_TRUE( cache.Lookup( Point( -1.0f + x / 32.0f , 0.0f , 0.0f ) , n , radiance ) );
+        EXPECT_NEAR( radiance[0] , (float)x , 0.001f );
+    }
+}
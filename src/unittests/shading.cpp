@@ -0,0 +1,173 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+
+    Copyright (c) 2011-2023 by Jiayin Cao - All rights reserved.
+
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+
+#include <vector>
+#include "thirdparty/gtest/gtest.h"
+#include "material/material.h"
+#include "material/shading_batch.h"
+#include "scatteringevent/scatteringevent.h"
+#include "entity/visual.h"
+#include "shape/triangle.h"
+#include "unittest_common.h"
+
+using namespace unittest;
+
+namespace {
+    // A material that does nothing, tests override what they are interested in.
+    class TestMaterial : public MaterialBase {
+    public:
+        void        UpdateScatteringEvent(ScatteringEvent& se, RenderContext& rc) const override {}
+        void        UpdateScatteringEvents(ScatteringEvent* const* ses, const unsigned cnt, RenderContext& rc) const override {}
+        void        UpdateMediumStack(const MediumInteraction& mi, const SE_Interaction flag, MediumStack& ms, RenderContext& rc) const override {}
+        void        EvaluateMediumSample(const MediumInteraction& mi, MediumSample& ms) const override {}
+        Spectrum    EvaluateTransparency(const SurfaceInteraction& intersection) const override { return 0.0f; }
+        bool        EvaluateTransparencyRange(const SurfaceInteraction* corners, const unsigned corner_cnt, Spectrum& lo, Spectrum& hi) const override { return false; }
+        void        BuildMaterial(Tsl_Namespace::ShadingContext* context) override {}
+        StringID    GetUniqueID() const override { return INVALID_SID; }
+        bool        HasTransparency() const override { return false; }
+        bool        HasSSS() const override { return false; }
+        bool        HasVolumeAttached() const override { return false; }
+        float       GetVolumeStep() const override { return 0.0f; }
+        unsigned    GetVolumeStepCnt() const override { return 0; }
+        float       GetVolumeMajorant(const float max_density) const override { return 0.0f; }
+        void        Serialize(IStreamBase& stream) override {}
+    };
+
+    // A material that only records the batches it is asked to evaluate.
+    class BatchRecordingMaterial : public TestMaterial {
+    public:
+        BatchRecordingMaterial(const sid_t id, std::vector<std::vector<const ScatteringEvent*>>& batches) : m_id(id), m_batches(batches) {}
+
+        void        UpdateScatteringEvent(ScatteringEvent& se, RenderContext& rc) const override {
+            m_batches.push_back({ &se });
+        }
+        void        UpdateScatteringEvents(ScatteringEvent* const* ses, const unsigned cnt, RenderContext& rc) const override {
+            m_batches.push_back(std::vector<const ScatteringEvent*>(ses, ses + cnt));
+        }
+        StringID    GetUniqueID() const override { return m_id; }
+
+    private:
+        const sid_t                                         m_id;
+        std::vector<std::vector<const ScatteringEvent*>>&   m_batches;
+    };
+
+    // An alpha tested material, it is clear inside a disk in texture space and opaque elsewhere.
+    class AlphaTestedMaterial : public TestMaterial {
+    public:
+        Spectrum    EvaluateTransparency(const SurfaceInteraction& intersection) const override {
+            const auto du = intersection.u - 0.3f, dv = intersection.v - 0.3f;
+            return ( du * du + dv * dv < 0.04f ) ? 1.0f : 0.0f;
+        }
+        bool        EvaluateTransparencyRange(const SurfaceInteraction* corners, const unsigned corner_cnt, Spectrum& lo, Spectrum& hi) const override {
+            // the closest and farthest points to the center of the disk in the bounding box of the region
+            auto u0 = corners[0].u, v0 = corners[0].v, u1 = u0, v1 = v0;
+            for (auto i = 1u; i < corner_cnt; ++i) {
+                u0 = std::min(u0, corners[i].u);
+                v0 = std::min(v0, corners[i].v);
+                u1 = std::max(u1, corners[i].u);
+                v1 = std::max(v1, corners[i].v);
+            }
+            const auto near_u = std::max(0.0f, std::max(u0 - 0.3f, 0.3f - u1)), near_v = std::max(0.0f, std::max(v0 - 0.3f, 0.3f - v1));
+            const auto far_u = std::max(fabs(u0 - 0.3f), fabs(u1 - 0.3f)), far_v = std::max(fabs(v0 - 0.3f), fabs(v1 - 0.3f));
+            lo = ( far_u * far_u + far_v * far_v < 0.04f ) ? 1.0f : 0.0f;
+            hi = ( near_u * near_u + near_v * near_v < 0.04f ) ? 1.0f : 0.0f;
+            return true;
+        }
+        bool        HasTransparency() const override { return true; }
+    };
+}
+
+// Shading points of the same material need to be evaluated in one batch, in the order they are added.
+TEST(SHADING, BatchSortedByMaterial) {
+    auto& rc = GetRenderContext();
+
+    std::vector<std::vector<const ScatteringEvent*>> batches;
+    const BatchRecordingMaterial mat0(3, batches), mat1(1, batches), mat2(2, batches);
+    const MaterialBase* materials[] = { &mat0, &mat1, &mat2, &mat1, &mat0, &mat1 };
+
+    SurfaceInteraction inter;
+    std::vector<std::unique_ptr<ScatteringEvent>> ses;
+    ShadingBatch batch;
+    for (const auto material : materials) {
+        ses.push_back(std::make_unique<ScatteringEvent>(inter));
+        batch.Add(material, *ses.back());
+    }
+    EXPECT_EQ(6u, batch.GetSize());
+
+    batch.Execute(rc);
+    EXPECT_EQ(0u, batch.GetSize());
+
+    const std::vector<std::vector<const ScatteringEvent*>> expected = {
+        { ses[1].get(), ses[3].get(), ses[5].get() },
+        { ses[2].get() },
+        { ses[0].get(), ses[4].get() },
+    };
+    EXPECT_EQ(expected.size(), batches.size());
+    for (auto i = 0u; i < expected.size() && i < batches.size(); ++i)
+        EXPECT_TRUE(expected[i] == batches[i]);
+}
+
+// Cells classified by the opacity micro-mask need to agree with the material, most of the triangle should be classified.
+TEST(SHADING, OpacityMask) {
+    auto& rc = GetRenderContext();
+
+    MeshVisual visual;
+    visual.m_memory = std::make_unique<Mesh>();
+    auto& mesh = *visual.m_memory;
+    mesh.m_vertices.resize(3);
+    mesh.m_vertices[0].m_position = Point(0.0f, 0.0f, 0.0f);
+    mesh.m_vertices[1].m_position = Point(2.0f, 0.0f, 0.0f);
+    mesh.m_vertices[2].m_position = Point(0.0f, 2.0f, 0.0f);
+    mesh.m_vertices[1].m_texCoord = Vector2f(1.0f, 0.0f);
+    mesh.m_vertices[2].m_texCoord = Vector2f(0.0f, 1.0f);
+    for (auto& vertex : mesh.m_vertices)
+        vertex.m_normal = DIR_UP;
+    mesh.m_indices.resize(1);
+    mesh.m_indices[0].m_id[0] = 0;
+    mesh.m_indices[0].m_id[1] = 1;
+    mesh.m_indices[0].m_id[2] = 2;
+
+    const AlphaTestedMaterial material;
+    const Triangle triangle(&visual, mesh.m_indices[0]);
+    mesh.m_indices[0].m_opacityMask = triangle.BuildOpacityMask(material);
+
+    constexpr auto N = 4096;
+    auto classified = 0;
+    for (auto i = 0; i < N; ++i) {
+        auto u = sort_rand<float>(rc), v = sort_rand<float>(rc);
+        if (u + v > 1.0f) {
+            u = 1.0f - u;
+            v = 1.0f - v;
+        }
+
+        SurfaceInteraction inter;
+        inter.intersect = Point(2.0f * u, 2.0f * v, 0.0f);
+        inter.u = u;
+        inter.v = v;
+
+        const auto opacity = triangle.ClassifyOpacity(inter);
+        if (OPACITY_UNKNOWN == opacity)
+            continue;
+
+        ++classified;
+        const auto transparency = material.EvaluateTransparency(inter);
+        EXPECT_EQ(OPACITY_CLEAR == opacity, !transparency.IsBlack());
+    }
+    // the disk straddles the four cells at the corner, the rest of the triangle is resolved by the mask
+    EXPECT_GE(classified, N / 4);
+}
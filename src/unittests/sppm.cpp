@@ -0,0 +1,109 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+
+    Copyright (c) 2011-2023 by Jiayin Cao - All rights reserved.
+
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#include <atomic>
+#include "thirdparty/gtest/gtest.h"
+#include "integrator/sppm.h"
+#include "unittest_common.h"
+
+using namespace unittest;
+
+TEST(SPPM, VisiblePointGridConcurrentInsert) {
+    auto& rc = GetRenderContext();
+
+    constexpr int pixel_cnt = 4096;
+    auto pixels = std::make_unique<SPPM_Pixel[]>( pixel_cnt );
+    BBox bbox;
+    auto max_radius = 0.0f;
+    for( auto i = 0 ; i < pixel_cnt ; ++i ){
+        auto& pixel = pixels[i];
+        pixel.p = Point( sort_rand<float>(rc) * 2.0f - 1.0f , sort_rand<float>(rc) * 2.0f - 1.0f , sort_rand<float>(rc) * 2.0f - 1.0f );
+        pixel.radius = 0.05f + 0.1f * sort_rand<float>(rc);
+
+        const auto r = Vector( pixel.radius , pixel.radius , pixel.radius );
+        bbox.Union( pixel.p - r );
+        bbox.Union( pixel.p + r );
+        max_radius = std::max( max_radius , pixel.radius );
+    }
+
+    VisiblePointGrid grid;
+    grid.Reset( bbox , max_radius , pixel_cnt );
+
+    // nodes are allocated from the contexts, which need to outlive the threads
+    constexpr int thread_cnt = 8;
+    RenderContext contexts[thread_cnt];
+    for( auto& context : contexts )
+        context.Init();
+
+    std::atomic<int> next( 0 );
+    ParrallRun<thread_cnt, pixel_cnt / thread_cnt>( [&]( int tid ){
+        grid.Insert( &pixels[next++] , contexts[tid] );
+    } );
+
+    // every pixel gathering a photon is visited exactly once
+    for( auto i = 0 ; i < 1024 ; ++i ){
+        const auto p = Point( sort_rand<float>(rc) * 2.0f - 1.0f , sort_rand<float>(rc) * 2.0f - 1.0f , sort_rand<float>(rc) * 2.0f - 1.0f );
+
+        auto expected = 0;
+        for( auto j = 0 ; j < pixel_cnt ; ++j )
+            expected += ( pixels[j].p - p ).SquaredLength() <= pixels[j].radius * pixels[j].radius;
+
+        auto found = 0;
+        grid.Query( p , [&]( SPPM_Pixel& pixel ){
+            found += ( pixel.p - p ).SquaredLength() <= pixel.radius * pixel.radius;
+        } );
+        EXPECT_TRUE( found == expected );
+    }
+}
+
+TEST(SPPM, VisiblePointGridMaxRadius) {
+    auto& rc = GetRenderContext();
+
+    // pixels with the maximum radius span exactly one cell, float rounding could make them touch three cells per axis
+    constexpr int pixel_cnt = 4096;
+    constexpr float radius = 0.1f / 3.0f;
+    auto pixels = std::make_unique<SPPM_Pixel[]>( pixel_cnt );
+    BBox bbox;
+    for( auto i = 0 ; i < pixel_cnt ; ++i ){
+        auto& pixel = pixels[i];
+        pixel.p = Point( sort_rand<float>(rc) * 2.0f - 1.0f , sort_rand<float>(rc) * 2.0f - 1.0f , sort_rand<float>(rc) * 2.0f - 1.0f );
+        pixel.radius = radius;
+
+        const auto r = Vector( pixel.radius , pixel.radius , pixel.radius );
+        bbox.Union( pixel.p - r );
+        bbox.Union( pixel.p + r );
+    }
+
+    VisiblePointGrid grid;
+    grid.Reset( bbox , radius , pixel_cnt );
+    for( auto i = 0 ; i < pixel_cnt ; ++i )
+        grid.Insert( &pixels[i] , rc );
+
+    for( auto i = 0 ; i < 1024 ; ++i ){
+        const auto p = Point( sort_rand<float>(rc) * 2.0f - 1.0f , sort_rand<float>(rc) * 2.0f - 1.0f , sort_rand<float>(rc) * 2.0f - 1.0f );
+
+        auto expected = 0;
+        for( auto j = 0 ; j < pixel_cnt ; ++j )
+            expected += ( pixels[j].p - p ).SquaredLength() <= radius * radius;
+
+        auto found = 0;
+        grid.Query( p , [&]( SPPM_Pixel& pixel ){
+            found += ( pixel.p - p ).SquaredLength() <= pixel.radius * pixel.radius;
+        } );
+        EXPECT_TRUE( found == expected );
+    }
+}
@@ -0,0 +1,51 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+
+    Copyright (c) 2011-2023 by Jiayin Cao - All rights reserved.
+
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#include "thirdparty/gtest/gtest.h"
+#include "integrator/vcm.h"
+#include "core/rand.h"
+#include "unittest_common.h"
+
+using namespace unittest;
+
+TEST(VCM, LightVertexGridQuery) {
+    auto& rc = GetRenderContext();
+
+    std::vector<VCM_LightVertex> vertices( 4096 );
+    for( auto& v : vertices )
+        v.p = Point( sort_rand<float>(rc) * 2.0f - 1.0f , sort_rand<float>(rc) * 2.0f - 1.0f , sort_rand<float>(rc) * 2.0f - 1.0f );
+
+    const auto radius = 0.1f;
+    LightVertexGrid grid;
+    grid.Build( vertices , radius );
+
+    // the grid should find exactly the vertices a brute force search finds
+    for( auto i = 0 ; i < 256 ; ++i ){
+        const auto p = Point( sort_rand<float>(rc) * 2.4f - 1.2f , sort_rand<float>(rc) * 2.4f - 1.2f , sort_rand<float>(rc) * 2.4f - 1.2f );
+
+        auto expected = 0u;
+        for( const auto& v : vertices )
+            expected += ( v.p - p ).SquaredLength() <= radius * radius;
+
+        auto found = 0u;
+        grid.Query( p , [&]( const VCM_LightVertex& v ){
+            EXPECT_TRUE( ( v.p - p ).SquaredLength() <= radius * radius );
+            ++found;
+        } );
+        EXPECT_TRUE( found == expected );
+    }
+}
@@ -24,6 +24,7 @@
 #include "stream/fstream.h"
 #include "core/strid.h"
 #include "material/matmanager.h"
+#include "texture/texture_cache.h"
 #include "core/timer.h"
 #include "sampler/random.h"
 #include "core/parse_args.h"
@@ -41,7 +42,6 @@ SORT_STATS_COUNTER("Statistics", "Sample per Pixel", sSamplePerPixel);
 SORT_STATS_COUNTER("Performance", "Worker thread number", sThreadCnt);
 
 static constexpr unsigned int GLOBAL_CONFIGURATION_VERSION = 0;
-static constexpr unsigned int IMAGE_TILE_SIZE = 64;
 
 void thread_shut_down(int id) {
     SortStatsFlushData();
@@ -86,6 +86,15 @@ void ImageEvaluation::StartRunning(int argc, char** argv) {
     if (m_need_render_target)
         m_render_target = std::make_unique<RenderTarget>(m_image_width, m_image_height);
 
+    // The startup is a dependency graph rather than a sequence of stages,
+    //  - Textures are decoded in their own tasks during material parsing.
+    //  - Material shader groups are built while the scene is being parsed.
+    //  - Meshes are transformed in their own tasks while the rest of the entities are parsed.
+    //  - Acceleration structure construction starts right after scene loading.
+    //  - Integrator pre-processing, which may execute shaders, waits for all of the above.
+    //  - Tiles are scheduled right away and start as soon as pre-processing is done.
+    // WaitGroups are captured by value since tasks could outlive this function.
+
     // Load materials from stream
     auto sc = pullContext(m_sc_holder);
     auto& mat_pool = MatManager::GetSingleton().ParseMatFile(stream, m_no_material_mode, sc->context.get());
@@ -94,7 +103,7 @@ void ImageEvaluation::StartRunning(int argc, char** argv) {
 #ifdef ENABLE_MULTI_THREAD_SHADER_COMPILATION
     marl::WaitGroup build_mat_wait_group((unsigned)mat_pool.size());
     for (auto& mat : mat_pool) {
-        marl::schedule([&](MaterialBase* mat) {
+        marl::schedule([this, build_mat_wait_group](MaterialBase* mat) {
             defer(build_mat_wait_group.done());
 
             auto sc = pullContext(m_sc_holder);
@@ -121,7 +130,7 @@ void ImageEvaluation::StartRunning(int argc, char** argv) {
     marl::WaitGroup pre_processing_done(1);
 
     // build acceleration structure
-    marl::schedule([&]() {
+    marl::schedule([this, accel_structure_done]() {
         // Decrement the WaitGroup counter when the task has finished.
         defer(accel_structure_done.done());
 
@@ -133,13 +142,29 @@ void ImageEvaluation::StartRunning(int argc, char** argv) {
     });
 
     // pre-processing for integrators, like instant radiosity
-    marl::schedule([&]() {
+    marl::schedule([=]() {
         // Decrement the WaitGroup counter when the task has finished.
         defer(pre_processing_done.done());
 
         // this has to be after the two acceleration structures construction to be done.
         accel_structure_done.wait();
 
+#ifdef ENABLE_MULTI_THREAD_SHADER_COMPILATION
+        // make sure all materials are built already
+        build_mat_wait_group.wait();
+#endif
+
+        // shaders could sample textures from this point on
+        MatManager::GetSingleton().WaitForResourceLoading();
+
+#ifdef ENABLE_TRANSPARENT_SHADOW
+        // Opacity masks of alpha tested surfaces are baked from bounds of the transparency of their materials. The
+        // bounds only account for variation through texture lookups, procedural transparency could be misclassified,
+        // so this is only done when explicitly asked for.
+        if (m_opacity_masks)
+            m_scene.BuildOpacityMasks();
+#endif
+
         // get a render context
         auto pRc = pullContext(m_rc_holder);
 
@@ -148,6 +173,9 @@ void ImageEvaluation::StartRunning(int argc, char** argv) {
 
         // recycle the render context
         recycleContext(m_rc_holder, pRc);
+
+        // at this point, we are starting to render stuff
+        m_timer.Reset();
     });
 
     // get the number of total task
@@ -161,17 +189,6 @@ void ImageEvaluation::StartRunning(int argc, char** argv) {
     int cur_dir_len = 1;
     const Vector2i dir[4] = { Vector2i(0 , -1) , Vector2i(-1 , 0) , Vector2i(0 , 1) , Vector2i(1 , 0) };
 
-    // make sure preprocessing is done
-    pre_processing_done.wait();
-
-#ifdef ENABLE_MULTI_THREAD_SHADER_COMPILATION
-    // make sure all materials are built already
-    build_mat_wait_group.wait();
-#endif
-
-    m_timer.Reset();
-
-    // at this point, we are starting to render stuff
     while (true) {
         // only process node inside the image region
         if (cur_pos.x >= 0 && cur_pos.x < tile_num.x && cur_pos.y >= 0 && cur_pos.y < tile_num.y) {
@@ -181,7 +198,10 @@ void ImageEvaluation::StartRunning(int argc, char** argv) {
 
             // pre-processing for integrators, like instant radiosity
             ++m_tile_cnt;
-            marl::schedule([this](const Vector2i& ori, const Vector2i& size) {
+            marl::schedule([this, pre_processing_done](const Vector2i& ori, const Vector2i& size) {
+                // tiles are queued before the scene is ready, wait for all dependencies first
+                pre_processing_done.wait();
+
                 // get a render context
                 auto pRc = pullContext(m_rc_holder);
                 auto& rc = *pRc;
@@ -222,6 +242,9 @@ void ImageEvaluation::StartRunning(int argc, char** argv) {
                         auto valid_pixel_cnt = m_sample_per_pixel;
                         for (unsigned k = 0; k < m_sample_per_pixel; ++k) {
 
+                            pixelSamples[k].pixel_x = j;
+                            pixelSamples[k].pixel_y = i;
+
                             // generate rays
                             auto r = camera->GenerateRay((float)j, (float)i, pixelSamples[k]);
                             // accumulate the radiance
@@ -337,8 +360,15 @@ void ImageEvaluation::parseCommandArgs(int argc, char** argv){
             m_blender_mode = true;
         }else if (key_str == "profiling"){
             m_enable_profiling = value_str == "on";
+        }else if (key_str == "opacitymask"){
+            m_opacity_masks = value_str == "on";
         }else if (key_str == "nomaterial" ){
             m_no_material_mode = true;
+        }else if (key_str == "texturememory" ){
+            // texture memory budget in mega bytes
+            const auto budget = std::atoll(value_str.c_str());
+            if (budget > 0)
+                TextureCache::GetSingleton().SetMemoryBudget((size_t)budget * 1024ull * 1024ull);
         }else if (key_str == "displayserver") {
             const auto split = value_str.find_last_of(':');
             if (split == std::string::npos)
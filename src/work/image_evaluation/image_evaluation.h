@@ -24,6 +24,9 @@
 #include "integrator/integrator.h"
 #include "texture/rendertarget.h"
 
+// Size of image tiles, pixels of a tile are rendered by a single task row by row.
+static constexpr unsigned int IMAGE_TILE_SIZE = 64;
+
 //! @brief  Generating an image using ray tracing algorithms.
 /**
  * This class has all the image generation specific logic inside, including parsing streamed input,
@@ -65,6 +68,8 @@ private:
     bool            m_enable_profiling = false;
     // No material mode
     bool            m_no_material_mode = false;
+    // Bake opacity micro-masks of alpha tested surfaces
+    bool            m_opacity_masks = false;
     // whether we need a render target
     bool            m_need_render_target = false;
 